@@ -0,0 +1,368 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF base file table
+ */
+
+#include "hbf/db/base_fs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Give up on a bucket after this many displacements (never seen in practice) */
+#define BASE_FS_MAX_DISP 0x1000000u
+
+static uint32_t base_fs_get_u32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void base_fs_put_u32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+/* FNV-1a over the seed's mix, finished with murmur3's fmix32 */
+uint32_t base_fs_hash(const char *s, size_t len, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+int base_fs_open(base_fs_t *fs, const unsigned char *table, size_t len)
+{
+	uint32_t strings_size;
+	uint32_t data_size;
+	uint64_t expect;
+	uint32_t i;
+
+	if (!fs || !table || len < BASE_FS_HEADER_SIZE ||
+	    memcmp(table, BASE_FS_MAGIC, 4) != 0 ||
+	    base_fs_get_u32(table + 4) != BASE_FS_VERSION) {
+		return -1;
+	}
+
+	fs->count = base_fs_get_u32(table + 8);
+	fs->buckets = base_fs_get_u32(table + 12);
+	strings_size = base_fs_get_u32(table + 16);
+	data_size = base_fs_get_u32(table + 20);
+	if (fs->buckets == 0) {
+		return -1;
+	}
+
+	expect = (uint64_t)BASE_FS_HEADER_SIZE + 4u * (uint64_t)fs->buckets +
+	         (uint64_t)BASE_FS_ENTRY_SIZE * fs->count + strings_size +
+	         data_size;
+	if (expect != (uint64_t)len) {
+		return -1;
+	}
+
+	fs->disp = table + BASE_FS_HEADER_SIZE;
+	fs->entries = fs->disp + 4u * (size_t)fs->buckets;
+	fs->strings = (const char *)(fs->entries +
+	                             (size_t)BASE_FS_ENTRY_SIZE * fs->count);
+	fs->data = (const unsigned char *)fs->strings + strings_size;
+
+	/* Lookups trust the entries from here on */
+	for (i = 0; i < fs->count; i++) {
+		const unsigned char *e = fs->entries + (size_t)BASE_FS_ENTRY_SIZE * i;
+		uint64_t path_off = base_fs_get_u32(e);
+		uint64_t path_len = base_fs_get_u32(e + 4);
+		uint64_t data_off = base_fs_get_u32(e + 8);
+		uint64_t stored_size = base_fs_get_u32(e + 12);
+		uint64_t strings_end = path_off + path_len + 2u +
+		                       BASE_FS_DIGEST_LEN;
+
+		if (strings_end > strings_size ||
+		    fs->strings[path_off + path_len] != '\0' ||
+		    memchr(fs->strings + path_off, '\0', (size_t)path_len) ||
+		    fs->strings[strings_end - 1u] != '\0' ||
+		    data_off + stored_size > data_size) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void base_fs_entry(const base_fs_t *fs, uint32_t slot, base_fs_entry_t *entry)
+{
+	const unsigned char *e = fs->entries + (size_t)BASE_FS_ENTRY_SIZE * slot;
+	uint32_t path_off = base_fs_get_u32(e);
+	uint32_t path_len = base_fs_get_u32(e + 4);
+
+	entry->path = fs->strings + path_off;
+	entry->digest = fs->strings + path_off + path_len + 1u;
+	entry->data = fs->data + base_fs_get_u32(e + 8);
+	entry->stored_size = base_fs_get_u32(e + 12);
+	entry->size = base_fs_get_u32(e + 16);
+	entry->gzip = (base_fs_get_u32(e + 20) & BASE_FS_GZIP) != 0;
+}
+
+int base_fs_find(const base_fs_t *fs, const char *path,
+                 base_fs_entry_t *entry)
+{
+	const unsigned char *e;
+	size_t len;
+	uint32_t disp;
+	uint32_t slot;
+
+	if (!fs || !path || fs->count == 0) {
+		return -1;
+	}
+
+	len = strlen(path);
+	disp = base_fs_get_u32(fs->disp +
+	                       4u * (base_fs_hash(path, len, 0) % fs->buckets));
+	if (disp == 0) {
+		return -1; /* Empty bucket */
+	}
+
+	slot = base_fs_hash(path, len, disp) % fs->count;
+	e = fs->entries + (size_t)BASE_FS_ENTRY_SIZE * slot;
+	if (base_fs_get_u32(e + 4) != len ||
+	    memcmp(fs->strings + base_fs_get_u32(e), path, len) != 0) {
+		return -1;
+	}
+
+	if (entry) {
+		base_fs_entry(fs, slot, entry);
+	}
+	return (int)slot;
+}
+
+/* Build-time view of one bucket */
+typedef struct {
+	uint32_t bucket;
+	uint32_t size;
+	uint32_t first; /* Into the order array */
+} base_fs_bucket_t;
+
+/* Largest buckets first; ties by bucket so the result is deterministic */
+static int base_fs_bucket_cmp(const void *a, const void *b)
+{
+	const base_fs_bucket_t *x = (const base_fs_bucket_t *)a;
+	const base_fs_bucket_t *y = (const base_fs_bucket_t *)b;
+
+	if (x->size != y->size) {
+		return x->size > y->size ? -1 : 1;
+	}
+	return x->bucket < y->bucket ? -1 : (x->bucket > y->bucket);
+}
+
+/*
+ * Slots of a bucket's keys under displacement d, into slot_of.
+ * Returns 1 if they are all free and distinct.
+ */
+static int base_fs_fits(const base_fs_entry_t *entries, uint32_t count,
+                        const uint32_t *keys, uint32_t nkeys, uint32_t d,
+                        const int64_t *slots, uint32_t *slot_of)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < nkeys; i++) {
+		const char *path = entries[keys[i]].path;
+
+		slot_of[i] = base_fs_hash(path, strlen(path), d) % count;
+		if (slots[slot_of[i]] >= 0) {
+			return 0;
+		}
+		for (j = 0; j < i; j++) {
+			if (slot_of[j] == slot_of[i]) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Hash and displace: place buckets, largest first, by trying
+ * displacements until all of a bucket's keys land in free slots.
+ * Fills disp and slots (slot -> entry). Returns 0, or -1 on failure.
+ */
+static int base_fs_place(const base_fs_entry_t *entries, uint32_t count,
+                         uint32_t buckets, uint32_t *disp, int64_t *slots)
+{
+	base_fs_bucket_t *b;
+	uint32_t *order;
+	uint32_t *key_bucket;
+	uint32_t *pending;
+	uint32_t i, j, k;
+	int rc = -1;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	b = calloc(buckets, sizeof(*b));
+	order = malloc(count * sizeof(*order));
+	key_bucket = malloc(count * sizeof(*key_bucket));
+	pending = malloc(count * sizeof(*pending));
+	if (!b || !order || !key_bucket || !pending) {
+		goto out;
+	}
+
+	for (i = 0; i < buckets; i++) {
+		b[i].bucket = i;
+	}
+	for (i = 0; i < count; i++) {
+		key_bucket[i] = base_fs_hash(entries[i].path,
+		                             strlen(entries[i].path), 0) % buckets;
+		b[key_bucket[i]].size++;
+	}
+	for (i = 0, j = 0; i < buckets; i++) {
+		b[i].first = j;
+		j += b[i].size;
+		b[i].size = 0;
+	}
+	for (i = 0; i < count; i++) {
+		base_fs_bucket_t *kb = &b[key_bucket[i]];
+
+		order[kb->first + kb->size++] = i;
+	}
+	qsort(b, buckets, sizeof(*b), base_fs_bucket_cmp);
+
+	for (i = 0; i < count; i++) {
+		slots[i] = -1;
+	}
+
+	for (i = 0; i < buckets && b[i].size > 0; i++) {
+		const uint32_t *keys = order + b[i].first;
+		uint32_t d = 1;
+
+		while (!base_fs_fits(entries, count, keys, b[i].size, d, slots,
+		                     pending)) {
+			if (++d == BASE_FS_MAX_DISP) {
+				goto out;
+			}
+		}
+
+		disp[b[i].bucket] = d;
+		for (k = 0; k < b[i].size; k++) {
+			slots[pending[k]] = keys[k];
+		}
+	}
+	rc = 0;
+
+out:
+	free(pending);
+	free(key_bucket);
+	free(order);
+	free(b);
+	return rc;
+}
+
+int base_fs_build(const base_fs_entry_t *entries, uint32_t count,
+                  unsigned char **table, size_t *len)
+{
+	uint32_t buckets = count / 2u + 1u;
+	uint32_t *disp = NULL;
+	int64_t *slots = NULL;
+	unsigned char *out = NULL;
+	unsigned char *e;
+	uint64_t strings_size = 0;
+	uint64_t data_size = 0;
+	uint64_t total;
+	uint32_t string_pos = 0;
+	uint32_t data_pos = 0;
+	uint32_t i;
+	int rc = -1;
+
+	if (!table || !len || (count > 0 && !entries)) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!entries[i].path || !entries[i].digest ||
+		    strlen(entries[i].digest) != BASE_FS_DIGEST_LEN ||
+		    entries[i].size > UINT32_MAX ||
+		    entries[i].stored_size > UINT32_MAX) {
+			return -1;
+		}
+		strings_size += strlen(entries[i].path) + 2u + BASE_FS_DIGEST_LEN;
+		data_size += entries[i].stored_size;
+	}
+	if (strings_size > UINT32_MAX || data_size > UINT32_MAX) {
+		return -1;
+	}
+
+	total = BASE_FS_HEADER_SIZE + 4u * (uint64_t)buckets +
+	        (uint64_t)BASE_FS_ENTRY_SIZE * count + strings_size + data_size;
+	if (total > SIZE_MAX) {
+		return -1;
+	}
+
+	disp = calloc(buckets, sizeof(*disp));
+	slots = malloc((count > 0 ? count : 1u) * sizeof(*slots));
+	out = calloc(1, (size_t)total);
+	if (!disp || !slots || !out ||
+	    base_fs_place(entries, count, buckets, disp, slots) != 0) {
+		free(out);
+		out = NULL;
+		goto out;
+	}
+
+	memcpy(out, BASE_FS_MAGIC, 4);
+	base_fs_put_u32(out + 4, BASE_FS_VERSION);
+	base_fs_put_u32(out + 8, count);
+	base_fs_put_u32(out + 12, buckets);
+	base_fs_put_u32(out + 16, (uint32_t)strings_size);
+	base_fs_put_u32(out + 20, (uint32_t)data_size);
+	for (i = 0; i < buckets; i++) {
+		base_fs_put_u32(out + BASE_FS_HEADER_SIZE + 4u * i, disp[i]);
+	}
+
+	e = out + BASE_FS_HEADER_SIZE + 4u * (size_t)buckets;
+	for (i = 0; i < count; i++, e += BASE_FS_ENTRY_SIZE) {
+		const base_fs_entry_t *in = &entries[slots[i]];
+		uint32_t path_len = (uint32_t)strlen(in->path);
+		unsigned char *strings = out + BASE_FS_HEADER_SIZE +
+		                         4u * (size_t)buckets +
+		                         (size_t)BASE_FS_ENTRY_SIZE * count;
+
+		base_fs_put_u32(e, string_pos);
+		base_fs_put_u32(e + 4, path_len);
+		base_fs_put_u32(e + 8, data_pos);
+		base_fs_put_u32(e + 12, (uint32_t)in->stored_size);
+		base_fs_put_u32(e + 16, (uint32_t)in->size);
+		base_fs_put_u32(e + 20, in->gzip ? BASE_FS_GZIP : 0u);
+
+		memcpy(strings + string_pos, in->path, path_len);
+		memcpy(strings + string_pos + path_len + 1u, in->digest,
+		       BASE_FS_DIGEST_LEN);
+		string_pos += path_len + 2u + BASE_FS_DIGEST_LEN;
+
+		if (in->stored_size > 0) {
+			memcpy(strings + strings_size + data_pos, in->data,
+			       in->stored_size);
+		}
+		data_pos += (uint32_t)in->stored_size;
+	}
+
+	*table = out;
+	*len = (size_t)total;
+	rc = 0;
+
+out:
+	free(slots);
+	free(disp);
+	return rc;
+}
@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF base file table
+ *
+ * Read-only table of the files asset_packer embeds in the binary (the v2
+ * asset bundle, <symbol>), indexed by a perfect hash computed at pack
+ * time. Each file is compressed on its own, so any one can be read or sent
+ * without touching the rest. Lookups return pointers into the table
+ * itself: no SQL, no allocation and no copy. overlay_fs migrates the table
+ * into the database and serves it as the base layer under whatever the
+ * database holds (overlay_fs_base_get).
+ *
+ * Table format (integers are u32 little-endian):
+ *   [magic "HBFT"][version][count][buckets][strings_size][data_size]
+ *   [disp:u32] x buckets
+ *   [path_off][path_len][data_off][stored_size][size][flags] x count
+ *   [strings:strings_size]  path, NUL, SHA-256 hex digest, NUL per entry
+ *   [data:data_size]        stored contents, identity or gzip
+ *
+ * Entries are in slot order: path p is in slot
+ *   base_fs_hash(p, d) % count, d = disp[base_fs_hash(p, 0) % buckets]
+ * path_off indexes strings; data_off indexes data.
+ */
+
+#ifndef HBF_DB_BASE_FS_H
+#define HBF_DB_BASE_FS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BASE_FS_MAGIC "HBFT"
+#define BASE_FS_VERSION 1u
+#define BASE_FS_HEADER_SIZE 24u
+#define BASE_FS_ENTRY_SIZE 24u
+
+/* Entry flags */
+#define BASE_FS_GZIP 1u /* Stored gzip-encoded */
+
+/* Length of an entry digest (SHA-256, lowercase hex) */
+#define BASE_FS_DIGEST_LEN 64
+
+/* An opened table; all pointers refer into it */
+typedef struct {
+	uint32_t count;
+	uint32_t buckets;
+	const unsigned char *disp;
+	const unsigned char *entries;
+	const char *strings;
+	const unsigned char *data;
+} base_fs_t;
+
+/* One file of the table (or, for base_fs_build, one file to pack) */
+typedef struct {
+	const char *path;          /* NUL-terminated */
+	const char *digest;        /* SHA-256 of the contents, hex */
+	const unsigned char *data; /* Stored contents */
+	size_t stored_size;
+	size_t size;               /* Decoded size */
+	int gzip;                  /* data is gzip-encoded */
+} base_fs_entry_t;
+
+/*
+ * Open table, checking every entry lies within it
+ *
+ * @param fs: Table handle to fill in
+ * @param table: Table bytes (must outlive fs)
+ * @param len: Length of table
+ * @return 0 on success, -1 if table is not a valid base table
+ */
+int base_fs_open(base_fs_t *fs, const unsigned char *table, size_t len);
+
+/*
+ * Find path in an opened table
+ *
+ * @param fs: Table handle
+ * @param path: File path
+ * @param entry: Output parameter for the entry (may be NULL)
+ * @return Slot of the entry (0..count-1), or -1 if path is not in the table
+ */
+int base_fs_find(const base_fs_t *fs, const char *path,
+                 base_fs_entry_t *entry);
+
+/*
+ * Entry in a slot, for walking the whole table
+ *
+ * @param fs: Table handle
+ * @param slot: 0..count-1
+ * @param entry: Output parameter for the entry
+ */
+void base_fs_entry(const base_fs_t *fs, uint32_t slot, base_fs_entry_t *entry);
+
+/* Seeded 32-bit string hash behind the index */
+uint32_t base_fs_hash(const char *s, size_t len, uint32_t seed);
+
+/*
+ * Pack files into a table (asset_packer)
+ *
+ * Output only depends on the set of entries, not their order.
+ *
+ * @param entries: Files to pack; paths must be distinct
+ * @param count: Number of entries
+ * @param table: Output parameter for the table (caller must free)
+ * @param len: Output parameter for the length of table
+ * @return 0 on success, -1 on error
+ */
+int base_fs_build(const base_fs_entry_t *entries, uint32_t count,
+                  unsigned char **table, size_t *len);
+
+#endif /* HBF_DB_BASE_FS_H */
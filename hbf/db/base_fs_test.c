@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: MIT */
+#include "base_fs.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_FILES 1000
+
+static const char *test_digest =
+	"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+
+/* TEST_FILES entries; entry i holds i % 7 bytes of 'a' + i % 26 */
+static base_fs_entry_t *make_entries(char paths[][32], unsigned char *data)
+{
+	base_fs_entry_t *entries = calloc(TEST_FILES, sizeof(*entries));
+	size_t off = 0;
+	int i;
+
+	assert(entries != NULL);
+	for (i = 0; i < TEST_FILES; i++) {
+		snprintf(paths[i], 32, "static/dir%d/file%d.js", i % 10, i);
+		memset(data + off, 'a' + i % 26, (size_t)(i % 7));
+		entries[i].path = paths[i];
+		entries[i].digest = test_digest;
+		entries[i].data = data + off;
+		entries[i].stored_size = (size_t)(i % 7);
+		entries[i].size = (size_t)(i % 7) * 3;
+		entries[i].gzip = i % 3 == 0;
+		off += (size_t)(i % 7);
+	}
+
+	return entries;
+}
+
+static void test_base_fs_build_find(void)
+{
+	static char paths[TEST_FILES][32];
+	static unsigned char data[TEST_FILES * 7];
+	base_fs_entry_t *entries = make_entries(paths, data);
+	base_fs_entry_t e;
+	base_fs_t fs;
+	unsigned char *table = NULL;
+	unsigned char *again = NULL;
+	size_t len = 0;
+	size_t again_len = 0;
+	int seen[TEST_FILES] = { 0 };
+	int slot;
+	int i;
+
+	assert(base_fs_build(entries, TEST_FILES, &table, &len) == 0);
+	assert(base_fs_open(&fs, table, len) == 0);
+	assert(fs.count == TEST_FILES);
+
+	for (i = 0; i < TEST_FILES; i++) {
+		slot = base_fs_find(&fs, paths[i], &e);
+		assert(slot >= 0 && slot < TEST_FILES && !seen[slot]);
+		seen[slot] = 1;
+		assert(strcmp(e.path, paths[i]) == 0);
+		assert(strcmp(e.digest, test_digest) == 0);
+		assert(e.stored_size == (size_t)(i % 7));
+		assert(e.size == (size_t)(i % 7) * 3);
+		assert(e.gzip == (i % 3 == 0));
+		assert(memcmp(e.data, entries[i].data, e.stored_size) == 0);
+	}
+
+	/* Misses, including prefixes and near misses of present paths */
+	assert(base_fs_find(&fs, "static/dir0/file0.jsx", NULL) == -1);
+	assert(base_fs_find(&fs, "static/dir0/file0.j", NULL) == -1);
+	assert(base_fs_find(&fs, "", NULL) == -1);
+	assert(base_fs_find(&fs, "static/missing.css", NULL) == -1);
+
+	/* Input order does not change the table */
+	for (i = 0; i < TEST_FILES / 2; i++) {
+		base_fs_entry_t tmp = entries[i];
+
+		entries[i] = entries[TEST_FILES - 1 - i];
+		entries[TEST_FILES - 1 - i] = tmp;
+	}
+	assert(base_fs_build(entries, TEST_FILES, &again, &again_len) == 0);
+	assert(again_len == len && memcmp(again, table, len) == 0);
+
+	free(again);
+	free(table);
+	free(entries);
+
+	printf("  ✓ Build and perfect-hash lookup (%d files)\n", TEST_FILES);
+}
+
+static void test_base_fs_invalid(void)
+{
+	static char paths[TEST_FILES][32];
+	static unsigned char data[TEST_FILES * 7];
+	base_fs_entry_t *entries = make_entries(paths, data);
+	base_fs_t fs;
+	unsigned char *table = NULL;
+	size_t len = 0;
+
+	/* Empty table: valid, finds nothing */
+	assert(base_fs_build(entries, 0, &table, &len) == 0);
+	assert(base_fs_open(&fs, table, len) == 0);
+	assert(base_fs_find(&fs, "static/dir0/file0.js", NULL) == -1);
+	free(table);
+
+	assert(base_fs_build(entries, 10, &table, &len) == 0);
+
+	/* Truncated, wrong magic, out-of-range entry */
+	assert(base_fs_open(&fs, table, len - 1) == -1);
+	assert(base_fs_open(&fs, table, 10) == -1);
+	table[0] = 'X';
+	assert(base_fs_open(&fs, table, len) == -1);
+	table[0] = 'H';
+	assert(base_fs_open(&fs, table, len) == 0);
+	table[BASE_FS_HEADER_SIZE + 4u * fs.buckets + 12] = 0xff;
+	assert(base_fs_open(&fs, table, len) == -1);
+	free(table);
+
+	/* Digests must be full SHA-256 hex */
+	entries[3].digest = "abc";
+	assert(base_fs_build(entries, 10, &table, &len) == -1);
+
+	free(entries);
+
+	printf("  ✓ Empty and invalid tables\n");
+}
+
+int main(void)
+{
+	printf("Base file table tests:\n");
+
+	test_base_fs_build_find();
+	test_base_fs_invalid();
+
+	printf("\nAll base file table tests passed!\n");
+	return 0;
+}
@@ -1,27 +1,116 @@
 /* SPDX-License-Identifier: MIT */
 #include "db.h"
 #include "overlay_fs.h"
+#include "db_pool.h"
+#include "stmt_cache.h"
 #include "hbf/shell/log.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-/* Asset bundle from asset_packer */
+/* Asset bundle from asset_packer (a base_fs table) */
 extern const unsigned char assets_blob[];
 extern const size_t assets_blob_len;
+extern const char assets_blob_id[];
 
 /* Embedded schema SQL (from overlay_schema_gen.c) */
 extern const char hbf_schema_sql[];
 extern const unsigned long hbf_schema_sql_len;
 
 #define HBF_DB_PATH "./hbf.db"
-#define HBF_DB_INMEM ":memory:"
+
+/*
+ * In-memory databases live in a named memdb so that per-thread read
+ * connections (db_pool.c) can open the same database. Each init gets a
+ * fresh name; the database disappears when its last connection closes.
+ */
+#define HBF_DB_INMEM_FMT "file:/hbf-inmem-%u?vfs=memdb"
+
+static unsigned int g_inmem_seq = 0;
+
+static double hbf_db_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* Prebuilt database for in-memory startup (hbf_db_set_image) */
+static const unsigned char *g_image = NULL;
+static size_t g_image_len = 0;
+
+void hbf_db_set_image(const unsigned char *image, size_t len)
+{
+	/* An empty image (pod built without one) means none */
+	g_image = len ? image : NULL;
+	g_image_len = g_image ? len : 0;
+}
+
+/*
+ * Copy the prebuilt image into db. The image is opened read-only where it
+ * lies (sqlite3_deserialize, no copy) and its pages copied with the backup
+ * API: db must stay a writable database that the per-thread readers can
+ * open by name, which a deserialized connection cannot be.
+ * Returns 0 on success, -1 if the image is unusable (db is left as is).
+ */
+static int hbf_db_load_image(sqlite3 *db)
+{
+	sqlite3 *src = NULL;
+	sqlite3_backup *backup;
+	int rc;
+
+	if (sqlite3_open_v2(":memory:", &src, SQLITE_OPEN_READWRITE, NULL) !=
+	    SQLITE_OK) {
+		sqlite3_close(src);
+		return -1;
+	}
+
+	/* READONLY: SQLite never writes to or frees the image */
+	rc = sqlite3_deserialize(src, "main",
+	                         (unsigned char *)(uintptr_t)g_image,
+	                         (sqlite3_int64)g_image_len,
+	                         (sqlite3_int64)g_image_len,
+	                         SQLITE_DESERIALIZE_READONLY);
+	if (rc != SQLITE_OK) {
+		hbf_log_warn("Failed to open database image: %s",
+		             sqlite3_errmsg(src));
+		sqlite3_close(src);
+		return -1;
+	}
+
+	backup = sqlite3_backup_init(db, "main", src, "main");
+	if (!backup) {
+		hbf_log_warn("Failed to copy database image: %s",
+		             sqlite3_errmsg(db));
+		sqlite3_close(src);
+		return -1;
+	}
+	rc = sqlite3_backup_step(backup, -1);
+	sqlite3_backup_finish(backup);
+	sqlite3_close(src);
+
+	if (rc != SQLITE_DONE) {
+		hbf_log_warn("Failed to copy database image: %d", rc);
+		return -1;
+	}
+
+	hbf_log_info("Loaded database image (%zu bytes)", g_image_len);
+	return 0;
+}
 
 /* NOLINTNEXTLINE(readability-function-cognitive-complexity) - Complex initialization logic */
 int hbf_db_init(int inmem, sqlite3 **db)
 {
 	int rc;
 	const char *db_path;
+	char inmem_uri[64];
+	/* Startup phase timings, reported once the database is ready */
+	double t_start = hbf_db_now_ms();
+	double t_open, t_schema, t_migrate = 0.0, t_ready;
+	int from_image = 0;
 
 	if (!db) {
 		hbf_log_error("NULL database handle pointer");
@@ -31,10 +120,18 @@ int hbf_db_init(int inmem, sqlite3 **db)
 	*db = NULL;
 
 	/* Determine database path */
-	db_path = inmem ? HBF_DB_INMEM : HBF_DB_PATH;
+	if (inmem) {
+		snprintf(inmem_uri, sizeof(inmem_uri), HBF_DB_INMEM_FMT,
+		         ++g_inmem_seq);
+		db_path = inmem_uri;
+	} else {
+		db_path = HBF_DB_PATH;
+	}
 
 	/* Open or create database */
-	rc = sqlite3_open(db_path, db);
+	rc = sqlite3_open_v2(db_path, db,
+	                     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+	                     SQLITE_OPEN_URI, NULL);
 	if (rc != SQLITE_OK) {
 		hbf_log_error("Failed to open database '%s': %s",
 		              db_path, sqlite3_errmsg(*db));
@@ -48,6 +145,12 @@ int hbf_db_init(int inmem, sqlite3 **db)
 	hbf_log_info("Opened database: %s", db_path);
 
 	/* Configure database */
+	/* Lets overlay_fs_compact shrink the file; only takes effect on new databases */
+	rc = sqlite3_exec(*db, "PRAGMA auto_vacuum=INCREMENTAL", NULL, NULL, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_warn("Failed to set auto_vacuum: %s", sqlite3_errmsg(*db));
+	}
+
 	rc = sqlite3_exec(*db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
 	if (rc != SQLITE_OK) {
 		hbf_log_warn("Failed to enable WAL mode: %s", sqlite3_errmsg(*db));
@@ -62,6 +165,24 @@ int hbf_db_init(int inmem, sqlite3 **db)
 		return -1;
 	}
 
+	t_open = hbf_db_now_ms();
+
+	/* A prebuilt image already holds the schema and migrated bundle */
+	if (inmem && g_image && hbf_db_load_image(*db) == 0) {
+		from_image = 1;
+		t_schema = hbf_db_now_ms();
+		t_migrate = t_schema;
+		goto ready;
+	}
+
+	/* Older databases kept file contents inline in file_versions */
+	if (overlay_fs_upgrade_schema(*db) != 0) {
+		hbf_log_error("Failed to upgrade overlay_fs schema");
+		sqlite3_close(*db);
+		*db = NULL;
+		return -1;
+	}
+
 	/* Apply overlay_fs schema if tables don't exist */
 	/* The schema uses CREATE TABLE IF NOT EXISTS so it's safe to run multiple times */
 	char *errmsg = NULL;
@@ -75,16 +196,21 @@ int hbf_db_init(int inmem, sqlite3 **db)
 	}
 
 	hbf_log_info("Applied overlay_fs schema");
+	t_schema = hbf_db_now_ms();
 
 	/* Migrate asset bundle if available */
-	migrate_status_t migrate_rc = overlay_fs_migrate_assets(*db, assets_blob, assets_blob_len);
+	migrate_status_t migrate_rc = overlay_fs_migrate_assets_id(*db, assets_blob,
+	                                                           assets_blob_len,
+	                                                           assets_blob_id);
 	if (migrate_rc != MIGRATE_OK && migrate_rc != MIGRATE_ERR_ALREADY_APPLIED) {
 		hbf_log_error("Failed to migrate asset bundle: %d", migrate_rc);
 		sqlite3_close(*db);
 		*db = NULL;
 		return -1;
 	}
+	t_migrate = hbf_db_now_ms();
 
+ready:
 	/* Verify overlay_fs schema exists */
 	rc = overlay_fs_check_schema(*db);
 	if (rc != 0) {
@@ -97,12 +223,32 @@ int hbf_db_init(int inmem, sqlite3 **db)
 	/* Initialize overlay_fs global database handle */
 	overlay_fs_init_global(*db);
 
+	/* Embedded files are served from the binary until overridden */
+	if (overlay_fs_base_init(*db, assets_blob, assets_blob_len) != 0) {
+		hbf_log_warn("Serving embedded files from the database only");
+	}
+
+	/* Worker threads read through their own connections */
+	if (hbf_db_pool_init(*db, db_path) != 0) {
+		hbf_log_warn("Database pool unavailable, sharing one connection");
+	}
+
+	t_ready = hbf_db_now_ms();
+	hbf_log_info("Database ready in %.1f ms (open %.1f, %s %.1f, "
+	             "migrate %.1f, pool %.1f)", t_ready - t_start,
+	             t_open - t_start, from_image ? "image" : "schema",
+	             t_schema - t_open, t_migrate - t_schema,
+	             t_ready - t_migrate);
+
 	return 0;
 }
 
 void hbf_db_close(sqlite3 *db)
 {
 	if (db) {
+		/* Readers and cached statements keep the database busy */
+		hbf_db_pool_shutdown(db);
+		hbf_db_stmt_cache_clear(db);
 		sqlite3_close(db);
 		hbf_log_debug("Closed main database");
 	}
@@ -114,8 +260,6 @@ int hbf_db_read_file_from_main(sqlite3 *db, const char *path,
 	sqlite3_stmt *stmt;
 	const char *sql;
 	int rc;
-	const void *blob_data;
-	int blob_size;
 
 	if (!db || !path || !data || !size) {
 		hbf_log_error("NULL parameter in hbf_db_read_file_from_main");
@@ -125,8 +269,8 @@ int hbf_db_read_file_from_main(sqlite3 *db, const char *path,
 	*data = NULL;
 	*size = 0;
 
-	/* Read from latest_files view (sqlar data was migrated to versioned filesystem) */
-	sql = "SELECT data FROM latest_files WHERE path = ?";
+	/* Point lookup of the latest version (sqlar data was migrated to versioned filesystem) */
+	sql = OVERLAY_FS_LATEST_SQL;
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
@@ -151,22 +295,17 @@ int hbf_db_read_file_from_main(sqlite3 *db, const char *path,
 		return -1;
 	}
 
-	/* Get data (already uncompressed in versioned filesystem) */
-	blob_data = sqlite3_column_blob(stmt, 0);
-	blob_size = sqlite3_column_bytes(stmt, 0);
-
-	if (blob_size > 0 && blob_data) {
-		*data = malloc((size_t)blob_size);
-		if (*data) {
-			memcpy(*data, blob_data, (size_t)blob_size);
-			*size = (size_t)blob_size;
-		}
-	}
+	/* Get data (gzip-compressed contents are inflated) */
+	rc = overlay_fs_decode((const char *)sqlite3_column_text(stmt, 6),
+	                       sqlite3_column_blob(stmt, 4),
+	                       (size_t)sqlite3_column_bytes(stmt, 4),
+	                       (size_t)sqlite3_column_int64(stmt, 3),
+	                       data, size);
 
 	sqlite3_finalize(stmt);
 
-	if (!*data && blob_size > 0) {
-		hbf_log_error("Failed to allocate memory for file data");
+	if (rc != 0) {
+		hbf_log_error("Failed to decode file data: %s", path);
 		return -1;
 	}
 
@@ -180,8 +319,6 @@ int hbf_db_read_file(sqlite3 *db, const char *path, int use_overlay,
 	sqlite3_stmt *stmt;
 	const char *sql;
 	int rc;
-	const void *blob_data;
-	int blob_size;
 
 	if (!db || !path || !data || !size) {
 		hbf_log_error("NULL parameter in hbf_db_read_file");
@@ -191,10 +328,10 @@ int hbf_db_read_file(sqlite3 *db, const char *path, int use_overlay,
 	*data = NULL;
 	*size = 0;
 
-	/* Always read from latest_files view (which contains migrated SQLAR data + overlays) */
+	/* Always read the latest version (which contains migrated SQLAR data + overlays) */
 	/* SQLAR table is dropped after migration, so all data is now in versioned filesystem */
 	(void)use_overlay; /* Suppress unused parameter warning */
-	sql = "SELECT data FROM latest_files WHERE path = ?";
+	sql = OVERLAY_FS_LATEST_SQL;
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
@@ -217,21 +354,16 @@ int hbf_db_read_file(sqlite3 *db, const char *path, int use_overlay,
 		return -1;
 	}
 
-	blob_data = sqlite3_column_blob(stmt, 0);
-	blob_size = sqlite3_column_bytes(stmt, 0);
-
-	if (blob_size > 0 && blob_data) {
-		*data = malloc((size_t)blob_size);
-		if (*data) {
-			memcpy(*data, blob_data, (size_t)blob_size);
-			*size = (size_t)blob_size;
-		}
-	}
+	rc = overlay_fs_decode((const char *)sqlite3_column_text(stmt, 6),
+	                       sqlite3_column_blob(stmt, 4),
+	                       (size_t)sqlite3_column_bytes(stmt, 4),
+	                       (size_t)sqlite3_column_int64(stmt, 3),
+	                       data, size);
 
 	sqlite3_finalize(stmt);
 
-	if (!*data && blob_size > 0) {
-		hbf_log_error("Failed to allocate memory for file");
+	if (rc != 0) {
+		hbf_log_error("Failed to decode file: %s", path);
 		return -1;
 	}
 
@@ -251,8 +383,8 @@ int hbf_db_file_exists_in_main(sqlite3 *db, const char *path)
 		return -1;
 	}
 
-	/* Use latest_files view instead of sqlar table (migrated data) */
-	sql = "SELECT 1 FROM latest_files WHERE path = ?";
+	/* Use the materialized latest metadata instead of sqlar table (migrated data) */
+	sql = "SELECT 1 FROM latest_files_meta WHERE path = ?";
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
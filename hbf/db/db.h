@@ -28,6 +28,21 @@
  */
 int hbf_db_init(int inmem, sqlite3 **db);
 
+/*
+ * Use a prebuilt database image for in-memory databases
+ *
+ * image is a serialized database produced at build time by //tools:db_image
+ * from the same asset bundle: schema applied, files and migration row in
+ * place. hbf_db_init(1, ...) then copies its pages into the new database
+ * instead of applying the schema and migrating the bundle, falling back to
+ * that if the image cannot be read. The bytes are read in place and must
+ * stay valid until hbf_db_init returns.
+ *
+ * @param image: Database image, or NULL (or len 0) to stop using one
+ * @param len: Length of image in bytes
+ */
+void hbf_db_set_image(const unsigned char *image, size_t len);
+
 /*
  * Close HBF database handle
  *
@@ -0,0 +1,323 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF database connection pool
+ */
+
+#include "hbf/db/db_pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hbf/db/stmt_cache.h"
+#include "hbf/shell/log.h"
+
+/* Readers wait this long for the writer to finish a commit */
+#define HBF_DB_POOL_BUSY_TIMEOUT_MS 5000
+
+/*
+ * A thread's read connection. The struct is owned by its thread and only
+ * freed on thread exit; shutdown merely closes the connection, so a
+ * thread outliving a pool finds db == NULL and reopens for the next one.
+ */
+typedef struct hbf_db_reader {
+	struct hbf_db_reader *next;
+	sqlite3 *writer; /* Writer this reader belongs to */
+	sqlite3 *db;
+} hbf_db_reader_t;
+
+static struct {
+	pthread_mutex_t lock;
+	sqlite3 *writer;
+	char *uri;
+	hbf_db_reader_t *readers; /* Every thread's reader */
+	int count;
+} g_db_pool = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, 0 };
+
+/* Thread currently holding the writer (see hbf_db_pool_writer_enter) */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int held;
+	pthread_t owner;
+} g_db_writer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_key_t g_db_pool_key;
+static pthread_once_t g_db_pool_once = PTHREAD_ONCE_INIT;
+static int g_db_pool_key_ok = 0;
+
+/* Close a reader's connection; lock must be held */
+static void hbf_db_reader_close(hbf_db_reader_t *reader)
+{
+	if (reader->db) {
+		hbf_db_stmt_cache_clear(reader->db);
+		sqlite3_close(reader->db);
+		reader->db = NULL;
+		reader->writer = NULL;
+		g_db_pool.count--;
+	}
+}
+
+/* Thread-exit destructor for the reader key */
+static void hbf_db_reader_destructor(void *arg)
+{
+	hbf_db_reader_t *reader = (hbf_db_reader_t *)arg;
+	hbf_db_reader_t **link;
+
+	pthread_mutex_lock(&g_db_pool.lock);
+	for (link = &g_db_pool.readers; *link; link = &(*link)->next) {
+		if (*link == reader) {
+			*link = reader->next;
+			break;
+		}
+	}
+	hbf_db_reader_close(reader);
+	pthread_mutex_unlock(&g_db_pool.lock);
+
+	free(reader);
+}
+
+static void hbf_db_pool_key_init(void)
+{
+	if (pthread_key_create(&g_db_pool_key, hbf_db_reader_destructor) == 0) {
+		g_db_pool_key_ok = 1;
+	} else {
+		hbf_log_error("Failed to create database pool key");
+	}
+}
+
+int hbf_db_pool_init(sqlite3 *writer, const char *uri)
+{
+	hbf_db_reader_t *reader;
+	char *copy;
+
+	if (!writer || !uri || strcmp(uri, ":memory:") == 0) {
+		hbf_log_error("Database pool needs a shareable database");
+		return -1;
+	}
+
+	pthread_once(&g_db_pool_once, hbf_db_pool_key_init);
+	if (!g_db_pool_key_ok) {
+		return -1;
+	}
+
+	copy = strdup(uri);
+	if (!copy) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&g_db_pool.lock);
+	/* Only one writer is pooled; readers of a previous one go away */
+	for (reader = g_db_pool.readers; reader; reader = reader->next) {
+		hbf_db_reader_close(reader);
+	}
+	free(g_db_pool.uri);
+	g_db_pool.uri = copy;
+	g_db_pool.writer = writer;
+	pthread_mutex_unlock(&g_db_pool.lock);
+
+	sqlite3_busy_timeout(writer, HBF_DB_POOL_BUSY_TIMEOUT_MS);
+
+	hbf_log_debug("Database pool enabled for %s", uri);
+	return 0;
+}
+
+/* Open the calling thread's reader for the current writer; lock held */
+static sqlite3 *hbf_db_reader_open(hbf_db_reader_t *reader)
+{
+	sqlite3 *db = NULL;
+	int rc;
+
+	rc = sqlite3_open_v2(g_db_pool.uri, &db,
+			     SQLITE_OPEN_READONLY | SQLITE_OPEN_URI |
+				     SQLITE_OPEN_NOMUTEX,
+			     NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_warn("Failed to open read connection: %s",
+			     db ? sqlite3_errmsg(db) : "out of memory");
+		sqlite3_close(db);
+		return NULL;
+	}
+
+	sqlite3_busy_timeout(db, HBF_DB_POOL_BUSY_TIMEOUT_MS);
+
+	reader->db = db;
+	reader->writer = g_db_pool.writer;
+	g_db_pool.count++;
+
+	hbf_log_debug("Opened read connection (%d open)", g_db_pool.count);
+	return db;
+}
+
+/* Whether another thread holds the writer */
+static int hbf_db_writer_held_elsewhere(void)
+{
+	int elsewhere;
+
+	pthread_mutex_lock(&g_db_writer.lock);
+	elsewhere = g_db_writer.held &&
+		    !pthread_equal(g_db_writer.owner, pthread_self());
+	pthread_mutex_unlock(&g_db_writer.lock);
+
+	return elsewhere;
+}
+
+sqlite3 *hbf_db_pool_reader(sqlite3 *db)
+{
+	hbf_db_reader_t *reader = NULL;
+	sqlite3 *rdb = NULL;
+
+	if (!db || !g_db_pool_key_ok) {
+		return db;
+	}
+
+	/*
+	 * Reads inside a write transaction must see its changes, but only
+	 * the thread that opened it may see them
+	 */
+	if (!sqlite3_get_autocommit(db) && !hbf_db_writer_held_elsewhere()) {
+		return db;
+	}
+
+	/* Fast path: this thread already has a reader for db */
+	reader = (hbf_db_reader_t *)pthread_getspecific(g_db_pool_key);
+	if (reader && reader->db && reader->writer == db) {
+		return reader->db;
+	}
+
+	pthread_mutex_lock(&g_db_pool.lock);
+	if (db != g_db_pool.writer) {
+		pthread_mutex_unlock(&g_db_pool.lock);
+		return db;
+	}
+
+	if (!reader) {
+		reader = (hbf_db_reader_t *)calloc(1, sizeof(*reader));
+		if (reader && pthread_setspecific(g_db_pool_key, reader) != 0) {
+			free(reader);
+			reader = NULL;
+		}
+		if (reader) {
+			reader->next = g_db_pool.readers;
+			g_db_pool.readers = reader;
+		}
+	}
+
+	if (reader) {
+		hbf_db_reader_close(reader); /* Left over from an earlier pool */
+		rdb = hbf_db_reader_open(reader);
+	}
+	pthread_mutex_unlock(&g_db_pool.lock);
+
+	return rdb ? rdb : db;
+}
+
+int hbf_db_pool_writer_enter(sqlite3 *db)
+{
+	pthread_t self = pthread_self();
+	struct timespec deadline;
+	int rc = 0;
+
+	if (!db || sqlite3_db_readonly(db, "main") == 1) {
+		return SQLITE_OK;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += HBF_DB_POOL_BUSY_TIMEOUT_MS / 1000;
+	deadline.tv_nsec += (HBF_DB_POOL_BUSY_TIMEOUT_MS % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&g_db_writer.lock);
+	while (g_db_writer.held && !pthread_equal(g_db_writer.owner, self) &&
+	       rc != ETIMEDOUT) {
+		rc = pthread_cond_timedwait(&g_db_writer.cond, &g_db_writer.lock,
+					    &deadline);
+	}
+	if (g_db_writer.held && !pthread_equal(g_db_writer.owner, self)) {
+		pthread_mutex_unlock(&g_db_writer.lock);
+		hbf_log_warn("Writer still held by another transaction");
+		return SQLITE_BUSY;
+	}
+	g_db_writer.held = 1;
+	g_db_writer.owner = self;
+	pthread_mutex_unlock(&g_db_writer.lock);
+
+	return SQLITE_OK;
+}
+
+/* Drop the writer if the calling thread holds it; force skips the
+ * transaction check */
+static void hbf_db_writer_release(sqlite3 *db, int force)
+{
+	pthread_mutex_lock(&g_db_writer.lock);
+	if (g_db_writer.held &&
+	    pthread_equal(g_db_writer.owner, pthread_self()) &&
+	    (force || sqlite3_get_autocommit(db))) {
+		g_db_writer.held = 0;
+		pthread_cond_broadcast(&g_db_writer.cond);
+	}
+	pthread_mutex_unlock(&g_db_writer.lock);
+}
+
+void hbf_db_pool_writer_leave(sqlite3 *db)
+{
+	if (!db || sqlite3_db_readonly(db, "main") == 1) {
+		return;
+	}
+
+	hbf_db_writer_release(db, 0);
+}
+
+void hbf_db_pool_writer_end(sqlite3 *db)
+{
+	int held;
+
+	if (!db) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_db_writer.lock);
+	held = g_db_writer.held &&
+	       pthread_equal(g_db_writer.owner, pthread_self());
+	pthread_mutex_unlock(&g_db_writer.lock);
+	if (!held) {
+		return;
+	}
+
+	if (!sqlite3_get_autocommit(db)) {
+		hbf_log_warn("Rolling back transaction left open by request");
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+	}
+
+	hbf_db_writer_release(db, 1);
+}
+
+void hbf_db_pool_shutdown(sqlite3 *writer)
+{
+	hbf_db_reader_t *reader;
+
+	pthread_mutex_lock(&g_db_pool.lock);
+	if (!writer || writer != g_db_pool.writer) {
+		pthread_mutex_unlock(&g_db_pool.lock);
+		return;
+	}
+
+	for (reader = g_db_pool.readers; reader; reader = reader->next) {
+		hbf_db_reader_close(reader);
+	}
+
+	g_db_pool.writer = NULL;
+	free(g_db_pool.uri);
+	g_db_pool.uri = NULL;
+	pthread_mutex_unlock(&g_db_pool.lock);
+
+	hbf_log_debug("Database pool shut down");
+}
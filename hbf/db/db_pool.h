@@ -0,0 +1,92 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF database connection pool
+ *
+ * The main connection returned by hbf_db_init() is the writer. Every
+ * thread that reads through hbf_db_pool_reader() gets its own read-only
+ * connection to the same database, so reads on different worker threads
+ * no longer serialize on the writer's mutex. WAL lets those readers run
+ * alongside the writer.
+ */
+
+#ifndef HBF_DB_POOL_H
+#define HBF_DB_POOL_H
+
+#include <sqlite3.h>
+
+/*
+ * Enable per-thread readers for writer
+ *
+ * Only one writer is pooled at a time; enabling another one closes the
+ * readers of the previous writer.
+ *
+ * @param writer: Writer connection (owned by the caller)
+ * @param uri: Filename/URI the writer was opened with; readers open the
+ *             same database through it (must not be a private ":memory:")
+ * @return 0 on success, -1 on error
+ */
+int hbf_db_pool_init(sqlite3 *writer, const char *uri);
+
+/*
+ * Get the calling thread's read connection for db
+ *
+ * Opens it on first use. Returns db itself when db is not a pooled
+ * writer, when the writer has an open transaction that does not belong
+ * to another thread (so reads see its uncommitted changes), or when a
+ * reader cannot be opened.
+ *
+ * @param db: Writer connection
+ * @return Connection to run read-only statements on
+ */
+sqlite3 *hbf_db_pool_reader(sqlite3 *db);
+
+/*
+ * Take the writer before stepping a statement on it
+ *
+ * The writer is shared by all worker threads, and so is its transaction
+ * state: once a thread has run BEGIN, every other thread's statements on
+ * the writer would land in that transaction. A thread therefore holds the
+ * writer while its statement runs and, if the statement left a
+ * transaction open, until that transaction ends. Other threads wait here
+ * meanwhile, as long as the busy timeout readers use. Re-entrant for the
+ * owning thread; no-op for read-only connections.
+ *
+ * Every statement stepped on the writer while worker threads run must be
+ * bracketed by enter/leave, including writes made from C.
+ *
+ * @param db: Connection the statement belongs to
+ * @return SQLITE_OK, or SQLITE_BUSY if another thread kept the writer
+ *         past the timeout (the caller must not step then)
+ */
+int hbf_db_pool_writer_enter(sqlite3 *db);
+
+/*
+ * Give the writer back after a statement, unless the calling thread now
+ * has a transaction open on it (released by the COMMIT or ROLLBACK)
+ *
+ * @param db: Connection passed to hbf_db_pool_writer_enter
+ */
+void hbf_db_pool_writer_leave(sqlite3 *db);
+
+/*
+ * Release the writer at the end of a request
+ *
+ * Rolls back a transaction the calling thread left open and lets waiting
+ * threads continue. No-op if the thread does not hold the writer.
+ *
+ * @param db: Writer connection
+ */
+void hbf_db_pool_writer_end(sqlite3 *db);
+
+/*
+ * Close all read connections of writer and forget it (no-op if writer is
+ * not the pooled connection)
+ *
+ * Called by hbf_db_close() before the writer is closed. Worker threads
+ * must have exited (their readers are closed on thread exit).
+ *
+ * @param writer: Writer connection passed to hbf_db_pool_init
+ */
+void hbf_db_pool_shutdown(sqlite3 *writer);
+
+#endif /* HBF_DB_POOL_H */
@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: MIT */
+#include "db_pool.h"
+#include "db.h"
+#include "overlay_fs.h"
+#include "hbf/shell/log.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static sqlite3 *g_writer = NULL;
+
+static int count_rows(sqlite3 *db)
+{
+	sqlite3_stmt *stmt = NULL;
+	int n = -1;
+
+	assert(sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM pool_t", -1,
+				  &stmt, NULL) == SQLITE_OK);
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		n = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+
+	return n;
+}
+
+static void *reader_thread(void *arg)
+{
+	sqlite3 **out = (sqlite3 **)arg;
+	sqlite3 *rdb;
+
+	rdb = hbf_db_pool_reader(g_writer);
+	assert(rdb != NULL && rdb != g_writer);
+	assert(hbf_db_pool_reader(g_writer) == rdb);
+	assert(count_rows(rdb) == 1);
+	*out = rdb;
+
+	return NULL;
+}
+
+static void test_db_pool_readers(void)
+{
+	sqlite3 *rdb;
+	sqlite3 *other = NULL;
+	pthread_t thread;
+
+	assert(hbf_db_init(1, &g_writer) == 0);
+	assert(sqlite3_exec(g_writer,
+			    "CREATE TABLE pool_t (x INTEGER);"
+			    "INSERT INTO pool_t VALUES (1);",
+			    NULL, NULL, NULL) == SQLITE_OK);
+
+	/* Reader is a separate connection that sees committed writes */
+	rdb = hbf_db_pool_reader(g_writer);
+	assert(rdb != NULL && rdb != g_writer);
+	assert(sqlite3_db_readonly(rdb, "main") == 1);
+	assert(count_rows(rdb) == 1);
+
+	/* Readers refuse writes */
+	assert(sqlite3_exec(rdb, "INSERT INTO pool_t VALUES (2)",
+			    NULL, NULL, NULL) != SQLITE_OK);
+
+	/* Each thread gets its own reader */
+	assert(pthread_create(&thread, NULL, reader_thread, &other) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(other != NULL && other != rdb);
+
+	hbf_db_close(g_writer);
+	g_writer = NULL;
+
+	printf("  ✓ Per-thread readers (verified: separate, read-only, shared data)\n");
+}
+
+static void test_db_pool_fallback(void)
+{
+	sqlite3 *plain = NULL;
+
+	assert(hbf_db_init(1, &g_writer) == 0);
+	assert(sqlite3_exec(g_writer, "CREATE TABLE pool_t (x INTEGER)",
+			    NULL, NULL, NULL) == SQLITE_OK);
+
+	/* Inside a transaction reads stay on the writer */
+	assert(sqlite3_exec(g_writer, "BEGIN; INSERT INTO pool_t VALUES (1);",
+			    NULL, NULL, NULL) == SQLITE_OK);
+	assert(hbf_db_pool_reader(g_writer) == g_writer);
+	assert(count_rows(hbf_db_pool_reader(g_writer)) == 1);
+	assert(sqlite3_exec(g_writer, "COMMIT", NULL, NULL, NULL) == SQLITE_OK);
+	assert(hbf_db_pool_reader(g_writer) != g_writer);
+
+	/* Connections that are not pooled are returned as is */
+	assert(sqlite3_open(":memory:", &plain) == SQLITE_OK);
+	assert(hbf_db_pool_reader(plain) == plain);
+	assert(hbf_db_pool_reader(NULL) == NULL);
+	sqlite3_close(plain);
+
+	/* After shutdown the writer is no longer pooled */
+	hbf_db_pool_shutdown(g_writer);
+	assert(hbf_db_pool_reader(g_writer) == g_writer);
+
+	hbf_db_close(g_writer);
+	g_writer = NULL;
+
+	printf("  ✓ Fallback to the writer\n");
+}
+
+static volatile int g_entered = 0;
+
+static void *writer_thread(void *arg)
+{
+	int *rows = (int *)arg;
+
+	/* Another thread's open transaction is not ours to read from */
+	assert(hbf_db_pool_reader(g_writer) != g_writer);
+
+	/* ...and our writes wait until it has ended */
+	assert(hbf_db_pool_writer_enter(g_writer) == SQLITE_OK);
+	g_entered = 1;
+	assert(sqlite3_get_autocommit(g_writer));
+	*rows = count_rows(g_writer);
+	hbf_db_pool_writer_leave(g_writer);
+
+	return NULL;
+}
+
+static void test_db_pool_writer_transaction(void)
+{
+	pthread_t thread;
+	int rows = -1;
+
+	assert(hbf_db_init(1, &g_writer) == 0);
+	assert(sqlite3_exec(g_writer, "CREATE TABLE pool_t (x INTEGER)",
+			    NULL, NULL, NULL) == SQLITE_OK);
+
+	/* Statements outside a transaction give the writer back */
+	hbf_db_pool_writer_enter(g_writer);
+	assert(sqlite3_exec(g_writer, "INSERT INTO pool_t VALUES (0)",
+			    NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+	assert(sqlite3_exec(g_writer, "DELETE FROM pool_t",
+			    NULL, NULL, NULL) == SQLITE_OK);
+
+	/* BEGIN keeps it until COMMIT */
+	hbf_db_pool_writer_enter(g_writer);
+	assert(sqlite3_exec(g_writer, "BEGIN", NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+	hbf_db_pool_writer_enter(g_writer); /* Re-entrant for the owner */
+	assert(sqlite3_exec(g_writer, "INSERT INTO pool_t VALUES (1)",
+			    NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+	assert(hbf_db_pool_reader(g_writer) == g_writer);
+
+	g_entered = 0;
+	assert(pthread_create(&thread, NULL, writer_thread, &rows) == 0);
+	{
+		struct timespec ts = { 0, 100 * 1000 * 1000 };
+		nanosleep(&ts, NULL);
+	}
+	assert(!g_entered);
+
+	hbf_db_pool_writer_enter(g_writer);
+	assert(sqlite3_exec(g_writer, "COMMIT", NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+
+	assert(pthread_join(thread, NULL) == 0);
+	assert(g_entered);
+	assert(rows == 1);
+
+	/* Request end rolls back what was left open */
+	hbf_db_pool_writer_enter(g_writer);
+	assert(sqlite3_exec(g_writer, "BEGIN; INSERT INTO pool_t VALUES (2);",
+			    NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+	hbf_db_pool_writer_end(g_writer);
+	assert(sqlite3_get_autocommit(g_writer));
+	assert(count_rows(g_writer) == 1);
+
+	/* The writer is free again for other threads */
+	rows = -1;
+	assert(pthread_create(&thread, NULL, writer_thread, &rows) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(rows == 1);
+
+	hbf_db_close(g_writer);
+	g_writer = NULL;
+
+	printf("  ✓ Writer transactions (verified: isolated, serialized, rolled back at end)\n");
+}
+
+static void *file_writer_thread(void *arg)
+{
+	int *ret = (int *)arg;
+
+	*ret = overlay_fs_write(g_writer, "late.txt",
+				(const unsigned char *)"late", 4);
+	g_entered = 1;
+
+	return NULL;
+}
+
+static void *busy_thread(void *arg)
+{
+	int *rc = (int *)arg;
+
+	*rc = hbf_db_pool_writer_enter(g_writer);
+
+	return NULL;
+}
+
+static void test_db_pool_writer_c_writes(void)
+{
+	pthread_t thread;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	int ret = -1;
+	int rc = SQLITE_OK;
+
+	assert(hbf_db_init(1, &g_writer) == 0);
+
+	/* A write from C waits for another thread's transaction... */
+	assert(hbf_db_pool_writer_enter(g_writer) == SQLITE_OK);
+	assert(sqlite3_exec(g_writer, "BEGIN", NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+
+	g_entered = 0;
+	assert(pthread_create(&thread, NULL, file_writer_thread, &ret) == 0);
+	{
+		struct timespec ts = { 0, 100 * 1000 * 1000 };
+		nanosleep(&ts, NULL);
+	}
+	assert(!g_entered);
+
+	/* ...so rolling that one back at request end does not undo it */
+	hbf_db_pool_writer_end(g_writer);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(ret == 0);
+	assert(overlay_fs_read(g_writer, "late.txt", &data, &size) == 0);
+	assert(size == 4 && memcmp(data, "late", 4) == 0);
+	free(data);
+
+	/* A transaction held past the timeout makes others fail busy */
+	assert(hbf_db_pool_writer_enter(g_writer) == SQLITE_OK);
+	assert(sqlite3_exec(g_writer, "BEGIN", NULL, NULL, NULL) == SQLITE_OK);
+	hbf_db_pool_writer_leave(g_writer);
+	assert(pthread_create(&thread, NULL, busy_thread, &rc) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(rc == SQLITE_BUSY);
+	hbf_db_pool_writer_end(g_writer);
+
+	hbf_db_close(g_writer);
+	g_writer = NULL;
+
+	printf("  ✓ Writes from C (verified: wait for transactions, busy after timeout)\n");
+}
+
+int main(void)
+{
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("Database pool tests:\n");
+
+	test_db_pool_readers();
+	test_db_pool_fallback();
+	test_db_pool_writer_transaction();
+	test_db_pool_writer_c_writes();
+
+	printf("\nAll database pool tests passed!\n");
+	return 0;
+}
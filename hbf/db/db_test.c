@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: MIT */
 #include "db.h"
+#include "overlay_fs.h"
+#include "hbf/db/db_pool.h"
 #include "hbf/shell/log.h"
 #include <assert.h>
 #include <stdio.h>
@@ -7,6 +9,11 @@
 #include <string.h>
 #include <unistd.h>
 
+/* Asset bundle from asset_packer */
+extern const unsigned char assets_blob[];
+extern const size_t assets_blob_len;
+extern const char assets_blob_id[];
+
 static void test_db_init_inmem(void)
 {
 	sqlite3 *db = NULL;
@@ -21,6 +28,32 @@ static void test_db_init_inmem(void)
 	printf("  ✓ In-memory database initialization\n");
 }
 
+static void test_db_bundle_id(void)
+{
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	/* asset_packer's digest is what the runtime would have computed */
+	ret = sqlite3_prepare_v2(db, "SELECT hbf_sha256(?) = ?, "
+	                         "(SELECT COUNT(*) FROM migrations WHERE bundle_id = ?2)",
+	                         -1, &stmt, NULL);
+	assert(ret == SQLITE_OK);
+	sqlite3_bind_blob(stmt, 1, assets_blob, (int)assets_blob_len, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, assets_blob_id, -1, SQLITE_STATIC);
+	assert(sqlite3_step(stmt) == SQLITE_ROW);
+	assert(sqlite3_column_int(stmt, 0) == 1);
+	assert(sqlite3_column_int(stmt, 1) == 1);
+	sqlite3_finalize(stmt);
+
+	hbf_db_close(db);
+
+	printf("  ✓ Precomputed bundle ID\n");
+}
+
 static void test_db_init_persistent(void)
 {
 	sqlite3 *db = NULL;
@@ -93,6 +126,471 @@ static void test_db_file_exists(void)
 	hbf_db_close(db);
 }
 
+static void test_db_file_cache(void)
+{
+	sqlite3 *db = NULL;
+	hbf_db_file_t *a;
+	hbf_db_file_t *b;
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	ret = overlay_fs_write_file("static/cache.txt",
+				    (const unsigned char *)"one", 3);
+	assert(ret == 0);
+
+	/* Second read is the same cached entry */
+	a = overlay_fs_get_file("static/cache.txt");
+	assert(a != NULL);
+	assert(a->size == 3 && memcmp(a->data, "one", 3) == 0);
+	b = overlay_fs_get_file("static/cache.txt");
+	assert(b == a);
+	overlay_fs_release_file(b);
+
+	/* overlay_fs_write replaces it; the old entry stays readable */
+	ret = overlay_fs_write_file("static/cache.txt",
+				    (const unsigned char *)"two!", 4);
+	assert(ret == 0);
+	b = overlay_fs_get_file("static/cache.txt");
+	assert(b != NULL && b != a);
+	assert(b->size == 4 && memcmp(b->data, "two!", 4) == 0);
+	assert(memcmp(a->data, "one", 3) == 0);
+	overlay_fs_release_file(a);
+	overlay_fs_release_file(b);
+
+	/* Writes that bypass overlay_fs are seen through the triggers */
+	ret = sqlite3_exec(db,
+			   "INSERT OR IGNORE INTO blobs (hash, data) "
+			   "VALUES (hbf_sha256('three'), 'three');"
+			   "INSERT INTO file_versions "
+			   "(file_id, path, version_number, mtime, size, hash) "
+			   "SELECT file_id, path, version_number + 1, mtime, 5, "
+			   "hbf_sha256('three') FROM latest_files_meta "
+			   "WHERE path = 'static/cache.txt'",
+			   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	a = overlay_fs_get_file("static/cache.txt");
+	assert(a != NULL);
+	assert(a->size == 5 && memcmp(a->data, "three", 5) == 0);
+	overlay_fs_release_file(a);
+
+	/* Unrelated writes only revalidate, the entry is kept */
+	a = overlay_fs_get_file("static/cache.txt");
+	ret = overlay_fs_write_file("static/other.txt",
+				    (const unsigned char *)"x", 1);
+	assert(ret == 0);
+	b = overlay_fs_get_file("static/cache.txt");
+	assert(b == a);
+	overlay_fs_release_file(a);
+	overlay_fs_release_file(b);
+
+	/* Compressible files also carry their stored gzip encoding */
+	{
+		unsigned char text[4096];
+
+		memset(text, 'a', sizeof(text));
+		ret = overlay_fs_write_file("static/big.txt", text, sizeof(text));
+		assert(ret == 0);
+		a = overlay_fs_get_file("static/big.txt");
+		assert(a != NULL);
+		assert(a->size == sizeof(text) && memcmp(a->data, text, a->size) == 0);
+		assert(a->gzip != NULL && a->gzip_size < a->size);
+		assert(a->gzip[0] == 0x1f && a->gzip[1] == 0x8b);
+		overlay_fs_release_file(a);
+	}
+
+	assert(overlay_fs_get_file("nonexistent/file.txt") == NULL);
+
+	printf("  ✓ File cache (verified: reuse, invalidation, revalidation)\n");
+
+	hbf_db_close(db);
+}
+
+/*
+ * --inmem runs on memdb, which has no WAL: the WAL hook never fires, so
+ * the post-commit generation bump comes from overlay_fs_statement_done
+ */
+static void test_db_file_cache_inmem_commit(void)
+{
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	hbf_db_file_t *file;
+	uint64_t generation;
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+	ret = sqlite3_prepare_v2(db, "PRAGMA journal_mode", -1, &stmt, NULL);
+	assert(ret == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW);
+	assert(strcmp((const char *)sqlite3_column_text(stmt, 0), "memory") == 0);
+	sqlite3_finalize(stmt);
+
+	ret = overlay_fs_write_file("static/commit.txt",
+				    (const unsigned char *)"one", 3);
+	assert(ret == 0);
+	file = overlay_fs_get_file("static/commit.txt");
+	assert(file != NULL && file->size == 3);
+	overlay_fs_release_file(file);
+
+	/* As db.execute would: a write in an explicit transaction */
+	ret = sqlite3_exec(db,
+			   "BEGIN;"
+			   "INSERT OR IGNORE INTO blobs (hash, data) "
+			   "VALUES (hbf_sha256('two'), 'two');"
+			   "INSERT INTO file_versions "
+			   "(file_id, path, version_number, mtime, size, hash) "
+			   "SELECT file_id, path, version_number + 1, mtime, 3, "
+			   "hbf_sha256('two') FROM latest_files_meta "
+			   "WHERE path = 'static/commit.txt'",
+			   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	generation = overlay_fs_generation();
+
+	/* Not committed yet: readers still see the old version */
+	overlay_fs_statement_done(db);
+	assert(overlay_fs_generation() == generation);
+
+	ret = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(overlay_fs_generation() == generation);
+	overlay_fs_statement_done(db);
+	assert(overlay_fs_generation() == generation + 1);
+	overlay_fs_statement_done(db);
+	assert(overlay_fs_generation() == generation + 1);
+
+	file = overlay_fs_get_file("static/commit.txt");
+	assert(file != NULL);
+	assert(file->size == 3 && memcmp(file->data, "two", 3) == 0);
+	overlay_fs_release_file(file);
+
+	hbf_db_close(db);
+
+	printf("  ✓ File cache after --inmem commits (no WAL hook)\n");
+}
+
+static void test_db_file_stat(void)
+{
+	sqlite3 *db = NULL;
+	overlay_fs_stat_t st;
+	overlay_fs_stat_t cached;
+	hbf_db_file_t *file;
+	unsigned char text[1024];
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	ret = overlay_fs_write_file("static/stat.txt",
+				    (const unsigned char *)"v1", 2);
+	assert(ret == 0);
+
+	/* Uncached: answered from metadata alone */
+	ret = overlay_fs_stat("static/stat.txt", &st);
+	assert(ret == 1);
+	assert(st.version == 1 && st.size == 2);
+	assert(strlen(st.hash) == OVERLAY_FS_HASH_LEN);
+
+	/* Cached: the same answer, from the entry */
+	file = overlay_fs_get_file("static/stat.txt");
+	assert(file != NULL);
+	assert(strcmp(file->digest, st.hash) == 0);
+	overlay_fs_release_file(file);
+	ret = overlay_fs_stat("static/stat.txt", &cached);
+	assert(ret == 1);
+	assert(cached.version == st.version && cached.mtime == st.mtime);
+	assert(strcmp(cached.hash, st.hash) == 0);
+
+	/* New contents, new hash */
+	ret = overlay_fs_write_file("static/stat.txt",
+				    (const unsigned char *)"v2", 2);
+	assert(ret == 0);
+	ret = overlay_fs_stat("static/stat.txt", &cached);
+	assert(ret == 1);
+	assert(cached.version == 2 && strcmp(cached.hash, st.hash) != 0);
+
+	assert(cached.gzip == 0);
+
+	/* Stored gzip: reported both uncached and cached */
+	memset(text, 'a', sizeof(text));
+	ret = overlay_fs_write_file("static/stat.txt", text, sizeof(text));
+	assert(ret == 0);
+	ret = overlay_fs_stat("static/stat.txt", &st);
+	assert(ret == 1 && st.gzip == 1);
+	file = overlay_fs_get_file("static/stat.txt");
+	assert(file != NULL);
+	overlay_fs_release_file(file);
+	ret = overlay_fs_stat("static/stat.txt", &cached);
+	assert(ret == 1 && cached.gzip == 1);
+
+	assert(overlay_fs_stat("nonexistent/file.txt", &st) == 0);
+
+	printf("  ✓ File stat (verified: cached and uncached)\n");
+
+	hbf_db_close(db);
+}
+
+/* Read all of a stream in steps of step bytes */
+static size_t read_stream(overlay_fs_stream_t *s, unsigned char *out,
+			  size_t step)
+{
+	unsigned char buf[OVERLAY_FS_STREAM_CHUNK];
+	size_t total = 0;
+	size_t got;
+
+	do {
+		assert(overlay_fs_stream_read(s, buf, step, &got) == 0);
+		memcpy(out + total, buf, got);
+		total += got;
+	} while (got > 0);
+
+	return total;
+}
+
+/* Statements of db in progress (open read transactions, blobs included) */
+static int busy_statements(sqlite3 *db)
+{
+	sqlite3_stmt *stmt = NULL;
+	int n = 0;
+
+	while ((stmt = sqlite3_next_stmt(db, stmt)) != NULL) {
+		if (sqlite3_stmt_busy(stmt)) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static void test_db_file_stream(void)
+{
+	sqlite3 *db = NULL;
+	overlay_fs_stream_t s;
+	unsigned char *text;
+	unsigned char *out;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	size_t len = 200000;
+	size_t i;
+	unsigned int seed = 1;
+	int ret;
+
+	text = malloc(len);
+	out = malloc(len);
+	assert(text && out);
+	for (i = 0; i < len; i++) {
+		text[i] = (unsigned char)('a' + (i * 7 + i / 13) % 26);
+	}
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	/* Compressible: stored gzip, streamed through inflate */
+	ret = overlay_fs_write_file("static/stream.txt", text, len);
+	assert(ret == 0);
+	ret = overlay_fs_stream_open("static/stream.txt", &s);
+	assert(ret == 1);
+	assert(s.gzip && s.st.size == len && s.stored_size < len);
+	assert(read_stream(&s, out, 1000) == len);
+	assert(memcmp(out, text, len) == 0);
+	overlay_fs_stream_close(&s);
+
+	/* Seeking forward discards inflated bytes; back is refused */
+	ret = overlay_fs_stream_open("static/stream.txt", &s);
+	assert(ret == 1);
+	assert(overlay_fs_stream_seek(&s, 150001) == 0);
+	assert(read_stream(&s, out, OVERLAY_FS_STREAM_CHUNK) == len - 150001);
+	assert(memcmp(out, text + 150001, len - 150001) == 0);
+	assert(overlay_fs_stream_seek(&s, 10) == -1);
+	overlay_fs_stream_close(&s);
+
+	/* Stored bytes are the gzip data overlay_fs_decode accepts */
+	ret = overlay_fs_stream_open("static/stream.txt", &s);
+	assert(ret == 1);
+	i = 0;
+	do {
+		assert(overlay_fs_stream_read_stored(&s, out + i, 4096,
+						     &size) == 0);
+		i += size;
+	} while (size > 0);
+	assert(i == s.stored_size);
+	ret = overlay_fs_decode(OVERLAY_FS_ENCODING_GZIP, out, i, len,
+				&data, &size);
+	assert(ret == 0 && size == len && memcmp(data, text, len) == 0);
+	free(data);
+	overlay_fs_stream_close(&s);
+
+	/* Incompressible: identity, seeks anywhere */
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245u + 12345u;
+		text[i] = (unsigned char)(seed >> 16);
+	}
+	ret = overlay_fs_write_file("static/stream.bin", text, len);
+	assert(ret == 0);
+	ret = overlay_fs_stream_open("static/stream.bin", &s);
+	assert(ret == 1);
+	assert(!s.gzip && s.stored_size == len);
+	assert(overlay_fs_stream_seek(&s, 12345) == 0);
+	assert(read_stream(&s, out, 777) == len - 12345);
+	assert(memcmp(out, text + 12345, len - 12345) == 0);
+	assert(overlay_fs_stream_seek(&s, 5) == 0);
+	assert(read_stream(&s, out, 10) == len - 5);
+	assert(memcmp(out, text + 5, len - 5) == 0);
+	overlay_fs_stream_close(&s);
+	overlay_fs_stream_close(&s);
+
+	/* No read transaction between reads, and the version being read
+	 * is streamed to the end after the file is replaced */
+	ret = overlay_fs_stream_open("static/stream.bin", &s);
+	assert(ret == 1);
+	assert(busy_statements(hbf_db_pool_reader(db)) == 0);
+	assert(overlay_fs_stream_read(&s, out, 1000, &size) == 0);
+	assert(size == 1000);
+	assert(busy_statements(hbf_db_pool_reader(db)) == 0);
+	ret = overlay_fs_write_file("static/stream.bin",
+				    (const unsigned char *)"new", 3);
+	assert(ret == 0);
+	assert(read_stream(&s, out + 1000, 4096) == len - 1000);
+	assert(memcmp(out, text, len) == 0);
+	overlay_fs_stream_close(&s);
+
+	assert(overlay_fs_stream_open("nonexistent/file.txt", &s) == 0);
+
+	printf("  ✓ File stream (verified: gzip, identity, seek, stored)\n");
+
+	free(text);
+	free(out);
+	hbf_db_close(db);
+}
+
+static void test_db_base_layer(void)
+{
+	overlay_fs_base_file_t base;
+	overlay_fs_stat_t st;
+	unsigned char *data = NULL;
+	unsigned char *decoded = NULL;
+	size_t size = 0;
+	size_t decoded_size = 0;
+	sqlite3 *db = NULL;
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	/* Every embedded file starts out served from the table */
+	ret = overlay_fs_base_get("hbf/server.js", &base);
+	assert(ret == 1);
+	ret = overlay_fs_read(db, "hbf/server.js", &data, &size);
+	assert(ret == 0);
+	ret = overlay_fs_decode(base.entry.gzip ? OVERLAY_FS_ENCODING_GZIP :
+	                        OVERLAY_FS_ENCODING_IDENTITY, base.entry.data,
+	                        base.entry.stored_size, base.entry.size,
+	                        &decoded, &decoded_size);
+	assert(ret == 0);
+	assert(decoded_size == size && memcmp(decoded, data, size) == 0);
+	free(decoded);
+
+	/* Same headers as the database would give */
+	assert(overlay_fs_stat("hbf/server.js", &st) == 1);
+	assert(st.version == base.st.version && st.mtime == base.st.mtime);
+	assert(st.size == base.st.size && strcmp(st.hash, base.st.hash) == 0);
+
+	assert(overlay_fs_base_get("static/not-embedded.txt", &base) == 0);
+
+	/* Overridden in the database: no longer from the table */
+	ret = overlay_fs_write(db, "hbf/server.js",
+	                       (const unsigned char *)"// override", 11);
+	assert(ret == 0);
+	assert(overlay_fs_base_get("hbf/server.js", &base) == 0);
+
+	/* Back to the embedded contents: served from the table again */
+	ret = overlay_fs_write(db, "hbf/server.js", data, size);
+	assert(ret == 0);
+	assert(overlay_fs_base_get("hbf/server.js", &base) == 1);
+	assert(base.st.version == 3);
+
+	free(data);
+	hbf_db_close(db);
+
+	printf("  ✓ Base layer served from the embedded table\n");
+}
+
+static int count_marker(sqlite3 *db)
+{
+	sqlite3_stmt *stmt = NULL;
+	int count;
+
+	assert(sqlite3_prepare_v2(db,
+	    "SELECT COUNT(*) FROM migrations WHERE bundle_id = 'image-marker'",
+	    -1, &stmt, NULL) == SQLITE_OK);
+	assert(sqlite3_step(stmt) == SQLITE_ROW);
+	count = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	return count;
+}
+
+static void test_db_init_image(void)
+{
+	static const unsigned char garbage[4096] = { 'n', 'o', 't', ' ', 'a' };
+	const char *text = "written after image load";
+	sqlite3 *db = NULL;
+	unsigned char *image;
+	unsigned char *data;
+	sqlite3_int64 image_len = 0;
+	size_t size;
+	int ret;
+
+	/* Image as //tools:db_image builds it, plus a row to recognise it by */
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+	assert(sqlite3_exec(db, "INSERT INTO migrations VALUES "
+	                    "('image-marker', 0, 0)", NULL, NULL, NULL) == SQLITE_OK);
+	image = sqlite3_serialize(db, "main", &image_len, 0);
+	assert(image != NULL);
+	hbf_db_close(db);
+
+	hbf_db_set_image(image, (size_t)image_len);
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+	assert(count_marker(db) == 1);
+
+	/* Loaded pages are a private, writable copy of the image */
+	ret = overlay_fs_write(db, "static/image.txt",
+	                       (const unsigned char *)text, strlen(text));
+	assert(ret == 0);
+	ret = overlay_fs_read(db, "static/image.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == strlen(text));
+	assert(memcmp(data, text, size) == 0);
+	free(data);
+	hbf_db_close(db);
+
+	/* Images are only used in memory */
+	unlink("./hbf.db");
+	unlink("./hbf.db-wal");
+	unlink("./hbf.db-shm");
+	ret = hbf_db_init(0, &db);
+	assert(ret == 0);
+	assert(count_marker(db) == 0);
+	hbf_db_close(db);
+	unlink("./hbf.db");
+	unlink("./hbf.db-wal");
+	unlink("./hbf.db-shm");
+
+	/* An unreadable image falls back to schema and migration */
+	hbf_db_set_image(garbage, sizeof(garbage));
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+	assert(count_marker(db) == 0);
+	hbf_db_close(db);
+
+	hbf_db_set_image(NULL, 0);
+	sqlite3_free(image);
+
+	printf("  ✓ In-memory database from prebuilt image\n");
+}
+
 int main(void)
 {
 	hbf_log_init(hbf_log_parse_level("DEBUG"));
@@ -100,9 +598,16 @@ int main(void)
 	printf("Database tests:\n");
 
 	test_db_init_inmem();
+	test_db_bundle_id();
 	test_db_init_persistent();
 	test_db_read_file();
 	test_db_file_exists();
+	test_db_file_cache();
+	test_db_file_cache_inmem_commit();
+	test_db_file_stat();
+	test_db_file_stream();
+	test_db_base_layer();
+	test_db_init_image();
 
 	printf("\nAll database tests passed!\n");
 	return 0;
@@ -0,0 +1,384 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF file cache
+ */
+
+#include "hbf/db/file_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbf/shell/log.h"
+
+#define HBF_DB_FILE_CACHE_BUCKETS 64u
+
+/*
+ * One shard: a hash table of entries plus an LRU list over the same
+ * entries. Entries still referenced by a reader are unlinked and freed
+ * on their last release.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	hbf_db_file_t *buckets[HBF_DB_FILE_CACHE_BUCKETS];
+	hbf_db_file_t *head; /* Most recently used */
+	hbf_db_file_t *tail; /* Least recently used */
+	size_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+} hbf_db_file_shard_t;
+
+static hbf_db_file_shard_t g_file_shards[HBF_DB_FILE_CACHE_SHARDS];
+static pthread_once_t g_file_cache_once = PTHREAD_ONCE_INIT;
+
+static struct {
+	pthread_mutex_t lock;
+	size_t budget;
+} g_file_cache = { PTHREAD_MUTEX_INITIALIZER, HBF_DB_FILE_CACHE_MAX_BYTES };
+
+static void hbf_db_file_cache_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < HBF_DB_FILE_CACHE_SHARDS; i++) {
+		pthread_mutex_init(&g_file_shards[i].lock, NULL);
+	}
+}
+
+/* FNV-1a hash of a file path */
+static uint32_t hbf_db_file_hash(const char *path)
+{
+	uint32_t h = 2166136261u;
+
+	while (*path) {
+		h ^= (unsigned char)*path++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static hbf_db_file_shard_t *hbf_db_file_shard(uint32_t hash)
+{
+	pthread_once(&g_file_cache_once, hbf_db_file_cache_init);
+	return &g_file_shards[hash & (HBF_DB_FILE_CACHE_SHARDS - 1u)];
+}
+
+static hbf_db_file_t **hbf_db_file_bucket(hbf_db_file_shard_t *shard,
+					  uint32_t hash)
+{
+	/* Low bits already picked the shard */
+	return &shard->buckets[(hash >> 4) % HBF_DB_FILE_CACHE_BUCKETS];
+}
+
+/* Find the link pointing at path's entry (shard lock held) */
+static hbf_db_file_t **hbf_db_file_find(hbf_db_file_shard_t *shard,
+					const char *path, uint32_t hash)
+{
+	hbf_db_file_t **link = hbf_db_file_bucket(shard, hash);
+
+	while (*link) {
+		if ((*link)->hash == hash && strcmp((*link)->path, path) == 0) {
+			return link;
+		}
+		link = &(*link)->chain;
+	}
+
+	return NULL;
+}
+
+/* Take file out of the LRU list (shard lock held) */
+static void hbf_db_file_lru_remove(hbf_db_file_shard_t *shard,
+				   hbf_db_file_t *file)
+{
+	if (file->prev) {
+		file->prev->next = file->next;
+	} else {
+		shard->head = file->next;
+	}
+	if (file->next) {
+		file->next->prev = file->prev;
+	} else {
+		shard->tail = file->prev;
+	}
+	file->prev = NULL;
+	file->next = NULL;
+}
+
+static void hbf_db_file_lru_push(hbf_db_file_shard_t *shard,
+				 hbf_db_file_t *file)
+{
+	file->prev = NULL;
+	file->next = shard->head;
+	if (shard->head) {
+		shard->head->prev = file;
+	} else {
+		shard->tail = file;
+	}
+	shard->head = file;
+}
+
+/* Unlink entry from the cache (shard lock held) */
+static void hbf_db_file_unlink(hbf_db_file_shard_t *shard,
+			       hbf_db_file_t **link)
+{
+	hbf_db_file_t *file = *link;
+
+	*link = file->chain;
+	file->chain = NULL;
+	hbf_db_file_lru_remove(shard, file);
+	file->cached = 0;
+	shard->bytes -= file->size + file->gzip_size;
+
+	if (file->refs == 0) {
+		free(file);
+	}
+}
+
+hbf_db_file_t *hbf_db_file_cache_get(const char *path, uint64_t generation,
+				     int *stale)
+{
+	hbf_db_file_shard_t *shard;
+	hbf_db_file_t **link;
+	hbf_db_file_t *file = NULL;
+	uint32_t hash;
+
+	if (!path) {
+		return NULL;
+	}
+
+	hash = hbf_db_file_hash(path);
+	shard = hbf_db_file_shard(hash);
+
+	pthread_mutex_lock(&shard->lock);
+	link = hbf_db_file_find(shard, path, hash);
+	if (link) {
+		file = *link;
+		file->refs++;
+		hbf_db_file_lru_remove(shard, file);
+		hbf_db_file_lru_push(shard, file);
+		if (stale) {
+			*stale = file->generation != generation;
+		}
+		shard->hits++;
+	} else {
+		shard->misses++;
+	}
+	pthread_mutex_unlock(&shard->lock);
+
+	return file;
+}
+
+void hbf_db_file_cache_revalidate(hbf_db_file_t *file, uint64_t generation)
+{
+	hbf_db_file_shard_t *shard;
+
+	if (!file) {
+		return;
+	}
+
+	shard = hbf_db_file_shard(file->hash);
+	pthread_mutex_lock(&shard->lock);
+	if (file->generation < generation) {
+		file->generation = generation;
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+hbf_db_file_t *hbf_db_file_cache_put(const char *path, int64_t version,
+				     int64_t mtime, uint64_t generation,
+				     const char *digest,
+				     const unsigned char *data, size_t size,
+				     const unsigned char *gzip,
+				     size_t gzip_size)
+{
+	hbf_db_file_shard_t *shard;
+	hbf_db_file_t **link;
+	hbf_db_file_t *file;
+	unsigned char *copy;
+	size_t path_len;
+	size_t limit;
+	size_t bytes;
+
+	if (!path || (size > 0 && !data)) {
+		return NULL;
+	}
+
+	if (!gzip) {
+		gzip_size = 0;
+	}
+	bytes = size + gzip_size;
+
+	/* Entry, contents, gzip encoding and path share one allocation */
+	path_len = strlen(path);
+	file = (hbf_db_file_t *)malloc(sizeof(*file) + bytes + path_len + 1);
+	if (!file) {
+		hbf_log_error("Failed to allocate file cache entry");
+		return NULL;
+	}
+
+	copy = (unsigned char *)(file + 1);
+	if (size > 0) {
+		memcpy(copy, data, size);
+	}
+	file->data = copy;
+	file->size = size;
+	file->gzip = NULL;
+	file->gzip_size = gzip_size;
+	if (gzip) {
+		memcpy(copy + size, gzip, gzip_size);
+		file->gzip = copy + size;
+	}
+	file->version = version;
+	file->mtime = mtime;
+	file->generation = generation;
+	file->digest[0] = '\0';
+	if (digest) {
+		strncpy(file->digest, digest, HBF_DB_FILE_DIGEST_LEN);
+		file->digest[HBF_DB_FILE_DIGEST_LEN] = '\0';
+	}
+	file->path = (char *)(copy + bytes);
+	memcpy(file->path, path, path_len + 1);
+	file->hash = hbf_db_file_hash(path);
+	file->refs = 1;
+	file->cached = 0;
+	file->chain = NULL;
+	file->prev = NULL;
+	file->next = NULL;
+
+	pthread_mutex_lock(&g_file_cache.lock);
+	limit = g_file_cache.budget / HBF_DB_FILE_CACHE_SHARDS;
+	pthread_mutex_unlock(&g_file_cache.lock);
+
+	if (limit == 0 || bytes > limit) {
+		return file;
+	}
+
+	shard = hbf_db_file_shard(file->hash);
+	pthread_mutex_lock(&shard->lock);
+
+	link = hbf_db_file_find(shard, path, file->hash);
+	if (link) {
+		/* Never replace a newer version loaded by another thread */
+		if ((*link)->generation > generation) {
+			pthread_mutex_unlock(&shard->lock);
+			return file;
+		}
+		hbf_db_file_unlink(shard, link);
+	}
+
+	while (shard->tail && shard->bytes + bytes > limit) {
+		hbf_db_file_t *lru = shard->tail;
+
+		hbf_db_file_unlink(shard,
+				   hbf_db_file_find(shard, lru->path, lru->hash));
+	}
+
+	link = hbf_db_file_bucket(shard, file->hash);
+	file->chain = *link;
+	*link = file;
+	hbf_db_file_lru_push(shard, file);
+	file->cached = 1;
+	shard->bytes += bytes;
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return file;
+}
+
+void hbf_db_file_release(hbf_db_file_t *file)
+{
+	hbf_db_file_shard_t *shard;
+	int free_it;
+
+	if (!file) {
+		return;
+	}
+
+	shard = hbf_db_file_shard(file->hash);
+	pthread_mutex_lock(&shard->lock);
+	file->refs--;
+	free_it = file->refs == 0 && !file->cached;
+	pthread_mutex_unlock(&shard->lock);
+
+	if (free_it) {
+		free(file);
+	}
+}
+
+static void hbf_db_file_shard_clear(hbf_db_file_shard_t *shard)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&shard->lock);
+	for (i = 0; i < HBF_DB_FILE_CACHE_BUCKETS; i++) {
+		while (shard->buckets[i]) {
+			hbf_db_file_unlink(shard, &shard->buckets[i]);
+		}
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void hbf_db_file_cache_invalidate(const char *path)
+{
+	hbf_db_file_shard_t *shard;
+	hbf_db_file_t **link;
+	unsigned int i;
+	uint32_t hash;
+
+	if (!path) {
+		pthread_once(&g_file_cache_once, hbf_db_file_cache_init);
+		for (i = 0; i < HBF_DB_FILE_CACHE_SHARDS; i++) {
+			hbf_db_file_shard_clear(&g_file_shards[i]);
+		}
+		return;
+	}
+
+	hash = hbf_db_file_hash(path);
+	shard = hbf_db_file_shard(hash);
+	pthread_mutex_lock(&shard->lock);
+	link = hbf_db_file_find(shard, path, hash);
+	if (link) {
+		hbf_db_file_unlink(shard, link);
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void hbf_db_file_cache_set_budget(size_t bytes)
+{
+	pthread_mutex_lock(&g_file_cache.lock);
+	g_file_cache.budget = bytes;
+	pthread_mutex_unlock(&g_file_cache.lock);
+
+	hbf_log_debug("File cache budget: %zu bytes", bytes);
+}
+
+void hbf_db_file_cache_stats(uint64_t *hits, uint64_t *misses,
+			     size_t *bytes)
+{
+	uint64_t total_hits = 0;
+	uint64_t total_misses = 0;
+	size_t total_bytes = 0;
+	unsigned int i;
+
+	pthread_once(&g_file_cache_once, hbf_db_file_cache_init);
+	for (i = 0; i < HBF_DB_FILE_CACHE_SHARDS; i++) {
+		hbf_db_file_shard_t *shard = &g_file_shards[i];
+
+		pthread_mutex_lock(&shard->lock);
+		total_hits += shard->hits;
+		total_misses += shard->misses;
+		total_bytes += shard->bytes;
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	if (hits) {
+		*hits = total_hits;
+	}
+	if (misses) {
+		*misses = total_misses;
+	}
+	if (bytes) {
+		*bytes = total_bytes;
+	}
+}
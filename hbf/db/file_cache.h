@@ -0,0 +1,86 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF file cache
+ *
+ * Process-wide cache of the latest version of overlay_fs files, keyed by
+ * path and split into shards so that worker threads rarely contend on a
+ * lock. Entries are immutable and reference counted: a reader keeps
+ * using its entry (e.g. while writing it to a socket) even if a newer
+ * version replaces it in the meantime.
+ */
+
+#ifndef HBF_DB_FILE_CACHE_H
+#define HBF_DB_FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Default upper bound on cached file contents */
+#define HBF_DB_FILE_CACHE_MAX_BYTES (32u * 1024u * 1024u)
+
+/* Number of independently locked shards (power of two) */
+#define HBF_DB_FILE_CACHE_SHARDS 16u
+
+/* Length of a content digest (SHA-256, lowercase hex) */
+#define HBF_DB_FILE_DIGEST_LEN 64
+
+/* One version of one file */
+typedef struct hbf_db_file {
+	const unsigned char *data; /* Contents (not NUL-terminated) */
+	size_t size;
+	const unsigned char *gzip; /* gzip-encoded contents, or NULL */
+	size_t gzip_size;
+	int64_t version;           /* file_versions.version_number */
+	int64_t mtime;             /* Guards against reused version numbers */
+	char digest[HBF_DB_FILE_DIGEST_LEN + 1]; /* blobs.hash, or "" */
+	uint64_t generation;       /* overlay_fs_generation() last validated at */
+	char *path;
+	uint32_t hash;
+	int refs;                  /* Outstanding references */
+	int cached;                /* 1 while linked into the cache */
+	struct hbf_db_file *chain; /* Next entry in the same bucket */
+	struct hbf_db_file *prev;  /* Towards most recently used */
+	struct hbf_db_file *next;  /* Towards least recently used */
+} hbf_db_file_t;
+
+/*
+ * Look up the cached version of path.
+ * Returns a referenced entry (release with hbf_db_file_release) or NULL
+ * on miss. *stale is set to 1 if the entry was validated under another
+ * generation than the given one and must be revalidated before use.
+ */
+hbf_db_file_t *hbf_db_file_cache_get(const char *path, uint64_t generation,
+				     int *stale);
+
+/* Mark file as still current under generation */
+void hbf_db_file_cache_revalidate(hbf_db_file_t *file, uint64_t generation);
+
+/*
+ * Store a copy of data (and of its gzip encoding, if gzip is not NULL) as
+ * the current version of path, replacing any other version cached for
+ * it. digest (may be NULL) identifies the contents. Files larger than a
+ * shard's share of the budget are returned without being cached.
+ * Returns a referenced entry (release with hbf_db_file_release) or NULL
+ * if out of memory.
+ */
+hbf_db_file_t *hbf_db_file_cache_put(const char *path, int64_t version,
+				     int64_t mtime, uint64_t generation,
+				     const char *digest,
+				     const unsigned char *data, size_t size,
+				     const unsigned char *gzip,
+				     size_t gzip_size);
+
+/* Release a reference returned by hbf_db_file_cache_get/put */
+void hbf_db_file_release(hbf_db_file_t *file);
+
+/* Drop the cached version of path (NULL drops everything) */
+void hbf_db_file_cache_invalidate(const char *path);
+
+/* Set the byte budget (0 disables caching; applies to later inserts) */
+void hbf_db_file_cache_set_budget(size_t bytes);
+
+/* Cache statistics (any pointer may be NULL) */
+void hbf_db_file_cache_stats(uint64_t *hits, uint64_t *misses,
+			     size_t *bytes);
+
+#endif /* HBF_DB_FILE_CACHE_H */
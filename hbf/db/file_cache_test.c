@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: MIT */
+#include "file_cache.h"
+#include "hbf/shell/log.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static void test_file_cache_get_put(void)
+{
+	hbf_db_file_t *a;
+	hbf_db_file_t *b;
+	int stale = -1;
+
+	hbf_db_file_cache_invalidate(NULL);
+
+	assert(hbf_db_file_cache_get("a.txt", 1, &stale) == NULL);
+
+	a = hbf_db_file_cache_put("a.txt", 1, 100, 1, "abc",
+				  (const unsigned char *)"hello", 5, NULL, 0);
+	assert(a != NULL && a->cached);
+	assert(a->size == 5 && memcmp(a->data, "hello", 5) == 0);
+	assert(a->gzip == NULL && a->gzip_size == 0);
+	assert(strcmp(a->digest, "abc") == 0);
+
+	b = hbf_db_file_cache_get("a.txt", 1, &stale);
+	assert(b == a && stale == 0);
+	hbf_db_file_release(b);
+
+	/* Another generation needs revalidation */
+	b = hbf_db_file_cache_get("a.txt", 2, &stale);
+	assert(b == a && stale == 1);
+	hbf_db_file_cache_revalidate(b, 2);
+	hbf_db_file_release(b);
+	b = hbf_db_file_cache_get("a.txt", 2, &stale);
+	assert(b == a && stale == 0);
+	hbf_db_file_release(b);
+
+	/* An older load never replaces a newer one */
+	b = hbf_db_file_cache_put("a.txt", 0, 50, 1, NULL,
+				  (const unsigned char *)"old", 3, NULL, 0);
+	assert(b != NULL && !b->cached);
+	hbf_db_file_release(b);
+
+	/* Invalidated entries stay valid for their holders */
+	hbf_db_file_cache_invalidate("a.txt");
+	assert(!a->cached);
+	assert(memcmp(a->data, "hello", 5) == 0);
+	assert(hbf_db_file_cache_get("a.txt", 2, &stale) == NULL);
+	hbf_db_file_release(a);
+
+	printf("  ✓ Get, put, revalidate and invalidate\n");
+}
+
+static void test_file_cache_budget(void)
+{
+	unsigned char big[4096];
+	hbf_db_file_t *file;
+	size_t bytes;
+	char path[32];
+	int stale;
+	int i;
+
+	hbf_db_file_cache_invalidate(NULL);
+	memset(big, 'x', sizeof(big));
+
+	/* Two files fit in each shard's share */
+	hbf_db_file_cache_set_budget(HBF_DB_FILE_CACHE_SHARDS * 2 * sizeof(big));
+
+	for (i = 0; i < 256; i++) {
+		snprintf(path, sizeof(path), "static/%d.bin", i);
+		file = hbf_db_file_cache_put(path, 1, 1, 1, NULL, big,
+					     sizeof(big), NULL, 0);
+		assert(file != NULL);
+		hbf_db_file_release(file);
+	}
+
+	hbf_db_file_cache_stats(NULL, NULL, &bytes);
+	assert(bytes <= HBF_DB_FILE_CACHE_SHARDS * 2 * sizeof(big));
+	assert(bytes > 0);
+
+	/* The most recent file survived eviction */
+	file = hbf_db_file_cache_get("static/255.bin", 1, &stale);
+	assert(file != NULL);
+	hbf_db_file_release(file);
+
+	/* Files over a shard's share are handed out uncached */
+	hbf_db_file_cache_set_budget(HBF_DB_FILE_CACHE_SHARDS * 1024);
+	file = hbf_db_file_cache_put("static/big.bin", 1, 1, 1, NULL, big,
+				     sizeof(big), NULL, 0);
+	assert(file != NULL && !file->cached);
+	hbf_db_file_release(file);
+
+	hbf_db_file_cache_set_budget(HBF_DB_FILE_CACHE_MAX_BYTES);
+	hbf_db_file_cache_invalidate(NULL);
+	hbf_db_file_cache_stats(NULL, NULL, &bytes);
+	assert(bytes == 0);
+
+	printf("  ✓ Byte budget and LRU eviction\n");
+}
+
+static void test_file_cache_gzip(void)
+{
+	hbf_db_file_t *file;
+	size_t bytes;
+
+	hbf_db_file_cache_invalidate(NULL);
+
+	/* Both encodings live in the entry and count against the budget */
+	file = hbf_db_file_cache_put("page.html", 1, 1, 1, NULL,
+				     (const unsigned char *)"plain text", 10,
+				     (const unsigned char *)"GZIP", 4);
+	assert(file != NULL && file->cached);
+	assert(file->size == 10 && memcmp(file->data, "plain text", 10) == 0);
+	assert(file->gzip_size == 4 && memcmp(file->gzip, "GZIP", 4) == 0);
+	assert(strcmp(file->path, "page.html") == 0);
+
+	hbf_db_file_cache_stats(NULL, NULL, &bytes);
+	assert(bytes == 14);
+
+	hbf_db_file_release(file);
+	hbf_db_file_cache_invalidate(NULL);
+
+	printf("  ✓ Cached gzip encoding\n");
+}
+
+int main(void)
+{
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("File cache tests:\n");
+
+	test_file_cache_get_put();
+	test_file_cache_budget();
+	test_file_cache_gzip();
+
+	printf("\nAll file cache tests passed!\n");
+	return 0;
+}
@@ -1,6 +1,11 @@
 /* SPDX-License-Identifier: MIT */
 #include "overlay_fs.h"
+#include "hbf/db/db_pool.h"
+#include "hbf/db/file_cache.h"
+#include "hbf/db/stmt_cache.h"
+#include "hbf/shell/hash.h"
 #include "hbf/shell/log.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +17,88 @@
 /* Set by overlay_fs_init_global(), used by overlay_fs_read_file/overlay_fs_write_file */
 static sqlite3 *g_overlay_db = NULL;
 
+/* Bumped whenever the latest version of any file may have changed */
+static uint64_t g_overlay_generation = 0;
+static int g_overlay_dirty = 0; /* Update hook fired, commit not seen yet */
+static pthread_mutex_t g_overlay_generation_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* SQLite's default; our WAL hook replaces its automatic checkpoints */
+#define OVERLAY_FS_WAL_CHECKPOINT_PAGES 1000
+
+/* Pages released per incremental_vacuum transaction after compaction */
+#define OVERLAY_FS_VACUUM_PAGES "1024"
+
+static void overlay_fs_bump_generation(void)
+{
+	pthread_mutex_lock(&g_overlay_generation_lock);
+	g_overlay_generation++;
+	pthread_mutex_unlock(&g_overlay_generation_lock);
+}
+
+uint64_t overlay_fs_generation(void)
+{
+	uint64_t generation;
+
+	pthread_mutex_lock(&g_overlay_generation_lock);
+	generation = g_overlay_generation;
+	pthread_mutex_unlock(&g_overlay_generation_lock);
+
+	return generation;
+}
+
+/*
+ * Update hook on the global handle. latest_files_meta is maintained by
+ * triggers on file_versions, so this also catches writes that bypass
+ * overlay_fs_write (e.g. db.execute from JavaScript).
+ */
+static void overlay_fs_update_hook(void *arg, int op, const char *db_name,
+				   const char *table, sqlite3_int64 rowid)
+{
+	(void)arg;
+	(void)op;
+	(void)db_name;
+	(void)rowid;
+
+	if (strcmp(table, "latest_files_meta") == 0) {
+		pthread_mutex_lock(&g_overlay_generation_lock);
+		g_overlay_generation++;
+		g_overlay_dirty = 1;
+		pthread_mutex_unlock(&g_overlay_generation_lock);
+	}
+}
+
+/*
+ * Run once a change is visible to other connections. The update hook
+ * fires before the commit, so a reader may have cached the old contents
+ * under the new generation in between; bumping again here makes such
+ * entries stale.
+ */
+static void overlay_fs_settle_generation(void)
+{
+	pthread_mutex_lock(&g_overlay_generation_lock);
+	if (g_overlay_dirty) {
+		g_overlay_generation++;
+		g_overlay_dirty = 0;
+	}
+	pthread_mutex_unlock(&g_overlay_generation_lock);
+}
+
+/* WAL hook on the global handle, run after every commit */
+static int overlay_fs_wal_hook(void *arg, sqlite3 *db, const char *db_name,
+			       int pages)
+{
+	(void)arg;
+
+	overlay_fs_settle_generation();
+
+	if (pages >= OVERLAY_FS_WAL_CHECKPOINT_PAGES) {
+		sqlite3_wal_checkpoint_v2(db, db_name, SQLITE_CHECKPOINT_PASSIVE,
+					  NULL, NULL);
+	}
+
+	return SQLITE_OK;
+}
+
 static int exec_sql_file(sqlite3 *db, const char *sql)
 {
 	char *errmsg = NULL;
@@ -25,6 +112,27 @@ static int exec_sql_file(sqlite3 *db, const char *sql)
 	return 0;
 }
 
+/* Run a single-value PRAGMA returning an integer */
+static int overlay_fs_pragma_int(sqlite3 *db, const char *sql, int *value)
+{
+	sqlite3_stmt *stmt = NULL;
+	int rc;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare '%s': %s", sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		*value = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+
+	return rc == SQLITE_ROW ? 0 : -1;
+}
+
 int overlay_fs_check_schema(sqlite3 *db)
 {
 	const char *sql =
@@ -82,6 +190,10 @@ int overlay_fs_init(const char *db_path, sqlite3 **db)
 		goto err;
 	}
 
+	if (overlay_fs_upgrade_schema(*db) < 0) {
+		goto err;
+	}
+
 	/* No embedded fallback schema application here */
 
 	return 0;
@@ -93,372 +205,206 @@ err:
 }
 
 
-/* SHA-256 implementation for bundle ID computation */
-#define ROTRIGHT(a, b) (((a) >> (b)) | ((a) << (32 - (b))))
-#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
-#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
-#define EP0(x) (ROTRIGHT(x, 2) ^ ROTRIGHT(x, 13) ^ ROTRIGHT(x, 22))
-#define EP1(x) (ROTRIGHT(x, 6) ^ ROTRIGHT(x, 11) ^ ROTRIGHT(x, 25))
-#define SIG0(x) (ROTRIGHT(x, 7) ^ ROTRIGHT(x, 18) ^ ((x) >> 3))
-#define SIG1(x) (ROTRIGHT(x, 17) ^ ROTRIGHT(x, 19) ^ ((x) >> 10))
-
-static const uint32_t sha256_k[64] = {
-	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
-	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
-	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
-	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-};
-
-typedef struct {
-	uint8_t data[64];
-	uint32_t datalen;
-	uint64_t bitlen;
-	uint32_t state[8];
-} sha256_ctx_t;
-
-static void sha256_transform(sha256_ctx_t *ctx, const uint8_t data[])
-{
-	uint32_t a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
-
-	for (i = 0, j = 0; i < 16; ++i, j += 4) {
-		m[i] = ((uint32_t)data[j] << 24) | ((uint32_t)data[j + 1] << 16) |
-		       ((uint32_t)data[j + 2] << 8) | ((uint32_t)data[j + 3]);
-	}
-	for (; i < 64; ++i) {
-		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
-	}
-
-	a = ctx->state[0];
-	b = ctx->state[1];
-	c = ctx->state[2];
-	d = ctx->state[3];
-	e = ctx->state[4];
-	f = ctx->state[5];
-	g = ctx->state[6];
-	h = ctx->state[7];
-
-	for (i = 0; i < 64; ++i) {
-		t1 = h + EP1(e) + CH(e, f, g) + sha256_k[i] + m[i];
-		t2 = EP0(a) + MAJ(a, b, c);
-		h = g;
-		g = f;
-		f = e;
-		e = d + t1;
-		d = c;
-		c = b;
-		b = a;
-		a = t1 + t2;
-	}
-
-	ctx->state[0] += a;
-	ctx->state[1] += b;
-	ctx->state[2] += c;
-	ctx->state[3] += d;
-	ctx->state[4] += e;
-	ctx->state[5] += f;
-	ctx->state[6] += g;
-	ctx->state[7] += h;
-}
-
-static void sha256_init(sha256_ctx_t *ctx)
-{
-	ctx->datalen = 0;
-	ctx->bitlen = 0;
-	ctx->state[0] = 0x6a09e667;
-	ctx->state[1] = 0xbb67ae85;
-	ctx->state[2] = 0x3c6ef372;
-	ctx->state[3] = 0xa54ff53a;
-	ctx->state[4] = 0x510e527f;
-	ctx->state[5] = 0x9b05688c;
-	ctx->state[6] = 0x1f83d9ab;
-	ctx->state[7] = 0x5be0cd19;
-}
-
-static void sha256_update(sha256_ctx_t *ctx, const uint8_t data[], size_t len)
+/* SQL function hbf_sha256(X): content hash used as blobs.hash */
+static void overlay_fs_sha256_func(sqlite3_context *ctx, int argc,
+				   sqlite3_value **argv)
 {
-	size_t i;
+	char hex[OVERLAY_FS_HASH_LEN + 1];
+	const void *data;
+	int len;
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
-		}
+	(void)argc;
+
+	if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+		sqlite3_result_null(ctx);
+		return;
 	}
+
+	data = sqlite3_value_blob(argv[0]);
+	len = sqlite3_value_bytes(argv[0]);
+	hbf_sha256_hex(data, (size_t)len, hex);
+	sqlite3_result_text(ctx, hex, OVERLAY_FS_HASH_LEN, SQLITE_TRANSIENT);
 }
 
-static void sha256_final(sha256_ctx_t *ctx, uint8_t hash[])
+int overlay_fs_register_functions(sqlite3 *db)
 {
-	uint32_t i;
-
-	i = ctx->datalen;
-
-	if (ctx->datalen < 56) {
-		ctx->data[i++] = 0x80;
-		while (i < 56) {
-			ctx->data[i++] = 0x00;
-		}
-	} else {
-		ctx->data[i++] = 0x80;
-		while (i < 64) {
-			ctx->data[i++] = 0x00;
-		}
-		sha256_transform(ctx, ctx->data);
-		memset(ctx->data, 0, 56);
-	}
-
-	ctx->bitlen += (uint64_t)ctx->datalen * 8;
-	ctx->data[63] = (uint8_t)(ctx->bitlen);
-	ctx->data[62] = (uint8_t)(ctx->bitlen >> 8);
-	ctx->data[61] = (uint8_t)(ctx->bitlen >> 16);
-	ctx->data[60] = (uint8_t)(ctx->bitlen >> 24);
-	ctx->data[59] = (uint8_t)(ctx->bitlen >> 32);
-	ctx->data[58] = (uint8_t)(ctx->bitlen >> 40);
-	ctx->data[57] = (uint8_t)(ctx->bitlen >> 48);
-	ctx->data[56] = (uint8_t)(ctx->bitlen >> 56);
-	sha256_transform(ctx, ctx->data);
-
-	for (i = 0; i < 4; ++i) {
-		hash[i] = (ctx->state[0] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 4] = (ctx->state[1] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 8] = (ctx->state[2] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 12] = (ctx->state[3] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 16] = (ctx->state[4] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 20] = (ctx->state[5] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 24] = (ctx->state[6] >> (24 - i * 8)) & 0x000000ff;
-		hash[i + 28] = (ctx->state[7] >> (24 - i * 8)) & 0x000000ff;
-	}
-}
-
-/* Compute SHA-256 of data and return as hex string */
-static void compute_bundle_id(const uint8_t *data, size_t len, char *bundle_id)
-{
-	sha256_ctx_t ctx;
-	uint8_t hash[32];
-	size_t i;
-
-	sha256_init(&ctx);
-	sha256_update(&ctx, data, len);
-	sha256_final(&ctx, hash);
+	int rc;
 
-	/* Convert to hex string */
-	for (i = 0; i < 32; i++) {
-		sprintf(bundle_id + (i * 2), "%02x", hash[i]);
+	rc = sqlite3_create_function_v2(db, "hbf_sha256", 1,
+					SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+					NULL, overlay_fs_sha256_func,
+					NULL, NULL, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to register hbf_sha256: %s",
+			      sqlite3_errmsg(db));
+		return -1;
 	}
-	bundle_id[64] = '\0';
-}
 
-/* Read u32 from buffer (little-endian) */
-static uint32_t read_u32(const uint8_t *buf)
-{
-	return (uint32_t)buf[0] |
-	       ((uint32_t)buf[1] << 8) |
-	       ((uint32_t)buf[2] << 16) |
-	       ((uint32_t)buf[3] << 24);
+	return 0;
 }
 
-migrate_status_t overlay_fs_migrate_assets(
-	sqlite3 *db,
-	const uint8_t *bundle_blob,
-	size_t bundle_len
-)
+/*
+ * Convert a database whose file_versions kept data inline into the
+ * content-addressed layout. The new file_versions definition must match
+ * overlay_schema.sql, which recreates its indexes, triggers and views.
+ */
+static const char *overlay_fs_upgrade_sql =
+	"DROP VIEW IF EXISTS latest_files;"
+	"DROP VIEW IF EXISTS latest_files_metadata;"
+	"CREATE TABLE IF NOT EXISTS blobs ("
+	"    hash TEXT PRIMARY KEY,"
+	"    encoding TEXT NOT NULL DEFAULT 'identity',"
+	"    data BLOB NOT NULL"
+	");"
+	"INSERT OR IGNORE INTO blobs (hash, data)"
+	"    SELECT hbf_sha256(data), data FROM file_versions;"
+	"CREATE TABLE file_versions_blobs ("
+	"    file_id INTEGER NOT NULL,"
+	"    path TEXT NOT NULL,"
+	"    version_number INTEGER NOT NULL,"
+	"    mtime INTEGER NOT NULL,"
+	"    size INTEGER NOT NULL,"
+	"    hash TEXT NOT NULL REFERENCES blobs(hash),"
+	"    PRIMARY KEY (file_id, version_number)"
+	") WITHOUT ROWID;"
+	"INSERT INTO file_versions_blobs"
+	"    (file_id, path, version_number, mtime, size, hash)"
+	"    SELECT file_id, path, version_number, mtime, size, hbf_sha256(data)"
+	"    FROM file_versions;"
+	"DROP TABLE file_versions;"
+	"ALTER TABLE file_versions_blobs RENAME TO file_versions;";
+
+/* Position of column in table, -1 if there is none, -2 on error */
+static int overlay_fs_column_index(sqlite3 *db, const char *table,
+				   const char *column)
 {
-	char bundle_id[65];
 	sqlite3_stmt *stmt = NULL;
+	int cid = -1;
 	int rc;
-	uint8_t *decompressed = NULL;
-	uLongf decompressed_len;
-	const uint8_t *ptr;
-	const uint8_t *end;
-	uint32_t num_entries;
-	uint32_t i;
-	int migrated_count = 0;
 
-	if (!db || !bundle_blob || bundle_len == 0) {
-		hbf_log_error("overlay_fs_migrate_assets: invalid arguments");
-		return MIGRATE_ERR_DB;
-	}
-
-	/* Compute bundle ID (SHA-256 of compressed data) */
-	compute_bundle_id(bundle_blob, bundle_len, bundle_id);
-
-	/* Check if already applied (idempotency) */
-	const char *check_sql = "SELECT 1 FROM migrations WHERE bundle_id = ? LIMIT 1";
-	rc = sqlite3_prepare_v2(db, check_sql, -1, &stmt, NULL);
+	rc = sqlite3_prepare_v2(db,
+				"SELECT cid FROM pragma_table_info(?) WHERE name = ?",
+				-1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to check migrations: %s", sqlite3_errmsg(db));
-		return MIGRATE_ERR_DB;
+		hbf_log_error("overlay_fs: schema version check failed: %s",
+			      sqlite3_errmsg(db));
+		return -2;
+	}
+	sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, column, -1, SQLITE_STATIC);
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		cid = sqlite3_column_int(stmt, 0);
 	}
-
-	sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-	rc = sqlite3_step(stmt);
 	sqlite3_finalize(stmt);
 
-	if (rc == SQLITE_ROW) {
-		hbf_log_info("Asset bundle already applied (bundle_id=%s)", bundle_id);
-		return MIGRATE_ERR_ALREADY_APPLIED;
-	}
+	return cid;
+}
 
-	hbf_log_info("Migrating asset bundle (bundle_id=%s, %zu bytes compressed)",
-	             bundle_id, bundle_len);
+/*
+ * Rebuild blobs with encoding ahead of data. Reading a column stored
+ * after a large BLOB walks the BLOB's whole overflow chain, which would
+ * defeat streaming. The trigger and view that use blobs are recreated by
+ * overlay_schema.sql. %s selects the encoding of existing rows.
+ */
+static const char *overlay_fs_blobs_rebuild_sql =
+	"DROP VIEW IF EXISTS latest_files;"
+	"DROP TRIGGER IF EXISTS trg_file_versions_blob_ad;"
+	"CREATE TABLE blobs_rebuild ("
+	"    hash TEXT PRIMARY KEY,"
+	"    encoding TEXT NOT NULL DEFAULT 'identity',"
+	"    data BLOB NOT NULL"
+	");"
+	"INSERT INTO blobs_rebuild (hash, encoding, data)"
+	"    SELECT hash, %s, data FROM blobs;"
+	"DROP TABLE blobs;"
+	"ALTER TABLE blobs_rebuild RENAME TO blobs;";
+
+/* Blobs from before compression, or with encoding stored last */
+static int overlay_fs_upgrade_encoding(sqlite3 *db)
+{
+	int data_cid = overlay_fs_column_index(db, "blobs", "data");
+	int encoding_cid = overlay_fs_column_index(db, "blobs", "encoding");
+	int foreign_keys = 0;
+	char *sql;
+	int ret = -1;
 
-	/* Decompress bundle */
-	decompressed_len = (uLongf)(bundle_len * 10); /* Initial guess */
-	decompressed = malloc(decompressed_len);
-	if (!decompressed) {
-		hbf_log_error("Failed to allocate decompression buffer");
-		return MIGRATE_ERR_DECOMPRESS;
+	if (data_cid < -1 || encoding_cid < -1) {
+		return -1;
 	}
-
-	rc = uncompress(decompressed, &decompressed_len, bundle_blob, (uLong)bundle_len);
-	if (rc != Z_OK) {
-		hbf_log_error("Decompression failed: %d", rc);
-		free(decompressed);
-		return MIGRATE_ERR_DECOMPRESS;
+	if (data_cid < 0 || (encoding_cid >= 0 && encoding_cid < data_cid)) {
+		return 0;
 	}
 
-	hbf_log_info("Decompressed to %lu bytes", decompressed_len);
+	hbf_log_info("overlay_fs: rebuilding blobs table (encoding column)");
 
-	/* Parse bundle */
-	ptr = decompressed;
-	end = decompressed + decompressed_len;
-
-	/* Read num_entries */
-	if (ptr + 4 > end) {
-		hbf_log_error("Bundle too short for num_entries");
-		free(decompressed);
-		return MIGRATE_ERR_CORRUPT;
+	sql = sqlite3_mprintf(overlay_fs_blobs_rebuild_sql,
+			      encoding_cid >= 0 ? "encoding" : "'identity'");
+	if (!sql) {
+		return -1;
 	}
-	num_entries = read_u32(ptr);
-	ptr += 4;
-
-	hbf_log_info("Bundle contains %u entries", num_entries);
 
-	/* Begin transaction */
-	if (exec_sql_file(db, "BEGIN IMMEDIATE;") < 0) {
-		free(decompressed);
-		return MIGRATE_ERR_DB;
+	/* Dropping the referenced table must not check file_versions */
+	if (overlay_fs_pragma_int(db, "PRAGMA foreign_keys", &foreign_keys) < 0 ||
+	    exec_sql_file(db, "PRAGMA foreign_keys=OFF;") < 0) {
+		sqlite3_free(sql);
+		return -1;
 	}
 
-	/* Process each entry */
-	for (i = 0; i < num_entries; i++) {
-		uint32_t name_len;
-		const char *name;
-		uint32_t data_len;
-		const uint8_t *data;
-
-		/* Read name_len */
-		if (ptr + 4 > end) {
-			hbf_log_error("Bundle truncated at entry %u name_len", i);
-			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_CORRUPT;
-		}
-		name_len = read_u32(ptr);
-		ptr += 4;
-
-		/* Read name */
-		if (ptr + name_len > end) {
-			hbf_log_error("Bundle truncated at entry %u name", i);
-			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_CORRUPT;
-		}
-		name = (const char *)ptr;
-		ptr += name_len;
-
-		/* Read data_len */
-		if (ptr + 4 > end) {
-			hbf_log_error("Bundle truncated at entry %u data_len", i);
+	if (exec_sql_file(db, "BEGIN IMMEDIATE;") == 0) {
+		if (exec_sql_file(db, sql) == 0 &&
+		    exec_sql_file(db, "COMMIT;") == 0) {
+			ret = 0;
+		} else {
 			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_CORRUPT;
 		}
-		data_len = read_u32(ptr);
-		ptr += 4;
+	}
 
-		/* Read data */
-		if (ptr + data_len > end) {
-			hbf_log_error("Bundle truncated at entry %u data", i);
-			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_CORRUPT;
-		}
-		data = ptr;
-		ptr += data_len;
+	if (foreign_keys) {
+		exec_sql_file(db, "PRAGMA foreign_keys=ON;");
+	}
+	sqlite3_free(sql);
 
-		/* Allocate null-terminated name string */
-		char *name_str = malloc(name_len + 1);
-		if (!name_str) {
-			hbf_log_error("Failed to allocate name string");
-			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_DB;
-		}
-		memcpy(name_str, name, name_len);
-		name_str[name_len] = '\0';
+	return ret;
+}
 
-		/* Write to overlay_fs */
-		if (overlay_fs_write(db, name_str, data, (size_t)data_len) < 0) {
-			hbf_log_error("Failed to migrate file: %s", name_str);
-			free(name_str);
-			exec_sql_file(db, "ROLLBACK;");
-			free(decompressed);
-			return MIGRATE_ERR_DB;
-		}
+int overlay_fs_upgrade_schema(sqlite3 *db)
+{
+	int inline_data;
 
-		hbf_log_debug("Migrated: %s (%u bytes)", name_str, data_len);
-		free(name_str);
-		migrated_count++;
+	if (!db) {
+		return -1;
 	}
 
-	/* Record migration */
-	const char *insert_sql =
-		"INSERT INTO migrations (bundle_id, applied_at, entries) "
-		"VALUES (?, strftime('%s','now'), ?)";
-
-	rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
-	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare migration insert: %s", sqlite3_errmsg(db));
-		exec_sql_file(db, "ROLLBACK;");
-		free(decompressed);
-		return MIGRATE_ERR_DB;
+	inline_data = overlay_fs_column_index(db, "file_versions", "data");
+	if (inline_data < -1) {
+		return -1;
 	}
 
-	sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-	sqlite3_bind_int(stmt, 2, migrated_count);
+	if (inline_data < 0) {
+		return overlay_fs_upgrade_encoding(db);
+	}
 
-	rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	hbf_log_info("overlay_fs: moving file contents into blobs table");
 
-	if (rc != SQLITE_DONE) {
-		hbf_log_error("Failed to record migration: %s", sqlite3_errmsg(db));
+	if (overlay_fs_register_functions(db) < 0) {
+		return -1;
+	}
+	if (exec_sql_file(db, "BEGIN IMMEDIATE;") < 0) {
+		return -1;
+	}
+	if (exec_sql_file(db, overlay_fs_upgrade_sql) < 0) {
 		exec_sql_file(db, "ROLLBACK;");
-		free(decompressed);
-		return MIGRATE_ERR_DB;
+		return -1;
 	}
-
-	/* Commit transaction */
 	if (exec_sql_file(db, "COMMIT;") < 0) {
-		free(decompressed);
-		return MIGRATE_ERR_DB;
+		exec_sql_file(db, "ROLLBACK;");
+		return -1;
 	}
 
-	free(decompressed);
-
-	hbf_log_info("Successfully migrated %d files from asset bundle", migrated_count);
-	return MIGRATE_OK;
+	return 0;
 }
 
+/* Read u32 from buffer (little-endian) */
 int overlay_fs_read(sqlite3 *db, const char *path,
                     unsigned char **data, size_t *size)
 {
@@ -473,16 +419,7 @@ int overlay_fs_read(sqlite3 *db, const char *path,
 	*data = NULL;
 	*size = 0;
 
-	/* Fast query using file_id and MAX(version_number) */
-	const char *sql =
-		"WITH file_info AS (\n"
-		"    SELECT file_id FROM file_ids WHERE path = ?\n"
-		")\n"
-		"SELECT fv.data\n"
-		"FROM file_versions fv, file_info fi\n"
-		"WHERE fv.file_id = fi.file_id\n"
-		"ORDER BY fv.version_number DESC\n"
-		"LIMIT 1";
+	const char *sql = OVERLAY_FS_LATEST_SQL;
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
@@ -494,30 +431,17 @@ int overlay_fs_read(sqlite3 *db, const char *path,
 
 	rc = sqlite3_step(stmt);
 	if (rc == SQLITE_ROW) {
-		const void *blob = sqlite3_column_blob(stmt, 0);
-		int blob_size = sqlite3_column_bytes(stmt, 0);
-
-		if (blob_size > 0) {
-			*data = malloc((size_t)blob_size);
-			if (!*data) {
-				hbf_log_error("Memory allocation failed");
-				sqlite3_finalize(stmt);
-				return -1;
-			}
-			memcpy(*data, blob, (size_t)blob_size);
-			*size = (size_t)blob_size;
-		} else {
-			/* Empty file - allocate minimal buffer */
-			*data = malloc(1);
-			if (!*data) {
-				hbf_log_error("Memory allocation failed");
-				sqlite3_finalize(stmt);
-				return -1;
-			}
-			*size = 0;
-		}
+		/* Empty files still get a (minimal) buffer */
+		rc = overlay_fs_decode((const char *)sqlite3_column_text(stmt, 6),
+				       sqlite3_column_blob(stmt, 4),
+				       (size_t)sqlite3_column_bytes(stmt, 4),
+				       (size_t)sqlite3_column_int64(stmt, 3),
+				       data, size);
 		sqlite3_finalize(stmt);
-		return 0;
+		if (rc < 0) {
+			hbf_log_error("Failed to decode file: %s", path);
+		}
+		return rc;
 	}
 
 	if (rc == SQLITE_DONE) {
@@ -531,125 +455,779 @@ int overlay_fs_read(sqlite3 *db, const char *path,
 	return -1;
 }
 
-int overlay_fs_write(sqlite3 *db, const char *path,
-                     const unsigned char *data, size_t size)
+/*
+ * gzip-compress data if that saves at least an eighth of it.
+ * Returns a malloc'd buffer (length in *out_size), or NULL to store the
+ * data uncompressed.
+ */
+static unsigned char *overlay_fs_gzip(const unsigned char *data, size_t size,
+				      size_t *out_size)
 {
-	sqlite3_stmt *stmt = NULL;
-	int rc;
-	int file_id = -1;
-	int next_version = 1;
+	z_stream zs;
+	unsigned char *out;
+	uLong bound;
 
-	if (!db || !path) {
-		hbf_log_error("overlay_fs_write: invalid arguments");
-		return -1;
+	if (size < OVERLAY_FS_COMPRESS_MIN_SIZE || size > UINT32_MAX) {
+		return NULL;
 	}
 
-	/* Allow empty files (data can be NULL or empty string if size is 0) */
-	if (size > 0 && !data) {
-		hbf_log_error("overlay_fs_write: data is NULL but size > 0");
-		return -1;
+	memset(&zs, 0, sizeof(zs));
+	/* windowBits 15 + 16 writes a gzip header and trailer */
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK) {
+		return NULL;
 	}
 
-	/* Get or create file_id */
-	const char *get_id_sql = "SELECT file_id FROM file_ids WHERE path = ?";
-
-	rc = sqlite3_prepare_v2(db, get_id_sql, -1, &stmt, NULL);
-	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare get_id: %s", sqlite3_errmsg(db));
-		return -1;
+	bound = deflateBound(&zs, (uLong)size);
+	out = malloc(bound);
+	if (!out) {
+		deflateEnd(&zs);
+		return NULL;
 	}
 
-	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
-	rc = sqlite3_step(stmt);
+	zs.next_in = (Bytef *)(uintptr_t)data;
+	zs.avail_in = (uInt)size;
+	zs.next_out = out;
+	zs.avail_out = (uInt)bound;
 
-	if (rc == SQLITE_ROW) {
-		file_id = sqlite3_column_int(stmt, 0);
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END ||
+	    zs.total_out > size - size / 8) {
+		deflateEnd(&zs);
+		free(out);
+		return NULL;
 	}
-	sqlite3_finalize(stmt);
 
-	if (file_id < 0) {
-		/* Create new file_id */
-		const char *insert_id_sql = "INSERT INTO file_ids (path) VALUES (?)";
+	*out_size = (size_t)zs.total_out;
+	deflateEnd(&zs);
+	return out;
+}
 
-		rc = sqlite3_prepare_v2(db, insert_id_sql, -1, &stmt, NULL);
-		if (rc != SQLITE_OK) {
-			hbf_log_error("Failed to prepare insert_id: %s", sqlite3_errmsg(db));
-			return -1;
-		}
+int overlay_fs_decode(const char *encoding, const void *stored,
+                      size_t stored_size, size_t size,
+                      unsigned char **data, size_t *data_size)
+{
+	z_stream zs;
+	unsigned char *out;
+	int rc;
 
-		sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
-		rc = sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
+	if (!data || !data_size || (stored_size > 0 && !stored)) {
+		return -1;
+	}
 
-		if (rc != SQLITE_DONE) {
-			hbf_log_error("Failed to insert file_id: %s", sqlite3_errmsg(db));
-			return -1;
-		}
+	*data = NULL;
+	*data_size = 0;
 
-		file_id = (int)sqlite3_last_insert_rowid(db);
-	} else {
-		/* Get next version number */
-		const char *get_version_sql =
-			"SELECT MAX(version_number) FROM file_versions WHERE file_id = ?";
-		rc = sqlite3_prepare_v2(db, get_version_sql, -1, &stmt, NULL);
-		if (rc != SQLITE_OK) {
-			hbf_log_error("Failed to prepare get_version: %s", sqlite3_errmsg(db));
+	if (!encoding || strcmp(encoding, OVERLAY_FS_ENCODING_IDENTITY) == 0) {
+		out = malloc(stored_size + 1);
+		if (!out) {
+			hbf_log_error("Memory allocation failed");
 			return -1;
 		}
-
-		sqlite3_bind_int(stmt, 1, file_id);
-		rc = sqlite3_step(stmt);
-
-		if (rc == SQLITE_ROW) {
-			next_version = sqlite3_column_int(stmt, 0) + 1;
+		if (stored_size > 0) {
+			memcpy(out, stored, stored_size);
 		}
-		sqlite3_finalize(stmt);
+		out[stored_size] = '\0';
+		*data = out;
+		*data_size = stored_size;
+		return 0;
 	}
 
-	/* Insert new version */
-	const char *insert_sql =
-		"INSERT INTO file_versions (file_id, path, version_number, mtime, size, data) "
-		"VALUES (?, ?, ?, ?, ?, ?)";
-
-	rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
-	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare insert: %s", sqlite3_errmsg(db));
+	if (strcmp(encoding, OVERLAY_FS_ENCODING_GZIP) != 0 ||
+	    stored_size > UINT32_MAX || size > UINT32_MAX) {
+		hbf_log_error("Unsupported content encoding: %s", encoding);
 		return -1;
 	}
 
-	time_t now = time(NULL);
-
-	sqlite3_bind_int(stmt, 1, file_id);
-	sqlite3_bind_text(stmt, 2, path, -1, SQLITE_STATIC);
-	sqlite3_bind_int(stmt, 3, next_version);
-	sqlite3_bind_int64(stmt, 4, (sqlite3_int64)now);
-	sqlite3_bind_int64(stmt, 5, (sqlite3_int64)size);
-	/* For empty files (size=0), use empty string to avoid binding NULL */
-	/* sqlite3_bind_blob with NULL pointer binds SQL NULL, not zero-length BLOB */
-	if (size == 0) {
-		sqlite3_bind_blob(stmt, 6, "", 0, SQLITE_STATIC);
-	} else {
-		sqlite3_bind_blob(stmt, 6, data, (int)size, SQLITE_STATIC);
+	out = malloc(size + 1);
+	if (!out) {
+		hbf_log_error("Memory allocation failed");
+		return -1;
 	}
 
-	rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+		free(out);
+		return -1;
+	}
 
-	if (rc != SQLITE_DONE) {
-		hbf_log_error("Failed to insert version: %s", sqlite3_errmsg(db));
+	zs.next_in = (Bytef *)(uintptr_t)stored;
+	zs.avail_in = (uInt)stored_size;
+	zs.next_out = out;
+	/* One spare byte catches contents longer than size */
+	zs.avail_out = (uInt)size + 1;
+
+	rc = inflate(&zs, Z_FINISH);
+	if (rc != Z_STREAM_END || zs.total_out != size) {
+		hbf_log_error("Corrupt gzip contents (%d)", rc);
+		inflateEnd(&zs);
+		free(out);
 		return -1;
 	}
+	inflateEnd(&zs);
 
+	out[size] = '\0';
+	*data = out;
+	*data_size = size;
 	return 0;
 }
 
-int overlay_fs_exists(sqlite3 *db, const char *path)
+/*
+ * Statements of the write path, prepared on first use and reused for
+ * every file written through the same writer (see overlay_fs_migrate_assets)
+ */
+typedef struct {
+	sqlite3 *db;
+	sqlite3_stmt *blob_exists;
+	sqlite3_stmt *blob_insert;
+	sqlite3_stmt *file_id;
+	sqlite3_stmt *file_id_insert;
+	sqlite3_stmt *max_version;
+	sqlite3_stmt *version_insert;
+} overlay_fs_writer_t;
+
+static void overlay_fs_writer_init(overlay_fs_writer_t *w, sqlite3 *db)
 {
-	sqlite3_stmt *stmt = NULL;
+	memset(w, 0, sizeof(*w));
+	w->db = db;
+}
+
+static void overlay_fs_writer_finalize(overlay_fs_writer_t *w)
+{
+	sqlite3_finalize(w->blob_exists);
+	sqlite3_finalize(w->blob_insert);
+	sqlite3_finalize(w->file_id);
+	sqlite3_finalize(w->file_id_insert);
+	sqlite3_finalize(w->max_version);
+	sqlite3_finalize(w->version_insert);
+	memset(w, 0, sizeof(*w));
+}
+
+/* The statement in *slot, prepared from sql if needed; NULL on error */
+static sqlite3_stmt *overlay_fs_writer_stmt(overlay_fs_writer_t *w,
+					    sqlite3_stmt **slot,
+					    const char *sql)
+{
+	if (!*slot &&
+	    sqlite3_prepare_v2(w->db, sql, -1, slot, NULL) != SQLITE_OK) {
+		hbf_log_error("Failed to prepare '%s': %s", sql,
+			      sqlite3_errmsg(w->db));
+		*slot = NULL;
+	}
+	return *slot;
+}
+
+/* Step stmt once, then make it ready for the next use */
+static int overlay_fs_writer_step(sqlite3_stmt *stmt)
+{
+	int rc = sqlite3_step(stmt);
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return rc;
+}
+
+/* 1 if a blob with hash exists, 0 if not, -1 on error */
+static int overlay_fs_blob_exists(overlay_fs_writer_t *w, const char *hash)
+{
+	sqlite3_stmt *stmt;
 	int rc;
 
-	if (!db || !path) {
-		hbf_log_error("overlay_fs_exists: invalid arguments");
+	stmt = overlay_fs_writer_stmt(w, &w->blob_exists,
+				      "SELECT 1 FROM blobs WHERE hash = ?");
+	if (!stmt) {
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, hash, OVERLAY_FS_HASH_LEN, SQLITE_STATIC);
+	rc = overlay_fs_writer_step(stmt);
+
+	if (rc == SQLITE_ROW) {
+		return 1;
+	}
+	if (rc == SQLITE_DONE) {
+		return 0;
+	}
+	hbf_log_error("Failed to look up blob: %s", sqlite3_errmsg(w->db));
+	return -1;
+}
+
+/* Insert a new blob already in its stored encoding */
+static int overlay_fs_insert_blob(overlay_fs_writer_t *w, const char *hash,
+				  const unsigned char *stored,
+				  size_t stored_size, const char *encoding)
+{
+	sqlite3_stmt *stmt;
+	int rc;
+
+	stmt = overlay_fs_writer_stmt(w, &w->blob_insert,
+				      "INSERT INTO blobs (hash, data, encoding) "
+				      "VALUES (?, ?, ?)");
+	if (!stmt) {
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, hash, OVERLAY_FS_HASH_LEN, SQLITE_STATIC);
+	/* sqlite3_bind_blob with NULL pointer binds SQL NULL, not zero-length BLOB */
+	sqlite3_bind_blob(stmt, 2, stored_size > 0 ? (const void *)stored : "",
+			  (int)stored_size, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 3, encoding, -1, SQLITE_STATIC);
+
+	rc = overlay_fs_writer_step(stmt);
+	if (rc != SQLITE_DONE) {
+		hbf_log_error("Failed to insert blob: %s", sqlite3_errmsg(w->db));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Store data once in blobs (no-op if identical content exists) */
+static int overlay_fs_write_blob(overlay_fs_writer_t *w, const char *hash,
+				 const unsigned char *data, size_t size)
+{
+	unsigned char *gz;
+	size_t gz_size = 0;
+	int rc;
+
+	/* Only new contents are worth compressing */
+	rc = overlay_fs_blob_exists(w, hash);
+	if (rc != 0) {
+		return rc < 0 ? -1 : 0;
+	}
+
+	gz = overlay_fs_gzip(data, size, &gz_size);
+	if (gz) {
+		rc = overlay_fs_insert_blob(w, hash, gz, gz_size,
+					    OVERLAY_FS_ENCODING_GZIP);
+		free(gz);
+	} else {
+		rc = overlay_fs_insert_blob(w, hash, data, size,
+					    OVERLAY_FS_ENCODING_IDENTITY);
+	}
+
+	return rc;
+}
+
+/*
+ * Add the next version of path, whose contents are already in blobs
+ * under hash; runs inside a caller's transaction
+ */
+static int overlay_fs_add_version(overlay_fs_writer_t *w, const char *path,
+				  const char *hash, size_t size)
+{
+	sqlite3_stmt *stmt;
+	int rc;
+	int file_id = -1;
+	int next_version = 1;
+
+	/* Get or create file_id */
+	stmt = overlay_fs_writer_stmt(w, &w->file_id,
+				      "SELECT file_id FROM file_ids WHERE path = ?");
+	if (!stmt) {
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		file_id = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	if (file_id < 0) {
+		/* Create new file_id */
+		stmt = overlay_fs_writer_stmt(w, &w->file_id_insert,
+					      "INSERT INTO file_ids (path) VALUES (?)");
+		if (!stmt) {
+			return -1;
+		}
+
+		sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+		rc = overlay_fs_writer_step(stmt);
+
+		if (rc != SQLITE_DONE) {
+			hbf_log_error("Failed to insert file_id: %s",
+				      sqlite3_errmsg(w->db));
+			return -1;
+		}
+
+		file_id = (int)sqlite3_last_insert_rowid(w->db);
+	} else {
+		/* Get next version number */
+		stmt = overlay_fs_writer_stmt(w, &w->max_version,
+					      "SELECT MAX(version_number) FROM file_versions "
+					      "WHERE file_id = ?");
+		if (!stmt) {
+			return -1;
+		}
+
+		sqlite3_bind_int(stmt, 1, file_id);
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			next_version = sqlite3_column_int(stmt, 0) + 1;
+		}
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+	}
+
+	/* Insert new version */
+	stmt = overlay_fs_writer_stmt(w, &w->version_insert,
+				      "INSERT INTO file_versions "
+				      "(file_id, path, version_number, mtime, size, hash) "
+				      "VALUES (?, ?, ?, ?, ?, ?)");
+	if (!stmt) {
+		return -1;
+	}
+
+	time_t now = time(NULL);
+
+	sqlite3_bind_int(stmt, 1, file_id);
+	sqlite3_bind_text(stmt, 2, path, -1, SQLITE_STATIC);
+	sqlite3_bind_int(stmt, 3, next_version);
+	sqlite3_bind_int64(stmt, 4, (sqlite3_int64)now);
+	sqlite3_bind_int64(stmt, 5, (sqlite3_int64)size);
+	sqlite3_bind_text(stmt, 6, hash, OVERLAY_FS_HASH_LEN, SQLITE_STATIC);
+
+	rc = overlay_fs_writer_step(stmt);
+
+	if (rc != SQLITE_DONE) {
+		hbf_log_error("Failed to insert version: %s", sqlite3_errmsg(w->db));
+		return -1;
+	}
+
+	hbf_db_file_cache_invalidate(path);
+	return 0;
+}
+
+/* Add the next version of path; runs inside a caller's transaction */
+static int overlay_fs_write_version(overlay_fs_writer_t *w, const char *path,
+				    const unsigned char *data, size_t size)
+{
+	char hash[OVERLAY_FS_HASH_LEN + 1];
+
+	hbf_sha256_hex(data, size, hash);
+	if (overlay_fs_write_blob(w, hash, data, size) < 0) {
+		return -1;
+	}
+
+	return overlay_fs_add_version(w, path, hash, size);
+}
+
+int overlay_fs_write(sqlite3 *db, const char *path,
+                     const unsigned char *data, size_t size)
+{
+	overlay_fs_writer_t w;
+	int ret = -1;
+
+	if (!db || !path) {
+		hbf_log_error("overlay_fs_write: invalid arguments");
+		return -1;
+	}
+
+	/* Allow empty files (data can be NULL or empty string if size is 0) */
+	if (size > 0 && !data) {
+		hbf_log_error("overlay_fs_write: data is NULL but size > 0");
+		return -1;
+	}
+
+	/* Other threads' transactions on the shared writer must not get it */
+	if (hbf_db_pool_writer_enter(db) != SQLITE_OK) {
+		hbf_log_error("overlay_fs_write: database is busy");
+		return -1;
+	}
+
+	/* Blob and version land together (nests inside callers' transactions) */
+	if (exec_sql_file(db, "SAVEPOINT overlay_fs_write;") < 0) {
+		hbf_db_pool_writer_leave(db);
+		return -1;
+	}
+
+	overlay_fs_writer_init(&w, db);
+	if (overlay_fs_write_version(&w, path, data, size) == 0 &&
+	    exec_sql_file(db, "RELEASE overlay_fs_write;") == 0) {
+		ret = 0;
+	}
+	overlay_fs_writer_finalize(&w);
+
+	if (ret < 0) {
+		exec_sql_file(db, "ROLLBACK TO overlay_fs_write;"
+			      "RELEASE overlay_fs_write;");
+		hbf_db_pool_writer_leave(db);
+		return -1;
+	}
+
+	hbf_db_pool_writer_leave(db);
+	overlay_fs_bump_generation();
+	return 0;
+}
+
+/* Longest path accepted from an asset bundle */
+#define OVERLAY_FS_BUNDLE_NAME_MAX 4096
+
+/* Incremental reader of a zlib-compressed asset bundle */
+typedef struct {
+	z_stream zs;
+	int done;   /* Z_STREAM_END seen */
+	int failed; /* inflate reported an error */
+} overlay_fs_bundle_t;
+
+/*
+ * Inflate exactly len bytes of the bundle into buf.
+ * Returns 0 on success, -1 if the bundle is corrupt or ends early.
+ */
+static int overlay_fs_bundle_read(overlay_fs_bundle_t *b, void *buf,
+				  size_t len)
+{
+	unsigned char *out = buf;
+	int rc;
+
+	while (len > 0) {
+		uInt part = len > UINT32_MAX ? UINT32_MAX : (uInt)len;
+
+		if (b->done) {
+			return -1;
+		}
+		b->zs.next_out = out;
+		b->zs.avail_out = part;
+		rc = inflate(&b->zs, Z_NO_FLUSH);
+		if (rc == Z_STREAM_END) {
+			b->done = 1;
+		} else if (rc == Z_BUF_ERROR && b->zs.avail_in == 0) {
+			/* Input used up: the bundle is truncated */
+			return -1;
+		} else if (rc != Z_OK) {
+			hbf_log_error("Decompression failed: %d", rc);
+			b->failed = 1;
+			return -1;
+		}
+		out += part - b->zs.avail_out;
+		len -= part - b->zs.avail_out;
+	}
+
+	return 0;
+}
+
+static int overlay_fs_bundle_read_u32(overlay_fs_bundle_t *b, uint32_t *value)
+{
+	uint8_t buf[4];
+
+	if (overlay_fs_bundle_read(b, buf, sizeof(buf)) < 0) {
+		return -1;
+	}
+
+	*value = (uint32_t)buf[0] |
+		 ((uint32_t)buf[1] << 8) |
+		 ((uint32_t)buf[2] << 16) |
+		 ((uint32_t)buf[3] << 24);
+	return 0;
+}
+
+/*
+ * Inflate and write the bundle's entries one at a time through a single
+ * writer, so memory holds at most the largest entry and every statement is
+ * prepared once. Runs inside overlay_fs_migrate_assets' transaction.
+ */
+static migrate_status_t overlay_fs_migrate_entries(sqlite3 *db,
+						   overlay_fs_bundle_t *b,
+						   uint32_t *count)
+{
+	overlay_fs_writer_t w;
+	migrate_status_t status = MIGRATE_OK;
+	char name[OVERLAY_FS_BUNDLE_NAME_MAX + 1];
+	unsigned char *data = NULL;
+	size_t data_cap = 0;
+	uint32_t max_len = (uint32_t)sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1);
+	uint32_t num_entries;
+	uint32_t i;
+
+	if (overlay_fs_bundle_read_u32(b, &num_entries) < 0) {
+		hbf_log_error("Bundle too short for num_entries");
+		return MIGRATE_ERR_CORRUPT;
+	}
+
+	hbf_log_info("Bundle contains %u entries", num_entries);
+
+	overlay_fs_writer_init(&w, db);
+
+	for (i = 0; i < num_entries && status == MIGRATE_OK; i++) {
+		uint32_t name_len;
+		uint32_t data_len;
+
+		if (overlay_fs_bundle_read_u32(b, &name_len) < 0 ||
+		    name_len > OVERLAY_FS_BUNDLE_NAME_MAX ||
+		    overlay_fs_bundle_read(b, name, name_len) < 0) {
+			hbf_log_error("Bundle corrupt at entry %u name", i);
+			status = MIGRATE_ERR_CORRUPT;
+			break;
+		}
+		name[name_len] = '\0';
+
+		if (overlay_fs_bundle_read_u32(b, &data_len) < 0 ||
+		    data_len > max_len) {
+			hbf_log_error("Bundle corrupt at entry %u data_len", i);
+			status = MIGRATE_ERR_CORRUPT;
+			break;
+		}
+
+		/* One buffer, grown to the largest entry */
+		if (data_len > data_cap) {
+			unsigned char *grown = realloc(data, data_len);
+
+			if (!grown) {
+				hbf_log_error("Failed to allocate %u bytes for %s",
+					      data_len, name);
+				status = MIGRATE_ERR_DB;
+				break;
+			}
+			data = grown;
+			data_cap = data_len;
+		}
+
+		if (overlay_fs_bundle_read(b, data, data_len) < 0) {
+			hbf_log_error("Bundle truncated at entry %u data", i);
+			status = MIGRATE_ERR_CORRUPT;
+			break;
+		}
+
+		if (overlay_fs_write_version(&w, name, data, data_len) < 0) {
+			hbf_log_error("Failed to migrate file: %s", name);
+			status = MIGRATE_ERR_DB;
+			break;
+		}
+
+		hbf_log_debug("Migrated: %s (%u bytes)", name, data_len);
+	}
+
+	overlay_fs_writer_finalize(&w);
+	free(data);
+
+	*count = i;
+	return status;
+}
+
+/* Lowercase hex SHA-256, as hbf_sha256_hex produces */
+static int is_sha256_hex(const char *id)
+{
+	size_t i;
+
+	for (i = 0; i < OVERLAY_FS_HASH_LEN; i++) {
+		if (!((id[i] >= '0' && id[i] <= '9') ||
+		      (id[i] >= 'a' && id[i] <= 'f'))) {
+			return 0;
+		}
+	}
+	return id[OVERLAY_FS_HASH_LEN] == '\0';
+}
+
+/* v1 bundle: one zlib stream, inflated as entries are parsed */
+static migrate_status_t overlay_fs_migrate_stream(sqlite3 *db,
+						  const uint8_t *bundle_blob,
+						  size_t bundle_len,
+						  uint32_t *count)
+{
+	overlay_fs_bundle_t bundle;
+	migrate_status_t status;
+
+	/* The input is already in memory */
+	memset(&bundle, 0, sizeof(bundle));
+	if (inflateInit(&bundle.zs) != Z_OK) {
+		hbf_log_error("Failed to initialize decompression");
+		return MIGRATE_ERR_DECOMPRESS;
+	}
+	bundle.zs.next_in = (Bytef *)(uintptr_t)bundle_blob;
+	bundle.zs.avail_in = (uInt)bundle_len;
+
+	status = overlay_fs_migrate_entries(db, &bundle, count);
+
+	hbf_log_info("Decompressed to %lu bytes", bundle.zs.total_out);
+	inflateEnd(&bundle.zs);
+	if (status == MIGRATE_ERR_CORRUPT && bundle.failed) {
+		status = MIGRATE_ERR_DECOMPRESS;
+	}
+
+	return status;
+}
+
+/*
+ * v2 bundle: a base_fs table whose entries are compressed one by one.
+ * Stored bytes go into blobs as is, under the digest asset_packer
+ * computed, so nothing is inflated, hashed or deflated here.
+ */
+static migrate_status_t overlay_fs_migrate_table(sqlite3 *db,
+						 const uint8_t *bundle_blob,
+						 size_t bundle_len,
+						 uint32_t *count)
+{
+	overlay_fs_writer_t w;
+	migrate_status_t status = MIGRATE_OK;
+	base_fs_t fs;
+	base_fs_entry_t e;
+	size_t max_len = (size_t)sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1);
+	uint32_t i;
+	int rc;
+
+	if (base_fs_open(&fs, bundle_blob, bundle_len) < 0) {
+		hbf_log_error("Bundle table is corrupt");
+		return MIGRATE_ERR_CORRUPT;
+	}
+
+	hbf_log_info("Bundle contains %u entries", fs.count);
+
+	overlay_fs_writer_init(&w, db);
+
+	for (i = 0; i < fs.count; i++) {
+		base_fs_entry(&fs, i, &e);
+
+		if (!is_sha256_hex(e.digest) || e.stored_size > max_len ||
+		    e.size > max_len || (!e.gzip && e.stored_size != e.size)) {
+			hbf_log_error("Bundle corrupt at entry %u (%s)", i, e.path);
+			status = MIGRATE_ERR_CORRUPT;
+			break;
+		}
+
+		rc = overlay_fs_blob_exists(&w, e.digest);
+		if (rc == 0) {
+			rc = overlay_fs_insert_blob(&w, e.digest, e.data,
+						    e.stored_size,
+						    e.gzip ?
+						    OVERLAY_FS_ENCODING_GZIP :
+						    OVERLAY_FS_ENCODING_IDENTITY);
+		}
+		if (rc < 0 ||
+		    overlay_fs_add_version(&w, e.path, e.digest, e.size) < 0) {
+			hbf_log_error("Failed to migrate file: %s", e.path);
+			status = MIGRATE_ERR_DB;
+			break;
+		}
+
+		hbf_log_debug("Migrated: %s (%zu bytes, %zu stored)", e.path,
+			      e.size, e.stored_size);
+	}
+
+	overlay_fs_writer_finalize(&w);
+
+	*count = i;
+	return status;
+}
+
+migrate_status_t overlay_fs_migrate_assets(
+	sqlite3 *db,
+	const uint8_t *bundle_blob,
+	size_t bundle_len
+)
+{
+	return overlay_fs_migrate_assets_id(db, bundle_blob, bundle_len, NULL);
+}
+
+migrate_status_t overlay_fs_migrate_assets_id(
+	sqlite3 *db,
+	const uint8_t *bundle_blob,
+	size_t bundle_len,
+	const char *known_id
+)
+{
+	char bundle_id[OVERLAY_FS_HASH_LEN + 1];
+	sqlite3_stmt *stmt = NULL;
+	migrate_status_t status;
+	uint32_t migrated_count = 0;
+	int rc;
+
+	if (!db || !bundle_blob || bundle_len == 0 || bundle_len > UINT32_MAX) {
+		hbf_log_error("overlay_fs_migrate_assets: invalid arguments");
+		return MIGRATE_ERR_DB;
+	}
+
+	/* Bundle ID (SHA-256 of the bundle), precomputed by asset_packer */
+	if (known_id && is_sha256_hex(known_id)) {
+		memcpy(bundle_id, known_id, sizeof(bundle_id));
+	} else {
+		if (known_id) {
+			hbf_log_warn("Ignoring malformed bundle ID");
+		}
+		hbf_sha256_hex(bundle_blob, bundle_len, bundle_id);
+	}
+
+	/* Check if already applied (idempotency) */
+	const char *check_sql = "SELECT 1 FROM migrations WHERE bundle_id = ? LIMIT 1";
+	rc = sqlite3_prepare_v2(db, check_sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to check migrations: %s", sqlite3_errmsg(db));
+		return MIGRATE_ERR_DB;
+	}
+
+	sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	if (rc == SQLITE_ROW) {
+		hbf_log_info("Asset bundle already applied (bundle_id=%s)", bundle_id);
+		return MIGRATE_ERR_ALREADY_APPLIED;
+	}
+
+	hbf_log_info("Migrating asset bundle (bundle_id=%s, %zu bytes)",
+	             bundle_id, bundle_len);
+
+	/* Begin transaction */
+	if (exec_sql_file(db, "BEGIN IMMEDIATE;") < 0) {
+		return MIGRATE_ERR_DB;
+	}
+
+	/* A zlib stream never starts with the table magic */
+	if (bundle_len >= 4 && memcmp(bundle_blob, BASE_FS_MAGIC, 4) == 0) {
+		status = overlay_fs_migrate_table(db, bundle_blob, bundle_len,
+						  &migrated_count);
+	} else {
+		status = overlay_fs_migrate_stream(db, bundle_blob, bundle_len,
+						   &migrated_count);
+	}
+
+	if (status != MIGRATE_OK) {
+		exec_sql_file(db, "ROLLBACK;");
+		return status;
+	}
+
+	/* Record migration */
+	const char *insert_sql =
+		"INSERT INTO migrations (bundle_id, applied_at, entries) "
+		"VALUES (?, strftime('%s','now'), ?)";
+
+	rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare migration insert: %s", sqlite3_errmsg(db));
+		exec_sql_file(db, "ROLLBACK;");
+		return MIGRATE_ERR_DB;
+	}
+
+	sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)migrated_count);
+
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	if (rc != SQLITE_DONE) {
+		hbf_log_error("Failed to record migration: %s", sqlite3_errmsg(db));
+		exec_sql_file(db, "ROLLBACK;");
+		return MIGRATE_ERR_DB;
+	}
+
+	/* Commit transaction */
+	if (exec_sql_file(db, "COMMIT;") < 0) {
+		exec_sql_file(db, "ROLLBACK;");
+		return MIGRATE_ERR_DB;
+	}
+
+	overlay_fs_bump_generation();
+
+	hbf_log_info("Successfully migrated %u files from asset bundle", migrated_count);
+	return MIGRATE_OK;
+}
+
+int overlay_fs_exists(sqlite3 *db, const char *path)
+{
+	sqlite3_stmt *stmt = NULL;
+	int rc;
+
+	if (!db || !path) {
+		hbf_log_error("overlay_fs_exists: invalid arguments");
 		return -1;
 	}
 
@@ -657,107 +1235,684 @@ int overlay_fs_exists(sqlite3 *db, const char *path)
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare exists: %s", sqlite3_errmsg(db));
+		hbf_log_error("Failed to prepare exists: %s", sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	if (rc == SQLITE_ROW) {
+		return 1;
+	}
+	if (rc == SQLITE_DONE) {
+		return 0;
+	}
+	return -1;
+}
+
+int overlay_fs_version_count(sqlite3 *db, const char *path)
+{
+	sqlite3_stmt *stmt = NULL;
+	int rc;
+	int count = 0;
+
+	if (!db || !path) {
+		hbf_log_error("overlay_fs_version_count: invalid arguments");
+		return -1;
+	}
+
+	const char *sql =
+		"SELECT COUNT(*) FROM file_versions fv "
+		"JOIN file_ids fi ON fv.file_id = fi.file_id "
+		"WHERE fi.path = ?";
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare count: %s", sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);
+
+	if (rc == SQLITE_ROW) {
+		count = sqlite3_column_int(stmt, 0);
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (rc != SQLITE_ROW) {
+		return -1;
+	}
+
+	return count;
+}
+
+/*
+ * Hand free pages back to the filesystem a chunk at a time, each chunk in
+ * its own transaction. Only databases created with auto_vacuum=INCREMENTAL
+ * support this; others keep their free pages for reuse.
+ */
+static int overlay_fs_incremental_vacuum(sqlite3 *db)
+{
+	int mode = 0;
+	int pages = 0;
+	int last = -1;
+
+	if (overlay_fs_pragma_int(db, "PRAGMA auto_vacuum", &mode) < 0) {
+		return -1;
+	}
+	if (mode != 2) {
+		hbf_log_debug("overlay_fs: auto_vacuum is not incremental, "
+			      "free pages are kept for reuse");
+		return 0;
+	}
+
+	for (;;) {
+		if (overlay_fs_pragma_int(db, "PRAGMA freelist_count", &pages) < 0) {
+			return -1;
+		}
+		/* Stop once done or if a chunk made no progress */
+		if (pages == 0 || pages == last) {
+			break;
+		}
+		last = pages;
+		if (exec_sql_file(db, "PRAGMA incremental_vacuum("
+				  OVERLAY_FS_VACUUM_PAGES ");") < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int overlay_fs_compact(sqlite3 *db, const overlay_fs_compact_opts_t *opts,
+                       int64_t *removed)
+{
+	/* Next file to look at, in file_id order */
+	const char *next_sql =
+		"SELECT file_id FROM latest_files_meta WHERE file_id > ? "
+		"ORDER BY file_id LIMIT 1";
+	/*
+	 * Oldest versions of file ?1 that are older than ?3 and than its
+	 * ?2 + 1 newest versions, at most ?4 of them
+	 */
+	const char *delete_sql =
+		"DELETE FROM file_versions WHERE file_id = ?1 "
+		"AND version_number IN ("
+		"SELECT version_number FROM file_versions "
+		"WHERE file_id = ?1 AND mtime < ?3 AND version_number < ("
+		"SELECT version_number FROM file_versions WHERE file_id = ?1 "
+		"ORDER BY version_number DESC LIMIT 1 OFFSET ?2) "
+		"ORDER BY version_number LIMIT ?4)";
+	sqlite3_stmt *next = NULL;
+	sqlite3_stmt *del = NULL;
+	sqlite3_int64 file_id = 0;
+	int64_t total = 0;
+	int batch;
+	int changes;
+	int ret = -1;
+	int rc;
+
+	if (removed) {
+		*removed = 0;
+	}
+
+	if (!db || !opts || opts->keep_versions < 1 || opts->batch < 0) {
+		hbf_log_error("overlay_fs_compact: invalid arguments");
+		return -1;
+	}
+
+	if (!sqlite3_get_autocommit(db)) {
+		hbf_log_error("overlay_fs_compact: called inside a transaction");
+		return -1;
+	}
+
+	batch = opts->batch > 0 ? opts->batch : OVERLAY_FS_COMPACT_BATCH;
+
+	if (sqlite3_prepare_v2(db, next_sql, -1, &next, NULL) != SQLITE_OK ||
+	    sqlite3_prepare_v2(db, delete_sql, -1, &del, NULL) != SQLITE_OK) {
+		hbf_log_error("Failed to prepare compaction: %s",
+			      sqlite3_errmsg(db));
+		goto out;
+	}
+
+	sqlite3_bind_int(del, 2, opts->keep_versions - 1);
+	sqlite3_bind_int64(del, 3, opts->keep_since > 0 ?
+			   (sqlite3_int64)opts->keep_since : INT64_MAX);
+	sqlite3_bind_int(del, 4, batch);
+
+	for (;;) {
+		sqlite3_bind_int64(next, 1, file_id);
+		rc = sqlite3_step(next);
+		if (rc == SQLITE_DONE) {
+			break;
+		}
+		if (rc != SQLITE_ROW) {
+			hbf_log_error("Failed to list files: %s", sqlite3_errmsg(db));
+			goto out;
+		}
+		file_id = sqlite3_column_int64(next, 0);
+		/* Hold no read transaction between batches */
+		sqlite3_reset(next);
+
+		sqlite3_bind_int64(del, 1, file_id);
+		do {
+			if (exec_sql_file(db, "BEGIN IMMEDIATE;") < 0) {
+				goto out;
+			}
+			rc = sqlite3_step(del);
+			changes = sqlite3_changes(db);
+			sqlite3_reset(del);
+			if (rc != SQLITE_DONE) {
+				hbf_log_error("Failed to delete versions: %s",
+					      sqlite3_errmsg(db));
+				exec_sql_file(db, "ROLLBACK;");
+				goto out;
+			}
+			if (exec_sql_file(db, "COMMIT;") < 0) {
+				exec_sql_file(db, "ROLLBACK;");
+				goto out;
+			}
+			total += changes;
+		} while (changes == batch);
+	}
+
+	if (overlay_fs_incremental_vacuum(db) < 0) {
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	sqlite3_finalize(next);
+	sqlite3_finalize(del);
+
+	if (removed) {
+		*removed = total;
+	}
+	hbf_log_info("overlay_fs: compaction removed %lld versions",
+		     (long long)total);
+
+	return ret;
+}
+
+void overlay_fs_close(sqlite3 *db)
+{
+	if (db) {
+		sqlite3_close(db);
+	}
+}
+
+void overlay_fs_statement_done(sqlite3 *db)
+{
+	/* Outside a transaction every change so far is committed */
+	if (db && db == g_overlay_db && sqlite3_get_autocommit(db)) {
+		overlay_fs_settle_generation();
+	}
+}
+
+void overlay_fs_init_global(sqlite3 *db)
+{
+	g_overlay_db = db;
+
+	/* Cached files belong to the previous handle's database */
+	hbf_db_file_cache_invalidate(NULL);
+	overlay_fs_bump_generation();
+
+	if (db) {
+		overlay_fs_register_functions(db);
+		sqlite3_update_hook(db, overlay_fs_update_hook, NULL);
+		sqlite3_wal_hook(db, overlay_fs_wal_hook, NULL);
+		hbf_log_info("overlay_fs: Global database handle initialized");
+	} else {
+		hbf_log_warn("overlay_fs: Global database handle set to NULL");
+	}
+}
+
+/*
+ * Version and mtime of the latest version of path, from the materialized
+ * latest_files_meta table (one index lookup).
+ * Returns 1 if found, 0 if not found, -1 on error.
+ */
+static int overlay_fs_latest_meta(sqlite3 *db, const char *path,
+				  int64_t *version, int64_t *mtime)
+{
+	sqlite3_stmt *stmt = NULL;
+	int found = -1;
+	int rc;
+	const char *sql =
+		"SELECT version_number, mtime FROM latest_files_meta WHERE path = ?";
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare file meta read: %s",
+		              sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		*version = sqlite3_column_int64(stmt, 0);
+		*mtime = sqlite3_column_int64(stmt, 1);
+		found = 1;
+	} else if (rc == SQLITE_DONE) {
+		found = 0;
+	} else {
+		hbf_log_error("Error reading file meta: %s", sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/* Load the latest version of path into the file cache */
+static hbf_db_file_t *overlay_fs_load_file(sqlite3 *db, const char *path,
+					   uint64_t generation)
+{
+	sqlite3_stmt *stmt = NULL;
+	hbf_db_file_t *file = NULL;
+	int rc;
+
+	const char *sql = OVERLAY_FS_LATEST_SQL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare file read: %s",
+		              sqlite3_errmsg(db));
+		return NULL;
+	}
+
+	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		const char *encoding = (const char *)sqlite3_column_text(stmt, 6);
+		const unsigned char *blob = sqlite3_column_blob(stmt, 4);
+		size_t blob_size = (size_t)sqlite3_column_bytes(stmt, 4);
+		unsigned char *data = NULL;
+		size_t size = 0;
+		int gzip = encoding &&
+			   strcmp(encoding, OVERLAY_FS_ENCODING_GZIP) == 0;
+
+		/* Keep the stored gzip bytes next to the contents */
+		if (overlay_fs_decode(encoding, blob, blob_size,
+				      (size_t)sqlite3_column_int64(stmt, 3),
+				      &data, &size) == 0) {
+			file = hbf_db_file_cache_put(path,
+						     sqlite3_column_int64(stmt, 1),
+						     sqlite3_column_int64(stmt, 2),
+						     generation,
+						     (const char *)sqlite3_column_text(stmt, 5),
+						     data, size,
+						     gzip ? blob : NULL,
+						     gzip ? blob_size : 0);
+			free(data);
+		} else {
+			hbf_log_error("overlay_fs: Failed to decode file: %s",
+				      path);
+		}
+		if (file) {
+			hbf_log_debug("overlay_fs: Loaded file '%s' (%zu bytes, "
+				      "%zu gzip)", path, file->size,
+				      file->gzip_size);
+		}
+	} else if (rc == SQLITE_DONE) {
+		hbf_log_debug("overlay_fs: File not found: %s", path);
+	} else {
+		hbf_log_error("Error reading file: %s", sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(stmt);
+	return file;
+}
+
+hbf_db_file_t *overlay_fs_get_file(const char *path)
+{
+	hbf_db_file_t *file;
+	sqlite3 *rdb;
+	uint64_t generation;
+	int64_t version;
+	int64_t mtime;
+	int stale = 0;
+
+	if (!g_overlay_db) {
+		hbf_log_error("overlay_fs_get_file: global database not initialized");
+		return NULL;
+	}
+
+	if (!path) {
+		hbf_log_error("overlay_fs_get_file: invalid arguments");
+		return NULL;
+	}
+
+	/* Taken before any query so a concurrent write leaves us stale */
+	generation = overlay_fs_generation();
+
+	file = hbf_db_file_cache_get(path, generation, &stale);
+	if (file && !stale) {
+		return file;
+	}
+
+	/* Serve from this thread's read connection */
+	rdb = hbf_db_pool_reader(g_overlay_db);
+
+	/* Some file changed; keep ours if its version did not */
+	if (file) {
+		if (overlay_fs_latest_meta(rdb, path, &version, &mtime) == 1 &&
+		    version == file->version && mtime == file->mtime) {
+			hbf_db_file_cache_revalidate(file, generation);
+			return file;
+		}
+		hbf_db_file_release(file);
+	}
+
+	return overlay_fs_load_file(rdb, path, generation);
+}
+
+/* overlay_fs_stat's query; returns 1 if found, 0 if not, -1 on error */
+static int overlay_fs_latest_stat(sqlite3 *db, const char *path,
+				  overlay_fs_stat_t *st)
+{
+	sqlite3_stmt *stmt = NULL;
+	int found = -1;
+	int rc;
+	const char *sql =
+		"SELECT lm.version_number, lm.mtime, lm.size, fv.hash, b.encoding "
+		"FROM latest_files_meta lm CROSS JOIN file_versions fv "
+		"ON fv.file_id = lm.file_id AND fv.version_number = lm.version_number "
+		"LEFT JOIN blobs b ON b.hash = fv.hash "
+		"WHERE lm.path = ?";
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		hbf_log_error("Failed to prepare file stat: %s",
+		              sqlite3_errmsg(db));
 		return -1;
 	}
 
 	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+
 	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		const unsigned char *hash = sqlite3_column_text(stmt, 3);
+		const char *encoding = (const char *)sqlite3_column_text(stmt, 4);
+
+		st->version = sqlite3_column_int64(stmt, 0);
+		st->mtime = sqlite3_column_int64(stmt, 1);
+		st->size = (size_t)sqlite3_column_int64(stmt, 2);
+		snprintf(st->hash, sizeof(st->hash), "%s",
+			 hash ? (const char *)hash : "");
+		st->gzip = encoding &&
+			   strcmp(encoding, OVERLAY_FS_ENCODING_GZIP) == 0;
+		found = 1;
+	} else if (rc == SQLITE_DONE) {
+		found = 0;
+	} else {
+		hbf_log_error("Error reading file stat: %s", sqlite3_errmsg(db));
+	}
+
 	sqlite3_finalize(stmt);
+	return found;
+}
 
-	if (rc == SQLITE_ROW) {
+int overlay_fs_stat(const char *path, overlay_fs_stat_t *st)
+{
+	hbf_db_file_t *file;
+	uint64_t generation;
+	int stale = 0;
+	int found;
+
+	if (!g_overlay_db) {
+		hbf_log_error("overlay_fs_stat: global database not initialized");
+		return -1;
+	}
+
+	if (!path || !st) {
+		hbf_log_error("overlay_fs_stat: invalid arguments");
+		return -1;
+	}
+
+	generation = overlay_fs_generation();
+
+	file = hbf_db_file_cache_get(path, generation, &stale);
+	if (file && !stale && file->digest[0]) {
+		st->version = file->version;
+		st->mtime = file->mtime;
+		st->size = file->size;
+		snprintf(st->hash, sizeof(st->hash), "%s", file->digest);
+		st->gzip = file->gzip != NULL;
+		hbf_db_file_release(file);
 		return 1;
 	}
-	if (rc == SQLITE_DONE) {
-		return 0;
+
+	found = overlay_fs_latest_stat(hbf_db_pool_reader(g_overlay_db), path,
+				       st);
+
+	/* Spare the next reader of an unchanged file the same lookup */
+	if (file) {
+		if (found == 1 && st->version == file->version &&
+		    st->mtime == file->mtime) {
+			hbf_db_file_cache_revalidate(file, generation);
+		}
+		hbf_db_file_release(file);
 	}
-	return -1;
+
+	return found;
 }
 
-int overlay_fs_version_count(sqlite3 *db, const char *path)
+/* What the database holds for one base file */
+typedef struct {
+	int64_t version;
+	int64_t mtime;
+	uint64_t generation; /* overlay_fs_generation() last checked at */
+	int live;            /* Latest version has the table's contents */
+} overlay_fs_base_state_t;
+
+/* Locks over g_base_state, striped by slot */
+#define OVERLAY_FS_BASE_LOCKS 16u
+
+static base_fs_t g_base;
+static overlay_fs_base_state_t *g_base_state = NULL;
+static pthread_mutex_t g_base_locks[OVERLAY_FS_BASE_LOCKS];
+static pthread_once_t g_base_once = PTHREAD_ONCE_INIT;
+
+static void overlay_fs_base_locks_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < OVERLAY_FS_BASE_LOCKS; i++) {
+		pthread_mutex_init(&g_base_locks[i], NULL);
+	}
+}
+
+/* Whether the database's latest version of a base file is the table's */
+static int overlay_fs_base_matches(const base_fs_entry_t *e, size_t size,
+				   const char *hash)
+{
+	return size == e->size && hash &&
+	       strncmp(hash, e->digest, OVERLAY_FS_HASH_LEN + 1) == 0;
+}
+
+int overlay_fs_base_init(sqlite3 *db, const unsigned char *table, size_t len)
 {
+	overlay_fs_base_state_t *state;
 	sqlite3_stmt *stmt = NULL;
+	uint64_t generation;
+	uint32_t live = 0;
+	uint32_t i;
 	int rc;
-	int count = 0;
+	const char *sql =
+		"SELECT lm.path, lm.version_number, lm.mtime, lm.size, fv.hash "
+		"FROM latest_files_meta lm CROSS JOIN file_versions fv "
+		"ON fv.file_id = lm.file_id AND fv.version_number = lm.version_number";
 
-	if (!db || !path) {
-		hbf_log_error("overlay_fs_version_count: invalid arguments");
+	pthread_once(&g_base_once, overlay_fs_base_locks_init);
+
+	free(g_base_state);
+	g_base_state = NULL;
+
+	if (!table) {
+		return 0;
+	}
+
+	if (!db || base_fs_open(&g_base, table, len) != 0) {
+		hbf_log_error("overlay_fs: Invalid embedded file table");
 		return -1;
 	}
 
-	const char *sql =
-		"SELECT COUNT(*) FROM file_versions fv "
-		"JOIN file_ids fi ON fv.file_id = fi.file_id "
-		"WHERE fi.path = ?";
+	state = calloc(g_base.count + 1u, sizeof(*state));
+	if (!state) {
+		hbf_log_error("Memory allocation failed");
+		return -1;
+	}
+
+	/* Taken before the query so a concurrent write leaves us stale */
+	generation = overlay_fs_generation();
 
 	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare count: %s", sqlite3_errmsg(db));
+		hbf_log_error("Failed to prepare base layer scan: %s",
+		              sqlite3_errmsg(db));
+		free(state);
 		return -1;
 	}
 
-	sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
-	rc = sqlite3_step(stmt);
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char *path = (const char *)sqlite3_column_text(stmt, 0);
+		base_fs_entry_t e;
+		int slot = path ? base_fs_find(&g_base, path, &e) : -1;
 
-	if (rc == SQLITE_ROW) {
-		count = sqlite3_column_int(stmt, 0);
+		if (slot < 0 ||
+		    !overlay_fs_base_matches(&e,
+					     (size_t)sqlite3_column_int64(stmt, 3),
+					     (const char *)sqlite3_column_text(stmt, 4))) {
+			continue;
+		}
+		state[slot].version = sqlite3_column_int64(stmt, 1);
+		state[slot].mtime = sqlite3_column_int64(stmt, 2);
+		state[slot].live = 1;
+		live++;
 	}
-
 	sqlite3_finalize(stmt);
 
-	if (rc != SQLITE_ROW) {
+	if (rc != SQLITE_DONE) {
+		hbf_log_error("Base layer scan failed: %s", sqlite3_errmsg(db));
+		free(state);
 		return -1;
 	}
 
-	return count;
+	for (i = 0; i < g_base.count; i++) {
+		state[i].generation = generation;
+	}
+	g_base_state = state;
+
+	hbf_log_info("overlay_fs: %u of %u embedded files served from the binary",
+	             live, g_base.count);
+	return 0;
 }
 
-void overlay_fs_close(sqlite3 *db)
+int overlay_fs_base_get(const char *path, overlay_fs_base_file_t *file)
 {
-	if (db) {
-		sqlite3_close(db);
+	overlay_fs_base_state_t state;
+	pthread_mutex_t *lock;
+	uint64_t generation;
+	int slot;
+
+	if (!g_base_state || !g_overlay_db || !path || !file) {
+		return 0;
 	}
-}
 
-void overlay_fs_init_global(sqlite3 *db)
-{
-	g_overlay_db = db;
-	if (db) {
-		hbf_log_info("overlay_fs: Global database handle initialized");
-	} else {
-		hbf_log_warn("overlay_fs: Global database handle set to NULL");
+	slot = base_fs_find(&g_base, path, &file->entry);
+	if (slot < 0) {
+		return 0;
+	}
+
+	lock = &g_base_locks[(unsigned int)slot % OVERLAY_FS_BASE_LOCKS];
+	generation = overlay_fs_generation();
+
+	pthread_mutex_lock(lock);
+	state = g_base_state[slot];
+	pthread_mutex_unlock(lock);
+
+	/* Some file changed since; see whether this one did */
+	if (state.generation != generation) {
+		int found = overlay_fs_latest_stat(hbf_db_pool_reader(g_overlay_db),
+						   path, &file->st);
+
+		if (found < 0) {
+			return 0;
+		}
+		state.live = found == 1 &&
+			     overlay_fs_base_matches(&file->entry, file->st.size,
+						     file->st.hash);
+		state.version = file->st.version;
+		state.mtime = file->st.mtime;
+		state.generation = generation;
+
+		pthread_mutex_lock(lock);
+		g_base_state[slot] = state;
+		pthread_mutex_unlock(lock);
+	}
+
+	if (!state.live) {
+		return 0;
 	}
+
+	file->st.version = state.version;
+	file->st.mtime = state.mtime;
+	file->st.size = file->entry.size;
+	memcpy(file->st.hash, file->entry.digest, OVERLAY_FS_HASH_LEN + 1);
+	file->st.gzip = file->entry.gzip;
+	return 1;
 }
 
-int overlay_fs_read_file(const char *path, int dev,
-                         unsigned char **data, size_t *size)
+/* Inflate state of a gzip stream */
+typedef struct {
+	z_stream zs;
+	int done; /* Z_STREAM_END seen */
+	unsigned char in[OVERLAY_FS_STREAM_CHUNK];
+} overlay_fs_inflate_t;
+
+int overlay_fs_stream_open(const char *path, overlay_fs_stream_t *s)
 {
 	sqlite3_stmt *stmt = NULL;
+	sqlite3 *rdb;
+	int found = -1;
 	int rc;
+	const char *sql =
+		"SELECT lm.version_number, lm.mtime, lm.size, fv.hash, "
+		"length(b.data), b.encoding "
+		"FROM latest_files_meta lm CROSS JOIN file_versions fv "
+		"ON fv.file_id = lm.file_id AND fv.version_number = lm.version_number "
+		"CROSS JOIN blobs b ON b.hash = fv.hash "
+		"WHERE lm.path = ?";
+
+	if (!s) {
+		return -1;
+	}
+	memset(s, 0, sizeof(*s));
 
 	if (!g_overlay_db) {
-		hbf_log_error("overlay_fs_read_file: global database not initialized");
+		hbf_log_error("overlay_fs_stream_open: global database not initialized");
 		return -1;
 	}
 
-	if (!path || !data || !size) {
-		hbf_log_error("overlay_fs_read_file: invalid arguments");
+	if (!path) {
+		hbf_log_error("overlay_fs_stream_open: invalid arguments");
 		return -1;
 	}
 
-	*data = NULL;
-	*size = 0;
-
-	/* Read from latest_files view (contains migrated SQLAR data + overlays) */
-	/* dev parameter reserved for future use */
-	(void)dev; /* Suppress unused parameter warning */
-
-	const char *sql = "SELECT data FROM latest_files WHERE path = ?";
+	rdb = hbf_db_pool_reader(g_overlay_db);
 
-	rc = sqlite3_prepare_v2(g_overlay_db, sql, -1, &stmt, NULL);
+	rc = sqlite3_prepare_v2(rdb, sql, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to prepare file read: %s",
-		              sqlite3_errmsg(g_overlay_db));
+		hbf_log_error("Failed to prepare file stream: %s",
+		              sqlite3_errmsg(rdb));
 		return -1;
 	}
 
@@ -765,43 +1920,305 @@ int overlay_fs_read_file(const char *path, int dev,
 
 	rc = sqlite3_step(stmt);
 	if (rc == SQLITE_ROW) {
-		const void *blob = sqlite3_column_blob(stmt, 0);
-		int blob_size = sqlite3_column_bytes(stmt, 0);
-
-		if (blob_size > 0) {
-			*data = malloc((size_t)blob_size);
-			if (!*data) {
-				hbf_log_error("Memory allocation failed");
-				sqlite3_finalize(stmt);
-				return -1;
-			}
-			memcpy(*data, blob, (size_t)blob_size);
-			*size = (size_t)blob_size;
+		const unsigned char *hash = sqlite3_column_text(stmt, 3);
+		const char *encoding = (const char *)sqlite3_column_text(stmt, 5);
+
+		s->st.version = sqlite3_column_int64(stmt, 0);
+		s->st.mtime = sqlite3_column_int64(stmt, 1);
+		s->st.size = (size_t)sqlite3_column_int64(stmt, 2);
+		snprintf(s->st.hash, sizeof(s->st.hash), "%s",
+			 hash ? (const char *)hash : "");
+		s->gzip = encoding &&
+			  strcmp(encoding, OVERLAY_FS_ENCODING_GZIP) == 0;
+		s->st.gzip = s->gzip;
+
+		if (encoding && !s->gzip &&
+		    strcmp(encoding, OVERLAY_FS_ENCODING_IDENTITY) != 0) {
+			hbf_log_error("Unsupported content encoding: %s",
+				      encoding);
 		} else {
-			/* Empty file - allocate minimal buffer */
-			*data = malloc(1);
-			if (!*data) {
-				hbf_log_error("Memory allocation failed");
-				sqlite3_finalize(stmt);
-				return -1;
-			}
-			*size = 0;
+			s->stored_size = (size_t)sqlite3_column_int64(stmt, 4);
+			s->open = 1;
+			found = 1;
 		}
-		sqlite3_finalize(stmt);
-		hbf_log_debug("overlay_fs: Read file '%s' (%zu bytes)", path, *size);
+	} else if (rc == SQLITE_DONE) {
+		found = 0;
+	} else {
+		hbf_log_error("Error reading file stream: %s",
+			      sqlite3_errmsg(rdb));
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (found == 1 && !s->gzip && s->stored_size != s->st.size) {
+		hbf_log_error("overlay_fs: Size mismatch for %s", path);
+		found = -1;
+	}
+	if (found == 1 && s->gzip) {
+		overlay_fs_inflate_t *inf = calloc(1, sizeof(*inf));
+
+		if (!inf || inflateInit2(&inf->zs, 15 + 16) != Z_OK) {
+			free(inf);
+			found = -1;
+		} else {
+			s->inflate = inf;
+		}
+	}
+	if (found != 1) {
+		overlay_fs_stream_close(s);
+	}
+
+	return found;
+}
+
+/*
+ * Read len stored bytes at offset. The blob is looked up by hash and
+ * opened for this read alone, so the read transaction ends with it.
+ */
+static int overlay_fs_stream_blob_read(const overlay_fs_stream_t *s,
+				       void *buf, size_t len, size_t offset)
+{
+	sqlite3 *rdb = hbf_db_pool_reader(g_overlay_db);
+	sqlite3_stmt *stmt;
+	sqlite3_blob *blob = NULL;
+	int rc;
+
+	stmt = hbf_db_stmt_cache_acquire(rdb,
+		"SELECT rowid FROM blobs WHERE hash = ?");
+	if (!stmt) {
+		hbf_log_error("Failed to prepare blob lookup: %s",
+			      sqlite3_errmsg(rdb));
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, s->st.hash, -1, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		rc = sqlite3_blob_open(rdb, "main", "blobs", "data",
+				       sqlite3_column_int64(stmt, 0), 0, &blob);
+	} else if (rc == SQLITE_DONE) {
+		hbf_log_error("Blob %s was deleted while streaming",
+			      s->st.hash);
+	}
+	hbf_db_stmt_cache_release(rdb, stmt);
+
+	if (!blob) {
+		if (rc != SQLITE_DONE) {
+			hbf_log_error("Failed to open blob: %s",
+				      sqlite3_errmsg(rdb));
+		}
+		return -1;
+	}
+
+	if ((size_t)sqlite3_blob_bytes(blob) != s->stored_size) {
+		hbf_log_error("Blob %s changed size while streaming",
+			      s->st.hash);
+		rc = SQLITE_CORRUPT;
+	} else {
+		rc = sqlite3_blob_read(blob, buf, (int)len, (int)offset);
+		if (rc != SQLITE_OK) {
+			hbf_log_error("Failed to read blob");
+		}
+	}
+
+	sqlite3_blob_close(blob);
+	return rc == SQLITE_OK ? 0 : -1;
+}
+
+/* Fill the inflate input from the blob; -1 on error or truncated data */
+static int overlay_fs_stream_fill(overlay_fs_stream_t *s,
+				  overlay_fs_inflate_t *inf)
+{
+	size_t n = s->stored_size - s->stored_pos;
+
+	if (n == 0) {
+		hbf_log_error("Corrupt gzip contents (truncated)");
+		return -1;
+	}
+	if (n > sizeof(inf->in)) {
+		n = sizeof(inf->in);
+	}
+	if (overlay_fs_stream_blob_read(s, inf->in, n, s->stored_pos) < 0) {
+		return -1;
+	}
+
+	s->stored_pos += n;
+	inf->zs.next_in = inf->in;
+	inf->zs.avail_in = (uInt)n;
+	return 0;
+}
+
+int overlay_fs_stream_read(overlay_fs_stream_t *s, unsigned char *buf,
+                           size_t len, size_t *got)
+{
+	overlay_fs_inflate_t *inf;
+	int rc;
+
+	if (!s || !s->open || !buf || !got) {
+		return -1;
+	}
+
+	*got = 0;
+	if (len > s->st.size - s->pos) {
+		len = s->st.size - s->pos;
+	}
+	if (len > OVERLAY_FS_STREAM_CHUNK) {
+		len = OVERLAY_FS_STREAM_CHUNK;
+	}
+	if (len == 0) {
 		return 0;
 	}
 
-	if (rc == SQLITE_DONE) {
-		/* File not found */
-		sqlite3_finalize(stmt);
-		hbf_log_debug("overlay_fs: File not found: %s", path);
+	if (!s->gzip) {
+		if (overlay_fs_stream_blob_read(s, buf, len, s->pos) < 0) {
+			return -1;
+		}
+		s->pos += len;
+		*got = len;
+		return 0;
+	}
+
+	inf = s->inflate;
+	inf->zs.next_out = buf;
+	inf->zs.avail_out = (uInt)len;
+
+	while (inf->zs.avail_out > 0) {
+		if (inf->done) {
+			hbf_log_error("Corrupt gzip contents (short)");
+			return -1;
+		}
+		if (inf->zs.avail_in == 0 && overlay_fs_stream_fill(s, inf) < 0) {
+			return -1;
+		}
+		rc = inflate(&inf->zs, Z_NO_FLUSH);
+		if (rc == Z_STREAM_END) {
+			inf->done = 1;
+		} else if (rc != Z_OK) {
+			hbf_log_error("Corrupt gzip contents (%d)", rc);
+			return -1;
+		}
+	}
+
+	s->pos += len;
+	*got = len;
+	return 0;
+}
+
+int overlay_fs_stream_seek(overlay_fs_stream_t *s, size_t offset)
+{
+	unsigned char discard[4096];
+	size_t got;
+
+	if (!s || !s->open || offset > s->st.size) {
 		return -1;
 	}
 
-	hbf_log_error("Error reading file: %s", sqlite3_errmsg(g_overlay_db));
-	sqlite3_finalize(stmt);
-	return -1;
+	if (!s->gzip) {
+		s->pos = offset;
+		return 0;
+	}
+
+	if (offset < s->pos) {
+		hbf_log_error("overlay_fs: Cannot seek back in gzip contents");
+		return -1;
+	}
+
+	while (s->pos < offset) {
+		size_t n = offset - s->pos;
+
+		if (overlay_fs_stream_read(s, discard,
+					   n < sizeof(discard) ? n : sizeof(discard),
+					   &got) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int overlay_fs_stream_read_stored(overlay_fs_stream_t *s, unsigned char *buf,
+                                  size_t len, size_t *got)
+{
+	if (!s || !s->open || !buf || !got) {
+		return -1;
+	}
+
+	*got = 0;
+	if (len > s->stored_size - s->stored_pos) {
+		len = s->stored_size - s->stored_pos;
+	}
+	if (len > OVERLAY_FS_STREAM_CHUNK) {
+		len = OVERLAY_FS_STREAM_CHUNK;
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	if (overlay_fs_stream_blob_read(s, buf, len, s->stored_pos) < 0) {
+		return -1;
+	}
+
+	s->stored_pos += len;
+	*got = len;
+	return 0;
+}
+
+void overlay_fs_stream_close(overlay_fs_stream_t *s)
+{
+	if (!s) {
+		return;
+	}
+
+	if (s->inflate) {
+		overlay_fs_inflate_t *inf = s->inflate;
+
+		inflateEnd(&inf->zs);
+		free(inf);
+		s->inflate = NULL;
+	}
+	s->open = 0;
+}
+
+void overlay_fs_release_file(hbf_db_file_t *file)
+{
+	hbf_db_file_release(file);
+}
+
+int overlay_fs_read_file(const char *path, int dev,
+                         unsigned char **data, size_t *size)
+{
+	hbf_db_file_t *file;
+
+	if (!path || !data || !size) {
+		hbf_log_error("overlay_fs_read_file: invalid arguments");
+		return -1;
+	}
+
+	*data = NULL;
+	*size = 0;
+
+	/* dev parameter reserved for future use */
+	(void)dev; /* Suppress unused parameter warning */
+
+	file = overlay_fs_get_file(path);
+	if (!file) {
+		return -1;
+	}
+
+	/* Callers own the copy; allocate at least one byte for empty files */
+	*data = malloc(file->size > 0 ? file->size : 1);
+	if (!*data) {
+		hbf_log_error("Memory allocation failed");
+		hbf_db_file_release(file);
+		return -1;
+	}
+	if (file->size > 0) {
+		memcpy(*data, file->data, file->size);
+	}
+	*size = file->size;
+
+	hbf_db_file_release(file);
+	return 0;
 }
 
 int overlay_fs_write_file(const char *path,
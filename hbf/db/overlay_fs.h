@@ -6,6 +6,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "hbf/db/base_fs.h"
+#include "hbf/db/file_cache.h"
+
 /*
  * Versioned file system using SQLite
  *
@@ -15,6 +18,31 @@
  * - Single SQLite database, no external dependencies
  */
 
+/*
+ * Latest version of one file by path (bind as parameter 1): an index
+ * lookup in latest_files_meta followed by primary key probes into
+ * file_versions and blobs, so the cost does not grow with version history.
+ * Columns: file_id, version_number, mtime, size, data, hash, encoding
+ * (data is stored as encoded; see overlay_fs_decode)
+ */
+#define OVERLAY_FS_LATEST_SQL \
+	"SELECT lm.file_id, lm.version_number, lm.mtime, lm.size, b.data, " \
+	"fv.hash, b.encoding " \
+	"FROM latest_files_meta lm CROSS JOIN file_versions fv " \
+	"ON fv.file_id = lm.file_id AND fv.version_number = lm.version_number " \
+	"CROSS JOIN blobs b ON b.hash = fv.hash " \
+	"WHERE lm.path = ?"
+
+/* Length of a content hash (SHA-256, lowercase hex) */
+#define OVERLAY_FS_HASH_LEN 64
+
+/* blobs.encoding values: contents stored as is, or gzip-compressed */
+#define OVERLAY_FS_ENCODING_IDENTITY "identity"
+#define OVERLAY_FS_ENCODING_GZIP "gzip"
+
+/* Files smaller than this are never compressed */
+#define OVERLAY_FS_COMPRESS_MIN_SIZE 256
+
 /*
  * Initialize overlay_fs database
  *
@@ -49,14 +77,49 @@ typedef enum {
 	MIGRATE_ERR_CORRUPT = -4,
 } migrate_status_t;
 
+/*
+ * Register overlay_fs SQL functions on a connection
+ *
+ * hbf_sha256(X) returns the lowercase hex SHA-256 of X, the key of the
+ * blobs table. Writers that bypass overlay_fs_write use it to add
+ * uncompressed contents:
+ * INSERT OR IGNORE INTO blobs (hash, data) VALUES (hbf_sha256(X), X).
+ * overlay_fs_init_global registers it on the global handle.
+ *
+ * @param db: Database handle
+ * @return 0 on success, -1 on error
+ */
+int overlay_fs_register_functions(sqlite3 *db);
+
+/*
+ * Convert a database that stores contents inline in file_versions.data
+ * to the content-addressed blobs table, and rebuild blobs tables that
+ * lack blobs.encoding or store it after data (no-op for current databases)
+ *
+ * Run before applying overlay_schema.sql, which recreates the indexes,
+ * triggers and views of the new file_versions table.
+ *
+ * @param db: Database handle
+ * @return 0 on success, -1 on error
+ */
+int overlay_fs_upgrade_schema(sqlite3 *db);
+
 /*
  * Migrate asset bundle to file_versions table
  *
- * Takes a compressed asset bundle (generated by asset_packer), decompresses it,
- * parses the binary format, and inserts all entries as version 1 in file_versions.
+ * Takes an asset bundle (generated by asset_packer) and writes each entry
+ * as a new version in file_versions. All entries land in one transaction
+ * through one set of prepared statements.
  * Migration is idempotent: subsequent calls with the same bundle are no-ops.
  *
- * Binary format (after decompression):
+ * Two formats are accepted, told apart by the leading magic:
+ *
+ * v2 (current): a base_fs table (see base_fs.h), each file compressed on
+ * its own. Stored contents and digests are copied into blobs as they are;
+ * nothing is decompressed.
+ *
+ * v1: one zlib stream, inflated incrementally as entries are parsed so
+ * memory holds at most the largest entry. After decompression:
  *   [num_entries:u32]
  *   repeat num_entries times:
  *     [name_len:u32]
@@ -65,8 +128,8 @@ typedef enum {
  *     [data:bytes]
  *
  * @param db: Database handle
- * @param bundle_blob: Compressed bundle data (from asset_packer)
- * @param bundle_len: Length of compressed bundle
+ * @param bundle_blob: Bundle data (from asset_packer)
+ * @param bundle_len: Length of bundle
  * @return migrate_status_t status code
  */
 migrate_status_t overlay_fs_migrate_assets(
@@ -75,10 +138,30 @@ migrate_status_t overlay_fs_migrate_assets(
 	size_t bundle_len
 );
 
+/*
+ * Migrate asset bundle whose ID is already known
+ *
+ * As overlay_fs_migrate_assets, but takes the bundle ID (lowercase hex
+ * SHA-256 of bundle_blob, emitted by asset_packer as <symbol>_id) instead
+ * of hashing the whole blob. A NULL or malformed ID is computed instead.
+ *
+ * @param db: Database handle
+ * @param bundle_blob: Bundle data (from asset_packer)
+ * @param bundle_len: Length of bundle
+ * @param bundle_id: Hex SHA-256 of bundle_blob, or NULL
+ * @return migrate_status_t status code
+ */
+migrate_status_t overlay_fs_migrate_assets_id(
+	sqlite3 *db,
+	const uint8_t *bundle_blob,
+	size_t bundle_len,
+	const char *bundle_id
+);
+
 /*
  * Read latest version of a file
  *
- * Uses optimized query with file_id and MAX(version_number).
+ * Uses OVERLAY_FS_LATEST_SQL.
  *
  * @param db: Database handle
  * @param path: File path
@@ -89,11 +172,29 @@ migrate_status_t overlay_fs_migrate_assets(
 int overlay_fs_read(sqlite3 *db, const char *path,
                     unsigned char **data, size_t *size);
 
+/*
+ * Decode contents as stored in blobs.data
+ *
+ * @param encoding: blobs.encoding (NULL is treated as identity)
+ * @param stored: Stored bytes
+ * @param stored_size: Length of stored
+ * @param size: Decoded size (file_versions.size), checked for gzip
+ * @param data: Output parameter for the contents, NUL-terminated for
+ *              convenience (caller must free)
+ * @param data_size: Output parameter for the length of data
+ * @return 0 on success, -1 on error (unknown encoding or corrupt data)
+ */
+int overlay_fs_decode(const char *encoding, const void *stored,
+                      size_t stored_size, size_t size,
+                      unsigned char **data, size_t *data_size);
+
 /*
  * Write new version of a file
  *
  * Creates new version entry with incremented version_number.
- * If file doesn't exist, creates new file_id.
+ * If file doesn't exist, creates new file_id. Contents are stored once
+ * per distinct SHA-256 in the blobs table, gzip-compressed when they are
+ * at least OVERLAY_FS_COMPRESS_MIN_SIZE bytes and compress by 1/8 or more.
  *
  * @param db: Database handle
  * @param path: File path
@@ -122,6 +223,42 @@ int overlay_fs_exists(sqlite3 *db, const char *path);
  */
 int overlay_fs_version_count(sqlite3 *db, const char *path);
 
+/* Versions deleted per transaction by overlay_fs_compact by default */
+#define OVERLAY_FS_COMPACT_BATCH 500
+
+/*
+ * Retention policy for overlay_fs_compact
+ *
+ * A version is kept if it is one of the keep_versions newest versions of
+ * its file, or if its mtime is at or after keep_since.
+ */
+typedef struct {
+	int keep_versions;  /* Newest versions kept per file (>= 1) */
+	int64_t keep_since; /* Unix time; 0 keeps nothing extra by age */
+	int batch;          /* Versions per transaction (0: default) */
+} overlay_fs_compact_opts_t;
+
+/*
+ * Delete old file versions according to a retention policy
+ *
+ * Works through one file at a time and deletes at most opts->batch
+ * versions per short write transaction, so readers (WAL) never wait and
+ * other writers get the lock between batches. The latest version of a
+ * file is never deleted. Blobs no version refers to any more are dropped
+ * by trigger. Finishes with an incremental vacuum, which returns free
+ * pages to the OS for databases created with auto_vacuum=INCREMENTAL
+ * (hbf_db_init sets it on new databases); elsewhere they are reused.
+ *
+ * Must not be called inside a transaction.
+ *
+ * @param db: Database handle
+ * @param opts: Retention policy
+ * @param removed: Output parameter for versions deleted (may be NULL)
+ * @return 0 on success, -1 on error (batches already committed stay)
+ */
+int overlay_fs_compact(sqlite3 *db, const overlay_fs_compact_opts_t *opts,
+                       int64_t *removed);
+
 /*
  * Close database handle
  *
@@ -134,17 +271,204 @@ void overlay_fs_close(sqlite3 *db);
  *
  * Sets the internal database handle for file operations.
  * Must be called before using overlay_fs_read_file or overlay_fs_write_file.
+ * Installs the handle's sqlite3_update_hook to track overlay_fs_generation().
  *
  * @param db: Database handle to use for all filesystem operations
  */
 void overlay_fs_init_global(sqlite3 *db);
 
+/*
+ * Filesystem generation counter
+ *
+ * Increases whenever the latest version of any file may have changed:
+ * on every overlay_fs_write, and on any change to latest_files_meta made
+ * through the global handle. Lets callers validate derived state (e.g.
+ * compiled modules) without querying the database.
+ *
+ * @return Current generation
+ */
+uint64_t overlay_fs_generation(void);
+
+/*
+ * Note that a statement on db has finished
+ *
+ * The update hook bumps the generation before a change commits, and the
+ * WAL hook bumps it again once the commit is visible. memdb databases
+ * (--inmem) have no WAL, so writers on the global handle that bypass
+ * overlay_fs_write (db.execute) call this after each statement instead:
+ * once db is back in autocommit mode, a pending change is committed and
+ * the generation moves on. No-op for other handles, inside a transaction
+ * or when nothing changed.
+ *
+ * @param db: Connection the statement ran on
+ */
+void overlay_fs_statement_done(sqlite3 *db);
+
+/*
+ * Get the latest version of a file through the file cache
+ *
+ * Hot files are served from memory with no SQL and no copy; files stored
+ * gzip-compressed also keep those bytes (file->gzip) so they can be sent
+ * as is to clients that accept gzip. After any
+ * filesystem change (see overlay_fs_generation) a cached file costs one
+ * latest_files_meta lookup to confirm its version is still the latest;
+ * only changed files are read again, through the calling thread's read
+ * connection (hbf_db_pool_reader).
+ *
+ * @param path: File path (e.g., "static/index.html" or "hbf/server.js")
+ * @return Referenced file (release with overlay_fs_release_file), or NULL
+ *         if not found or on error
+ */
+hbf_db_file_t *overlay_fs_get_file(const char *path);
+
+/* Metadata of the latest version of a file */
+typedef struct {
+	int64_t version;                    /* file_versions.version_number */
+	int64_t mtime;                      /* Unix time */
+	size_t size;                        /* Uncompressed size */
+	char hash[OVERLAY_FS_HASH_LEN + 1]; /* Content SHA-256 (blobs.hash) */
+	int gzip;                           /* Stored gzip-compressed */
+} overlay_fs_stat_t;
+
+/*
+ * Get the metadata of the latest version of a file without its contents
+ *
+ * Answered from the file cache when it holds a current entry; otherwise
+ * one latest_files_meta lookup plus file_versions and blobs primary key
+ * probes on the calling thread's read connection. Never reads blobs, so it suits
+ * conditional requests (ETag from hash, Last-Modified from mtime).
+ *
+ * @param path: File path
+ * @param st: Output parameter for the metadata
+ * @return 1 if found, 0 if not found, -1 on error
+ */
+int overlay_fs_stat(const char *path, overlay_fs_stat_t *st);
+
+/* A base layer file, as overlay_fs_base_get returns it */
+typedef struct {
+	base_fs_entry_t entry; /* Contents, pointing into the table */
+	overlay_fs_stat_t st;  /* What overlay_fs_stat reports for the file */
+} overlay_fs_base_file_t;
+
+/*
+ * Set the base layer: the files of a v2 asset bundle (<symbol>, a base_fs
+ * table) as embedded in the binary
+ *
+ * A base file is served from the table for as long as the latest version
+ * in the database has the same contents (SHA-256); one query over
+ * latest_files_meta establishes that for every file up front. Call after
+ * overlay_fs_init_global, before serving requests.
+ *
+ * @param db: Database handle the files were migrated into
+ * @param table: Table bytes (must outlive overlay_fs), or NULL for none
+ * @param len: Length of table
+ * @return 0 on success, -1 if the table is invalid (no base layer then)
+ */
+int overlay_fs_base_init(sqlite3 *db, const unsigned char *table, size_t len);
+
+/*
+ * Look up path in the base layer
+ *
+ * No SQL, allocation or copy while the filesystem generation is
+ * unchanged. After a write, the first lookup of each base file checks its
+ * latest version again (overlay_fs_stat's query), much as the file cache
+ * revalidates entries.
+ *
+ * @param path: File path
+ * @param file: Output parameter for the file
+ * @return 1 if the table holds the current contents of path, 0 if not
+ *         (no such base file, or overridden in the database)
+ */
+int overlay_fs_base_get(const char *path, overlay_fs_base_file_t *file);
+
+/* Bytes read from blobs per step when streaming */
+#define OVERLAY_FS_STREAM_CHUNK (64u * 1024u)
+
+/*
+ * Incremental reader of the latest version of one file
+ *
+ * Reads the stored contents in place with sqlite3_blob_read, so memory
+ * use does not depend on file size. Each read opens the blob for that
+ * step only: no read transaction stays open between reads, however slow
+ * the consumer, so writers, checkpoints and compaction are not held up.
+ * The stream still reads the version current at open (its contents are
+ * found again by hash) even if the file is replaced; reads fail if
+ * compaction has deleted that version since.
+ */
+typedef struct {
+	overlay_fs_stat_t st;   /* Version being read */
+	int gzip;               /* Stored gzip-compressed */
+	size_t stored_size;     /* Length of the stored bytes */
+	/* Internal */
+	int open;               /* Set by overlay_fs_stream_open */
+	size_t stored_pos;      /* Next stored byte */
+	size_t pos;             /* Next content byte */
+	void *inflate;          /* Inflate state, gzip only */
+} overlay_fs_stream_t;
+
+/*
+ * Open a stream on the latest version of a file
+ *
+ * @param path: File path
+ * @param s: Stream to initialize (close it if 1 is returned)
+ * @return 1 if found, 0 if not found, -1 on error
+ */
+int overlay_fs_stream_open(const char *path, overlay_fs_stream_t *s);
+
+/*
+ * Move to a content offset (forward only for gzip contents, which are
+ * inflated and discarded up to offset)
+ *
+ * @param s: Open stream, not yet read with overlay_fs_stream_read_stored
+ * @param offset: Content offset (<= s->st.size)
+ * @return 0 on success, -1 on error
+ */
+int overlay_fs_stream_seek(overlay_fs_stream_t *s, size_t offset);
+
+/*
+ * Read contents, decoded, from the current offset
+ *
+ * @param s: Open stream
+ * @param buf: Output buffer
+ * @param len: Size of buf
+ * @param got: Output parameter for bytes read (0 at end of file)
+ * @return 0 on success, -1 on error (corrupt data or SQL error)
+ */
+int overlay_fs_stream_read(overlay_fs_stream_t *s, unsigned char *buf,
+                           size_t len, size_t *got);
+
+/*
+ * Read the stored bytes (gzip data when s->gzip) in order; do not mix
+ * with overlay_fs_stream_read or overlay_fs_stream_seek
+ *
+ * @param s: Open stream
+ * @param buf: Output buffer
+ * @param len: Size of buf
+ * @param got: Output parameter for bytes read (0 at end)
+ * @return 0 on success, -1 on error
+ */
+int overlay_fs_stream_read_stored(overlay_fs_stream_t *s, unsigned char *buf,
+                                  size_t len, size_t *got);
+
+/*
+ * Close a stream opened by overlay_fs_stream_open
+ *
+ * @param s: Stream (closing twice is harmless)
+ */
+void overlay_fs_stream_close(overlay_fs_stream_t *s);
+
+/*
+ * Release a file returned by overlay_fs_get_file
+ *
+ * @param file: File to release (may be NULL)
+ */
+void overlay_fs_release_file(hbf_db_file_t *file);
+
 /*
  * Read file with overlay support
  *
  * Reads from the global database handle set by overlay_fs_init_global.
- * Uses latest_files view (overlay + base) for file access.
- * NO MUTEX - relies on SQLite's internal locking (SQLITE_THREADSAFE=1 + WAL).
+ * Returns a private copy of overlay_fs_get_file's contents.
  *
  * @param path: File path (e.g., "static/index.html" or "hbf/server.js")
  * @param dev: Reserved for future use
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: MIT */
+/* Point read latency versus version history benchmark
+ *
+ * Reads the latest version of one file whose history holds 10, 1k and
+ * 100k versions (among a few other files), comparing the former
+ * GROUP BY view definition against the latest_files_meta point lookup
+ * every read path now uses (OVERLAY_FS_LATEST_SQL).
+ *
+ * Usage: bazel run //hbf/db:overlay_fs_bench [-- iterations]
+ */
+#include "hbf/db/overlay_fs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hbf/shell/log.h"
+
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_PATH "static/bench.txt"
+#define BENCH_OTHER_FILES 100
+
+/* Generated from hbf/db/overlay_schema.sql via //hbf/db:overlay_schema_c */
+extern const char * const hbf_schema_sql_ptr;
+
+/* latest_files as defined before the view used latest_files_meta */
+static const char *bench_group_by_sql =
+	"WITH latest_versions AS ("
+	"    SELECT file_id, MAX(version_number) AS max_version"
+	"    FROM file_versions GROUP BY file_id"
+	") "
+	"SELECT b.data FROM file_versions fv "
+	"INNER JOIN latest_versions lv ON fv.file_id = lv.file_id "
+	"AND fv.version_number = lv.max_version "
+	"JOIN blobs b ON b.hash = fv.hash "
+	"WHERE fv.path = ?";
+
+static double bench_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void bench_exec(sqlite3 *db, const char *sql)
+{
+	char *errmsg = NULL;
+
+	if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+		fprintf(stderr, "SQL error: %s\n", errmsg ? errmsg : "unknown");
+		exit(1);
+	}
+}
+
+/* Database with BENCH_OTHER_FILES files plus versions of BENCH_PATH */
+static sqlite3 *bench_open(int versions)
+{
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	int i;
+
+	if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+		fprintf(stderr, "Failed to open database\n");
+		exit(1);
+	}
+	bench_exec(db, hbf_schema_sql_ptr);
+	bench_exec(db, "BEGIN");
+
+	/* Every version shares one blob */
+	bench_exec(db, "INSERT INTO blobs (hash, data) "
+		       "VALUES ('bench', zeroblob(16))");
+
+	if (sqlite3_prepare_v2(db,
+			       "INSERT INTO file_versions "
+			       "(file_id, path, version_number, mtime, size, hash) "
+			       "VALUES (?, ?, ?, 0, 16, 'bench')",
+			       -1, &stmt, NULL) != SQLITE_OK) {
+		fprintf(stderr, "Prepare failed: %s\n", sqlite3_errmsg(db));
+		exit(1);
+	}
+
+	for (i = 0; i < BENCH_OTHER_FILES + versions; i++) {
+		char path[64];
+		int other = i < BENCH_OTHER_FILES;
+
+		if (other) {
+			snprintf(path, sizeof(path), "static/other%d.txt", i);
+		}
+		sqlite3_bind_int(stmt, 1, other ? i + 1 : BENCH_OTHER_FILES + 1);
+		sqlite3_bind_text(stmt, 2, other ? path : BENCH_PATH, -1,
+				  SQLITE_TRANSIENT);
+		sqlite3_bind_int(stmt, 3, other ? 1 : i - BENCH_OTHER_FILES + 1);
+		if (sqlite3_step(stmt) != SQLITE_DONE) {
+			fprintf(stderr, "Insert failed: %s\n", sqlite3_errmsg(db));
+			exit(1);
+		}
+		sqlite3_reset(stmt);
+	}
+
+	sqlite3_finalize(stmt);
+	bench_exec(db, "COMMIT");
+	bench_exec(db, "ANALYZE");
+
+	return db;
+}
+
+static double bench_read(sqlite3 *db, const char *sql, int iterations)
+{
+	sqlite3_stmt *stmt = NULL;
+	double start;
+	int i;
+
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		fprintf(stderr, "Prepare failed: %s\n", sqlite3_errmsg(db));
+		exit(1);
+	}
+
+	start = bench_now_us();
+	for (i = 0; i < iterations; i++) {
+		sqlite3_bind_text(stmt, 1, BENCH_PATH, -1, SQLITE_STATIC);
+		if (sqlite3_step(stmt) != SQLITE_ROW) {
+			fprintf(stderr, "Read failed: %s\n", sqlite3_errmsg(db));
+			exit(1);
+		}
+		sqlite3_reset(stmt);
+	}
+
+	sqlite3_finalize(stmt);
+	return (bench_now_us() - start) / (double)iterations;
+}
+
+int main(int argc, char **argv)
+{
+	static const int versions[] = { 10, 1000, 100000 };
+	int iterations = BENCH_DEFAULT_ITERATIONS;
+	size_t i;
+
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+		if (iterations <= 0) {
+			iterations = BENCH_DEFAULT_ITERATIONS;
+		}
+	}
+
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("Latest-version point read (%d iterations):\n", iterations);
+	printf("  %-10s %16s %16s\n", "versions", "GROUP BY view", "meta lookup");
+
+	for (i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+		sqlite3 *db = bench_open(versions[i]);
+		/* The old plan scans all versions; keep its run short */
+		int slow_iterations = iterations / 20 > 0 ? iterations / 20 : 1;
+		double group_by = bench_read(db, bench_group_by_sql,
+					     slow_iterations);
+		double meta = bench_read(db, OVERLAY_FS_LATEST_SQL, iterations);
+
+		printf("  %-10d %13.2f us %13.2f us\n", versions[i], group_by,
+		       meta);
+		sqlite3_close(db);
+	}
+
+	return 0;
+}
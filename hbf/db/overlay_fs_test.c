@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
 
 /* Generated from hbf/db/overlay_schema.sql via //hbf/db:overlay_schema_c */
 extern const char * const hbf_schema_sql_ptr;
@@ -113,6 +114,18 @@ static void test_multiple_versions(void)
 	count = overlay_fs_version_count(db, "versioned.txt");
 	assert(count == 3);
 
+	/* Dropping the latest version falls back to the previous one */
+	ret = sqlite3_exec(db,
+	                   "DELETE FROM file_versions WHERE path = 'versioned.txt' "
+	                   "AND version_number = 3",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	ret = overlay_fs_read(db, "versioned.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == strlen(v2));
+	assert(memcmp(data, v2, size) == 0);
+	free(data);
+
 	overlay_fs_close(db);
 
 	printf("  ✓ Multiple versions\n");
@@ -255,6 +268,559 @@ static void test_large_file(void)
 	printf("  ✓ Large file (1 MB)\n");
 }
 
+static int count_rows(sqlite3 *db, const char *sql)
+{
+	sqlite3_stmt *stmt = NULL;
+	int n = -1;
+
+	assert(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK);
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		n = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return n;
+}
+
+static void test_blob_dedup(void)
+{
+	sqlite3 *db = NULL;
+	const char *same = "identical contents";
+	const char *other = "something else";
+	int ret;
+
+	ret = open_test_db(&db);
+	assert(ret == 0);
+
+	/* Same contents under two paths and twice under one: one blob */
+	ret = overlay_fs_write(db, "a.txt", (const unsigned char *)same,
+	                       strlen(same));
+	assert(ret == 0);
+	ret = overlay_fs_write(db, "a.txt", (const unsigned char *)same,
+	                       strlen(same));
+	assert(ret == 0);
+	ret = overlay_fs_write(db, "b.txt", (const unsigned char *)same,
+	                       strlen(same));
+	assert(ret == 0);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 1);
+	assert(count_rows(db, "SELECT COUNT(*) FROM file_versions") == 3);
+
+	ret = overlay_fs_write(db, "b.txt", (const unsigned char *)other,
+	                       strlen(other));
+	assert(ret == 0);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 2);
+
+	/* Blobs go away with their last version */
+	ret = sqlite3_exec(db, "DELETE FROM file_versions WHERE path = 'b.txt' "
+	                   "AND version_number = 2", NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 1);
+	ret = sqlite3_exec(db, "DELETE FROM file_versions WHERE path = 'a.txt'",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 1);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Content-addressed blobs (verified: dedup, cleanup)\n");
+}
+
+static void test_upgrade_inline_data(void)
+{
+	sqlite3 *db = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	int ret;
+
+	/* Layout used before the blobs table existed */
+	ret = sqlite3_open(":memory:", &db);
+	assert(ret == SQLITE_OK);
+	ret = sqlite3_exec(db,
+	                   "CREATE TABLE file_versions ("
+	                   "  file_id INTEGER NOT NULL, path TEXT NOT NULL,"
+	                   "  version_number INTEGER NOT NULL,"
+	                   "  mtime INTEGER NOT NULL, size INTEGER NOT NULL,"
+	                   "  data BLOB NOT NULL,"
+	                   "  PRIMARY KEY (file_id, version_number)"
+	                   ") WITHOUT ROWID;"
+	                   "CREATE VIEW latest_files AS SELECT * FROM file_versions;"
+	                   "INSERT INTO file_versions VALUES"
+	                   "  (1, 'old.txt', 1, 0, 3, 'one'),"
+	                   "  (1, 'old.txt', 2, 0, 3, 'two'),"
+	                   "  (2, 'copy.txt', 1, 0, 3, 'two');",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	ret = overlay_fs_upgrade_schema(db);
+	assert(ret == 0);
+	ret = sqlite3_exec(db, hbf_schema_sql_ptr, NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 2);
+	assert(count_rows(db, "SELECT COUNT(*) FROM file_versions") == 3);
+
+	ret = overlay_fs_read(db, "old.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == 3 && memcmp(data, "two", 3) == 0);
+	free(data);
+
+	/* Running it again is a no-op */
+	ret = overlay_fs_upgrade_schema(db);
+	assert(ret == 0);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Upgrade from inline file contents\n");
+}
+
+static void test_compression(void)
+{
+	sqlite3 *db = NULL;
+	unsigned char text[8192];
+	unsigned char noise[1024];
+	unsigned char *data = NULL;
+	size_t size = 0;
+	unsigned int seed = 1;
+	int ret, i;
+
+	ret = open_test_db(&db);
+	assert(ret == 0);
+
+	for (i = 0; i < (int)sizeof(text); i++) {
+		text[i] = (unsigned char)"hello, compressible world\n"[i % 26];
+	}
+	for (i = 0; i < (int)sizeof(noise); i++) {
+		seed = seed * 1103515245u + 12345u;
+		noise[i] = (unsigned char)(seed >> 16);
+	}
+
+	ret = overlay_fs_write(db, "text.txt", text, sizeof(text));
+	assert(ret == 0);
+	ret = overlay_fs_write(db, "noise.bin", noise, sizeof(noise));
+	assert(ret == 0);
+	ret = overlay_fs_write(db, "small.txt", (const unsigned char *)"aaaa", 4);
+	assert(ret == 0);
+
+	/* Only text that shrinks is stored compressed */
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE encoding = 'gzip'") == 1);
+	assert(count_rows(db, "SELECT length(b.data) < fv.size FROM blobs b "
+	                      "JOIN file_versions fv ON fv.hash = b.hash "
+	                      "WHERE fv.path = 'text.txt'") == 1);
+	assert(count_rows(db, "SELECT size FROM latest_files_meta "
+	                      "WHERE path = 'text.txt'") == (int)sizeof(text));
+
+	/* Reads see the original contents */
+	ret = overlay_fs_read(db, "text.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == sizeof(text) && memcmp(data, text, size) == 0);
+	free(data);
+	ret = overlay_fs_read(db, "noise.bin", &data, &size);
+	assert(ret == 0);
+	assert(size == sizeof(noise) && memcmp(data, noise, size) == 0);
+	free(data);
+
+	/* Unknown encodings and damaged contents are errors */
+	ret = overlay_fs_decode("br", "x", 1, 1, &data, &size);
+	assert(ret == -1 && data == NULL);
+	ret = overlay_fs_decode(OVERLAY_FS_ENCODING_GZIP, "\x1f\x8b", 2, 1,
+	                        &data, &size);
+	assert(ret == -1 && data == NULL);
+	ret = overlay_fs_decode(NULL, "abc", 3, 3, &data, &size);
+	assert(ret == 0 && size == 3 && data[3] == '\0');
+	free(data);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Compressed storage\n");
+}
+
+static void test_upgrade_blob_encoding(void)
+{
+	sqlite3 *db = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	int ret;
+
+	/* blobs as created before the encoding column existed */
+	ret = sqlite3_open(":memory:", &db);
+	assert(ret == SQLITE_OK);
+	ret = sqlite3_exec(db,
+	                   "CREATE TABLE blobs (hash TEXT PRIMARY KEY,"
+	                   "  data BLOB NOT NULL);"
+	                   "INSERT INTO blobs VALUES ('h1', 'old');",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	ret = overlay_fs_upgrade_schema(db);
+	assert(ret == 0);
+	ret = sqlite3_exec(db, hbf_schema_sql_ptr, NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE encoding = 'identity'") == 1);
+	assert(count_rows(db, "SELECT cid FROM pragma_table_info('blobs') "
+	                      "WHERE name = 'encoding'") == 1);
+
+	ret = sqlite3_exec(db,
+	                   "INSERT INTO file_ids (file_id, path) VALUES (1, 'old.txt');"
+	                   "INSERT INTO file_versions VALUES (1, 'old.txt', 1, 0, 3, 'h1');",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	ret = overlay_fs_read(db, "old.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == 3 && memcmp(data, "old", 3) == 0);
+	free(data);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Upgrade blobs without encoding\n");
+}
+
+static void test_upgrade_blob_column_order(void)
+{
+	sqlite3 *db = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	int ret;
+
+	/* encoding after data, as ALTER TABLE added it */
+	ret = open_test_db(&db);
+	assert(ret == 0);
+	ret = sqlite3_exec(db,
+	                   "PRAGMA foreign_keys=ON;"
+	                   "DROP VIEW latest_files;"
+	                   "DROP TRIGGER trg_file_versions_blob_ad;"
+	                   "DROP TABLE blobs;"
+	                   "CREATE TABLE blobs (hash TEXT PRIMARY KEY,"
+	                   "  data BLOB NOT NULL,"
+	                   "  encoding TEXT NOT NULL DEFAULT 'identity');",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	ret = overlay_fs_write(db, "text.txt", (const unsigned char *)
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789"
+	                       "0123456789012345678901234567890123456789",
+	                       280);
+	assert(ret == 0);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE encoding = 'gzip'") == 1);
+
+	/* Rebuilt in place, keeping rows, encodings and foreign keys */
+	ret = overlay_fs_upgrade_schema(db);
+	assert(ret == 0);
+	ret = sqlite3_exec(db, hbf_schema_sql_ptr, NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(count_rows(db, "SELECT cid FROM pragma_table_info('blobs') "
+	                      "WHERE name = 'encoding'") == 1);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE encoding = 'gzip'") == 1);
+	assert(count_rows(db, "PRAGMA foreign_keys") == 1);
+	ret = overlay_fs_read(db, "text.txt", &data, &size);
+	assert(ret == 0 && size == 280 && memcmp(data, "0123456789", 10) == 0);
+	free(data);
+
+	/* Current layouts are left alone */
+	ret = overlay_fs_upgrade_schema(db);
+	assert(ret == 0);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Upgrade blobs with encoding after data\n");
+}
+
+/* Append a little-endian u32 */
+static size_t put_u32(unsigned char *buf, size_t pos, uint32_t v)
+{
+	buf[pos] = (unsigned char)v;
+	buf[pos + 1] = (unsigned char)(v >> 8);
+	buf[pos + 2] = (unsigned char)(v >> 16);
+	buf[pos + 3] = (unsigned char)(v >> 24);
+	return pos + 4;
+}
+
+static void test_migrate_assets(void)
+{
+	static const char *names[] = { "static/a.txt", "static/zeros.bin", "empty" };
+	size_t sizes[] = { 5, 1024 * 1024, 0 };
+	sqlite3 *db = NULL;
+	sqlite3_stmt *stmt = NULL;
+	char bundle_id[OVERLAY_FS_HASH_LEN + 1];
+	unsigned char *raw;
+	unsigned char *bundle;
+	unsigned char *data = NULL;
+	uLongf bundle_len;
+	size_t raw_len = 0;
+	size_t size = 0;
+	size_t i;
+	int ret;
+
+	/* a.txt, then 1 MB of zeros: far beyond 10x compression */
+	raw = calloc(1, 64 + sizes[1]);
+	assert(raw != NULL);
+	raw_len = put_u32(raw, raw_len, 3);
+	for (i = 0; i < 3; i++) {
+		raw_len = put_u32(raw, raw_len, (uint32_t)strlen(names[i]));
+		memcpy(raw + raw_len, names[i], strlen(names[i]));
+		raw_len += strlen(names[i]);
+		raw_len = put_u32(raw, raw_len, (uint32_t)sizes[i]);
+		if (i == 0) {
+			memcpy(raw + raw_len, "hello", 5);
+		}
+		raw_len += sizes[i];
+	}
+	bundle_len = compressBound((uLong)raw_len);
+	bundle = malloc(bundle_len);
+	assert(bundle != NULL);
+	ret = compress2(bundle, &bundle_len, raw, (uLong)raw_len, 9);
+	assert(ret == Z_OK);
+	assert(bundle_len * 10 < raw_len);
+
+	ret = open_test_db(&db);
+	assert(ret == 0);
+
+	/* Truncated or damaged bundles leave nothing behind */
+	ret = overlay_fs_migrate_assets(db, bundle, bundle_len / 2);
+	assert(ret == MIGRATE_ERR_CORRUPT);
+	assert(count_rows(db, "SELECT COUNT(*) FROM file_versions") == 0);
+	ret = overlay_fs_migrate_assets(db, raw, 64);
+	assert(ret == MIGRATE_ERR_DECOMPRESS);
+	assert(count_rows(db, "SELECT COUNT(*) FROM migrations") == 0);
+
+	ret = overlay_fs_migrate_assets(db, bundle, bundle_len);
+	assert(ret == MIGRATE_OK);
+	assert(count_rows(db, "SELECT entries FROM migrations") == 3);
+	ret = overlay_fs_read(db, "static/a.txt", &data, &size);
+	assert(ret == 0 && size == 5 && memcmp(data, "hello", 5) == 0);
+	free(data);
+	ret = overlay_fs_read(db, "static/zeros.bin", &data, &size);
+	assert(ret == 0 && size == sizes[1] && data[0] == 0 && data[size - 1] == 0);
+	free(data);
+	assert(overlay_fs_exists(db, "empty") == 1);
+
+	/* The same bundle again is a no-op */
+	ret = overlay_fs_migrate_assets(db, bundle, bundle_len);
+	assert(ret == MIGRATE_ERR_ALREADY_APPLIED);
+	assert(overlay_fs_version_count(db, "static/a.txt") == 1);
+
+	/* A precomputed ID is used as is; a malformed one is recomputed */
+	ret = sqlite3_prepare_v2(db, "SELECT bundle_id FROM migrations", -1,
+	                         &stmt, NULL);
+	assert(ret == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW);
+	snprintf(bundle_id, sizeof(bundle_id), "%s",
+	         (const char *)sqlite3_column_text(stmt, 0));
+	sqlite3_finalize(stmt);
+	ret = overlay_fs_migrate_assets_id(db, bundle, bundle_len, bundle_id);
+	assert(ret == MIGRATE_ERR_ALREADY_APPLIED);
+	bundle_id[0] = 'X';
+	ret = overlay_fs_migrate_assets_id(db, bundle, bundle_len, bundle_id);
+	assert(ret == MIGRATE_ERR_ALREADY_APPLIED);
+	assert(count_rows(db, "SELECT COUNT(*) FROM migrations") == 1);
+
+	overlay_fs_close(db);
+	free(bundle);
+	free(raw);
+
+	printf("  ✓ Asset bundle migration (verified: >10x ratio, errors)\n");
+}
+
+/* Hex SHA-256 of data, through the hbf_sha256 SQL function */
+static void sha256_of(sqlite3 *db, const void *data, size_t len, char *hex)
+{
+	sqlite3_stmt *stmt = NULL;
+	int ret;
+
+	ret = sqlite3_prepare_v2(db, "SELECT hbf_sha256(?)", -1, &stmt, NULL);
+	assert(ret == SQLITE_OK);
+	sqlite3_bind_blob(stmt, 1, len > 0 ? data : "", (int)len, SQLITE_STATIC);
+	assert(sqlite3_step(stmt) == SQLITE_ROW);
+	snprintf(hex, OVERLAY_FS_HASH_LEN + 1, "%s",
+	         (const char *)sqlite3_column_text(stmt, 0));
+	sqlite3_finalize(stmt);
+}
+
+static void test_migrate_table(void)
+{
+	static unsigned char text[8192];
+	static unsigned char gz[8192];
+	char digests[3][OVERLAY_FS_HASH_LEN + 1];
+	base_fs_entry_t entries[3];
+	sqlite3 *db = NULL;
+	z_stream zs;
+	unsigned char *table = NULL;
+	unsigned char *data = NULL;
+	size_t table_len = 0;
+	size_t size = 0;
+	size_t gz_len;
+	int ret, i;
+
+	for (i = 0; i < (int)sizeof(text); i++) {
+		text[i] = (unsigned char)"hello, compressible world\n"[i % 26];
+	}
+	memset(&zs, 0, sizeof(zs));
+	ret = deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+	assert(ret == Z_OK);
+	zs.next_in = text;
+	zs.avail_in = sizeof(text);
+	zs.next_out = gz;
+	zs.avail_out = sizeof(gz);
+	assert(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+	gz_len = zs.total_out;
+	deflateEnd(&zs);
+
+	ret = open_test_db(&db);
+	assert(ret == 0);
+	ret = overlay_fs_register_functions(db);
+	assert(ret == 0);
+
+	sha256_of(db, "hello", 5, digests[0]);
+	sha256_of(db, text, sizeof(text), digests[1]);
+	sha256_of(db, "", 0, digests[2]);
+	memset(entries, 0, sizeof(entries));
+	entries[0].path = "static/a.txt";
+	entries[0].data = (const unsigned char *)"hello";
+	entries[0].stored_size = entries[0].size = 5;
+	entries[1].path = "static/text.txt";
+	entries[1].data = gz;
+	entries[1].stored_size = gz_len;
+	entries[1].size = sizeof(text);
+	entries[1].gzip = 1;
+	entries[2].path = "empty";
+	entries[2].data = (const unsigned char *)"";
+	for (i = 0; i < 3; i++) {
+		entries[i].digest = digests[i];
+	}
+
+	/* Inconsistent or damaged tables leave nothing behind */
+	entries[0].size = 6;
+	ret = base_fs_build(entries, 3, &table, &table_len);
+	assert(ret == 0);
+	ret = overlay_fs_migrate_assets(db, table, table_len);
+	assert(ret == MIGRATE_ERR_CORRUPT);
+	free(table);
+	entries[0].size = 5;
+	ret = base_fs_build(entries, 3, &table, &table_len);
+	assert(ret == 0);
+	ret = overlay_fs_migrate_assets(db, table, table_len - 1);
+	assert(ret == MIGRATE_ERR_CORRUPT);
+	assert(count_rows(db, "SELECT COUNT(*) FROM file_versions") == 0);
+	assert(count_rows(db, "SELECT COUNT(*) FROM migrations") == 0);
+
+	ret = overlay_fs_migrate_assets(db, table, table_len);
+	assert(ret == MIGRATE_OK);
+	assert(count_rows(db, "SELECT entries FROM migrations") == 3);
+	ret = overlay_fs_read(db, "static/a.txt", &data, &size);
+	assert(ret == 0 && size == 5 && memcmp(data, "hello", 5) == 0);
+	free(data);
+	ret = overlay_fs_read(db, "static/text.txt", &data, &size);
+	assert(ret == 0 && size == sizeof(text) && memcmp(data, text, size) == 0);
+	free(data);
+	assert(overlay_fs_exists(db, "empty") == 1);
+
+	/* Stored as packed: gzip bytes copied, not recompressed */
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE encoding = 'gzip'") == 1);
+	assert(count_rows(db, "SELECT length(data) FROM blobs "
+	                      "WHERE encoding = 'gzip'") == (int)gz_len);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs "
+	                      "WHERE hash = hbf_sha256(CAST('hello' AS BLOB))") == 1);
+
+	ret = overlay_fs_migrate_assets(db, table, table_len);
+	assert(ret == MIGRATE_ERR_ALREADY_APPLIED);
+	assert(overlay_fs_version_count(db, "static/text.txt") == 1);
+
+	overlay_fs_close(db);
+	free(table);
+
+	printf("  ✓ File table (v2) bundle migration\n");
+}
+
+static void test_compact(void)
+{
+	overlay_fs_compact_opts_t opts = { 3, 0, 2 };
+	sqlite3 *db = NULL;
+	unsigned char *data = NULL;
+	size_t size = 0;
+	int64_t removed = -1;
+	char content[16];
+	int ret, i;
+
+	/* As hbf_db_init creates databases, so free pages can be released */
+	ret = sqlite3_open(":memory:", &db);
+	assert(ret == SQLITE_OK);
+	ret = sqlite3_exec(db, "PRAGMA auto_vacuum=INCREMENTAL", NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	ret = sqlite3_exec(db, hbf_schema_sql_ptr, NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	for (i = 1; i <= 10; i++) {
+		snprintf(content, sizeof(content), "a version %d", i);
+		ret = overlay_fs_write(db, "a.txt", (const unsigned char *)content,
+		                       strlen(content));
+		assert(ret == 0);
+	}
+	for (i = 1; i <= 2; i++) {
+		snprintf(content, sizeof(content), "b version %d", i);
+		ret = overlay_fs_write(db, "b.txt", (const unsigned char *)content,
+		                       strlen(content));
+		assert(ret == 0);
+	}
+	ret = sqlite3_exec(db, "UPDATE file_versions SET mtime = version_number * 100",
+	                   NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	/* Newest three per file, several batches for a.txt */
+	ret = overlay_fs_compact(db, &opts, &removed);
+	assert(ret == 0);
+	assert(removed == 7);
+	assert(overlay_fs_version_count(db, "a.txt") == 3);
+	assert(overlay_fs_version_count(db, "b.txt") == 2);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 5);
+	assert(count_rows(db, "PRAGMA freelist_count") == 0);
+
+	ret = overlay_fs_read(db, "a.txt", &data, &size);
+	assert(ret == 0);
+	assert(size == strlen("a version 10"));
+	assert(memcmp(data, "a version 10", size) == 0);
+	free(data);
+
+	/* Anything at or after keep_since stays */
+	opts.keep_versions = 1;
+	opts.keep_since = 200;
+	opts.batch = 0;
+	ret = overlay_fs_compact(db, &opts, &removed);
+	assert(ret == 0);
+	assert(removed == 1);
+	assert(overlay_fs_version_count(db, "a.txt") == 3);
+	assert(overlay_fs_version_count(db, "b.txt") == 1);
+
+	/* The latest version always stays */
+	opts.keep_since = 0;
+	ret = overlay_fs_compact(db, &opts, &removed);
+	assert(ret == 0);
+	assert(removed == 2);
+	assert(overlay_fs_version_count(db, "a.txt") == 1);
+	assert(overlay_fs_version_count(db, "b.txt") == 1);
+	assert(count_rows(db, "SELECT COUNT(*) FROM latest_files_meta") == 2);
+	assert(count_rows(db, "SELECT COUNT(*) FROM blobs") == 2);
+
+	/* Invalid policy, and no compaction inside a transaction */
+	opts.keep_versions = 0;
+	assert(overlay_fs_compact(db, &opts, NULL) == -1);
+	opts.keep_versions = 1;
+	ret = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+	assert(overlay_fs_compact(db, &opts, NULL) == -1);
+	ret = sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+	assert(ret == SQLITE_OK);
+
+	overlay_fs_close(db);
+
+	printf("  ✓ Version history compaction\n");
+}
+
 int main(void)
 {
 	/* Initialize logging */
@@ -269,6 +835,14 @@ int main(void)
 	test_multiple_files();
 	test_empty_file();
 	test_large_file();
+	test_blob_dedup();
+	test_upgrade_inline_data();
+	test_compression();
+	test_upgrade_blob_encoding();
+	test_upgrade_blob_column_order();
+	test_migrate_assets();
+	test_migrate_table();
+	test_compact();
 
 	printf("\n✅ All tests passed\n");
 	return 0;
@@ -2,17 +2,35 @@
 -- Versioned file system schema for overlay_fs
 -- Each file write creates a new version; reads get the latest version
 
+-- Content-addressed file contents: identical data is stored once, however
+-- many versions or paths refer to it. The hash doubles as a strong ETag.
+-- Compressible text is stored gzip-compressed and served as is to clients
+-- that accept gzip; file_versions.size is always the uncompressed size.
+-- encoding precedes data so that reading it never walks a large BLOB's
+-- overflow pages; older layouts are rebuilt on open
+-- (overlay_fs_upgrade_schema)
+CREATE TABLE IF NOT EXISTS blobs (
+    hash      TEXT PRIMARY KEY,  -- SHA-256 of the uncompressed content, lowercase hex (hbf_sha256())
+    encoding  TEXT NOT NULL DEFAULT 'identity',  -- 'identity' or 'gzip'
+    data      BLOB NOT NULL      -- Content, encoded as above
+);
+
 -- File versions table - stores all versions of all files
+-- Databases that kept data inline here are converted on open
+-- (overlay_fs_upgrade_schema)
 CREATE TABLE IF NOT EXISTS file_versions (
     file_id         INTEGER NOT NULL,    -- Unique ID for each file path
     path            TEXT NOT NULL,       -- Full file path
     version_number  INTEGER NOT NULL,    -- Version counter for this file_id
     mtime           INTEGER NOT NULL,    -- Unix timestamp
     size            INTEGER NOT NULL,    -- File size in bytes (pre-computed for performance)
-    data            BLOB NOT NULL,       -- Uncompressed content
+    hash            TEXT NOT NULL REFERENCES blobs(hash), -- Content
     PRIMARY KEY (file_id, version_number)
 ) WITHOUT ROWID;
 
+-- Index to find the remaining users of a blob
+CREATE INDEX IF NOT EXISTS idx_file_versions_hash ON file_versions(hash);
+
 -- Index for fast path lookups (path -> file_id)
 CREATE INDEX IF NOT EXISTS idx_file_versions_path ON file_versions(path);
 
@@ -33,43 +51,6 @@ CREATE TABLE IF NOT EXISTS file_ids (
     path     TEXT NOT NULL UNIQUE
 );
 
--- View to get latest version of each file
-CREATE VIEW IF NOT EXISTS latest_files AS
-WITH latest_versions AS (
-    SELECT file_id, MAX(version_number) as max_version
-    FROM file_versions
-    GROUP BY file_id
-)
-SELECT
-    fv.file_id,
-    fv.path,
-    fv.version_number,
-    fv.mtime,
-    fv.size,
-    fv.data
-FROM file_versions fv
-INNER JOIN latest_versions lv
-    ON fv.file_id = lv.file_id
-    AND fv.version_number = lv.max_version;
-
--- View to get latest file metadata WITHOUT data blobs (fast for listings)
-CREATE VIEW IF NOT EXISTS latest_files_metadata AS
-WITH latest_versions AS (
-    SELECT file_id, MAX(version_number) as max_version
-    FROM file_versions
-    GROUP BY file_id
-)
-SELECT
-    fv.file_id,
-    fv.path,
-    fv.version_number,
-    fv.mtime,
-    fv.size
-FROM file_versions fv
-INNER JOIN latest_versions lv
-    ON fv.file_id = lv.file_id
-    AND fv.version_number = lv.max_version;
-
 -- Materialized latest metadata for faster listings
 CREATE TABLE IF NOT EXISTS latest_files_meta (
     file_id        INTEGER PRIMARY KEY,
@@ -134,6 +115,52 @@ BEGIN
       AND NOT EXISTS (SELECT 1 FROM file_versions WHERE file_id = OLD.file_id);
 END;
 
+-- Drop contents no version refers to any more
+CREATE TRIGGER IF NOT EXISTS trg_file_versions_blob_ad
+AFTER DELETE ON file_versions
+BEGIN
+    DELETE FROM blobs
+    WHERE hash = OLD.hash
+      AND NOT EXISTS (SELECT 1 FROM file_versions WHERE hash = OLD.hash);
+END;
+
+-- View to get latest version of each file: an index lookup in
+-- latest_files_meta plus primary key probes into file_versions and blobs,
+-- so reads by path stay flat as version history grows (CROSS JOIN pins
+-- that order).
+-- Dropped and recreated so databases with the former GROUP BY definition
+-- pick it up on open.
+DROP VIEW IF EXISTS latest_files;
+CREATE VIEW latest_files AS
+SELECT
+    lm.file_id,
+    lm.path,
+    lm.version_number,
+    lm.mtime,
+    lm.size,
+    b.data,
+    fv.hash,
+    b.encoding
+FROM latest_files_meta lm
+CROSS JOIN file_versions fv
+    ON fv.file_id = lm.file_id
+    AND fv.version_number = lm.version_number
+CROSS JOIN blobs b
+    ON b.hash = fv.hash;
+
+-- View to get latest file metadata WITHOUT data blobs (fast for listings)
+DROP VIEW IF EXISTS latest_files_metadata;
+CREATE VIEW latest_files_metadata AS
+SELECT file_id, path, version_number, mtime, size
+FROM latest_files_meta;
+
+-- Compiled module bytecode is cached in memory only: QuickJS loads
+-- bytecode unchecked, and handler SQL could rewrite a table holding it.
+-- Drop the persistent cache of earlier versions.
+DROP TRIGGER IF EXISTS trg_file_versions_bytecode_ai;
+DROP TRIGGER IF EXISTS trg_file_versions_bytecode_ad;
+DROP TABLE IF EXISTS bytecode_cache;
+
 -- Migration tracking table for asset bundles
 CREATE TABLE IF NOT EXISTS migrations (
     bundle_id   TEXT PRIMARY KEY,  -- SHA256 hash of compressed bundle
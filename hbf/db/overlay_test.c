@@ -181,10 +181,23 @@ static void test_file_versions_basic(void)
 
 	printf("  ✓ Retrieved file_id: %d\n", file_id);
 
+	/* Insert the contents */
+	const char *insert_blob_sql =
+		"INSERT OR IGNORE INTO blobs (hash, data) VALUES (hbf_sha256(?1), ?1)";
+
+	rc = sqlite3_prepare_v2(db, insert_blob_sql, -1, &stmt, NULL);
+	assert(rc == SQLITE_OK);
+
+	sqlite3_bind_blob(stmt, 1, test_content, (int)strlen(test_content), SQLITE_STATIC);
+
+	rc = sqlite3_step(stmt);
+	assert(rc == SQLITE_DONE);
+	sqlite3_finalize(stmt);
+
 	/* Insert a version */
 	const char *insert_version_sql =
-		"INSERT INTO file_versions (file_id, path, version_number, mtime, size, data) "
-		"VALUES (?, ?, 1, 1234567890, ?, ?)";
+		"INSERT INTO file_versions (file_id, path, version_number, mtime, size, hash) "
+		"VALUES (?, ?, 1, 1234567890, ?, hbf_sha256(?))";
 
 	rc = sqlite3_prepare_v2(db, insert_version_sql, -1, &stmt, NULL);
 	assert(rc == SQLITE_OK);
@@ -0,0 +1,259 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF prepared statement cache
+ */
+
+#include "hbf/db/stmt_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbf/shell/log.h"
+
+/* Idle statement, linked into its connection's LRU list */
+typedef struct hbf_db_stmt_entry {
+	struct hbf_db_stmt_entry *prev; /* Towards most recently used */
+	struct hbf_db_stmt_entry *next; /* Towards least recently used */
+	uint32_t hash;
+	sqlite3_stmt *stmt;
+} hbf_db_stmt_entry_t;
+
+/* Cache of one connection */
+typedef struct hbf_db_stmt_cache {
+	struct hbf_db_stmt_cache *next;
+	sqlite3 *db;
+	hbf_db_stmt_entry_t *head; /* Most recently used */
+	hbf_db_stmt_entry_t *tail; /* Least recently used */
+	unsigned int count;
+	uint64_t hits;
+	uint64_t misses;
+} hbf_db_stmt_cache_t;
+
+static struct {
+	pthread_mutex_t lock;
+	hbf_db_stmt_cache_t *caches;
+	unsigned int capacity;
+} g_stmt_cache = { PTHREAD_MUTEX_INITIALIZER, NULL,
+		   HBF_DB_STMT_CACHE_CAPACITY };
+
+/* FNV-1a hash of SQL text */
+static uint32_t hbf_db_stmt_hash(const char *sql)
+{
+	uint32_t h = 2166136261u;
+
+	while (*sql) {
+		h ^= (unsigned char)*sql++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/* Find (or create) the cache of db; lock must be held */
+static hbf_db_stmt_cache_t *hbf_db_stmt_cache_find(sqlite3 *db, int create)
+{
+	hbf_db_stmt_cache_t *cache;
+
+	for (cache = g_stmt_cache.caches; cache; cache = cache->next) {
+		if (cache->db == db) {
+			return cache;
+		}
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	cache = (hbf_db_stmt_cache_t *)calloc(1, sizeof(*cache));
+	if (!cache) {
+		return NULL;
+	}
+
+	cache->db = db;
+	cache->next = g_stmt_cache.caches;
+	g_stmt_cache.caches = cache;
+
+	return cache;
+}
+
+static void hbf_db_stmt_unlink(hbf_db_stmt_cache_t *cache,
+			       hbf_db_stmt_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+	cache->count--;
+}
+
+void hbf_db_stmt_cache_set_capacity(unsigned int capacity)
+{
+	pthread_mutex_lock(&g_stmt_cache.lock);
+	g_stmt_cache.capacity = capacity;
+	pthread_mutex_unlock(&g_stmt_cache.lock);
+
+	hbf_log_debug("Statement cache capacity: %u", capacity);
+}
+
+sqlite3_stmt *hbf_db_stmt_cache_acquire(sqlite3 *db, const char *sql)
+{
+	hbf_db_stmt_cache_t *cache;
+	hbf_db_stmt_entry_t *entry;
+	sqlite3_stmt *stmt = NULL;
+	uint32_t hash;
+	int rc;
+
+	if (!db || !sql) {
+		return NULL;
+	}
+
+	hash = hbf_db_stmt_hash(sql);
+
+	pthread_mutex_lock(&g_stmt_cache.lock);
+	cache = hbf_db_stmt_cache_find(db, 1);
+	if (cache) {
+		for (entry = cache->head; entry; entry = entry->next) {
+			if (entry->hash == hash &&
+			    strcmp(sqlite3_sql(entry->stmt), sql) == 0) {
+				hbf_db_stmt_unlink(cache, entry);
+				stmt = entry->stmt;
+				free(entry);
+				break;
+			}
+		}
+
+		if (stmt) {
+			cache->hits++;
+		} else {
+			cache->misses++;
+		}
+	}
+	pthread_mutex_unlock(&g_stmt_cache.lock);
+
+	if (stmt) {
+		return stmt;
+	}
+
+	/* Prepare outside the lock; planning is the expensive part */
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+
+	return stmt;
+}
+
+void hbf_db_stmt_cache_release(sqlite3 *db, sqlite3_stmt *stmt)
+{
+	hbf_db_stmt_cache_t *cache;
+	hbf_db_stmt_entry_t *entry;
+	sqlite3_stmt *evicted = NULL;
+	const char *sql;
+
+	if (!stmt) {
+		return;
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	sql = sqlite3_sql(stmt);
+	entry = (hbf_db_stmt_entry_t *)malloc(sizeof(*entry));
+	if (!db || !sql || !entry) {
+		free(entry);
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	entry->hash = hbf_db_stmt_hash(sql);
+	entry->stmt = stmt;
+	entry->prev = NULL;
+
+	pthread_mutex_lock(&g_stmt_cache.lock);
+	cache = hbf_db_stmt_cache_find(db, 1);
+	if (!cache || g_stmt_cache.capacity == 0) {
+		pthread_mutex_unlock(&g_stmt_cache.lock);
+		free(entry);
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	entry->next = cache->head;
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+	cache->head = entry;
+	cache->count++;
+
+	/* Evict one at a time; capacity shrinks drain over later releases */
+	if (cache->count > g_stmt_cache.capacity) {
+		hbf_db_stmt_entry_t *lru = cache->tail;
+
+		hbf_db_stmt_unlink(cache, lru);
+		evicted = lru->stmt;
+		free(lru);
+	}
+	pthread_mutex_unlock(&g_stmt_cache.lock);
+
+	if (evicted) {
+		sqlite3_finalize(evicted);
+	}
+}
+
+void hbf_db_stmt_cache_clear(sqlite3 *db)
+{
+	hbf_db_stmt_cache_t **link;
+	hbf_db_stmt_cache_t *cache = NULL;
+	hbf_db_stmt_entry_t *entry;
+
+	pthread_mutex_lock(&g_stmt_cache.lock);
+	for (link = &g_stmt_cache.caches; *link; link = &(*link)->next) {
+		if ((*link)->db == db) {
+			cache = *link;
+			*link = cache->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_stmt_cache.lock);
+
+	if (!cache) {
+		return;
+	}
+
+	while (cache->head) {
+		entry = cache->head;
+		cache->head = entry->next;
+		sqlite3_finalize(entry->stmt);
+		free(entry);
+	}
+
+	hbf_log_debug("Statement cache cleared (%llu hits, %llu misses)",
+		      (unsigned long long)cache->hits,
+		      (unsigned long long)cache->misses);
+	free(cache);
+}
+
+void hbf_db_stmt_cache_stats(sqlite3 *db, uint64_t *hits, uint64_t *misses)
+{
+	hbf_db_stmt_cache_t *cache;
+
+	pthread_mutex_lock(&g_stmt_cache.lock);
+	cache = hbf_db_stmt_cache_find(db, 0);
+	if (hits) {
+		*hits = cache ? cache->hits : 0;
+	}
+	if (misses) {
+		*misses = cache ? cache->misses : 0;
+	}
+	pthread_mutex_unlock(&g_stmt_cache.lock);
+}
@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF prepared statement cache
+ *
+ * Per-connection LRU of prepared statements keyed by SQL text. The main
+ * connection is shared by all worker threads, so a statement is checked
+ * out of the cache while in use and returned (reset, bindings cleared)
+ * afterwards; two threads running the same SQL each get their own.
+ */
+
+#ifndef HBF_DB_STMT_CACHE_H
+#define HBF_DB_STMT_CACHE_H
+
+#include <sqlite3.h>
+#include <stdint.h>
+
+/* Default number of idle statements kept per connection */
+#define HBF_DB_STMT_CACHE_CAPACITY 64
+
+/*
+ * Set the number of idle statements kept per connection (0 = no caching).
+ * Applies to all connections; excess statements are finalized lazily.
+ */
+void hbf_db_stmt_cache_set_capacity(unsigned int capacity);
+
+/*
+ * Check out a prepared statement for sql on db.
+ * Reuses an idle cached statement when possible, otherwise prepares one.
+ * Returns statement (return it with hbf_db_stmt_cache_release) or NULL on
+ * error (details in sqlite3_errmsg(db)).
+ */
+sqlite3_stmt *hbf_db_stmt_cache_acquire(sqlite3 *db, const char *sql);
+
+/*
+ * Return a statement obtained from hbf_db_stmt_cache_acquire.
+ * The statement is reset and its bindings cleared before it is cached;
+ * the least recently used idle statement is finalized when full.
+ */
+void hbf_db_stmt_cache_release(sqlite3 *db, sqlite3_stmt *stmt);
+
+/*
+ * Finalize all idle statements of db and forget its cache.
+ * Must be called before sqlite3_close(db); hbf_db_close() does this.
+ */
+void hbf_db_stmt_cache_clear(sqlite3 *db);
+
+/* Hit/miss counters for db (any pointer may be NULL) */
+void hbf_db_stmt_cache_stats(sqlite3 *db, uint64_t *hits, uint64_t *misses);
+
+#endif /* HBF_DB_STMT_CACHE_H */
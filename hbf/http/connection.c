@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: MIT */
+#include "hbf/http/connection.h"
+
+#include <civetweb.h>
+#include <string.h>
+#include <strings.h>
+
+/* 1 if a comma-separated header value lists token (case-insensitive) */
+static int header_has_token(const char *header, const char *token)
+{
+	size_t len = strlen(token);
+	const char *p = header;
+	size_t n;
+
+	while (*p) {
+		while (*p == ' ' || *p == '\t' || *p == ',') {
+			p++;
+		}
+		n = strcspn(p, " \t,");
+		if (n == len && strncasecmp(p, token, len) == 0) {
+			return 1;
+		}
+		p += n;
+		p += strcspn(p, ",");
+	}
+
+	return 0;
+}
+
+const char *hbf_http_connection(const struct mg_connection *conn)
+{
+	const struct mg_request_info *ri = mg_get_request_info(conn);
+	const char *enabled = mg_get_option(mg_get_context(conn),
+					    "enable_keep_alive");
+	const char *header = mg_get_header(conn, "Connection");
+
+	if (!ri || !enabled || strcmp(enabled, "yes") != 0) {
+		return "close";
+	}
+	if (header) {
+		return header_has_token(header, "keep-alive") ? "keep-alive" :
+								"close";
+	}
+	if (!ri->http_version || strcmp(ri->http_version, "1.1") != 0) {
+		return "close";
+	}
+
+	return "keep-alive";
+}
+
+void hbf_http_close(struct mg_connection *conn)
+{
+	if (conn) {
+		mg_close_connection(conn);
+	}
+}
+
+int hbf_http_is_head(const struct mg_connection *conn)
+{
+	const struct mg_request_info *ri = mg_get_request_info(conn);
+
+	return ri && ri->request_method &&
+	       strcmp(ri->request_method, "HEAD") == 0;
+}
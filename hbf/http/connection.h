@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef HBF_HTTP_CONNECTION_H
+#define HBF_HTTP_CONNECTION_H
+
+struct mg_connection;
+
+/*
+ * Connection header value for a response written by a handler
+ *
+ * Mirrors CivetWeb's own choice of keeping the connection open once the
+ * handler returns: enable_keep_alive must be on, and the request must be
+ * HTTP/1.1 without a Connection header or list keep-alive in it.
+ * Handlers that write their own status line send this so that clients
+ * (HTTP/1.0 ones in particular) know whether to reuse the connection.
+ *
+ * @param conn: Connection being answered
+ * @return "keep-alive" or "close"
+ */
+const char *hbf_http_connection(const struct mg_connection *conn);
+
+/*
+ * Whether the request is HEAD
+ *
+ * Handlers that write their own responses send the headers of the GET
+ * response, Content-Length included, and no body: on a kept-alive
+ * connection the client reads the next response right after the headers.
+ *
+ * @param conn: Connection being answered
+ * @return 1 for HEAD, 0 otherwise
+ */
+int hbf_http_is_head(const struct mg_connection *conn);
+
+/*
+ * Close the connection now that the response is complete
+ *
+ * For bodies whose end only the close can signal: unframed HTTP/1.0
+ * streams, and responses that failed after their headers went out.
+ * Headers not yet sent should say "Connection: close" so the client does
+ * not expect a keep-alive. mg_close_connection() flushes and shuts the
+ * socket and marks the connection, so CivetWeb leaves its keep-alive loop
+ * once the handler returns; nothing may be written to conn afterwards.
+ *
+ * @param conn: Connection being answered
+ */
+void hbf_http_close(struct mg_connection *conn);
+
+#endif /* HBF_HTTP_CONNECTION_H */
@@ -2,10 +2,8 @@
 #include "hbf/http/handler.h"
 #include "hbf/http/server.h"
 #include <stdlib.h>
-#include <pthread.h>
 
 #include "hbf/shell/log.h"
-#include "hbf/db/overlay_fs.h"
 #include "hbf/qjs/bindings/request.h"
 #include "hbf/qjs/bindings/response.h"
 #include "hbf/qjs/engine.h"
@@ -13,17 +11,22 @@
 #include "sqlite3.h"
 
 /*
- * Handler mutex to prevent QuickJS malloc contention
+ * Threading model
  *
- * The crash was caused by heap corruption from malloc contention when
- * multiple threads simultaneously created/destroyed QuickJS contexts.
- * This mutex serializes QuickJS context creation/destruction, eliminating
- * the malloc contention while allowing SQLite to handle concurrency with
- * its built-in locking (SQLITE_THREADSAFE=1 + WAL mode).
+ * Handlers run concurrently on all CivetWeb worker threads. Each worker
+ * owns its JSRuntime (see hbf_qjs_ctx_acquire), and a JSRuntime is never
+ * touched by more than one thread, so no lock is held around JS execution.
+ * The only state shared between workers is the SQLite connection, which
+ * is opened in serialized mode (SQLITE_THREADSAFE=1) with WAL. Its
+ * transaction state is shared too, so a request that runs BEGIN holds the
+ * writer until COMMIT/ROLLBACK or until its context is released (see
+ * hbf_db_pool_writer_enter); other requests' writes wait meanwhile.
  *
- * Static file serving remains parallel (no mutex) since it doesn't use QuickJS.
+ * The heap corruption previously worked around with a global handler
+ * mutex came from the response class ID being reset and re-allocated on
+ * every context creation while other threads were still using it; see
+ * hbf_qjs_init_response_class().
  */
-static pthread_mutex_t handler_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* QuickJS request handler */
 /* NOLINTNEXTLINE(readability-function-cognitive-complexity) - Complex request handling logic */
@@ -35,7 +38,7 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 	JSValue global, app, handle_func, req, res, result;
 	hbf_response_t response;
 	int status;
-	int mutex_locked = 0;
+	int streamed;
 	/* cbdata is expected to be hbf_server_t* for access to db */
 	hbf_server_t *server = (hbf_server_t *)cbdata;
 
@@ -49,26 +52,13 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 	hbf_log_debug("QuickJS handler: %s %s", ri->request_method, ri->local_uri);
 
 	/*
-	 * CRITICAL: Lock mutex BEFORE creating QuickJS context to prevent malloc contention.
-	 * The mutex serializes context creation/destruction across threads, eliminating
-	 * heap corruption from concurrent malloc/free operations in QuickJS.
+	 * Acquire a fresh JSContext on this worker thread's pooled JSRuntime.
+	 * Contexts are never reused between requests (complete JS isolation);
+	 * only the runtime is kept warm and recycled per the engine's policy.
 	 */
-	pthread_mutex_lock(&handler_mutex);
-	mutex_locked = 1;
-	hbf_log_debug("Handler mutex locked");
-
-	/*
-	 * CRITICAL: Create a fresh JSRuntime + JSContext for each request.
-	 * This prevents stack overflow errors and ensures complete isolation.
-	 * DO NOT reuse contexts between requests - this is a QuickJS best practice.
-	 */
-	qjs_ctx = hbf_qjs_ctx_create_with_db(server ? server->db : NULL);
+	qjs_ctx = hbf_qjs_ctx_acquire(server ? server->db : NULL);
 	if (!qjs_ctx) {
 		hbf_log_error("Failed to create QuickJS context for request");
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
@@ -76,65 +66,43 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 	ctx = (JSContext *)hbf_qjs_get_js_context(qjs_ctx);
 	if (!ctx) {
 		hbf_log_error("Failed to get JS context");
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
 
-		/* Load hbf/server.js from database */
-		unsigned char *js_data = NULL;
-		size_t js_size = 0;
-		int ret = overlay_fs_read_file("hbf/server.js", 1, &js_data, &js_size);
-		if (ret != 0 || !js_data || js_size == 0) {
+	/* Load hbf/server.js as an ES module (precompiled bytecode when cached) */
+	{
+		int ret = hbf_qjs_eval_module_path(qjs_ctx, "hbf/server.js");
+		if (ret == -2) {
 			hbf_log_error("hbf/server.js not found in database");
-			hbf_qjs_ctx_destroy(qjs_ctx);
-			if (mutex_locked) {
-				pthread_mutex_unlock(&handler_mutex);
-				hbf_log_debug("Handler mutex unlocked (early exit)");
-			}
+			hbf_qjs_ctx_release(qjs_ctx);
 			mg_send_http_error(conn, 503, "Service Unavailable");
 			return 503;
 		}
-		/* Load server.js as an ES module to support static imports */
-		ret = hbf_qjs_eval_module(qjs_ctx, (const char *)js_data, js_size, "hbf/server.js");
-		free(js_data);
 		if (ret != 0) {
 			hbf_log_error("Failed to load hbf/server.js: %s", hbf_qjs_get_error(qjs_ctx));
-			hbf_qjs_ctx_destroy(qjs_ctx);
-			if (mutex_locked) {
-				pthread_mutex_unlock(&handler_mutex);
-				hbf_log_debug("Handler mutex unlocked (early exit)");
-			}
+			hbf_qjs_ctx_release(qjs_ctx);
 			mg_send_http_error(conn, 500, "Internal Server Error");
 			return 500;
 		}
+	}
 
 	/* Create request and response objects */
 	req = hbf_qjs_create_request(ctx, conn);
 	if (JS_IsException(req) || JS_IsNull(req)) {
 		hbf_log_error("Failed to create request object");
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
 
 	res = hbf_qjs_create_response(ctx, &response);
+	response.conn = conn; /* Enables res.write() streaming */
 	if (JS_IsException(res) || JS_IsNull(res)) {
 		hbf_log_error("Failed to create response object");
 		JS_FreeValue(ctx, req);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
@@ -147,11 +115,7 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, res);
 		JS_FreeValue(ctx, req);
 		hbf_response_free(&response);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
@@ -168,11 +132,7 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, req);
 		JS_FreeValue(ctx, global);
 		hbf_response_free(&response);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 503, "Service Unavailable");
 		return 503;
 	}
@@ -184,11 +144,7 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, req);
 		JS_FreeValue(ctx, global);
 		hbf_response_free(&response);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 503, "Service Unavailable");
 		return 503;
 	}
@@ -204,11 +160,7 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, req);
 		JS_FreeValue(ctx, global);
 		hbf_response_free(&response);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
@@ -222,16 +174,12 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, req);
 		JS_FreeValue(ctx, global);
 		hbf_response_free(&response);
-		hbf_qjs_ctx_destroy(qjs_ctx);
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (early exit)");
-		}
+		hbf_qjs_ctx_release(qjs_ctx);
 		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
 
-	/* Call app.handle(req, res) - no mutex needed (isolated context) */
+	/* Call app.handle(req, res) - no lock needed (worker-owned runtime) */
 	{
 		JSValue args[2];
 		args[0] = req;
@@ -246,20 +194,47 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		hbf_log_debug("Calling JS_Call (handle_func=%p, app=%p, argc=2)...", (void*)handle_func.u.ptr, (void*)app.u.ptr);
 		result = JS_Call(ctx, handle_func, app, 2, args);
 		hbf_log_debug("JS_Call returned (result=%p)", (void*)result.u.ptr);
+	}
+
+	/*
+	 * Async handlers: keep running promise jobs and timers until the
+	 * returned promise settles and res.send() has been called. The
+	 * execution timeout set by hbf_qjs_begin_exec() spans this whole loop.
+	 */
+	if (!JS_IsException(result)) {
+		int loop_status = hbf_qjs_run_event_loop(qjs_ctx, result,
+							 &response.sent);
+
+		if (loop_status != 0) {
+			if (loop_status == -2) {
+				hbf_log_error("Request handler timed out: %s %s",
+					      ri->request_method, ri->local_uri);
+			} else {
+				hbf_log_error("JavaScript error in request handler: %s",
+					      hbf_qjs_get_error(qjs_ctx) ?
+						      hbf_qjs_get_error(qjs_ctx) :
+						      "unknown");
+			}
+
+			JS_FreeValue(ctx, result);
+			JS_FreeValue(ctx, handle_func);
+			JS_FreeValue(ctx, app);
+			JS_FreeValue(ctx, res);
+			JS_FreeValue(ctx, req);
+			JS_FreeValue(ctx, global);
+			/* Headers already went out: cut the stream short */
+			streamed = response.streaming;
+			if (streamed) {
+				hbf_response_abort(conn, &response);
+			}
+			hbf_response_free(&response);
+			hbf_qjs_ctx_release(qjs_ctx);
 
-		/* Run QuickJS job queue to resolve promises (dynamic import, etc.) */
-		JSRuntime *rt = JS_GetRuntime(ctx);
-		int jobs_executed = 0;
-		JSContext *last_ctx = NULL;
-		while (JS_IsJobPending(rt)) {
-			int job_status = JS_ExecutePendingJob(rt, &last_ctx);
-			if (job_status < 0) {
-				hbf_log_error("QuickJS job execution error");
-				break;
+			if (!streamed) {
+				mg_send_http_error(conn, 500, "Internal Server Error");
 			}
-			jobs_executed++;
+			return 500;
 		}
-		hbf_log_debug("Executed %d pending jobs after JS_Call", jobs_executed);
 	}
 
 	/* Check for JavaScript error */
@@ -311,17 +286,18 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 		JS_FreeValue(ctx, res);
 		JS_FreeValue(ctx, req);
 		JS_FreeValue(ctx, global);
+		streamed = response.streaming;
+		if (streamed) {
+			hbf_response_abort(conn, &response);
+		}
 		hbf_response_free(&response);
 
 		/* Destroy context after error */
-		hbf_qjs_ctx_destroy(qjs_ctx);
+		hbf_qjs_ctx_release(qjs_ctx);
 
-		if (mutex_locked) {
-			pthread_mutex_unlock(&handler_mutex);
-			hbf_log_debug("Handler mutex unlocked (error exit)");
+		if (!streamed) {
+			mg_send_http_error(conn, 500, "Internal Server Error");
 		}
-
-		mg_send_http_error(conn, 500, "Internal Server Error");
 		return 500;
 	}
 
@@ -338,18 +314,8 @@ int hbf_qjs_request_handler(struct mg_connection *conn, void *cbdata)
 	JS_FreeValue(ctx, global);
 	hbf_response_free(&response);
 
-	/* Destroy the context and runtime (per-request isolation) */
-	hbf_qjs_ctx_destroy(qjs_ctx);
-
-	/*
-	 * Unlock mutex AFTER destroying QuickJS context.
-	 * This ensures malloc contention is eliminated by serializing
-	 * the entire lifecycle of QuickJS context creation and destruction.
-	 */
-	if (mutex_locked) {
-		pthread_mutex_unlock(&handler_mutex);
-		hbf_log_debug("Handler mutex unlocked (success)");
-	}
+	/* Release the context; the runtime returns to the worker pool */
+	hbf_qjs_ctx_release(qjs_ctx);
 
 	return status;
 }
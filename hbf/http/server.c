@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: MIT */
 #include "server.h"
 #include "hbf/http/handler.h"
+#include "hbf/http/connection.h"
 #include "hbf/shell/log.h"
 #include "hbf/db/overlay_fs.h"
 #include "hbf/db/db.h"
@@ -8,6 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
 
 
@@ -59,6 +62,539 @@ static const char *get_mime_type(const char *path)
 	return "application/octet-stream";
 }
 
+/* 1 if an Accept-Encoding element's parameters (up to end) set q=0 */
+static int accept_qvalue_zero(const char *params, const char *end)
+{
+	const char *q;
+
+	for (q = params; q + 1 < end; q++) {
+		if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+			for (q += 2; q < end && (*q == '0' || *q == '.'); q++) {
+			}
+			return q == end || *q == ' ' || *q == '\t' || *q == ';';
+		}
+	}
+
+	return 0;
+}
+
+/* 1 if an Accept-Encoding header value allows a gzip response */
+static int accepts_gzip(const char *header)
+{
+	const char *p = header;
+	int gzip = -1; /* Not listed */
+	int any = 0;
+
+	if (!header) {
+		return 0;
+	}
+
+	while (*p) {
+		const char *end = strchr(p, ',');
+		size_t len;
+
+		if (!end) {
+			end = p + strlen(p);
+		}
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+		len = strcspn(p, " \t;,");
+
+		if (len == 4 && strncasecmp(p, "gzip", 4) == 0) {
+			gzip = !accept_qvalue_zero(p + len, end);
+		} else if (len == 1 && *p == '*') {
+			any = !accept_qvalue_zero(p + len, end);
+		}
+
+		p = *end ? end + 1 : end;
+	}
+
+	return gzip >= 0 ? gzip : any;
+}
+
+/* Static responses may be cached, then revalidated with ETag/Last-Modified */
+#define STATIC_CACHE_CONTROL "Cache-Control: public, max-age=3600\r\n"
+
+static const char *const http_days[] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+static const char *const http_months[] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* Format Unix time t as an HTTP-date (IMF-fixdate) */
+static void format_http_date(char *buf, size_t len, int64_t t)
+{
+	time_t tt = (time_t)t;
+	struct tm tm;
+
+	if (!gmtime_r(&tt, &tm)) {
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_mday = 1;
+		tm.tm_year = 70;
+		tm.tm_wday = 4;
+	}
+
+	snprintf(buf, len, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+	         http_days[tm.tm_wday], tm.tm_mday, http_months[tm.tm_mon],
+	         tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static int64_t days_from_civil(int64_t y, int64_t m, int64_t d)
+{
+	int64_t era;
+	int64_t yoe;
+	int64_t doy;
+	int64_t doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+/* Parse an IMF-fixdate HTTP-date; returns -1 if malformed */
+static int64_t parse_http_date(const char *s)
+{
+	char month[4];
+	int day, year, hour, min, sec;
+	int m;
+
+	if (sscanf(s, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month,
+	           &year, &hour, &min, &sec) != 6) {
+		return -1;
+	}
+
+	for (m = 0; m < 12; m++) {
+		if (strcmp(month, http_months[m]) == 0) {
+			break;
+		}
+	}
+	if (m == 12 || day < 1 || day > 31 || hour > 23 || min > 59 ||
+	    sec > 60) {
+		return -1;
+	}
+
+	return days_from_civil(year, m + 1, day) * 86400 +
+	       hour * 3600 + min * 60 + sec;
+}
+
+/* 1 if an If-None-Match value is "*" or lists etag (weak comparison) */
+static int etag_matches(const char *header, const char *etag)
+{
+	const char *p = header;
+	size_t len = strlen(etag);
+
+	while (*p) {
+		while (*p == ' ' || *p == '\t' || *p == ',') {
+			p++;
+		}
+		if (*p == '*') {
+			return 1;
+		}
+		if (strncmp(p, "W/", 2) == 0) {
+			p += 2;
+		}
+		if (strncmp(p, etag, len) == 0 &&
+		    (p[len] == '\0' || p[len] == ',' || p[len] == ' ' ||
+		     p[len] == '\t')) {
+			return 1;
+		}
+		p += strcspn(p, ",");
+	}
+
+	return 0;
+}
+
+/* Quoted ETag plus NUL: "<hash>" or, for the gzip form, "<hash>-gz" */
+#define STATIC_ETAG_SIZE (OVERLAY_FS_HASH_LEN + 6)
+
+/*
+ * Strong ETag of one representation of a file. The gzip and identity
+ * forms differ byte for byte, so they must not share a strong validator.
+ */
+static void format_etag(char *buf, size_t len, const char *hash, int gzip)
+{
+	snprintf(buf, len, "\"%s%s\"", hash, gzip ? "-gz" : "");
+}
+
+/*
+ * Answer a conditional GET with 304 if the client's copy is current.
+ * If-None-Match takes precedence over If-Modified-Since (RFC 9110).
+ * Validators are those of the representation a 200 would carry: the gzip
+ * form's ETag for clients that accept gzip of a gzip-stored file, the
+ * identity ETag otherwise.
+ */
+static int send_not_modified(struct mg_connection *conn, const char *path,
+                             const overlay_fs_stat_t *st, int accept_gzip)
+{
+	const char *if_none_match = mg_get_header(conn, "If-None-Match");
+	const char *if_modified_since = mg_get_header(conn, "If-Modified-Since");
+	char etag[STATIC_ETAG_SIZE];
+	char last_modified[64];
+	int64_t since;
+
+	if (!if_none_match && !if_modified_since) {
+		return 0;
+	}
+	if (!st->hash[0]) {
+		return 0;
+	}
+
+	format_etag(etag, sizeof(etag), st->hash, st->gzip && accept_gzip);
+	if (if_none_match) {
+		if (!etag_matches(if_none_match, etag)) {
+			return 0;
+		}
+	} else {
+		since = parse_http_date(if_modified_since);
+		if (since < 0 || st->mtime > since) {
+			return 0;
+		}
+	}
+
+	format_http_date(last_modified, sizeof(last_modified), st->mtime);
+	mg_printf(conn,
+	          "HTTP/1.1 304 Not Modified\r\n"
+	          "ETag: %s\r\n"
+	          "Last-Modified: %s\r\n"
+	          "Vary: Accept-Encoding\r\n"
+	          STATIC_CACHE_CONTROL
+	          "Connection: %s\r\n"
+	          "\r\n",
+	          etag, last_modified, hbf_http_connection(conn));
+
+	hbf_log_debug("Not modified: %s", path);
+	return 1;
+}
+
+/* Files this large are streamed from the database instead of cached */
+#define STATIC_STREAM_MIN_SIZE (1024u * 1024u)
+
+/* Parse the digits at *p, advancing it; -1 if none or on overflow */
+static int parse_range_pos(const char **p, uint64_t *value)
+{
+	const char *s = *p;
+	uint64_t v = 0;
+
+	if (*s < '0' || *s > '9') {
+		return -1;
+	}
+	for (; *s >= '0' && *s <= '9'; s++) {
+		if (v > (UINT64_MAX - 9) / 10) {
+			return -1;
+		}
+		v = v * 10 + (uint64_t)(*s - '0');
+	}
+
+	*p = s;
+	*value = v;
+	return 0;
+}
+
+/*
+ * Parse a Range header against a file of size bytes. Returns 1 with the
+ * inclusive range in start/end, 0 to ignore the header (malformed, not
+ * bytes, or several ranges, which are served whole), -1 if the range
+ * cannot be satisfied (416).
+ */
+static int parse_range(const char *header, size_t size, size_t *start,
+                       size_t *end)
+{
+	const char *p = header;
+	uint64_t first;
+	uint64_t last;
+
+	if (strncasecmp(p, "bytes=", 6) != 0) {
+		return 0;
+	}
+	p += 6;
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	if (strchr(p, ',')) {
+		return 0;
+	}
+
+	if (*p == '-') {
+		/* Suffix: the last n bytes */
+		p++;
+		if (parse_range_pos(&p, &last) < 0) {
+			return 0;
+		}
+		if (last == 0 || size == 0) {
+			return -1;
+		}
+		*start = last >= size ? 0 : size - (size_t)last;
+		*end = size - 1;
+	} else {
+		if (parse_range_pos(&p, &first) < 0 || *p++ != '-') {
+			return 0;
+		}
+		last = UINT64_MAX;
+		if (*p >= '0' && *p <= '9' && parse_range_pos(&p, &last) < 0) {
+			return 0;
+		}
+		if (last < first) {
+			return 0;
+		}
+		if (first >= size) {
+			return -1;
+		}
+		*start = (size_t)first;
+		*end = last >= size ? size - 1 : (size_t)last;
+	}
+
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	return *p ? 0 : 1;
+}
+
+/*
+ * 1 if an If-Range value names the representation: strong ETag, or date
+ * when that cannot refer to another representation (last_modified NULL)
+ */
+static int if_range_matches(const char *header, const char *etag,
+                            const char *last_modified)
+{
+	if (header[0] == '"') {
+		return strcmp(header, etag) == 0;
+	}
+	if (strncmp(header, "W/", 2) == 0 || !last_modified) {
+		return 0;
+	}
+	return strcmp(header, last_modified) == 0;
+}
+
+/*
+ * Status line and headers of a static response; extra holds further
+ * header lines (Content-Range, Content-Encoding, Vary) or is empty, gzip
+ * whether the body is the gzip form
+ */
+static void send_static_headers(struct mg_connection *conn, int status,
+                                const char *mime_type, size_t length,
+                                const char *extra,
+                                const overlay_fs_stat_t *st, int gzip)
+{
+	char last_modified[64];
+	char etag[STATIC_ETAG_SIZE];
+
+	format_http_date(last_modified, sizeof(last_modified), st->mtime);
+	format_etag(etag, sizeof(etag), st->hash, gzip);
+
+	mg_printf(conn,
+	          "HTTP/1.1 %d %s\r\n"
+	          "Content-Type: %s\r\n"
+	          "Content-Length: %zu\r\n"
+	          "Accept-Ranges: bytes\r\n"
+	          "%s"
+	          "ETag: %s\r\n"
+	          "Last-Modified: %s\r\n"
+	          STATIC_CACHE_CONTROL
+	          "Connection: %s\r\n"
+	          "\r\n",
+	          status, status == 206 ? "Partial Content" : "OK",
+	          mime_type, length, extra, etag, last_modified,
+	          hbf_http_connection(conn));
+}
+
+/*
+ * Range of st's contents a request asks for. Returns 206 with the range
+ * in start/end, 200 for the whole file, or 416 after answering it.
+ * Ranges address the identity form, so If-Range must name that: a client
+ * holding part of the gzip form (whose 200 response would be gzip, as
+ * gzip_form says) gets the whole file.
+ */
+static int static_range(struct mg_connection *conn,
+                        const overlay_fs_stat_t *st, int gzip_form,
+                        size_t *start, size_t *end)
+{
+	const char *range = mg_get_header(conn, "Range");
+	const char *if_range = mg_get_header(conn, "If-Range");
+	char etag[STATIC_ETAG_SIZE];
+	char last_modified[64];
+	int rc;
+
+	if (!range) {
+		return 200;
+	}
+
+	/* A changed file, or another representation, is sent whole */
+	if (if_range) {
+		format_etag(etag, sizeof(etag), st->hash, 0);
+		format_http_date(last_modified, sizeof(last_modified),
+		                 st->mtime);
+		if (!if_range_matches(if_range, etag,
+		                      gzip_form ? NULL : last_modified)) {
+			return 200;
+		}
+	}
+
+	rc = parse_range(range, st->size, start, end);
+	if (rc == 0) {
+		return 200;
+	}
+	if (rc < 0) {
+		mg_printf(conn,
+		          "HTTP/1.1 416 Range Not Satisfiable\r\n"
+		          "Content-Range: bytes */%zu\r\n"
+		          "Content-Length: 0\r\n"
+		          "Connection: %s\r\n"
+		          "\r\n",
+		          st->size, hbf_http_connection(conn));
+		return 416;
+	}
+
+	return 206;
+}
+
+/*
+ * Serve a large file in OVERLAY_FS_STREAM_CHUNK steps straight from its
+ * blob, so memory per request stays bounded whatever the file size.
+ * Every step is a short blob read of its own: no read transaction stays
+ * open while mg_write waits on the client. Ranges of gzip-stored files
+ * are inflated up to their start.
+ */
+static int serve_stream(struct mg_connection *conn, const char *path,
+                        const char *mime_type, int accept_gzip)
+{
+	overlay_fs_stream_t s;
+	unsigned char *buf;
+	char extra[128];
+	size_t start = 0;
+	size_t end = 0;
+	size_t length;
+	size_t got;
+	int status;
+	int gzip;
+	int rc;
+
+	rc = overlay_fs_stream_open(path, &s);
+	if (rc != 1) {
+		mg_send_http_error(conn, rc == 0 ? 404 : 500,
+		                   rc == 0 ? "Not Found" : "Internal error");
+		return rc == 0 ? 404 : 500;
+	}
+
+	status = static_range(conn, &s.st, s.gzip && accept_gzip, &start, &end);
+	if (status == 416) {
+		overlay_fs_stream_close(&s);
+		return status;
+	}
+
+	buf = malloc(OVERLAY_FS_STREAM_CHUNK);
+	if (!buf || (status == 206 && overlay_fs_stream_seek(&s, start) < 0)) {
+		free(buf);
+		overlay_fs_stream_close(&s);
+		mg_send_http_error(conn, 500, "Internal error");
+		return 500;
+	}
+
+	/* Ranges always address the uncompressed contents */
+	gzip = status == 200 && s.gzip && accept_gzip;
+	if (status == 206) {
+		length = end - start + 1;
+		snprintf(extra, sizeof(extra),
+		         "Content-Range: bytes %zu-%zu/%zu\r\n%s",
+		         start, end, s.st.size,
+		         s.gzip ? "Vary: Accept-Encoding\r\n" : "");
+	} else {
+		length = gzip ? s.stored_size : s.st.size;
+		snprintf(extra, sizeof(extra), "%s%s",
+		         gzip ? "Content-Encoding: gzip\r\n" : "",
+		         s.gzip ? "Vary: Accept-Encoding\r\n" : "");
+	}
+	send_static_headers(conn, status, mime_type, length, extra, &s.st,
+	                    gzip);
+	if (hbf_http_is_head(conn)) {
+		length = 0;
+	}
+
+	while (length > 0) {
+		size_t want = length < OVERLAY_FS_STREAM_CHUNK ?
+		              length : OVERLAY_FS_STREAM_CHUNK;
+
+		rc = gzip ? overlay_fs_stream_read_stored(&s, buf, want, &got) :
+		            overlay_fs_stream_read(&s, buf, want, &got);
+		if (rc < 0 || got == 0) {
+			/* Headers are out; the client sees a short body */
+			hbf_log_error("Stream failed: %s", path);
+			break;
+		}
+		if (mg_write(conn, buf, got) <= 0) {
+			hbf_log_debug("Client went away: %s", path);
+			break;
+		}
+		length -= got;
+	}
+
+	hbf_log_debug("Streamed: %s (%d, %zu bytes%s, %s)", path, status,
+	              s.st.size, gzip ? " gzip" : "", mime_type);
+	free(buf);
+	overlay_fs_stream_close(&s);
+	return status;
+}
+
+/*
+ * Serve a base layer file straight from the binary. Returns 0, having
+ * sent nothing, when the stored form cannot be sent: gzip-stored files
+ * to clients that want identity bytes or a range.
+ */
+static int serve_base(struct mg_connection *conn, const char *path,
+                      const overlay_fs_base_file_t *base,
+                      const char *mime_type, int accept_gzip)
+{
+	const base_fs_entry_t *e = &base->entry;
+	const unsigned char *body = e->data;
+	size_t body_size = e->stored_size;
+	char extra[128];
+	size_t start = 0;
+	size_t end = 0;
+	int status;
+
+	if (send_not_modified(conn, path, &base->st, accept_gzip)) {
+		return 304;
+	}
+
+	if (e->gzip && (!accept_gzip || mg_get_header(conn, "Range"))) {
+		return 0;
+	}
+
+	status = static_range(conn, &base->st, 0, &start, &end);
+	if (status == 416) {
+		return status;
+	}
+
+	if (status == 206) {
+		body += start;
+		body_size = end - start + 1;
+		snprintf(extra, sizeof(extra),
+		         "Content-Range: bytes %zu-%zu/%zu\r\n", start, end,
+		         e->size);
+	} else {
+		snprintf(extra, sizeof(extra), "%s",
+		         e->gzip ? "Content-Encoding: gzip\r\n"
+		                   "Vary: Accept-Encoding\r\n" : "");
+	}
+
+	send_static_headers(conn, status, mime_type, body_size, extra,
+	                    &base->st, status == 200 && e->gzip);
+	if (!hbf_http_is_head(conn)) {
+		mg_write(conn, body, body_size);
+	}
+
+	hbf_log_debug("Served from binary: %s (%d, %zu bytes%s, %s)", path,
+	              status, body_size, e->gzip ? " gzip" : "", mime_type);
+	return status;
+}
+
 /* Static file handler - serves files from SQLAR archive */
 static int static_handler(struct mg_connection *conn, void *cbdata)
 {
@@ -66,10 +602,18 @@ static int static_handler(struct mg_connection *conn, void *cbdata)
 	(void)cbdata;
 	const char *uri;
 	char path[512];
-	unsigned char *data = NULL;
-	size_t size;
+	overlay_fs_base_file_t base;
+	overlay_fs_stat_t st;
+	hbf_db_file_t *file;
 	const char *mime_type;
-	int ret;
+	const unsigned char *body;
+	size_t body_size;
+	char extra[128];
+	size_t start = 0;
+	size_t end = 0;
+	int accept_gzip;
+	int status;
+	int gzip;
 
 	if (!ri) {
 		mg_send_http_error(conn, 500, "Internal error");
@@ -88,33 +632,82 @@ static int static_handler(struct mg_connection *conn, void *cbdata)
 
 	hbf_log_debug("Static request: %s -> %s", uri, path);
 
-	/* Read file from database */
+	mime_type = get_mime_type(path);
+	accept_gzip = accepts_gzip(mg_get_header(conn, "Accept-Encoding"));
+
+	/* Embedded files nobody has overridden: no SQL, no copy */
+	if (overlay_fs_base_get(path, &base) == 1) {
+		status = serve_base(conn, path, &base, mime_type, accept_gzip);
+		if (status != 0) {
+			return status;
+		}
+	}
+
+	/* Metadata only: enough for 404, 304 and choosing how to send */
+	if (overlay_fs_stat(path, &st) != 1) {
+		hbf_log_debug("File not found: %s", path);
+		mg_send_http_error(conn, 404, "Not Found");
+		return 404;
+	}
+
+	if (send_not_modified(conn, path, &st, accept_gzip)) {
+		return 304;
+	}
+
+	if (st.size >= STATIC_STREAM_MIN_SIZE) {
+		return serve_stream(conn, path, mime_type, accept_gzip);
+	}
+
+	/* Hot files come straight from the file cache, without a copy */
 	/* NO MUTEX - static file serving stays parallel */
-	ret = overlay_fs_read_file(path, 1, &data, &size);
-	if (ret != 0) {
+	file = overlay_fs_get_file(path);
+	if (!file) {
 		hbf_log_debug("File not found: %s", path);
 		mg_send_http_error(conn, 404, "Not Found");
 		return 404;
 	}
 
-	/* Determine MIME type */
-	mime_type = get_mime_type(path);
+	/* Headers describe the version actually sent */
+	st.version = file->version;
+	st.mtime = file->mtime;
+	st.size = file->size;
+	snprintf(st.hash, sizeof(st.hash), "%s", file->digest);
+	st.gzip = file->gzip != NULL;
+
+	status = static_range(conn, &st, file->gzip && accept_gzip, &start,
+	                      &end);
+	if (status == 416) {
+		overlay_fs_release_file(file);
+		return status;
+	}
 
-	/* Send response */
-	mg_printf(conn,
-	          "HTTP/1.1 200 OK\r\n"
-	          "Content-Type: %s\r\n"
-	          "Content-Length: %zu\r\n"
-	          "Cache-Control: public, max-age=3600\r\n"
-	          "Connection: close\r\n"
-	          "\r\n",
-	          mime_type, size);
+	/* Files stored compressed go out as stored when the client allows */
+	gzip = status == 200 && file->gzip && accept_gzip;
+	if (status == 206) {
+		body = file->data + start;
+		body_size = end - start + 1;
+		snprintf(extra, sizeof(extra),
+		         "Content-Range: bytes %zu-%zu/%zu\r\n%s",
+		         start, end, file->size,
+		         file->gzip ? "Vary: Accept-Encoding\r\n" : "");
+	} else {
+		body = gzip ? file->gzip : file->data;
+		body_size = gzip ? file->gzip_size : file->size;
+		snprintf(extra, sizeof(extra), "%s%s",
+		         gzip ? "Content-Encoding: gzip\r\n" : "",
+		         file->gzip ? "Vary: Accept-Encoding\r\n" : "");
+	}
 
-	mg_write(conn, data, size);
-	free(data);
+	send_static_headers(conn, status, mime_type, body_size, extra, &st,
+	                    gzip);
+	if (!hbf_http_is_head(conn)) {
+		mg_write(conn, body, body_size);
+	}
 
-	hbf_log_debug("Served: %s (%zu bytes, %s)", path, size, mime_type);
-	return 200;
+	hbf_log_debug("Served: %s (%d, %zu bytes%s, %s)", path, status,
+	              body_size, gzip ? " gzip" : "", mime_type);
+	overlay_fs_release_file(file);
+	return status;
 }
 
 /* Health check handler */
@@ -128,9 +721,10 @@ static int health_handler(struct mg_connection *conn, void *cbdata)
 	          "HTTP/1.1 200 OK\r\n"
 	          "Content-Type: application/json\r\n"
 	          "Content-Length: %zu\r\n"
-	          "Connection: close\r\n"
+	          "Connection: %s\r\n"
 	          "\r\n%s",
-	          strlen(response), response);
+	          strlen(response), hbf_http_connection(conn),
+	          hbf_http_is_head(conn) ? "" : response);
 
 	return 200;
 }
@@ -153,6 +747,12 @@ hbf_server_t *hbf_server_create(int port, sqlite3 *db)
 	server->port = port;
 	server->db = db;
 	server->ctx = NULL;
+	server->keep_alive = 1;
+	server->keep_alive_timeout_ms = HBF_SERVER_KEEP_ALIVE_TIMEOUT_MS;
+	server->num_threads = HBF_SERVER_NUM_THREADS;
+	server->connection_queue = HBF_SERVER_CONNECTION_QUEUE;
+	server->listen_backlog = HBF_SERVER_LISTEN_BACKLOG;
+	server->request_timeout_ms = HBF_SERVER_REQUEST_TIMEOUT_MS;
 
 	return server;
 }
@@ -160,9 +760,21 @@ hbf_server_t *hbf_server_create(int port, sqlite3 *db)
 int hbf_server_start(hbf_server_t *server)
 {
 	char port_str[16];
+	char keep_alive_timeout_str[16];
+	char threads_str[16];
+	char queue_str[16];
+	char backlog_str[16];
+	char request_timeout_str[16];
 	const char *options[] = {
 		"listening_ports", port_str,
-		"num_threads", "4",
+		"num_threads", threads_str,
+		"connection_queue", queue_str,
+		"listen_backlog", backlog_str,
+		"request_timeout_ms", request_timeout_str,
+		"enable_keep_alive", server && server->keep_alive ? "yes" : "no",
+		"keep_alive_timeout_ms", keep_alive_timeout_str,
+		/* Nagle would hold back a body written after its headers */
+		"tcp_nodelay", "1",
 		NULL
 	};
 
@@ -171,6 +783,13 @@ int hbf_server_start(hbf_server_t *server)
 	}
 
 	snprintf(port_str, sizeof(port_str), "%d", server->port);
+	snprintf(threads_str, sizeof(threads_str), "%d", server->num_threads);
+	snprintf(queue_str, sizeof(queue_str), "%d", server->connection_queue);
+	snprintf(backlog_str, sizeof(backlog_str), "%d", server->listen_backlog);
+	snprintf(request_timeout_str, sizeof(request_timeout_str), "%d",
+	         server->request_timeout_ms);
+	snprintf(keep_alive_timeout_str, sizeof(keep_alive_timeout_str), "%d",
+	         server->keep_alive_timeout_ms);
 
 	server->ctx = mg_start(NULL, 0, options);
 	if (!server->ctx) {
@@ -187,7 +806,9 @@ int hbf_server_start(hbf_server_t *server)
 	mg_set_request_handler(server->ctx, "/static/**", static_handler, server);
 	mg_set_request_handler(server->ctx, "**", hbf_qjs_request_handler, server);
 
-	hbf_log_info("HTTP server listening at http://localhost:%d/", server->port);
+	hbf_log_info("HTTP server listening at http://localhost:%d/ "
+	             "(%d threads, keep-alive %s)", server->port,
+	             server->num_threads, server->keep_alive ? "on" : "off");
 	return 0;
 }
 
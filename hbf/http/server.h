@@ -7,11 +7,33 @@
 /* Forward declaration for CivetWeb context */
 struct mg_context;
 
+/*
+ * Idle time before a kept-alive connection is closed. CivetWeb holds a
+ * worker thread per open connection, so this bounds how long an idle
+ * client can keep one from serving others.
+ */
+#define HBF_SERVER_KEEP_ALIVE_TIMEOUT_MS 2000
+
+/*
+ * Defaults of the tunables below (CivetWeb's own, but more workers: each
+ * kept-alive connection holds one while idle)
+ */
+#define HBF_SERVER_NUM_THREADS 32
+#define HBF_SERVER_CONNECTION_QUEUE 20
+#define HBF_SERVER_LISTEN_BACKLOG 200
+#define HBF_SERVER_REQUEST_TIMEOUT_MS 30000
+
 /* HTTP server structure */
 typedef struct hbf_server {
 	int port;
 	sqlite3 *db;       /* Main database (contains SQLAR) */
 	struct mg_context *ctx;
+	int keep_alive;            /* Persistent connections (default: 1) */
+	int keep_alive_timeout_ms; /* Idle timeout of kept-alive connections */
+	int num_threads;           /* Worker threads, one request each */
+	int connection_queue;      /* Accepted connections waiting for a worker */
+	int listen_backlog;        /* Kernel queue of unaccepted connections */
+	int request_timeout_ms;    /* Time allowed to receive a request */
 } hbf_server_t;
 
 /*
@@ -26,6 +48,9 @@ hbf_server_t *hbf_server_create(int port, sqlite3 *db);
 /*
  * Start HTTP server
  *
+ * Set the keep-alive, thread, queue and timeout fields on the server
+ * before starting it to change the defaults from hbf_server_create.
+ *
  * @param server: Server instance
  * @return 0 on success, -1 on error
  */
@@ -2,10 +2,16 @@
 #include "server.h"
 #include "hbf/shell/log.h"
 #include "hbf/db/db.h"
+#include "hbf/db/overlay_fs.h"
 #include "hbf/qjs/engine.h"
+#include <arpa/inet.h>
 #include <assert.h>
+#include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 static void test_server_startup(void)
@@ -45,6 +51,579 @@ static void test_server_startup(void)
 	printf("  ✓ Server startup and shutdown\n");
 }
 
+/*
+ * Send request on a connection to port and read until the server closes it.
+ * Servers under test use a long keep-alive timeout, so a connection left
+ * open fails the read timeout here instead of passing for a close.
+ */
+static size_t http_exchange(int port, const char *request, char *buf,
+			    size_t len)
+{
+	struct sockaddr_in addr;
+	struct timeval tv = { 5, 0 };
+	size_t total = 0;
+	ssize_t n = 0;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	assert(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+	assert(write(fd, request, strlen(request)) == (ssize_t)strlen(request));
+	while (total + 1 < len &&
+	       (n = read(fd, buf + total, len - total - 1)) > 0) {
+		total += (size_t)n;
+	}
+	assert(n == 0 || total + 1 == len);
+	buf[total] = '\0';
+
+	close(fd);
+	return total;
+}
+
+static int count_substr(const char *s, const char *sub)
+{
+	int count = 0;
+
+	while ((s = strstr(s, sub)) != NULL) {
+		count++;
+		s += strlen(sub);
+	}
+
+	return count;
+}
+
+static void test_server_keep_alive(void)
+{
+	sqlite3 *db = NULL;
+	hbf_server_t *server = NULL;
+	char buf[8192];
+	int ret;
+
+	ret = hbf_db_init(1, &db);
+	assert(ret == 0);
+
+	server = hbf_server_create(15310, db);
+	assert(server != NULL);
+	assert(server->keep_alive == 1);
+	server->keep_alive_timeout_ms = 60000;
+	ret = hbf_server_start(server);
+	assert(ret == 0);
+
+	/* Pipelined requests share one connection until the client ends it */
+	http_exchange(15310,
+		      "GET /health HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		      "GET /health HTTP/1.1\r\nHost: localhost\r\n"
+		      "Connection: close\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 2);
+	assert(count_substr(buf, "Connection: keep-alive") == 1);
+	assert(count_substr(buf, "Connection: close") == 1);
+
+	/* HEAD: headers with the GET Content-Length, no body to desync on */
+	http_exchange(15310,
+		      "HEAD /health HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		      "GET /health HTTP/1.1\r\nHost: localhost\r\n"
+		      "Connection: close\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 2);
+	assert(count_substr(buf, "Content-Length: 15") == 2);
+	assert(count_substr(buf, "{\"status\":\"ok\"}") == 1);
+	assert(strstr(buf, "\r\n\r\nHTTP/1.1 200 OK") != NULL);
+
+	/* HTTP/1.0 clients must ask */
+	http_exchange(15310, "GET /health HTTP/1.0\r\n\r\n", buf, sizeof(buf));
+	assert(count_substr(buf, "Connection: close") == 1);
+
+	hbf_server_stop(server);
+	hbf_server_destroy(server);
+
+	/* Disabled: every response closes */
+	server = hbf_server_create(15310, db);
+	assert(server != NULL);
+	server->keep_alive = 0;
+	ret = hbf_server_start(server);
+	assert(ret == 0);
+
+	http_exchange(15310, "GET /health HTTP/1.1\r\nHost: localhost\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 1);
+	assert(count_substr(buf, "Connection: close") == 1);
+
+	hbf_server_destroy(server);
+	hbf_db_close(db);
+
+	printf("  ✓ Keep-alive connections\n");
+}
+
+/* Replace the pod's hbf/server.js with a test app */
+static void install_app(sqlite3 *db, const char *js)
+{
+	assert(overlay_fs_write(db, "hbf/server.js", (const unsigned char *)js,
+				strlen(js)) == 0);
+}
+
+/* Start a server for app on port with a long keep-alive timeout */
+static hbf_server_t *start_app_server(sqlite3 **db, int port, const char *js)
+{
+	hbf_server_t *server;
+
+	assert(hbf_db_init(1, db) == 0);
+	install_app(*db, js);
+	assert(hbf_qjs_init(64, 5000) == 0);
+
+	server = hbf_server_create(port, *db);
+	assert(server != NULL);
+	server->keep_alive_timeout_ms = 60000;
+	assert(hbf_server_start(server) == 0);
+
+	return server;
+}
+
+static void stop_app_server(hbf_server_t *server, sqlite3 *db)
+{
+	hbf_server_stop(server);
+	hbf_server_destroy(server);
+	hbf_qjs_shutdown();
+	hbf_db_close(db);
+}
+
+static const char stream_app[] =
+	"globalThis.app = { handle(req, res) {\n"
+	"  res.set('Content-Type', 'text/plain');\n"
+	"  if (req.path === '/stream') {\n"
+	"    res.write('hello ');\n"
+	"    res.end('world');\n"
+	"    return;\n"
+	"  }\n"
+	"  if (req.path === '/fail') {\n"
+	"    res.write('partial');\n"
+	"    throw new Error('cut short');\n"
+	"  }\n"
+	"  res.status(404);\n"
+	"  res.send('Not Found');\n"
+	"} };\n";
+
+static void test_server_streaming(void)
+{
+	sqlite3 *db = NULL;
+	hbf_server_t *server;
+	char buf[8192];
+
+	server = start_app_server(&db, 15311, stream_app);
+
+	/* HTTP/1.1: chunked, and the connection carries the next request */
+	http_exchange(15311,
+		      "GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		      "GET /health HTTP/1.1\r\nHost: localhost\r\n"
+		      "Connection: close\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 2);
+	assert(count_substr(buf, "Transfer-Encoding: chunked") == 1);
+	assert(count_substr(buf, "Connection: keep-alive") == 1);
+	assert(strstr(buf, "\r\n\r\n6\r\nhello \r\n5\r\nworld\r\n"
+			   "0\r\n\r\nHTTP/1.1 200 OK") != NULL);
+
+	/* HTTP/1.0: no chunking; the close ends the body even when the
+	 * client asked for keep-alive, so a pipelined request goes unserved */
+	http_exchange(15311,
+		      "GET /stream HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"
+		      "GET /health HTTP/1.0\r\nConnection: keep-alive\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 1);
+	assert(strstr(buf, "Transfer-Encoding") == NULL);
+	assert(strstr(buf, "Content-Length") == NULL);
+	assert(count_substr(buf, "Connection: close") == 1);
+	assert(strlen(buf) > 11 &&
+	       strcmp(buf + strlen(buf) - 11, "hello world") == 0);
+
+	/* Failed part way: no terminating chunk, and the connection closes */
+	http_exchange(15311,
+		      "GET /fail HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		      "GET /health HTTP/1.1\r\nHost: localhost\r\n\r\n",
+		      buf, sizeof(buf));
+	assert(count_substr(buf, "HTTP/1.1 200 OK") == 1);
+	assert(strstr(buf, "7\r\npartial\r\n") != NULL);
+	assert(strstr(buf, "0\r\n\r\n") == NULL);
+	assert(strstr(buf, "Internal Server Error") == NULL);
+
+	stop_app_server(server, db);
+
+	printf("  ✓ Streamed responses\n");
+}
+
+static const char body_app[] =
+	"globalThis.app = { handle(req, res) {\n"
+	"  if (req.path === '/buffer') {\n"
+	"    res.send(new Uint8Array([0, 1, 2, 255, 13, 10]).buffer);\n"
+	"  } else if (req.path === '/view') {\n"
+	"    const all = new Uint8Array([9, 9, 0, 104, 105, 0, 9]);\n"
+	"    res.send(new Uint8Array(all.buffer, 2, 4));\n"
+	"  } else if (req.path === '/string') {\n"
+	"    res.send('h\\u00e9llo \\u2713');\n"
+	"  } else if (req.path === '/large') {\n"
+	"    res.send('x'.repeat(20000) + 'end');\n"
+	"  }\n"
+	"} };\n";
+
+/*
+ * GET path and return the response body (binary safe), checking that
+ * Content-Length matches the bytes that came before the close
+ */
+static const char *get_body(int port, const char *path, char *buf,
+			    size_t len, size_t *body_len)
+{
+	char request[256];
+	const char *cl;
+	const char *body;
+	size_t total;
+
+	snprintf(request, sizeof(request),
+		 "GET %s HTTP/1.1\r\nHost: localhost\r\n"
+		 "Connection: close\r\n\r\n", path);
+	total = http_exchange(port, request, buf, len);
+	assert(strncmp(buf, "HTTP/1.1 200 OK\r\n", 17) == 0);
+
+	body = strstr(buf, "\r\n\r\n");
+	assert(body != NULL);
+	body += 4;
+	*body_len = total - (size_t)(body - buf);
+
+	cl = strstr(buf, "Content-Length: ");
+	assert(cl != NULL && cl < body);
+	assert(strtoul(cl + 16, NULL, 10) == *body_len);
+
+	return body;
+}
+
+static void test_server_bodies(void)
+{
+	static const char buffer[] = { 0, 1, 2, (char)255, 13, 10 };
+	static const char view[] = { 0, 'h', 'i', 0 };
+	static const char string[] = "h\xc3\xa9llo \xe2\x9c\x93";
+	sqlite3 *db = NULL;
+	hbf_server_t *server;
+	static char buf[32768];
+	const char *body;
+	size_t body_len;
+	size_t i;
+
+	server = start_app_server(&db, 15312, body_app);
+
+	/* ArrayBuffer: every byte, NUL and CR LF included */
+	body = get_body(15312, "/buffer", buf, sizeof(buf), &body_len);
+	assert(body_len == sizeof(buffer));
+	assert(memcmp(body, buffer, sizeof(buffer)) == 0);
+
+	/* Typed array view: only its window of the buffer */
+	body = get_body(15312, "/view", buf, sizeof(buf), &body_len);
+	assert(body_len == sizeof(view));
+	assert(memcmp(body, view, sizeof(view)) == 0);
+
+	/* String: UTF-8 bytes, counted as bytes */
+	body = get_body(15312, "/string", buf, sizeof(buf), &body_len);
+	assert(body_len == strlen(string));
+	assert(memcmp(body, string, strlen(string)) == 0);
+
+	/* Past the coalescing limit: headers and body go out separately */
+	body = get_body(15312, "/large", buf, sizeof(buf), &body_len);
+	assert(body_len == 20003);
+	for (i = 0; i < 20000; i++) {
+		assert(body[i] == 'x');
+	}
+	assert(memcmp(body + 20000, "end", 3) == 0);
+
+	stop_app_server(server, db);
+
+	printf("  ✓ Response bodies\n");
+}
+
+/*
+ * GET path with extra header lines; returns the status code. If body is
+ * not NULL it gets the response body (binary safe) and body_len its size.
+ */
+static int static_get(int port, const char *path, const char *headers,
+		      char *buf, size_t len, const char **body,
+		      size_t *body_len)
+{
+	char request[512];
+	const char *end;
+	size_t total;
+
+	snprintf(request, sizeof(request),
+		 "GET %s HTTP/1.1\r\nHost: localhost\r\n%s"
+		 "Connection: close\r\n\r\n", path, headers);
+	total = http_exchange(port, request, buf, len);
+	assert(strncmp(buf, "HTTP/1.1 ", 9) == 0);
+
+	if (body) {
+		end = strstr(buf, "\r\n\r\n");
+		assert(end != NULL);
+		*body = end + 4;
+		*body_len = total - (size_t)(*body - buf);
+	}
+
+	return atoi(buf + 9);
+}
+
+/* Copy the value of response header name (with its ": ") into out */
+static void header_value(const char *buf, const char *name, char *out,
+			 size_t len)
+{
+	const char *p = strstr(buf, name);
+	size_t n;
+
+	assert(p != NULL);
+	p += strlen(name);
+	n = strcspn(p, "\r");
+	assert(n < len);
+	memcpy(out, p, n);
+	out[n] = '\0';
+}
+
+static void test_server_conditional(void)
+{
+	sqlite3 *db = NULL;
+	hbf_server_t *server;
+	unsigned char text[4096];
+	char headers[256];
+	char etag[128];
+	char etag_gz[128];
+	char last_modified[64];
+	char got[128];
+	static char buf[16384];
+
+	server = start_app_server(&db, 15313, stream_app);
+
+	/* Compressible, so stored (and served) gzip */
+	memset(text, 'a', sizeof(text));
+	assert(overlay_fs_write(db, "static/cond.txt", text,
+				sizeof(text)) == 0);
+
+	assert(static_get(15313, "/static/cond.txt", "", buf,
+			  sizeof(buf), NULL, NULL) == 200);
+	assert(strstr(buf, "Content-Encoding") == NULL);
+	header_value(buf, "ETag: ", etag, sizeof(etag));
+	header_value(buf, "Last-Modified: ", last_modified,
+		     sizeof(last_modified));
+
+	assert(static_get(15313, "/static/cond.txt",
+			  "Accept-Encoding: gzip\r\n", buf,
+			  sizeof(buf), NULL, NULL) == 200);
+	assert(strstr(buf, "Content-Encoding: gzip\r\n") != NULL);
+	header_value(buf, "ETag: ", etag_gz, sizeof(etag_gz));
+	assert(strcmp(etag, etag_gz) != 0);
+	assert(strstr(etag_gz, "-gz\"") != NULL);
+
+	/* If-None-Match: 304 with the ETag the 200 would have carried */
+	snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", etag);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 304);
+	header_value(buf, "ETag: ", got, sizeof(got));
+	assert(strcmp(got, etag) == 0);
+	assert(strstr(buf, "Content-Length") == NULL);
+
+	/* The gzip form's ETag only matches when gzip would be sent */
+	snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", etag_gz);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 200);
+	snprintf(headers, sizeof(headers),
+		 "Accept-Encoding: gzip\r\nIf-None-Match: %s\r\n", etag_gz);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 304);
+	header_value(buf, "ETag: ", got, sizeof(got));
+	assert(strcmp(got, etag_gz) == 0);
+	snprintf(headers, sizeof(headers),
+		 "Accept-Encoding: gzip\r\nIf-None-Match: W/%s\r\n", etag);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 200);
+
+	/* "*" matches any current representation */
+	assert(static_get(15313, "/static/cond.txt", "If-None-Match: *\r\n",
+			  buf, sizeof(buf), NULL, NULL) == 304);
+	assert(static_get(15313, "/static/none.txt", "If-None-Match: *\r\n",
+			  buf, sizeof(buf), NULL, NULL) == 404);
+
+	/* If-Modified-Since, ETag again per representation */
+	snprintf(headers, sizeof(headers), "If-Modified-Since: %s\r\n",
+		 last_modified);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 304);
+	header_value(buf, "ETag: ", got, sizeof(got));
+	assert(strcmp(got, etag) == 0);
+	snprintf(headers, sizeof(headers),
+		 "Accept-Encoding: gzip\r\nIf-Modified-Since: %s\r\n",
+		 last_modified);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 304);
+	header_value(buf, "ETag: ", got, sizeof(got));
+	assert(strcmp(got, etag_gz) == 0);
+	assert(static_get(15313, "/static/cond.txt",
+			  "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n",
+			  buf, sizeof(buf), NULL, NULL) == 200);
+
+	/* If-None-Match wins over a matching If-Modified-Since */
+	snprintf(headers, sizeof(headers),
+		 "If-None-Match: \"stale\"\r\nIf-Modified-Since: %s\r\n",
+		 last_modified);
+	assert(static_get(15313, "/static/cond.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 200);
+
+	stop_app_server(server, db);
+
+	printf("  ✓ Conditional requests\n");
+}
+
+/* Fill data with bytes that do not compress (stored identity) */
+static void fill_random(unsigned char *data, size_t len)
+{
+	unsigned int seed = 1;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245u + 12345u;
+		data[i] = (unsigned char)(seed >> 16);
+	}
+}
+
+/* Expect a 206 for range of path with the given Content-Range */
+static void expect_range(int port, const char *path, const char *headers,
+			 const unsigned char *data, size_t size, size_t start,
+			 size_t end, char *buf, size_t len)
+{
+	char content_range[128];
+	const char *body;
+	size_t body_len;
+
+	assert(static_get(port, path, headers, buf, len, &body,
+			  &body_len) == 206);
+	snprintf(content_range, sizeof(content_range),
+		 "Content-Range: bytes %zu-%zu/%zu\r\n", start, end, size);
+	assert(strstr(buf, content_range) != NULL);
+	assert(strstr(buf, "Content-Encoding") == NULL);
+	assert(body_len == end - start + 1);
+	assert(memcmp(body, data + start, body_len) == 0);
+}
+
+static void test_server_ranges(void)
+{
+	static unsigned char small[4000];
+	static unsigned char large[1536 * 1024];
+	static unsigned char text[1200 * 1024];
+	static char buf[2 * 1024 * 1024];
+	sqlite3 *db = NULL;
+	hbf_server_t *server;
+	char headers[256];
+	char etag[128];
+	char etag_gz[128];
+	char last_modified[64];
+	const char *body;
+	size_t body_len;
+	size_t i;
+
+	server = start_app_server(&db, 15314, stream_app);
+
+	/* Cached, streamed identity, and streamed gzip-stored files */
+	fill_random(small, sizeof(small));
+	fill_random(large, sizeof(large));
+	for (i = 0; i < sizeof(text); i++) {
+		text[i] = (unsigned char)('a' + (i * 7 + i / 13) % 26);
+	}
+	assert(overlay_fs_write(db, "static/small.bin", small,
+				sizeof(small)) == 0);
+	assert(overlay_fs_write(db, "static/large.bin", large,
+				sizeof(large)) == 0);
+	assert(overlay_fs_write(db, "static/large.txt", text,
+				sizeof(text)) == 0);
+
+	/* First-last, open-ended and suffix ranges */
+	expect_range(15314, "/static/small.bin", "Range: bytes=10-19\r\n",
+		     small, sizeof(small), 10, 19, buf, sizeof(buf));
+	expect_range(15314, "/static/small.bin", "Range: bytes=3990-\r\n",
+		     small, sizeof(small), 3990, 3999, buf, sizeof(buf));
+	expect_range(15314, "/static/small.bin", "Range: bytes=-5\r\n",
+		     small, sizeof(small), 3995, 3999, buf, sizeof(buf));
+	expect_range(15314, "/static/small.bin", "Range: bytes=-5000\r\n",
+		     small, sizeof(small), 0, 3999, buf, sizeof(buf));
+	expect_range(15314, "/static/small.bin", "Range: bytes=100-99999\r\n",
+		     small, sizeof(small), 100, 3999, buf, sizeof(buf));
+
+	/* Unsatisfiable: 416 with the size; several ranges: served whole */
+	assert(static_get(15314, "/static/small.bin",
+			  "Range: bytes=4000-\r\n", buf, sizeof(buf), &body,
+			  &body_len) == 416);
+	assert(strstr(buf, "Content-Range: bytes */4000\r\n") != NULL);
+	assert(body_len == 0);
+	assert(static_get(15314, "/static/small.bin", "Range: bytes=-0\r\n",
+			  buf, sizeof(buf), NULL, NULL) == 416);
+	assert(static_get(15314, "/static/small.bin",
+			  "Range: bytes=0-1,5-6\r\n", buf, sizeof(buf), &body,
+			  &body_len) == 200);
+	assert(body_len == sizeof(small));
+
+	/* If-Range: the current ETag or date gets the range, else the file */
+	assert(static_get(15314, "/static/small.bin", "", buf, sizeof(buf),
+			  NULL, NULL) == 200);
+	header_value(buf, "ETag: ", etag, sizeof(etag));
+	header_value(buf, "Last-Modified: ", last_modified,
+		     sizeof(last_modified));
+	snprintf(headers, sizeof(headers),
+		 "Range: bytes=0-9\r\nIf-Range: %s\r\n", etag);
+	expect_range(15314, "/static/small.bin", headers, small,
+		     sizeof(small), 0, 9, buf, sizeof(buf));
+	snprintf(headers, sizeof(headers),
+		 "Range: bytes=0-9\r\nIf-Range: %s\r\n", last_modified);
+	expect_range(15314, "/static/small.bin", headers, small,
+		     sizeof(small), 0, 9, buf, sizeof(buf));
+	assert(static_get(15314, "/static/small.bin",
+			  "Range: bytes=0-9\r\nIf-Range: \"stale\"\r\n",
+			  buf, sizeof(buf), &body, &body_len) == 200);
+	assert(body_len == sizeof(small));
+	snprintf(headers, sizeof(headers),
+		 "Range: bytes=0-9\r\nIf-Range: W/%s\r\n", etag);
+	assert(static_get(15314, "/static/small.bin", headers, buf,
+			  sizeof(buf), NULL, NULL) == 200);
+
+	/* Streamed from the database: whole, a range, a suffix */
+	assert(static_get(15314, "/static/large.bin", "", buf, sizeof(buf),
+			  &body, &body_len) == 200);
+	assert(body_len == sizeof(large));
+	assert(memcmp(body, large, sizeof(large)) == 0);
+	expect_range(15314, "/static/large.bin",
+		     "Range: bytes=1000000-1099999\r\n", large,
+		     sizeof(large), 1000000, 1099999, buf, sizeof(buf));
+	expect_range(15314, "/static/large.bin", "Range: bytes=-100\r\n",
+		     large, sizeof(large), sizeof(large) - 100,
+		     sizeof(large) - 1, buf, sizeof(buf));
+
+	/* Ranges of a gzip-stored file address its contents */
+	expect_range(15314, "/static/large.txt",
+		     "Accept-Encoding: gzip\r\nRange: bytes=1100000-1100099\r\n",
+		     text, sizeof(text), 1100000, 1100099, buf, sizeof(buf));
+
+	/* If-Range naming the gzip form: the whole (gzip) file instead */
+	assert(static_get(15314, "/static/large.txt",
+			  "Accept-Encoding: gzip\r\n", buf, sizeof(buf), NULL,
+			  NULL) == 200);
+	header_value(buf, "ETag: ", etag_gz, sizeof(etag_gz));
+	snprintf(headers, sizeof(headers),
+		 "Accept-Encoding: gzip\r\nRange: bytes=0-9\r\n"
+		 "If-Range: %s\r\n", etag_gz);
+	assert(static_get(15314, "/static/large.txt", headers, buf,
+			  sizeof(buf), NULL, NULL) == 200);
+	assert(strstr(buf, "Content-Encoding: gzip\r\n") != NULL);
+
+	stop_app_server(server, db);
+
+	printf("  ✓ Range requests\n");
+}
+
 int main(void)
 {
 	hbf_log_init(hbf_log_parse_level("ERROR"));
@@ -52,6 +631,11 @@ int main(void)
 	printf("HTTP server tests:\n");
 
 	test_server_startup();
+	test_server_keep_alive();
+	test_server_streaming();
+	test_server_bodies();
+	test_server_conditional();
+	test_server_ranges();
 
 	printf("\nAll HTTP server tests passed!\n");
 	return 0;
@@ -0,0 +1,412 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF QuickJS runtime arena allocator
+ *
+ * Small blocks are carved from 64 KB chunks and recycled through
+ * per-size-class free lists; a free is a single list push. Blocks above
+ * HBF_QJS_ARENA_MAX_CLASS go to malloc and are linked so the arena can
+ * release them on destroy. Every block carries a 16-byte header holding
+ * its usable size, which keeps payloads 16-byte aligned. The limit
+ * applies to live blocks: memory parked on a free list is not in use.
+ */
+
+#include "hbf/qjs/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HBF_QJS_ARENA_NUM_CLASSES 32
+#define HBF_QJS_ARENA_LARGE ((size_t)-1)
+
+/* Block header, immediately before every payload */
+typedef union hbf_qjs_arena_hdr {
+	struct {
+		size_t size; /* Usable payload size */
+		size_t cls;  /* Size class index or HBF_QJS_ARENA_LARGE */
+	} s;
+	unsigned char pad[16];
+} hbf_qjs_arena_hdr_t;
+
+/* Extra header in front of large blocks */
+typedef union hbf_qjs_arena_large {
+	struct {
+		union hbf_qjs_arena_large *prev;
+		union hbf_qjs_arena_large *next;
+	} s;
+	unsigned char pad[16];
+} hbf_qjs_arena_large_t;
+
+/* Chunk header; blocks follow it */
+typedef union hbf_qjs_arena_chunk {
+	union hbf_qjs_arena_chunk *next;
+	unsigned char pad[16];
+} hbf_qjs_arena_chunk_t;
+
+/* Free list link, stored in a free block's payload */
+typedef struct hbf_qjs_arena_free {
+	struct hbf_qjs_arena_free *next;
+} hbf_qjs_arena_free_t;
+
+struct hbf_qjs_arena {
+	hbf_qjs_arena_free_t *free_lists[HBF_QJS_ARENA_NUM_CLASSES];
+	hbf_qjs_arena_chunk_t *chunks;
+	hbf_qjs_arena_large_t *large;
+	unsigned char *bump;     /* Next unused byte of the current chunk */
+	unsigned char *bump_end;
+	size_t footprint; /* Chunks and large blocks taken from the system */
+	size_t live;      /* Allocated blocks, headers included */
+	size_t limit;
+};
+
+/* Payload sizes: 16-byte steps to 256, then four steps per doubling */
+static const size_t hbf_qjs_arena_classes[HBF_QJS_ARENA_NUM_CLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	144, 160, 176, 192, 208, 224, 240, 256,
+	320, 384, 448, 512, 640, 768, 896, 1024,
+	1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+};
+
+static size_t hbf_qjs_arena_class_of(size_t size)
+{
+	size_t cls;
+
+	if (size <= 256) {
+		return size == 0 ? 0 : (size - 1) / 16;
+	}
+
+	for (cls = 16; cls < HBF_QJS_ARENA_NUM_CLASSES; cls++) {
+		if (size <= hbf_qjs_arena_classes[cls]) {
+			break;
+		}
+	}
+
+	return cls;
+}
+
+static hbf_qjs_arena_hdr_t *hbf_qjs_arena_hdr(const void *ptr)
+{
+	return (hbf_qjs_arena_hdr_t *)((uintptr_t)ptr - sizeof(hbf_qjs_arena_hdr_t));
+}
+
+/* Account for a block of bytes about to be handed out; -1 past the limit */
+static int hbf_qjs_arena_charge(hbf_qjs_arena_t *arena, size_t bytes)
+{
+	if (arena->limit > 0 && (bytes > arena->limit ||
+				 arena->live > arena->limit - bytes)) {
+		return -1;
+	}
+
+	arena->live += bytes;
+	return 0;
+}
+
+static void *hbf_qjs_arena_alloc_large(hbf_qjs_arena_t *arena, size_t size)
+{
+	hbf_qjs_arena_large_t *large;
+	hbf_qjs_arena_hdr_t *hdr;
+	size_t total;
+
+	if (size > SIZE_MAX - sizeof(*large) - sizeof(*hdr)) {
+		return NULL;
+	}
+
+	total = sizeof(*large) + sizeof(*hdr) + size;
+	if (hbf_qjs_arena_charge(arena, total) != 0) {
+		return NULL;
+	}
+
+	large = (hbf_qjs_arena_large_t *)malloc(total);
+	if (!large) {
+		arena->live -= total;
+		return NULL;
+	}
+	arena->footprint += total;
+
+	large->s.prev = NULL;
+	large->s.next = arena->large;
+	if (arena->large) {
+		arena->large->s.prev = large;
+	}
+	arena->large = large;
+
+	hdr = (hbf_qjs_arena_hdr_t *)(large + 1);
+	hdr->s.size = size;
+	hdr->s.cls = HBF_QJS_ARENA_LARGE;
+
+	return hdr + 1;
+}
+
+static void hbf_qjs_arena_free_large(hbf_qjs_arena_t *arena,
+				     hbf_qjs_arena_hdr_t *hdr)
+{
+	hbf_qjs_arena_large_t *large = (hbf_qjs_arena_large_t *)hdr - 1;
+
+	if (large->s.prev) {
+		large->s.prev->s.next = large->s.next;
+	} else {
+		arena->large = large->s.next;
+	}
+	if (large->s.next) {
+		large->s.next->s.prev = large->s.prev;
+	}
+
+	arena->footprint -= sizeof(*large) + sizeof(*hdr) + hdr->s.size;
+	arena->live -= sizeof(*large) + sizeof(*hdr) + hdr->s.size;
+	free(large);
+}
+
+/* Resize a large block in place or by moving it (shrinking included) */
+static void *hbf_qjs_arena_realloc_large(hbf_qjs_arena_t *arena,
+					 hbf_qjs_arena_hdr_t *hdr, size_t size)
+{
+	hbf_qjs_arena_large_t *large = (hbf_qjs_arena_large_t *)hdr - 1;
+	size_t old_size = hdr->s.size;
+
+	if (size > SIZE_MAX - sizeof(*large) - sizeof(*hdr)) {
+		return NULL;
+	}
+	if (size > old_size &&
+	    hbf_qjs_arena_charge(arena, size - old_size) != 0) {
+		return NULL;
+	}
+
+	large = (hbf_qjs_arena_large_t *)realloc(large, sizeof(*large) +
+						 sizeof(*hdr) + size);
+	if (!large) {
+		if (size > old_size) {
+			arena->live -= size - old_size;
+			return NULL;
+		}
+		/* Failed shrink: the block is still big enough */
+		return hdr + 1;
+	}
+
+	/* Neighbours may point at the old address */
+	if (large->s.prev) {
+		large->s.prev->s.next = large;
+	} else {
+		arena->large = large;
+	}
+	if (large->s.next) {
+		large->s.next->s.prev = large;
+	}
+
+	if (size < old_size) {
+		arena->live -= old_size - size;
+	}
+	arena->footprint = arena->footprint - old_size + size;
+
+	hdr = (hbf_qjs_arena_hdr_t *)(large + 1);
+	hdr->s.size = size;
+	return hdr + 1;
+}
+
+/* Carve a new block of class cls from the current chunk */
+static void *hbf_qjs_arena_carve(hbf_qjs_arena_t *arena, size_t cls)
+{
+	size_t block = sizeof(hbf_qjs_arena_hdr_t) + hbf_qjs_arena_classes[cls];
+	hbf_qjs_arena_hdr_t *hdr;
+
+	if (!arena->bump || (size_t)(arena->bump_end - arena->bump) < block) {
+		hbf_qjs_arena_chunk_t *chunk;
+
+		/* Tail of the old chunk is abandoned until destroy */
+		chunk = (hbf_qjs_arena_chunk_t *)malloc(HBF_QJS_ARENA_CHUNK_SIZE);
+		if (!chunk) {
+			return NULL;
+		}
+		arena->footprint += HBF_QJS_ARENA_CHUNK_SIZE;
+
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->bump = (unsigned char *)(chunk + 1);
+		arena->bump_end = (unsigned char *)chunk + HBF_QJS_ARENA_CHUNK_SIZE;
+	}
+
+	hdr = (hbf_qjs_arena_hdr_t *)arena->bump;
+	arena->bump += block;
+	hdr->s.size = hbf_qjs_arena_classes[cls];
+	hdr->s.cls = cls;
+
+	return hdr + 1;
+}
+
+static void *hbf_qjs_arena_malloc(void *opaque, size_t size)
+{
+	hbf_qjs_arena_t *arena = (hbf_qjs_arena_t *)opaque;
+	hbf_qjs_arena_free_t *blk;
+	size_t block;
+	size_t cls;
+
+	if (size > HBF_QJS_ARENA_MAX_CLASS) {
+		return hbf_qjs_arena_alloc_large(arena, size);
+	}
+
+	cls = hbf_qjs_arena_class_of(size);
+	block = sizeof(hbf_qjs_arena_hdr_t) + hbf_qjs_arena_classes[cls];
+	if (hbf_qjs_arena_charge(arena, block) != 0) {
+		return NULL;
+	}
+
+	blk = arena->free_lists[cls];
+	if (blk) {
+		arena->free_lists[cls] = blk->next;
+		return blk;
+	}
+
+	blk = (hbf_qjs_arena_free_t *)hbf_qjs_arena_carve(arena, cls);
+	if (!blk) {
+		arena->live -= block;
+	}
+	return blk;
+}
+
+static void *hbf_qjs_arena_calloc(void *opaque, size_t count, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && count > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	ptr = hbf_qjs_arena_malloc(opaque, count * size);
+	if (ptr) {
+		/* Recycled blocks are dirty */
+		memset(ptr, 0, count * size);
+	}
+
+	return ptr;
+}
+
+static void hbf_qjs_arena_free(void *opaque, void *ptr)
+{
+	hbf_qjs_arena_t *arena = (hbf_qjs_arena_t *)opaque;
+	hbf_qjs_arena_hdr_t *hdr;
+	hbf_qjs_arena_free_t *blk;
+
+	if (!ptr) {
+		return;
+	}
+
+	hdr = hbf_qjs_arena_hdr(ptr);
+	if (hdr->s.cls == HBF_QJS_ARENA_LARGE) {
+		hbf_qjs_arena_free_large(arena, hdr);
+		return;
+	}
+
+	arena->live -= sizeof(*hdr) + hdr->s.size;
+	blk = (hbf_qjs_arena_free_t *)ptr;
+	blk->next = arena->free_lists[hdr->s.cls];
+	arena->free_lists[hdr->s.cls] = blk;
+}
+
+static void *hbf_qjs_arena_realloc(void *opaque, void *ptr, size_t size)
+{
+	hbf_qjs_arena_hdr_t *hdr;
+	void *new_ptr;
+
+	if (!ptr) {
+		return hbf_qjs_arena_malloc(opaque, size);
+	}
+
+	if (size == 0) {
+		hbf_qjs_arena_free(opaque, ptr);
+		return NULL;
+	}
+
+	hdr = hbf_qjs_arena_hdr(ptr);
+
+	/* Large stays large: let the system allocator resize it */
+	if (hdr->s.cls == HBF_QJS_ARENA_LARGE) {
+		if (size == hdr->s.size) {
+			return ptr;
+		}
+		if (size > HBF_QJS_ARENA_MAX_CLASS) {
+			return hbf_qjs_arena_realloc_large(
+				(hbf_qjs_arena_t *)opaque, hdr, size);
+		}
+	} else if (size <= hdr->s.size) {
+		/* Shrinking, or growing within the block's class */
+		return ptr;
+	}
+
+	new_ptr = hbf_qjs_arena_malloc(opaque, size);
+	if (!new_ptr) {
+		return NULL;
+	}
+
+	memcpy(new_ptr, ptr, hdr->s.size < size ? hdr->s.size : size);
+	hbf_qjs_arena_free(opaque, ptr);
+
+	return new_ptr;
+}
+
+static size_t hbf_qjs_arena_usable_size(const void *ptr)
+{
+	if (!ptr) {
+		return 0;
+	}
+
+	return hbf_qjs_arena_hdr(ptr)->s.size;
+}
+
+static const JSMallocFunctions hbf_qjs_arena_mf = {
+	hbf_qjs_arena_calloc,
+	hbf_qjs_arena_malloc,
+	hbf_qjs_arena_free,
+	hbf_qjs_arena_realloc,
+	hbf_qjs_arena_usable_size,
+};
+
+const JSMallocFunctions *hbf_qjs_arena_malloc_functions(void)
+{
+	return &hbf_qjs_arena_mf;
+}
+
+hbf_qjs_arena_t *hbf_qjs_arena_new(size_t limit_bytes)
+{
+	hbf_qjs_arena_t *arena;
+
+	arena = (hbf_qjs_arena_t *)calloc(1, sizeof(hbf_qjs_arena_t));
+	if (!arena) {
+		return NULL;
+	}
+
+	arena->limit = limit_bytes;
+	return arena;
+}
+
+void hbf_qjs_arena_destroy(hbf_qjs_arena_t *arena)
+{
+	hbf_qjs_arena_chunk_t *chunk;
+	hbf_qjs_arena_large_t *large;
+
+	if (!arena) {
+		return;
+	}
+
+	while (arena->chunks) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+
+	while (arena->large) {
+		large = arena->large;
+		arena->large = large->s.next;
+		free(large);
+	}
+
+	free(arena);
+}
+
+size_t hbf_qjs_arena_footprint(const hbf_qjs_arena_t *arena)
+{
+	return arena ? arena->footprint : 0;
+}
+
+size_t hbf_qjs_arena_live(const hbf_qjs_arena_t *arena)
+{
+	return arena ? arena->live : 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF QuickJS runtime arena allocator
+ *
+ * Size-class pool allocator installed into each JSRuntime through
+ * JS_NewRuntime2. An arena belongs to exactly one runtime, and a runtime
+ * is only used by one thread at a time, so no locking is needed.
+ */
+
+#ifndef HBF_QJS_ARENA_H
+#define HBF_QJS_ARENA_H
+
+#include <stddef.h>
+
+#include "quickjs.h"
+
+/* Memory obtained from the system in units of this size */
+#define HBF_QJS_ARENA_CHUNK_SIZE (64u * 1024u)
+
+/* Largest request served from size classes; bigger ones use malloc */
+#define HBF_QJS_ARENA_MAX_CLASS 4096u
+
+typedef struct hbf_qjs_arena hbf_qjs_arena_t;
+
+/* Create an arena
+ * limit_bytes: Maximum bytes in live blocks, headers included
+ *              (0 = unlimited). Allocations past it fail, which QuickJS
+ *              reports as an out-of-memory exception. Freed blocks do
+ *              not count, even while their chunk is kept for reuse.
+ * Returns arena or NULL on error
+ */
+hbf_qjs_arena_t *hbf_qjs_arena_new(size_t limit_bytes);
+
+/* Destroy an arena, releasing all of its memory at once
+ * Must only be called after the runtime using it has been freed.
+ */
+void hbf_qjs_arena_destroy(hbf_qjs_arena_t *arena);
+
+/* Bytes currently taken from the system (chunks + large blocks) */
+size_t hbf_qjs_arena_footprint(const hbf_qjs_arena_t *arena);
+
+/* Bytes in live blocks, headers included (what the limit applies to) */
+size_t hbf_qjs_arena_live(const hbf_qjs_arena_t *arena);
+
+/* Allocator table for JS_NewRuntime2(table, arena) */
+const JSMallocFunctions *hbf_qjs_arena_malloc_functions(void);
+
+#endif /* HBF_QJS_ARENA_H */
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: MIT */
+/* QuickJS arena allocator tests */
+#include "hbf/qjs/arena.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hbf/shell/log.h"
+
+static void test_reuse_after_free(void)
+{
+	const JSMallocFunctions *mf = hbf_qjs_arena_malloc_functions();
+	hbf_qjs_arena_t *arena = hbf_qjs_arena_new(0);
+	void *a, *b;
+
+	assert(arena != NULL);
+
+	a = mf->js_malloc(arena, 40);
+	assert(a != NULL);
+	assert(((uintptr_t)a % 16) == 0); /* Payloads MUST be 16-byte aligned */
+	assert(mf->js_malloc_usable_size(a) >= 40);
+
+	/* Same size class MUST reuse the freed block */
+	mf->js_free(arena, a);
+	b = mf->js_malloc(arena, 33);
+	assert(b == a);
+
+	mf->js_free(arena, b);
+	hbf_qjs_arena_destroy(arena);
+
+	printf("  ✓ Freed blocks are reused within a size class\n");
+}
+
+static void test_calloc_and_realloc(void)
+{
+	const JSMallocFunctions *mf = hbf_qjs_arena_malloc_functions();
+	hbf_qjs_arena_t *arena = hbf_qjs_arena_new(0);
+	unsigned char *p;
+	size_t i;
+
+	/* Dirty a block, free it, and make sure calloc clears it */
+	p = (unsigned char *)mf->js_malloc(arena, 64);
+	memset(p, 0xAB, 64);
+	mf->js_free(arena, p);
+	p = (unsigned char *)mf->js_calloc(arena, 8, 8);
+	for (i = 0; i < 64; i++) {
+		assert(p[i] == 0);
+	}
+
+	/* Grow through several classes and into a large block */
+	for (i = 0; i < 64; i++) {
+		p[i] = (unsigned char)i;
+	}
+	p = (unsigned char *)mf->js_realloc(arena, p, 1000);
+	assert(p != NULL);
+	p = (unsigned char *)mf->js_realloc(arena, p, 20000);
+	assert(p != NULL);
+	assert(mf->js_malloc_usable_size(p) >= 20000);
+	for (i = 0; i < 64; i++) {
+		assert(p[i] == (unsigned char)i); /* Contents MUST survive */
+	}
+
+	assert(mf->js_realloc(arena, p, 0) == NULL);
+	hbf_qjs_arena_destroy(arena);
+
+	printf("  ✓ calloc zeroes recycled blocks, realloc preserves data\n");
+}
+
+static void test_limit_enforced(void)
+{
+	const JSMallocFunctions *mf = hbf_qjs_arena_malloc_functions();
+	hbf_qjs_arena_t *arena = hbf_qjs_arena_new(4 * HBF_QJS_ARENA_CHUNK_SIZE);
+	void *blocks[1000];
+	void *large;
+	int count = 0;
+	int i;
+
+	/* Small allocations stop once live blocks reach the limit */
+	while ((blocks[count] = mf->js_malloc(arena, 4096)) != NULL) {
+		count++;
+		assert(count < 1000);
+	}
+	assert(count > 0);
+	assert(hbf_qjs_arena_live(arena) <= 4 * HBF_QJS_ARENA_CHUNK_SIZE);
+
+	/* Large allocations count against the same limit */
+	assert(mf->js_malloc(arena, HBF_QJS_ARENA_CHUNK_SIZE) == NULL);
+
+	/* Freed blocks stop counting, though their chunks are kept for
+	 * reuse: another size class gets the room */
+	for (i = 0; i < count; i++) {
+		mf->js_free(arena, blocks[i]);
+	}
+	assert(hbf_qjs_arena_live(arena) == 0);
+	assert(hbf_qjs_arena_footprint(arena) > 0);
+	for (i = 0; i < count; i++) {
+		blocks[i] = mf->js_malloc(arena, 2000);
+		assert(blocks[i] != NULL);
+	}
+	large = mf->js_malloc(arena, 8 * HBF_QJS_ARENA_CHUNK_SIZE);
+	assert(large == NULL);
+
+	hbf_qjs_arena_destroy(arena);
+
+	/* Freeing a large block gives its bytes back */
+	arena = hbf_qjs_arena_new(0);
+	large = mf->js_malloc(arena, 100000);
+	assert(large != NULL);
+	assert(hbf_qjs_arena_footprint(arena) > 100000);
+	mf->js_free(arena, large);
+	assert(hbf_qjs_arena_footprint(arena) == 0);
+
+	/* Destroy releases outstanding blocks without individual frees */
+	assert(mf->js_malloc(arena, 100000) != NULL);
+	assert(mf->js_malloc(arena, 16) != NULL);
+	hbf_qjs_arena_destroy(arena);
+
+	printf("  ✓ Memory limit enforced by the arena\n");
+}
+
+static void test_realloc_large(void)
+{
+	const JSMallocFunctions *mf = hbf_qjs_arena_malloc_functions();
+	hbf_qjs_arena_t *arena = hbf_qjs_arena_new(0);
+	unsigned char *p;
+	size_t i;
+
+	p = (unsigned char *)mf->js_malloc(arena, 1000000);
+	assert(p != NULL);
+	for (i = 0; i < 10000; i++) {
+		p[i] = (unsigned char)i;
+	}
+
+	/* Shrinking gives the memory back */
+	p = (unsigned char *)mf->js_realloc(arena, p, 10000);
+	assert(p != NULL);
+	assert(mf->js_malloc_usable_size(p) == 10000);
+	assert(hbf_qjs_arena_footprint(arena) < 20000);
+	assert(hbf_qjs_arena_live(arena) == hbf_qjs_arena_footprint(arena));
+
+	/* Growing again, then down into a size class */
+	p = (unsigned char *)mf->js_realloc(arena, p, 300000);
+	assert(p != NULL);
+	assert(hbf_qjs_arena_footprint(arena) > 300000);
+	p = (unsigned char *)mf->js_realloc(arena, p, 100);
+	assert(p != NULL);
+	assert(mf->js_malloc_usable_size(p) < 4096);
+	for (i = 0; i < 100; i++) {
+		assert(p[i] == (unsigned char)i); /* Contents MUST survive */
+	}
+	assert(hbf_qjs_arena_footprint(arena) == HBF_QJS_ARENA_CHUNK_SIZE);
+
+	mf->js_free(arena, p);
+	assert(hbf_qjs_arena_live(arena) == 0);
+	hbf_qjs_arena_destroy(arena);
+
+	printf("  ✓ realloc resizes large blocks, shrinking included\n");
+}
+
+int main(void)
+{
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("QuickJS Arena Tests:\n");
+
+	test_reuse_after_free();
+	test_calloc_and_realloc();
+	test_limit_enforced();
+	test_realloc_large();
+
+	printf("\nAll arena tests passed!\n");
+	return 0;
+}
@@ -1,19 +1,23 @@
 /* Response object binding implementation */
 #include "hbf/qjs/bindings/response.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "hbf/http/connection.h"
 #include "hbf/shell/log.h"
 
 /*
  * Class ID for response objects.
- * NOTE: This MUST be re-initialized for each JSRuntime since class IDs
- * are runtime-specific. When using per-request runtimes, we reset this
- * to 0 and re-register the class for each new runtime.
+ * NOTE: Class IDs are allocated per JSRuntime, but every runtime is set up
+ * identically, so the first allocation yields the same ID for all of them.
+ * The class itself must still be registered once in each runtime.
  */
 static JSClassID hbf_response_class_id = 0;
+static pthread_mutex_t hbf_response_class_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Helper: Get response_t from JS object using opaque pointer */
 static hbf_response_t *get_response_data(JSContext *ctx, JSValueConst this_val)
@@ -54,13 +58,83 @@ static JSValue js_res_status(JSContext *ctx, JSValueConst this_val,
 	return JS_UNDEFINED;
 }
 
-/* res.send(body) - Send text response */
+/*
+ * Keep a JS string alive as the response body.
+ * JS_ToCStringLen shares the string's storage for plain ASCII strings, so
+ * in the common case nothing is copied; the handle is released in
+ * hbf_response_free().
+ */
+static int hbf_response_set_string(JSContext *ctx, hbf_response_t *res,
+				   JSValueConst val)
+{
+	const char *str;
+	size_t len;
+
+	str = JS_ToCStringLen(ctx, &len, val);
+	if (!str) {
+		return -1;
+	}
+
+	res->body_ctx = ctx;
+	res->body_str = str;
+	res->body = str;
+	res->body_len = len;
+	res->sent = 1;
+
+	return 0;
+}
+
+/*
+ * Keep an ArrayBuffer (or the buffer behind a typed array) alive as the
+ * response body. Returns 1 if val was binary, 0 if not, -1 on error.
+ */
+static int hbf_response_set_buffer(JSContext *ctx, hbf_response_t *res,
+				   JSValueConst val)
+{
+	JSValue buf;
+	size_t offset = 0;
+	size_t len = 0;
+	size_t elem_size = 0;
+	size_t size;
+	uint8_t *data;
+
+	if (JS_IsArrayBuffer(val)) {
+		buf = JS_DupValue(ctx, val);
+	} else if (JS_GetTypedArrayType(val) >= 0) {
+		buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &len, &elem_size);
+		if (JS_IsException(buf)) {
+			return -1;
+		}
+	} else {
+		return 0;
+	}
+
+	data = JS_GetArrayBuffer(ctx, &size, buf);
+	if (!data) {
+		JS_FreeValue(ctx, buf);
+		return -1;
+	}
+
+	if (JS_IsArrayBuffer(val)) {
+		len = size;
+	}
+
+	res->body_ctx = ctx;
+	res->body_buf = buf;
+	res->body_offset = offset;
+	res->body = (const char *)data + offset;
+	res->body_len = len;
+	res->sent = 1;
+
+	return 1;
+}
+
+/* res.send(body) - Send text or binary response */
 static JSValue js_res_send(JSContext *ctx, JSValueConst this_val,
 			    int argc, JSValueConst *argv)
 {
 	hbf_response_t *res;
-	const char *body;
-	size_t len;
+	int ret;
 
 	(void)argc;
 
@@ -74,20 +148,17 @@ static JSValue js_res_send(JSContext *ctx, JSValueConst this_val,
 		return JS_UNDEFINED;
 	}
 
-	body = JS_ToCStringLen(ctx, &len, argv[0]);
-	if (!body) {
-		return JS_EXCEPTION;
+	if (res->streaming) {
+		return JS_ThrowTypeError(ctx, "res.send: response is streaming, use res.end()");
 	}
 
-	res->body = (char *)malloc(len + 1);
-	if (res->body) {
-		memcpy(res->body, body, len);
-		res->body[len] = '\0';
-		res->body_len = len;
-		res->sent = 1;
+	ret = hbf_response_set_buffer(ctx, res, argv[0]);
+	if (ret == 0) {
+		ret = hbf_response_set_string(ctx, res, argv[0]);
+	}
+	if (ret < 0) {
+		return JS_EXCEPTION;
 	}
-
-	JS_FreeCString(ctx, body);
 
 	return JS_UNDEFINED;
 }
@@ -98,8 +169,7 @@ static JSValue js_res_json(JSContext *ctx, JSValueConst this_val,
 {
 	hbf_response_t *res;
 	JSValue json_str;
-	const char *str;
-	size_t len;
+	int ret;
 
 	(void)argc;
 
@@ -113,31 +183,27 @@ static JSValue js_res_json(JSContext *ctx, JSValueConst this_val,
 		return JS_UNDEFINED;
 	}
 
+	if (res->streaming) {
+		return JS_ThrowTypeError(ctx, "res.json: response is streaming, use res.end()");
+	}
+
 	/* Use JSON.stringify */
 	json_str = JS_JSONStringify(ctx, argv[0], JS_NULL, JS_NULL);
 	if (JS_IsException(json_str)) {
 		return JS_EXCEPTION;
 	}
 
-	str = JS_ToCStringLen(ctx, &len, json_str);
-	if (str) {
-		res->body = (char *)malloc(len + 1);
-		if (res->body) {
-			memcpy(res->body, str, len);
-			res->body[len] = '\0';
-			res->body_len = len;
-			res->sent = 1;
-
-			/* Set Content-Type header */
-			if (res->header_count < 32) {
-				res->headers[res->header_count++] =
-					strdup("Content-Type: application/json");
-			}
-		}
-		JS_FreeCString(ctx, str);
+	ret = hbf_response_set_string(ctx, res, json_str);
+	JS_FreeValue(ctx, json_str);
+	if (ret < 0) {
+		return JS_EXCEPTION;
 	}
 
-	JS_FreeValue(ctx, json_str);
+	/* Set Content-Type header */
+	if (res->header_count < 32) {
+		res->headers[res->header_count++] =
+			strdup("Content-Type: application/json");
+	}
 
 	return JS_UNDEFINED;
 }
@@ -188,21 +254,291 @@ static JSValue js_res_set(JSContext *ctx, JSValueConst this_val,
 }
 
 /*
- * Initialize response class for a new JSRuntime.
- * IMPORTANT: Must be called for EACH new runtime when using per-request runtimes.
- * Class IDs are runtime-specific and cannot be shared across runtimes.
+ * Format status line, headers, Connection and the framing header
+ * (Content-Length or Transfer-Encoding; "" for none) into a malloc'd
+ * buffer with extra bytes to spare.
+ * Returns buffer (caller frees) or NULL on allocation failure.
+ */
+static char *hbf_response_format_head(struct mg_connection *conn,
+				      const hbf_response_t *response,
+				      const char *framing, size_t extra,
+				      size_t *head_len)
+{
+	const char *reason;
+	const char *connection;
+	size_t len;
+	size_t cap;
+	char *buf;
+	int i;
+	int n;
+
+	reason = mg_get_response_code_text(conn, response->status_code);
+	connection = response->must_close ? "close" :
+					    hbf_http_connection(conn);
+
+	/* Status line + headers + Connection + framing + blank line */
+	cap = 48 + strlen(reason) + strlen(connection) + strlen(framing) + extra;
+	for (i = 0; i < response->header_count; i++) {
+		cap += strlen(response->headers[i]) + 2;
+	}
+
+	buf = (char *)malloc(cap);
+	if (!buf) {
+		hbf_log_error("Failed to allocate response headers");
+		return NULL;
+	}
+
+	n = snprintf(buf, cap, "HTTP/1.1 %d %s\r\n", response->status_code,
+		     reason);
+	len = (size_t)n;
+
+	for (i = 0; i < response->header_count; i++) {
+		/* Whether the connection stays open is CivetWeb's call */
+		if (strncasecmp(response->headers[i], "Connection:", 11) == 0) {
+			continue;
+		}
+		n = snprintf(buf + len, cap - len, "%s\r\n",
+			     response->headers[i]);
+		len += (size_t)n;
+	}
+
+	n = snprintf(buf + len, cap - len, "Connection: %s\r\n%s%s\r\n",
+		     connection, framing, framing[0] ? "\r\n" : "");
+	len += (size_t)n;
+
+	*head_len = len;
+	return buf;
+}
+
+/* Send streamed bytes, as one or more chunks unless the stream is
+ * unframed; returns 0 on success, -1 if the client went away. Writes
+ * block while the socket is full, which is what keeps a streaming
+ * handler from outrunning the client.
+ */
+static int hbf_response_send_chunks(const hbf_response_t *res,
+				    const char *data, size_t len)
+{
+	unsigned int part;
+	int ret;
+
+	/* HEAD: the headers went out, the body does not */
+	if (hbf_http_is_head(res->conn)) {
+		return 0;
+	}
+
+	while (len > 0) {
+		part = len > HBF_RESPONSE_CHUNK_MAX ? HBF_RESPONSE_CHUNK_MAX :
+						      (unsigned int)len;
+		ret = res->chunked ? mg_send_chunk(res->conn, data, part) :
+				     mg_write(res->conn, data, part);
+		if (ret <= 0) {
+			return -1;
+		}
+		data += part;
+		len -= part;
+	}
+
+	return 0;
+}
+
+/* Write a string, ArrayBuffer or typed array as chunked body data */
+static int hbf_response_write_value(JSContext *ctx, hbf_response_t *res,
+				    JSValueConst val)
+{
+	JSValue buf;
+	size_t offset = 0;
+	size_t len = 0;
+	size_t elem_size = 0;
+	size_t size;
+	uint8_t *data;
+	const char *str;
+	int ret;
+
+	if (JS_IsArrayBuffer(val) || JS_GetTypedArrayType(val) >= 0) {
+		if (JS_IsArrayBuffer(val)) {
+			buf = JS_DupValue(ctx, val);
+		} else {
+			buf = JS_GetTypedArrayBuffer(ctx, val, &offset, &len,
+						     &elem_size);
+			if (JS_IsException(buf)) {
+				return -1;
+			}
+		}
+
+		data = JS_GetArrayBuffer(ctx, &size, buf);
+		if (!data) {
+			JS_FreeValue(ctx, buf);
+			return -1;
+		}
+		if (JS_IsArrayBuffer(val)) {
+			len = size;
+		}
+
+		ret = hbf_response_send_chunks(res, (const char *)data + offset,
+					       len);
+		JS_FreeValue(ctx, buf);
+	} else {
+		str = JS_ToCStringLen(ctx, &len, val);
+		if (!str) {
+			return -1;
+		}
+
+		ret = hbf_response_send_chunks(res, str, len);
+		JS_FreeCString(ctx, str);
+	}
+
+	if (ret < 0) {
+		JS_ThrowInternalError(ctx, "res.write: connection closed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Flush status line and headers and switch to chunked encoding. HTTP/1.0
+ * has no chunked encoding: the body goes out as is, and closing the
+ * connection ends it.
+ */
+static int hbf_response_begin_stream(hbf_response_t *res)
+{
+	const struct mg_request_info *ri = mg_get_request_info(res->conn);
+	size_t head_len;
+	char *buf;
+	int ret;
+
+	res->chunked = ri && ri->http_version &&
+		       strcmp(ri->http_version, "1.1") == 0;
+	res->must_close = !res->chunked;
+
+	buf = hbf_response_format_head(res->conn, res,
+				       res->chunked ?
+					       "Transfer-Encoding: chunked" : "",
+				       0, &head_len);
+	if (!buf) {
+		return -1;
+	}
+
+	ret = mg_write(res->conn, buf, head_len);
+	free(buf);
+	if (ret <= 0) {
+		return -1;
+	}
+
+	res->streaming = 1;
+	return 0;
+}
+
+/* Write the terminating zero-length chunk (once) */
+static void hbf_response_finish_stream(hbf_response_t *res)
+{
+	if (!res->streaming || res->sent) {
+		return;
+	}
+
+	if (res->chunked && !hbf_http_is_head(res->conn)) {
+		mg_send_chunk(res->conn, "", 0);
+	}
+	if (res->must_close) {
+		hbf_http_close(res->conn);
+	}
+	res->sent = 1;
+}
+
+/* res.write(chunk) - Stream part of the body (chunked encoding) */
+static JSValue js_res_write(JSContext *ctx, JSValueConst this_val,
+			     int argc, JSValueConst *argv)
+{
+	hbf_response_t *res;
+
+	res = get_response_data(ctx, this_val);
+	if (!res) {
+		return JS_EXCEPTION;
+	}
+
+	if (res->sent) {
+		hbf_log_warn("Response already sent");
+		return JS_UNDEFINED;
+	}
+
+	if (!res->conn) {
+		return JS_ThrowTypeError(ctx, "res.write: response is not streamable");
+	}
+
+	if (!res->streaming && hbf_response_begin_stream(res) != 0) {
+		return JS_ThrowInternalError(ctx, "res.write: connection closed");
+	}
+
+	if (argc > 0 && !JS_IsUndefined(argv[0]) &&
+	    hbf_response_write_value(ctx, res, argv[0]) != 0) {
+		return JS_EXCEPTION;
+	}
+
+	return JS_UNDEFINED;
+}
+
+/* res.end([chunk]) - Finish the response */
+static JSValue js_res_end(JSContext *ctx, JSValueConst this_val,
+			   int argc, JSValueConst *argv)
+{
+	hbf_response_t *res;
+	int ret;
+
+	res = get_response_data(ctx, this_val);
+	if (!res) {
+		return JS_EXCEPTION;
+	}
+
+	if (res->sent) {
+		hbf_log_warn("Response already sent");
+		return JS_UNDEFINED;
+	}
+
+	/* Nothing streamed yet: behave like res.send() (Content-Length) */
+	if (!res->streaming) {
+		if (argc > 0 && !JS_IsUndefined(argv[0])) {
+			ret = hbf_response_set_buffer(ctx, res, argv[0]);
+			if (ret == 0) {
+				ret = hbf_response_set_string(ctx, res, argv[0]);
+			}
+			if (ret < 0) {
+				return JS_EXCEPTION;
+			}
+		}
+		res->sent = 1;
+		return JS_UNDEFINED;
+	}
+
+	if (argc > 0 && !JS_IsUndefined(argv[0]) &&
+	    hbf_response_write_value(ctx, res, argv[0]) != 0) {
+		return JS_EXCEPTION;
+	}
+
+	hbf_response_finish_stream(res);
+	return JS_UNDEFINED;
+}
+
+/*
+ * Initialize response class for a context's JSRuntime.
+ * Safe to call for every new context: pooled runtimes host many contexts,
+ * and the class is only registered the first time a runtime sees it.
  */
 void hbf_qjs_init_response_class(JSContext *ctx)
 {
 	JSRuntime *rt = JS_GetRuntime(ctx);
+	JSClassID class_id;
 
-	/*
-	 * Always reset and re-register the class for the new runtime.
-	 * The static variable is just used to pass the ID between functions
-	 * within a single runtime's lifetime.
-	 */
-	hbf_response_class_id = 0;
-	JS_NewClassID(rt, &hbf_response_class_id);
+	/* Worker threads set up their runtimes concurrently */
+	pthread_mutex_lock(&hbf_response_class_lock);
+	if (hbf_response_class_id == 0) {
+		JS_NewClassID(rt, &hbf_response_class_id);
+	}
+	class_id = hbf_response_class_id;
+	pthread_mutex_unlock(&hbf_response_class_lock);
+
+	if (JS_IsRegisteredClass(rt, class_id)) {
+		return;
+	}
 
 	/* Define class (no finalizer since we don't own the response_t) */
 	JSClassDef response_class_def = {
@@ -210,7 +546,7 @@ void hbf_qjs_init_response_class(JSContext *ctx)
 		.finalizer = NULL, /* We don't own the response data */
 	};
 
-	JS_NewClass(rt, hbf_response_class_id, &response_class_def);
+	JS_NewClass(rt, class_id, &response_class_def);
 }
 
 /* Create JavaScript response object */
@@ -234,6 +570,14 @@ JSValue hbf_qjs_create_response(JSContext *ctx, hbf_response_t *res_data)
 	res_data->body = NULL;
 	res_data->body_len = 0;
 	res_data->sent = 0;
+	res_data->body_ctx = NULL;
+	res_data->body_str = NULL;
+	res_data->body_buf = JS_UNDEFINED;
+	res_data->body_offset = 0;
+	res_data->conn = NULL;
+	res_data->streaming = 0;
+	res_data->chunked = 0;
+	res_data->must_close = 0;
 
 	/* Create response object with proper class */
 	res = JS_NewObjectClass(ctx, (int)hbf_response_class_id);
@@ -253,35 +597,108 @@ JSValue hbf_qjs_create_response(JSContext *ctx, hbf_response_t *res_data)
 			  JS_NewCFunction(ctx, js_res_json, "json", 1));
 	JS_SetPropertyStr(ctx, res, "set",
 			  JS_NewCFunction(ctx, js_res_set, "set", 2));
+	JS_SetPropertyStr(ctx, res, "write",
+			  JS_NewCFunction(ctx, js_res_write, "write", 1));
+	JS_SetPropertyStr(ctx, res, "end",
+			  JS_NewCFunction(ctx, js_res_end, "end", 1));
 
 	return res;
 }
 
+/*
+ * Body bytes at send time. A binary body is looked up again in case the
+ * script detached its ArrayBuffer after res.send().
+ */
+static const char *hbf_response_body(hbf_response_t *response, size_t *len)
+{
+	uint8_t *data;
+	size_t size;
+
+	*len = 0;
+
+	if (!response->body) {
+		return NULL;
+	}
+
+	if (response->body_ctx && !response->body_str) {
+		data = JS_GetArrayBuffer(response->body_ctx, &size,
+					 response->body_buf);
+		if (!data || size < response->body_offset + response->body_len) {
+			JS_FreeValue(response->body_ctx,
+				     JS_GetException(response->body_ctx));
+			hbf_log_warn("Response body buffer was detached");
+			return NULL;
+		}
+		response->body = (const char *)data + response->body_offset;
+	}
+
+	*len = response->body_len;
+	return response->body;
+}
+
 /* Send accumulated response to CivetWeb */
 void hbf_send_response(struct mg_connection *conn, hbf_response_t *response)
 {
-	int i;
+	const char *body;
+	size_t body_len;
+	size_t head_len;
+	char framing[64];
+	char *buf;
 
 	if (!conn || !response) {
 		return;
 	}
 
-	/* Send status line */
-	mg_printf(conn, "HTTP/1.1 %d OK\r\n", response->status_code);
+	/* Streamed responses are already on the wire; just terminate them */
+	if (response->streaming) {
+		hbf_response_finish_stream(response);
+		return;
+	}
+
+	body = hbf_response_body(response, &body_len);
+	snprintf(framing, sizeof(framing), "Content-Length: %zu", body_len);
 
-	/* Send custom headers */
-	for (i = 0; i < response->header_count; i++) {
-		mg_printf(conn, "%s\r\n", response->headers[i]);
+	buf = hbf_response_format_head(conn, response, framing,
+				       body_len <= HBF_RESPONSE_COALESCE_MAX ?
+					       body_len : 0,
+				       &head_len);
+	if (!buf) {
+		mg_send_http_error(conn, 500, "Internal Server Error");
+		return;
 	}
 
-	/* Send body */
-	if (response->body && response->body_len > 0) {
-		mg_printf(conn, "Content-Length: %zu\r\n\r\n",
-			  response->body_len);
-		mg_write(conn, response->body, response->body_len);
+	/* HEAD: Content-Length of the body that a GET would get, no body */
+	if (hbf_http_is_head(conn)) {
+		mg_write(conn, buf, head_len);
+		free(buf);
+		return;
+	}
+
+	/* Small bodies ride along with the headers in one write */
+	if (body_len > 0 && body_len <= HBF_RESPONSE_COALESCE_MAX) {
+		memcpy(buf + head_len, body, body_len);
+		mg_write(conn, buf, head_len + body_len);
 	} else {
-		mg_printf(conn, "Content-Length: 0\r\n\r\n");
+		mg_write(conn, buf, head_len);
+		if (body_len > 0) {
+			mg_write(conn, body, body_len);
+		}
+	}
+
+	free(buf);
+}
+
+void hbf_response_abort(struct mg_connection *conn, hbf_response_t *response)
+{
+	if (!conn || !response || !response->streaming) {
+		return;
 	}
+
+	/* Too late for Connection: close; ending the stream by closing the
+	 * connection is what marks it incomplete */
+	response->must_close = 1;
+	hbf_http_close(conn);
+	response->sent = 1;
 }
 
 /* Free response data */
@@ -299,13 +716,23 @@ void hbf_response_free(hbf_response_t *response)
 		response->headers[i] = NULL;
 	}
 
-	/* Free body */
-	if (response->body) {
-		free(response->body);
-		response->body = NULL;
+	/* Release the JS value holding the body */
+	if (response->body_ctx) {
+		if (response->body_str) {
+			JS_FreeCString(response->body_ctx, response->body_str);
+		} else {
+			JS_FreeValue(response->body_ctx, response->body_buf);
+		}
+		response->body_ctx = NULL;
+		response->body_str = NULL;
+		response->body_buf = JS_UNDEFINED;
 	}
 
+	response->body = NULL;
 	response->header_count = 0;
 	response->body_len = 0;
+	response->body_offset = 0;
 	response->sent = 0;
+	response->streaming = 0;
+	response->chunked = 0;
 }
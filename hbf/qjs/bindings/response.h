@@ -6,14 +6,33 @@
 
 #include "quickjs.h"
 
-/* Response data structure (accumulates response in C) */
+/* Bodies up to this size are written together with the headers */
+#define HBF_RESPONSE_COALESCE_MAX (16 * 1024)
+
+/* res.write() data is split into chunks of at most this size */
+#define HBF_RESPONSE_CHUNK_MAX (1024u * 1024u)
+
+/* Response data structure (accumulates response in C)
+ * The body is not copied: it points into the JS string or ArrayBuffer
+ * passed to res.send()/res.json(), which is kept alive until
+ * hbf_response_free(). Free the response before its JSContext.
+ */
 typedef struct {
 	int status_code;
 	char *headers[32];  /* Array of "Key: Value" strings */
 	int header_count;
-	char *body;
+	const char *body;   /* Body bytes, owned by the JS value below */
 	size_t body_len;
 	int sent;  /* Flag to prevent double-send */
+	JSContext *body_ctx;  /* Context the body was set from, or NULL */
+	const char *body_str; /* String body (JS_ToCStringLen), or NULL */
+	JSValue body_buf;     /* ArrayBuffer backing a binary body */
+	size_t body_offset;   /* Offset of the body within body_buf */
+	struct mg_connection *conn; /* Set to enable res.write(), or NULL */
+	int streaming; /* 1 once headers went out for res.write() */
+	int chunked;   /* Streamed with chunked encoding (HTTP/1.1), else
+			* unframed and ended by closing the connection */
+	int must_close; /* Sent Connection: close; close once done */
 } hbf_response_t;
 
 /* Initialize response class (call once at startup before creating responses) */
@@ -22,17 +41,32 @@ void hbf_qjs_init_response_class(JSContext *ctx);
 /* Create a JavaScript response object
  * Methods created:
  *   - res.status(code): Set HTTP status code
- *   - res.send(body): Send text response
+ *   - res.send(body): Send text, ArrayBuffer or typed array response
  *   - res.json(obj): Send JSON response
  *   - res.set(name, value): Set response header
+ *   - res.write(chunk): Stream body data; the first call flushes the
+ *     headers with Transfer-Encoding: chunked (needs res_data->conn).
+ *     HTTP/1.0 clients get the body unframed and the connection closed
+ *   - res.end([chunk]): Finish the response (like send() if nothing was
+ *     written yet)
  *
  * Returns: JSValue response object (must be freed with JS_FreeValue)
  */
 JSValue hbf_qjs_create_response(JSContext *ctx, hbf_response_t *res_data);
 
-/* Send accumulated response to CivetWeb connection */
+/* Send accumulated response to CivetWeb connection
+ * Status line and headers are formatted into one buffer; small bodies are
+ * appended to it so the whole response goes out in a single write.
+ * For a streamed response this only writes the terminating chunk.
+ */
 void hbf_send_response(struct mg_connection *conn, hbf_response_t *response);
 
+/* End a streamed response that failed part way (handler threw or timed
+ * out): no terminating chunk, and the connection is closed, so clients
+ * and proxies see an incomplete message rather than a complete one.
+ */
+void hbf_response_abort(struct mg_connection *conn, hbf_response_t *response);
+
 /* Free response data */
 void hbf_response_free(hbf_response_t *response);
 
@@ -0,0 +1,217 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF QuickJS bytecode cache
+ */
+
+#include "hbf/qjs/bytecode_cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hbf/shell/log.h"
+
+#define HBF_QJS_BYTECODE_BUCKETS 256
+
+/*
+ * One entry per module path; a newer version replaces the older one.
+ * Entries still referenced by a reader are unlinked and freed on their
+ * last release.
+ */
+static struct {
+	pthread_mutex_t lock;
+	hbf_qjs_bytecode_t *buckets[HBF_QJS_BYTECODE_BUCKETS];
+	size_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+} g_bc_cache = { PTHREAD_MUTEX_INITIALIZER, {NULL}, 0, 0, 0 };
+
+/* FNV-1a hash of a module path */
+static uint32_t hbf_qjs_bytecode_hash(const char *path)
+{
+	uint32_t h = 2166136261u;
+
+	while (*path) {
+		h ^= (uint8_t)*path++;
+		h *= 16777619u;
+	}
+
+	return h % HBF_QJS_BYTECODE_BUCKETS;
+}
+
+static void hbf_qjs_bytecode_free(hbf_qjs_bytecode_t *bc)
+{
+	free(bc->path);
+	free(bc->data);
+	free(bc);
+}
+
+/* Unlink entry from its bucket (lock held) */
+static void hbf_qjs_bytecode_unlink(hbf_qjs_bytecode_t **link)
+{
+	hbf_qjs_bytecode_t *bc = *link;
+
+	*link = bc->next;
+	bc->next = NULL;
+	bc->cached = 0;
+	g_bc_cache.bytes -= bc->len;
+
+	if (bc->refs == 0) {
+		hbf_qjs_bytecode_free(bc);
+	}
+}
+
+/* Find the link pointing at path's entry (lock held) */
+static hbf_qjs_bytecode_t **hbf_qjs_bytecode_find(const char *path)
+{
+	hbf_qjs_bytecode_t **link;
+
+	link = &g_bc_cache.buckets[hbf_qjs_bytecode_hash(path)];
+	while (*link) {
+		if (strcmp((*link)->path, path) == 0) {
+			return link;
+		}
+		link = &(*link)->next;
+	}
+
+	return NULL;
+}
+
+hbf_qjs_bytecode_t *hbf_qjs_bytecode_cache_get(const char *path,
+					       int64_t version, int64_t mtime,
+					       int64_t size)
+{
+	hbf_qjs_bytecode_t **link;
+	hbf_qjs_bytecode_t *bc = NULL;
+
+	if (!path) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&g_bc_cache.lock);
+
+	link = hbf_qjs_bytecode_find(path);
+	if (link && (*link)->version == version && (*link)->mtime == mtime &&
+	    (*link)->size == size) {
+		bc = *link;
+		bc->refs++;
+		g_bc_cache.hits++;
+	} else {
+		g_bc_cache.misses++;
+	}
+
+	pthread_mutex_unlock(&g_bc_cache.lock);
+	return bc;
+}
+
+void hbf_qjs_bytecode_release(hbf_qjs_bytecode_t *bc)
+{
+	int release;
+
+	if (!bc) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_bc_cache.lock);
+	bc->refs--;
+	release = bc->refs == 0 && !bc->cached;
+	pthread_mutex_unlock(&g_bc_cache.lock);
+
+	if (release) {
+		hbf_qjs_bytecode_free(bc);
+	}
+}
+
+int hbf_qjs_bytecode_cache_put(const char *path, int64_t version,
+			       int64_t mtime, int64_t size,
+			       const uint8_t *data, size_t len)
+{
+	hbf_qjs_bytecode_t *bc;
+	hbf_qjs_bytecode_t **link;
+	uint32_t bucket;
+
+	if (!path || !data || len == 0) {
+		return -1;
+	}
+
+	bc = (hbf_qjs_bytecode_t *)calloc(1, sizeof(hbf_qjs_bytecode_t));
+	if (!bc) {
+		return -1;
+	}
+
+	bc->path = strdup(path);
+	bc->data = (uint8_t *)malloc(len);
+	if (!bc->path || !bc->data) {
+		hbf_qjs_bytecode_free(bc);
+		return -1;
+	}
+
+	memcpy(bc->data, data, len);
+	bc->len = len;
+	bc->version = version;
+	bc->mtime = mtime;
+	bc->size = size;
+	bc->cached = 1;
+
+	pthread_mutex_lock(&g_bc_cache.lock);
+
+	/* Replace whatever version of path was cached before */
+	link = hbf_qjs_bytecode_find(path);
+	if (link) {
+		hbf_qjs_bytecode_unlink(link);
+	}
+
+	if (g_bc_cache.bytes + len > HBF_QJS_BYTECODE_CACHE_MAX_BYTES) {
+		pthread_mutex_unlock(&g_bc_cache.lock);
+		hbf_log_debug("Bytecode cache full, not caching %s", path);
+		hbf_qjs_bytecode_free(bc);
+		return 0;
+	}
+
+	bucket = hbf_qjs_bytecode_hash(path);
+	bc->next = g_bc_cache.buckets[bucket];
+	g_bc_cache.buckets[bucket] = bc;
+	g_bc_cache.bytes += len;
+
+	pthread_mutex_unlock(&g_bc_cache.lock);
+	return 0;
+}
+
+void hbf_qjs_bytecode_cache_invalidate(const char *path)
+{
+	hbf_qjs_bytecode_t **link;
+	size_t i;
+
+	pthread_mutex_lock(&g_bc_cache.lock);
+
+	if (path) {
+		link = hbf_qjs_bytecode_find(path);
+		if (link) {
+			hbf_qjs_bytecode_unlink(link);
+		}
+	} else {
+		for (i = 0; i < HBF_QJS_BYTECODE_BUCKETS; i++) {
+			while (g_bc_cache.buckets[i]) {
+				hbf_qjs_bytecode_unlink(&g_bc_cache.buckets[i]);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&g_bc_cache.lock);
+}
+
+void hbf_qjs_bytecode_cache_stats(uint64_t *hits, uint64_t *misses,
+				  size_t *bytes)
+{
+	pthread_mutex_lock(&g_bc_cache.lock);
+	if (hits) {
+		*hits = g_bc_cache.hits;
+	}
+	if (misses) {
+		*misses = g_bc_cache.misses;
+	}
+	if (bytes) {
+		*bytes = g_bc_cache.bytes;
+	}
+	pthread_mutex_unlock(&g_bc_cache.lock);
+}
@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: MIT
+ * HBF QuickJS bytecode cache
+ *
+ * Process-wide cache of compiled module bytecode (JS_WriteObject output),
+ * keyed by (path, version_number). Shared by all worker threads.
+ */
+
+#ifndef HBF_QJS_BYTECODE_CACHE_H
+#define HBF_QJS_BYTECODE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Upper bound on cached bytecode kept in memory */
+#define HBF_QJS_BYTECODE_CACHE_MAX_BYTES (32u * 1024u * 1024u)
+
+/* Compiled bytecode for one version of one module */
+typedef struct hbf_qjs_bytecode {
+	char *path;
+	int64_t version;  /* file_versions.version_number */
+	int64_t mtime;    /* Guards against reused version numbers */
+	int64_t size;     /* Source size in bytes */
+	uint8_t *data;    /* JS_WriteObject output */
+	size_t len;
+	int refs;         /* Outstanding hbf_qjs_bytecode_cache_get() refs */
+	int cached;       /* 1 while linked into the cache */
+	struct hbf_qjs_bytecode *next;
+} hbf_qjs_bytecode_t;
+
+/*
+ * Look up bytecode for (path, version, mtime, size).
+ * Returns a referenced entry (release with hbf_qjs_bytecode_release) or
+ * NULL on miss.
+ */
+hbf_qjs_bytecode_t *hbf_qjs_bytecode_cache_get(const char *path,
+					       int64_t version, int64_t mtime,
+					       int64_t size);
+
+/* Release a reference returned by hbf_qjs_bytecode_cache_get */
+void hbf_qjs_bytecode_release(hbf_qjs_bytecode_t *bc);
+
+/*
+ * Store a copy of data for (path, version, mtime, size), replacing any
+ * other version cached for path.
+ * Returns 0 on success (or if skipped over budget), -1 on error
+ */
+int hbf_qjs_bytecode_cache_put(const char *path, int64_t version,
+			       int64_t mtime, int64_t size,
+			       const uint8_t *data, size_t len);
+
+/* Drop cached bytecode for path (NULL drops everything) */
+void hbf_qjs_bytecode_cache_invalidate(const char *path);
+
+/* Cache statistics (any pointer may be NULL) */
+void hbf_qjs_bytecode_cache_stats(uint64_t *hits, uint64_t *misses,
+				  size_t *bytes);
+
+#endif /* HBF_QJS_BYTECODE_CACHE_H */
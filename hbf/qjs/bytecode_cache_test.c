@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: MIT */
+/* Bytecode cache tests */
+#include "hbf/qjs/bytecode_cache.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hbf/shell/log.h"
+
+static const uint8_t bc_v1[] = { 1, 2, 3, 4 };
+static const uint8_t bc_v2[] = { 5, 6, 7, 8, 9 };
+
+static void test_hit_and_miss(void)
+{
+	hbf_qjs_bytecode_t *bc;
+	uint64_t hits, misses;
+
+	hbf_qjs_bytecode_cache_invalidate(NULL);
+
+	/* Cold cache */
+	bc = hbf_qjs_bytecode_cache_get("hbf/server.js", 1, 100, 4);
+	assert(bc == NULL);
+
+	assert(hbf_qjs_bytecode_cache_put("hbf/server.js", 1, 100, 4,
+					  bc_v1, sizeof(bc_v1)) == 0);
+
+	bc = hbf_qjs_bytecode_cache_get("hbf/server.js", 1, 100, 4);
+	assert(bc != NULL);
+	assert(bc->len == sizeof(bc_v1));
+	assert(memcmp(bc->data, bc_v1, sizeof(bc_v1)) == 0);
+	hbf_qjs_bytecode_release(bc);
+
+	/* Same version number but different file stamp MUST miss */
+	assert(hbf_qjs_bytecode_cache_get("hbf/server.js", 1, 101, 4) == NULL);
+	assert(hbf_qjs_bytecode_cache_get("hbf/other.js", 1, 100, 4) == NULL);
+
+	hbf_qjs_bytecode_cache_stats(&hits, &misses, NULL);
+	assert(hits == 1);
+	assert(misses == 3);
+
+	printf("  ✓ Hit and miss by (path, version)\n");
+}
+
+static void test_new_version_replaces_old(void)
+{
+	hbf_qjs_bytecode_t *bc;
+	size_t bytes;
+
+	hbf_qjs_bytecode_cache_invalidate(NULL);
+
+	assert(hbf_qjs_bytecode_cache_put("lib/a.js", 1, 100, 4,
+					  bc_v1, sizeof(bc_v1)) == 0);
+	assert(hbf_qjs_bytecode_cache_put("lib/a.js", 2, 200, 5,
+					  bc_v2, sizeof(bc_v2)) == 0);
+
+	/* Old version MUST be gone, new one present */
+	assert(hbf_qjs_bytecode_cache_get("lib/a.js", 1, 100, 4) == NULL);
+	bc = hbf_qjs_bytecode_cache_get("lib/a.js", 2, 200, 5);
+	assert(bc != NULL);
+	assert(memcmp(bc->data, bc_v2, sizeof(bc_v2)) == 0);
+	hbf_qjs_bytecode_release(bc);
+
+	hbf_qjs_bytecode_cache_stats(NULL, NULL, &bytes);
+	assert(bytes == sizeof(bc_v2));
+
+	printf("  ✓ New version replaces old\n");
+}
+
+static void test_invalidate_while_referenced(void)
+{
+	hbf_qjs_bytecode_t *bc;
+	size_t bytes;
+
+	hbf_qjs_bytecode_cache_invalidate(NULL);
+
+	assert(hbf_qjs_bytecode_cache_put("lib/b.js", 3, 300, 4,
+					  bc_v1, sizeof(bc_v1)) == 0);
+	bc = hbf_qjs_bytecode_cache_get("lib/b.js", 3, 300, 4);
+	assert(bc != NULL);
+
+	hbf_qjs_bytecode_cache_invalidate("lib/b.js");
+	assert(hbf_qjs_bytecode_cache_get("lib/b.js", 3, 300, 4) == NULL);
+
+	/* Reader's reference MUST stay valid until released */
+	assert(memcmp(bc->data, bc_v1, sizeof(bc_v1)) == 0);
+	hbf_qjs_bytecode_release(bc);
+
+	hbf_qjs_bytecode_cache_stats(NULL, NULL, &bytes);
+	assert(bytes == 0);
+
+	printf("  ✓ Invalidate while referenced\n");
+}
+
+int main(void)
+{
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("Bytecode Cache Tests:\n");
+
+	test_hit_and_miss();
+	test_new_version_replaces_old();
+	test_invalidate_while_referenced();
+
+	printf("\nAll bytecode cache tests passed!\n");
+	return 0;
+}
@@ -1,16 +1,102 @@
-/* JS module for DB access: db.query and db.execute */
+/* JS module for DB access: db.query, db.execute and db.iterate */
 #include <stdint.h>
 #include "quickjs.h"
 #include "hbf/db/db.h"
+#include "hbf/db/db_pool.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/db/stmt_cache.h"
 #include "hbf/qjs/engine.h"
 #include "hbf/qjs/db_module.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Class ID for db.iterate() cursors (see hbf_qjs_init_response_class) */
+static JSClassID db_cursor_class_id = 0;
+static pthread_mutex_t db_cursor_class_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Live statement behind a cursor; NULL once iteration has ended. Open
+ * cursors are linked into their hbf_qjs_ctx_t so the statement can be
+ * returned when the request ends, even if the cursor object is never
+ * collected (e.g. it sits in a reference cycle on a pooled runtime).
+ */
+typedef struct hbf_qjs_db_cursor {
+    sqlite3_stmt *stmt;
+    hbf_qjs_ctx_t *owner; /* NULL once closed */
+    struct hbf_qjs_db_cursor *prev;
+    struct hbf_qjs_db_cursor *next;
+} db_cursor_t;
 
+// Bind params (only array of values supported for now)
+static void db_bind_params(JSContext *ctx, sqlite3_stmt *stmt, JSValueConst params) {
+    if (JS_IsUndefined(params) || !JS_IsArray(ctx, params)) {
+        return;
+    }
+    int64_t len = 0;
+    JSValue len_val = JS_GetPropertyStr(ctx, params, "length");
+    JS_ToInt64(ctx, &len, len_val);
+    JS_FreeValue(ctx, len_val);
+    for (int i = 0; i < len; i++) {
+        JSValue val = JS_GetPropertyUint32(ctx, params, (uint32_t)i);
+        if (JS_IsNumber(val)) {
+            double num;
+            JS_ToFloat64(ctx, &num, val);
+            sqlite3_bind_double(stmt, i + 1, num);
+        } else if (JS_IsString(val)) {
+            const char *s = JS_ToCString(ctx, val);
+            sqlite3_bind_text(stmt, i + 1, s, -1, SQLITE_TRANSIENT);
+            JS_FreeCString(ctx, s);
+        } else if (JS_IsNull(val) || JS_IsUndefined(val)) {
+            sqlite3_bind_null(stmt, i + 1);
+        }
+        JS_FreeValue(ctx, val);
+    }
+}
 
+// Convert the current row of stmt to a JS object keyed by column name
+static JSValue db_row_to_object(JSContext *ctx, sqlite3_stmt *stmt) {
+    int cols = sqlite3_column_count(stmt);
+    JSValue obj = JS_NewObject(ctx);
+    for (int c = 0; c < cols; c++) {
+        const char *col = sqlite3_column_name(stmt, c);
+        switch (sqlite3_column_type(stmt, c)) {
+            case SQLITE_INTEGER:
+                JS_SetPropertyStr(ctx, obj, col, JS_NewInt64(ctx, sqlite3_column_int64(stmt, c)));
+                break;
+            case SQLITE_FLOAT:
+                JS_SetPropertyStr(ctx, obj, col, JS_NewFloat64(ctx, sqlite3_column_double(stmt, c)));
+                break;
+            case SQLITE_TEXT:
+                JS_SetPropertyStr(ctx, obj, col, JS_NewString(ctx, (const char *)sqlite3_column_text(stmt, c)));
+                break;
+            case SQLITE_NULL:
+            case SQLITE_BLOB:
+            default:
+                JS_SetPropertyStr(ctx, obj, col, JS_NULL);
+                break;
+        }
+    }
+    return obj;
+}
+
+// Prepare a read on this thread's pooled connection; statements that
+// write (e.g. INSERT ... RETURNING) fall back to the writer. *db is
+// updated to the connection the statement belongs to.
+static sqlite3_stmt *db_acquire_read(sqlite3 **db, const char *sql) {
+    sqlite3 *writer = *db;
+    sqlite3 *rdb = hbf_db_pool_reader(writer);
+    if (rdb != writer) {
+        sqlite3_stmt *stmt = hbf_db_stmt_cache_acquire(rdb, sql);
+        if (stmt && sqlite3_stmt_readonly(stmt)) {
+            *db = rdb;
+            return stmt;
+        }
+        hbf_db_stmt_cache_release(rdb, stmt);
+    }
+    return hbf_db_stmt_cache_acquire(writer, sql);
+}
 
 static JSValue js_db_query(JSContext *ctx, JSValueConst this_val __attribute__((unused)), int argc, JSValueConst *argv) {
     if (argc < 1) {
@@ -23,65 +109,35 @@ static JSValue js_db_query(JSContext *ctx, JSValueConst this_val __attribute__((
     JSValue params = argc > 1 ? argv[1] : JS_UNDEFINED;
     hbf_qjs_ctx_t *engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
     sqlite3 *db = engine_ctx ? engine_ctx->db : NULL;
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    if (!db) {
+        JS_FreeCString(ctx, sql);
+        return JS_ThrowInternalError(ctx, "db.query: no database");
+    }
+    sqlite3_stmt *stmt = db_acquire_read(&db, sql);
+    int rc;
+    if (!stmt) {
         JS_FreeCString(ctx, sql);
     return JS_ThrowInternalError(ctx, "db.query: prepare failed: %s", sqlite3_errmsg(db));
     }
-    // Bind params (only array of values supported for now)
-    if (!JS_IsUndefined(params) && JS_IsArray(ctx, params)) {
-        int64_t len = 0;
-        JSValue len_val = JS_GetPropertyStr(ctx, params, "length");
-        JS_ToInt64(ctx, &len, len_val);
-        JS_FreeValue(ctx, len_val);
-        for (int i = 0; i < len; i++) {
-            JSValue val = JS_GetPropertyUint32(ctx, params, (uint32_t)i);
-            if (JS_IsNumber(val)) {
-                double num;
-                JS_ToFloat64(ctx, &num, val);
-                sqlite3_bind_double(stmt, i + 1, num);
-            } else if (JS_IsString(val)) {
-                const char *s = JS_ToCString(ctx, val);
-                sqlite3_bind_text(stmt, i + 1, s, -1, SQLITE_TRANSIENT);
-                JS_FreeCString(ctx, s);
-            } else if (JS_IsNull(val) || JS_IsUndefined(val)) {
-                sqlite3_bind_null(stmt, i + 1);
-            }
-            JS_FreeValue(ctx, val);
-        }
+    db_bind_params(ctx, stmt, params);
+    if (hbf_db_pool_writer_enter(db) != SQLITE_OK) {
+        hbf_db_stmt_cache_release(db, stmt);
+        JS_FreeCString(ctx, sql);
+        return JS_ThrowInternalError(ctx, "db.query: database is busy");
     }
     // Build result array
     JSValue result = JS_NewArray(ctx);
     int row = 0;
     rc = sqlite3_step(stmt);
     while (rc == SQLITE_ROW) {
-        int cols = sqlite3_column_count(stmt);
-        JSValue obj = JS_NewObject(ctx);
-        for (int c = 0; c < cols; c++) {
-            const char *col = sqlite3_column_name(stmt, c);
-            switch (sqlite3_column_type(stmt, c)) {
-                case SQLITE_INTEGER:
-                    JS_SetPropertyStr(ctx, obj, col, JS_NewInt64(ctx, sqlite3_column_int64(stmt, c)));
-                    break;
-                case SQLITE_FLOAT:
-                    JS_SetPropertyStr(ctx, obj, col, JS_NewFloat64(ctx, sqlite3_column_double(stmt, c)));
-                    break;
-                case SQLITE_TEXT:
-                    JS_SetPropertyStr(ctx, obj, col, JS_NewString(ctx, (const char *)sqlite3_column_text(stmt, c)));
-                    break;
-                case SQLITE_NULL:
-                case SQLITE_BLOB:
-                default:
-                    JS_SetPropertyStr(ctx, obj, col, JS_NULL);
-                    break;
-            }
-        }
+        JSValue obj = db_row_to_object(ctx, stmt);
         JS_SetPropertyUint32(ctx, result, (uint32_t)row++, JS_DupValue(ctx, obj));
         JS_FreeValue(ctx, obj);
         rc = sqlite3_step(stmt);
     }
-    sqlite3_finalize(stmt);
+    hbf_db_stmt_cache_release(db, stmt);
+    overlay_fs_statement_done(db);
+    hbf_db_pool_writer_leave(db);
     JS_FreeCString(ctx, sql);
     return result;
 }
@@ -97,37 +153,30 @@ static JSValue js_db_execute(JSContext *ctx, JSValueConst this_val __attribute__
     JSValue params = argc > 1 ? argv[1] : JS_UNDEFINED;
     hbf_qjs_ctx_t *engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
     sqlite3 *db = engine_ctx ? engine_ctx->db : NULL;
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    if (!db) {
+        JS_FreeCString(ctx, sql);
+        return JS_ThrowInternalError(ctx, "db.execute: no database");
+    }
+    /* Always the writer: SQLite reports BEGIN, COMMIT, SAVEPOINT and the
+     * like as read-only, and they must run where the writes do */
+    sqlite3_stmt *stmt = hbf_db_stmt_cache_acquire(db, sql);
+    int rc;
+    if (!stmt) {
         JS_FreeCString(ctx, sql);
     return JS_ThrowInternalError(ctx, "db.execute: prepare failed: %s", sqlite3_errmsg(db));
     }
-    // Bind params (only array of values supported for now)
-    if (!JS_IsUndefined(params) && JS_IsArray(ctx, params)) {
-        int64_t len = 0;
-        JSValue len_val = JS_GetPropertyStr(ctx, params, "length");
-        JS_ToInt64(ctx, &len, len_val);
-        JS_FreeValue(ctx, len_val);
-        for (int i = 0; i < len; i++) {
-            JSValue val = JS_GetPropertyUint32(ctx, params, (uint32_t)i);
-            if (JS_IsNumber(val)) {
-                double num;
-                JS_ToFloat64(ctx, &num, val);
-                sqlite3_bind_double(stmt, i + 1, num);
-            } else if (JS_IsString(val)) {
-                const char *s = JS_ToCString(ctx, val);
-                sqlite3_bind_text(stmt, i + 1, s, -1, SQLITE_TRANSIENT);
-                JS_FreeCString(ctx, s);
-            } else if (JS_IsNull(val) || JS_IsUndefined(val)) {
-                sqlite3_bind_null(stmt, i + 1);
-            }
-            JS_FreeValue(ctx, val);
-        }
+    db_bind_params(ctx, stmt, params);
+    /* Held until COMMIT/ROLLBACK if this opens a transaction */
+    if (hbf_db_pool_writer_enter(db) != SQLITE_OK) {
+        hbf_db_stmt_cache_release(db, stmt);
+        JS_FreeCString(ctx, sql);
+        return JS_ThrowInternalError(ctx, "db.execute: database is busy");
     }
     rc = sqlite3_step(stmt);
     int changes = sqlite3_changes(db);
-    sqlite3_finalize(stmt);
+    hbf_db_stmt_cache_release(db, stmt);
+    overlay_fs_statement_done(db);
+    hbf_db_pool_writer_leave(db);
     JS_FreeCString(ctx, sql);
     if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
     return JS_ThrowInternalError(ctx, "db.execute: step failed: %s", sqlite3_errmsg(db));
@@ -135,13 +184,184 @@ static JSValue js_db_execute(JSContext *ctx, JSValueConst this_val __attribute__
     return JS_NewInt32(ctx, changes);
 }
 
+// Return the cursor's statement to the cache (idempotent)
+static void db_cursor_close(db_cursor_t *cur) {
+    if (!cur) {
+        return;
+    }
+    if (cur->owner) {
+        if (cur->prev) {
+            cur->prev->next = cur->next;
+        } else {
+            cur->owner->cursors = cur->next;
+        }
+        if (cur->next) {
+            cur->next->prev = cur->prev;
+        }
+        cur->owner = NULL;
+        cur->prev = NULL;
+        cur->next = NULL;
+    }
+    if (cur->stmt) {
+        sqlite3 *db = sqlite3_db_handle(cur->stmt);
+        hbf_db_stmt_cache_release(db, cur->stmt);
+        overlay_fs_statement_done(db);
+        cur->stmt = NULL;
+    }
+}
+
+void hbf_qjs_db_cursors_close(hbf_qjs_ctx_t *ctx) {
+    while (ctx && ctx->cursors) {
+        db_cursor_close(ctx->cursors);
+    }
+}
+
+// Runs when the cursor is garbage collected or its context is freed
+static void db_cursor_finalizer(JSRuntime *rt __attribute__((unused)), JSValue val) {
+    db_cursor_t *cur = (db_cursor_t *)JS_GetOpaque(val, db_cursor_class_id);
+    db_cursor_close(cur);
+    free(cur);
+}
+
+static JSValue db_iter_result(JSContext *ctx, JSValue value, int done) {
+    JSValue res = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, res, "value", value);
+    JS_SetPropertyStr(ctx, res, "done", JS_NewBool(ctx, done));
+    return res;
+}
+
+// cursor.next() - step the statement and return the next row
+static JSValue js_db_cursor_next(JSContext *ctx, JSValueConst this_val, int argc __attribute__((unused)), JSValueConst *argv __attribute__((unused))) {
+    db_cursor_t *cur = (db_cursor_t *)JS_GetOpaque2(ctx, this_val, db_cursor_class_id);
+    if (!cur) {
+        return JS_EXCEPTION;
+    }
+    if (!cur->stmt) {
+        return db_iter_result(ctx, JS_UNDEFINED, 1);
+    }
+    sqlite3 *db = sqlite3_db_handle(cur->stmt);
+    if (hbf_db_pool_writer_enter(db) != SQLITE_OK) {
+        db_cursor_close(cur);
+        return JS_ThrowInternalError(ctx, "db.iterate: database is busy");
+    }
+    int rc = sqlite3_step(cur->stmt);
+    hbf_db_pool_writer_leave(db);
+    if (rc == SQLITE_ROW) {
+        return db_iter_result(ctx, db_row_to_object(ctx, cur->stmt), 0);
+    }
+    if (rc != SQLITE_DONE) {
+        JSValue err = JS_ThrowInternalError(ctx, "db.iterate: step failed: %s", sqlite3_errmsg(db));
+        db_cursor_close(cur);
+        return err;
+    }
+    db_cursor_close(cur);
+    return db_iter_result(ctx, JS_UNDEFINED, 1);
+}
+
+// cursor.return() / cursor.close() - stop early (for...of break) and finalize
+static JSValue js_db_cursor_return(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    db_cursor_t *cur = (db_cursor_t *)JS_GetOpaque2(ctx, this_val, db_cursor_class_id);
+    if (!cur) {
+        return JS_EXCEPTION;
+    }
+    db_cursor_close(cur);
+    return db_iter_result(ctx, argc > 0 ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED, 1);
+}
+
+// cursor[Symbol.iterator]() - a cursor is its own iterator
+static JSValue js_db_cursor_iterator(JSContext *ctx, JSValueConst this_val, int argc __attribute__((unused)), JSValueConst *argv __attribute__((unused))) {
+    return JS_DupValue(ctx, this_val);
+}
+
+static const JSCFunctionListEntry db_cursor_proto_funcs[] = {
+    JS_CFUNC_DEF("next", 0, js_db_cursor_next),
+    JS_CFUNC_DEF("return", 1, js_db_cursor_return),
+    JS_CFUNC_DEF("close", 0, js_db_cursor_return),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_db_cursor_iterator)
+};
+
+// db.iterate(sql, params) - rows on demand from a live statement
+static JSValue js_db_iterate(JSContext *ctx, JSValueConst this_val __attribute__((unused)), int argc, JSValueConst *argv) {
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "db.iterate: missing SQL argument");
+    }
+    const char *sql = JS_ToCString(ctx, argv[0]);
+    if (!sql) {
+        return JS_ThrowTypeError(ctx, "db.iterate: invalid SQL");
+    }
+    JSValue params = argc > 1 ? argv[1] : JS_UNDEFINED;
+    hbf_qjs_ctx_t *engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
+    sqlite3 *db = engine_ctx ? engine_ctx->db : NULL;
+    if (!db) {
+        JS_FreeCString(ctx, sql);
+        return JS_ThrowInternalError(ctx, "db.iterate: no database");
+    }
+    sqlite3_stmt *stmt = db_acquire_read(&db, sql);
+    JS_FreeCString(ctx, sql);
+    if (!stmt) {
+        return JS_ThrowInternalError(ctx, "db.iterate: prepare failed: %s", sqlite3_errmsg(db));
+    }
+    db_bind_params(ctx, stmt, params);
+
+    db_cursor_t *cur = (db_cursor_t *)calloc(1, sizeof(db_cursor_t));
+    if (!cur) {
+        hbf_db_stmt_cache_release(db, stmt);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    JSValue obj = JS_NewObjectClass(ctx, (int)db_cursor_class_id);
+    if (JS_IsException(obj)) {
+        hbf_db_stmt_cache_release(db, stmt);
+        free(cur);
+        return obj;
+    }
+    cur->stmt = stmt;
+    if (engine_ctx) {
+        cur->owner = engine_ctx;
+        cur->next = engine_ctx->cursors;
+        if (cur->next) {
+            cur->next->prev = cur;
+        }
+        engine_ctx->cursors = cur;
+    }
+    JS_SetOpaque(obj, cur);
+    return obj;
+}
+
 static const JSCFunctionListEntry db_funcs[] = {
     JS_CFUNC_DEF("query", 2, js_db_query),
-    JS_CFUNC_DEF("execute", 2, js_db_execute)
+    JS_CFUNC_DEF("execute", 2, js_db_execute),
+    JS_CFUNC_DEF("iterate", 2, js_db_iterate),
+    JS_CFUNC_DEF("cursor", 2, js_db_iterate)
 };
 
+// Register the cursor class once per runtime and its prototype per context
+static void db_init_cursor_class(JSContext *ctx) {
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSClassID class_id;
+
+    pthread_mutex_lock(&db_cursor_class_lock);
+    if (db_cursor_class_id == 0) {
+        JS_NewClassID(rt, &db_cursor_class_id);
+    }
+    class_id = db_cursor_class_id;
+    pthread_mutex_unlock(&db_cursor_class_lock);
+
+    if (!JS_IsRegisteredClass(rt, class_id)) {
+        JSClassDef cursor_class_def = {
+            .class_name = "HbfDbCursor",
+            .finalizer = db_cursor_finalizer,
+        };
+        JS_NewClass(rt, class_id, &cursor_class_def);
+    }
+
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, db_cursor_proto_funcs, sizeof(db_cursor_proto_funcs)/sizeof(JSCFunctionListEntry));
+    JS_SetClassProto(ctx, class_id, proto);
+}
+
 int hbf_qjs_init_db_module(JSContext *ctx) {
     JSValue global_obj;
+    db_init_cursor_class(ctx);
     JSValue db_obj = JS_NewObject(ctx);
     JS_SetPropertyFunctionList(ctx, db_obj, db_funcs, sizeof(db_funcs)/sizeof(JSCFunctionListEntry));
     global_obj = JS_GetGlobalObject(ctx);
@@ -1,8 +1,13 @@
 #ifndef HBF_QJS_DB_MODULE_H
 #define HBF_QJS_DB_MODULE_H
 
+#include "hbf/qjs/engine.h"
 #include "quickjs.h"
 
 int hbf_qjs_init_db_module(JSContext *ctx);
 
+/* Return the statements of all db.iterate() cursors still open on ctx
+ * (must run before a pooled runtime goes back to its worker) */
+void hbf_qjs_db_cursors_close(hbf_qjs_ctx_t *ctx);
+
 #endif // HBF_QJS_DB_MODULE_H
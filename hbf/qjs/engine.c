@@ -1,6 +1,7 @@
 /* QuickJS engine wrapper implementation */
 #include "hbf/qjs/engine.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -9,18 +10,53 @@
 #include "quickjs.h"
 
 #include "hbf/db/db.h"
+#include "hbf/db/db_pool.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/db/stmt_cache.h"
+#include "hbf/qjs/arena.h"
 #include "hbf/qjs/db_module.h"
 #include "hbf/qjs/console_module.h"
 #include "hbf/qjs/module_loader.h"
+#include "hbf/qjs/timers_module.h"
 #include "hbf/qjs/bindings/response.h"
 
+/* Default recycle policy for pooled worker runtimes */
+#define HBF_QJS_RECYCLE_REQUESTS 1000
+#define HBF_QJS_RECYCLE_HEAP_MB 16
+
 /* Global engine configuration */
 static struct {
 	size_t mem_limit_bytes;
 	int timeout_ms;
 	int initialized;
-} g_qjs_config = {0};
+	unsigned int recycle_requests;
+	size_t recycle_heap_bytes;
+} g_qjs_config = {
+	0, 0, 0, HBF_QJS_RECYCLE_REQUESTS,
+	(size_t)HBF_QJS_RECYCLE_HEAP_MB * 1024 * 1024
+};
+
+/*
+ * Per-thread runtime pool.
+ *
+ * Each CivetWeb worker thread owns at most one warm JSRuntime. Requests get
+ * a fresh JSContext on it, so JS globals never leak between requests, while
+ * runtime setup (atoms, shapes, class registration) is paid once per worker
+ * instead of once per request. The runtime is only ever touched by its
+ * owning thread, so no locking is needed.
+ */
+typedef struct hbf_qjs_worker {
+	JSRuntime *rt;
+	unsigned int requests; /* Contexts served since the runtime was created */
+	int in_use;
+	hbf_qjs_module_template_t *tpl; /* Module graph of this worker's app */
+} hbf_qjs_worker_t;
+
+static pthread_key_t g_qjs_worker_key;
+static pthread_once_t g_qjs_worker_once = PTHREAD_ONCE_INIT;
+static int g_qjs_worker_key_ok = 0;
 
+static void hbf_qjs_worker_free_runtime(hbf_qjs_worker_t *worker);
 
 /* Get current time in milliseconds */
 static int64_t hbf_qjs_get_time_ms(void)
@@ -79,46 +115,65 @@ void hbf_qjs_shutdown(void)
 		return;
 	}
 
+	/* Other workers free their runtimes on thread exit */
+	if (g_qjs_worker_key_ok) {
+		hbf_qjs_worker_t *worker;
+
+		worker = (hbf_qjs_worker_t *)pthread_getspecific(g_qjs_worker_key);
+		if (worker) {
+			hbf_qjs_worker_free_runtime(worker);
+			hbf_qjs_module_template_free(worker->tpl);
+			worker->tpl = NULL;
+		}
+	}
+
 	g_qjs_config.initialized = 0;
 	hbf_log_info("QuickJS engine shutdown");
 }
 
-/* Create QuickJS context (internal implementation) */
-static hbf_qjs_ctx_t *hbf_qjs_ctx_create_internal(sqlite3 *db, int own_db)
+/*
+ * Create a runtime backed by its own arena allocator.
+ * The arena enforces the engine-wide memory limit and is kept as the
+ * runtime opaque so hbf_qjs_runtime_free() can release it.
+ */
+static JSRuntime *hbf_qjs_runtime_new(void)
 {
-	hbf_qjs_ctx_t *ctx;
+	hbf_qjs_arena_t *arena;
 	JSRuntime *rt;
-	JSContext *js_ctx;
 
-	if (!g_qjs_config.initialized) {
-		hbf_log_error("QuickJS engine not initialized");
-		return NULL;
-	}
-
-	/* Allocate context wrapper */
-	ctx = (hbf_qjs_ctx_t *)calloc(1, sizeof(hbf_qjs_ctx_t));
-	if (!ctx) {
-		hbf_log_error("Failed to allocate QuickJS context");
+	arena = hbf_qjs_arena_new(g_qjs_config.mem_limit_bytes);
+	if (!arena) {
+		hbf_log_error("Failed to create QuickJS arena");
 		return NULL;
 	}
 
-	/* Create runtime */
-	rt = JS_NewRuntime();
+	rt = JS_NewRuntime2(hbf_qjs_arena_malloc_functions(), arena);
 	if (!rt) {
 		hbf_log_error("Failed to create QuickJS runtime");
-		free(ctx);
+		hbf_qjs_arena_destroy(arena);
 		return NULL;
 	}
 
-	/* Set memory limit */
-	if (g_qjs_config.mem_limit_bytes > 0) {
-		JS_SetMemoryLimit(rt, g_qjs_config.mem_limit_bytes);
-	}
+	JS_SetRuntimeOpaque(rt, arena);
+	return rt;
+}
 
-	/* Set interrupt handler for timeout */
-	if (g_qjs_config.timeout_ms > 0) {
-		JS_SetInterruptHandler(rt, hbf_qjs_interrupt_handler, ctx);
-	}
+/* Free a runtime and then its arena in one sweep */
+static void hbf_qjs_runtime_free(JSRuntime *rt)
+{
+	hbf_qjs_arena_t *arena = (hbf_qjs_arena_t *)JS_GetRuntimeOpaque(rt);
+
+	JS_FreeRuntime(rt);
+	hbf_qjs_arena_destroy(arena);
+}
+
+/*
+ * Create a fresh JSContext on rt and register host modules.
+ * ctx->db must already be set. Returns 0 on success, -1 on error.
+ */
+static int hbf_qjs_ctx_attach(hbf_qjs_ctx_t *ctx, JSRuntime *rt)
+{
+	JSContext *js_ctx;
 
 	/* Create context with standard library */
 	/* NOTE: JS_NewContext already initializes all standard intrinsics:
@@ -129,15 +184,67 @@ static hbf_qjs_ctx_t *hbf_qjs_ctx_create_internal(sqlite3 *db, int own_db)
 	js_ctx = JS_NewContext(rt);
 	if (!js_ctx) {
 		hbf_log_error("Failed to create QuickJS context");
-		JS_FreeRuntime(rt);
-		free(ctx);
-		return NULL;
+		return -1;
 	}
 
 	ctx->rt = rt;
 	ctx->ctx = js_ctx;
 	ctx->start_time_ms = hbf_qjs_get_time_ms();
 	ctx->error_buf[0] = '\0';
+
+	/*
+	 * Interrupt handler and module loader carry per-context opaques, so
+	 * they are (re)installed every time a context is attached to a
+	 * possibly reused runtime.
+	 */
+	if (g_qjs_config.timeout_ms > 0) {
+		JS_SetInterruptHandler(rt, hbf_qjs_interrupt_handler, ctx);
+	} else {
+		JS_SetInterruptHandler(rt, NULL, NULL);
+	}
+
+	/* Set context opaque to allow DB access from JS modules */
+	JS_SetContextOpaque(js_ctx, ctx);
+
+	/* Initialize ES module loader */
+	hbf_qjs_module_loader_init(rt, ctx->db);
+
+	/* Register custom modules */
+	hbf_qjs_init_db_module(js_ctx);
+	hbf_qjs_init_console_module(js_ctx);
+	hbf_qjs_init_timers_module(js_ctx);
+
+	/* Initialize response class for proper opaque pointer handling */
+	hbf_qjs_init_response_class(js_ctx);
+
+	return 0;
+}
+
+/* Create QuickJS context (internal implementation) */
+static hbf_qjs_ctx_t *hbf_qjs_ctx_create_internal(sqlite3 *db, int own_db)
+{
+	hbf_qjs_ctx_t *ctx;
+	JSRuntime *rt;
+
+	if (!g_qjs_config.initialized) {
+		hbf_log_error("QuickJS engine not initialized");
+		return NULL;
+	}
+
+	/* Allocate context wrapper */
+	ctx = (hbf_qjs_ctx_t *)calloc(1, sizeof(hbf_qjs_ctx_t));
+	if (!ctx) {
+		hbf_log_error("Failed to allocate QuickJS context");
+		return NULL;
+	}
+
+	/* Create runtime */
+	rt = hbf_qjs_runtime_new();
+	if (!rt) {
+		free(ctx);
+		return NULL;
+	}
+
 	ctx->db = NULL;
 
 	/* Handle database setup */
@@ -154,26 +261,21 @@ static hbf_qjs_ctx_t *hbf_qjs_ctx_create_internal(sqlite3 *db, int own_db)
 			if (ctx->db) {
 				sqlite3_close(ctx->db);
 			}
-			JS_FreeContext(js_ctx);
-			JS_FreeRuntime(rt);
+			hbf_qjs_runtime_free(rt);
 			free(ctx);
 			return NULL;
 		}
 		ctx->own_db = 1; /* Close on destroy */
 	}
 
-	/* Set context opaque to allow DB access from JS modules */
-	JS_SetContextOpaque(js_ctx, ctx);
-
-	/* Initialize ES module loader */
-	hbf_qjs_module_loader_init(rt, ctx->db);
-
-	/* Register custom modules */
-	hbf_qjs_init_db_module(js_ctx);
-	hbf_qjs_init_console_module(js_ctx);
-
-	/* Initialize response class for proper opaque pointer handling */
-	hbf_qjs_init_response_class(js_ctx);
+	if (hbf_qjs_ctx_attach(ctx, rt) != 0) {
+		if (ctx->own_db) {
+			sqlite3_close(ctx->db);
+		}
+		hbf_qjs_runtime_free(rt);
+		free(ctx);
+		return NULL;
+	}
 
 	hbf_log_debug("QuickJS context created");
 	return ctx;
@@ -202,24 +304,253 @@ void hbf_qjs_ctx_destroy(hbf_qjs_ctx_t *ctx)
 		return;
 	}
 
-	/* Only close database if we own it */
-	if (ctx->db && ctx->own_db) {
-		sqlite3_close(ctx->db);
-		ctx->db = NULL;
+	/* Pooled runtimes outlive their contexts */
+	if (ctx->pooled) {
+		hbf_qjs_ctx_release(ctx);
+		return;
 	}
 
 	if (ctx->ctx && ctx->rt) {
+		hbf_qjs_timers_free(ctx);
 		JS_RunGC(ctx->rt);
 		JS_FreeContext(ctx->ctx);
-		JS_FreeRuntime(ctx->rt);
+		hbf_qjs_runtime_free(ctx->rt);
 		ctx->ctx = NULL;
 		ctx->rt = NULL;
 	}
 
+	/* Only close database if we own it (after JS cursors are gone) */
+	if (ctx->db && ctx->own_db) {
+		hbf_db_stmt_cache_clear(ctx->db);
+		sqlite3_close(ctx->db);
+		ctx->db = NULL;
+	}
+
 	free(ctx);
 	hbf_log_debug("QuickJS context destroyed");
 }
 
+/* Free a worker's runtime (if any) */
+static void hbf_qjs_worker_free_runtime(hbf_qjs_worker_t *worker)
+{
+	if (worker->rt) {
+		hbf_qjs_runtime_free(worker->rt);
+		worker->rt = NULL;
+		hbf_log_debug("Pooled QuickJS runtime freed after %u requests",
+			      worker->requests);
+	}
+	worker->requests = 0;
+	worker->in_use = 0;
+}
+
+/* Thread-exit destructor for the worker key */
+static void hbf_qjs_worker_destructor(void *arg)
+{
+	hbf_qjs_worker_t *worker = (hbf_qjs_worker_t *)arg;
+
+	if (!worker) {
+		return;
+	}
+
+	hbf_qjs_worker_free_runtime(worker);
+	hbf_qjs_module_template_free(worker->tpl);
+	free(worker);
+}
+
+static void hbf_qjs_worker_key_init(void)
+{
+	if (pthread_key_create(&g_qjs_worker_key, hbf_qjs_worker_destructor) == 0) {
+		g_qjs_worker_key_ok = 1;
+	} else {
+		hbf_log_error("Failed to create QuickJS worker key");
+	}
+}
+
+/* Get (or lazily create) the calling thread's worker slot */
+static hbf_qjs_worker_t *hbf_qjs_worker_get(void)
+{
+	hbf_qjs_worker_t *worker;
+
+	pthread_once(&g_qjs_worker_once, hbf_qjs_worker_key_init);
+	if (!g_qjs_worker_key_ok) {
+		return NULL;
+	}
+
+	worker = (hbf_qjs_worker_t *)pthread_getspecific(g_qjs_worker_key);
+	if (worker) {
+		return worker;
+	}
+
+	worker = (hbf_qjs_worker_t *)calloc(1, sizeof(hbf_qjs_worker_t));
+	if (!worker) {
+		hbf_log_error("Failed to allocate QuickJS worker");
+		return NULL;
+	}
+
+	if (pthread_setspecific(g_qjs_worker_key, worker) != 0) {
+		hbf_log_error("Failed to register QuickJS worker");
+		free(worker);
+		return NULL;
+	}
+
+	return worker;
+}
+
+/*
+ * Decide whether a worker's runtime should be dropped after a release.
+ * The arena never hands memory back to the system while its runtime
+ * lives, so its footprint is what the heap watermark is checked against.
+ */
+static int hbf_qjs_worker_should_recycle(hbf_qjs_worker_t *worker)
+{
+	hbf_qjs_arena_t *arena;
+
+	if (g_qjs_config.recycle_requests > 0 &&
+	    worker->requests >= g_qjs_config.recycle_requests) {
+		return 1;
+	}
+
+	if (g_qjs_config.recycle_heap_bytes == 0) {
+		return 0;
+	}
+
+	arena = (hbf_qjs_arena_t *)JS_GetRuntimeOpaque(worker->rt);
+	return hbf_qjs_arena_footprint(arena) > g_qjs_config.recycle_heap_bytes;
+}
+
+/* Configure recycling of pooled worker runtimes */
+void hbf_qjs_set_recycle_policy(unsigned int max_requests,
+				size_t heap_watermark_mb)
+{
+	g_qjs_config.recycle_requests = max_requests;
+	g_qjs_config.recycle_heap_bytes = heap_watermark_mb * 1024 * 1024;
+
+	hbf_log_debug("QuickJS recycle policy: %u requests, %zu MB heap",
+		      max_requests, heap_watermark_mb);
+}
+
+/* Acquire a fresh context on the calling thread's pooled runtime */
+hbf_qjs_ctx_t *hbf_qjs_ctx_acquire(sqlite3 *db)
+{
+	hbf_qjs_worker_t *worker;
+	hbf_qjs_ctx_t *ctx;
+
+	if (!g_qjs_config.initialized) {
+		hbf_log_error("QuickJS engine not initialized");
+		return NULL;
+	}
+
+	if (!db) {
+		hbf_log_error("External database pointer is NULL");
+		return NULL;
+	}
+
+	worker = hbf_qjs_worker_get();
+	if (!worker) {
+		return NULL;
+	}
+
+	/* Nested acquire on the same thread: fall back to a private runtime */
+	if (worker->in_use) {
+		hbf_log_debug("Pooled QuickJS runtime busy, using a private runtime");
+		return hbf_qjs_ctx_create_internal(db, 0);
+	}
+
+	if (!worker->rt) {
+		worker->rt = hbf_qjs_runtime_new();
+		if (!worker->rt) {
+			return NULL;
+		}
+		worker->requests = 0;
+		hbf_log_debug("Pooled QuickJS runtime created");
+	} else {
+		/* Stack depth at entry differs between requests */
+		JS_UpdateStackTop(worker->rt);
+	}
+
+	ctx = (hbf_qjs_ctx_t *)calloc(1, sizeof(hbf_qjs_ctx_t));
+	if (!ctx) {
+		hbf_log_error("Failed to allocate QuickJS context");
+		return NULL;
+	}
+
+	ctx->db = db;
+	ctx->own_db = 0;
+	ctx->pooled = 1;
+
+	/* Start from the worker's module template if the files are unchanged */
+	if (!worker->tpl) {
+		worker->tpl = hbf_qjs_module_template_new();
+	}
+	hbf_qjs_module_template_sync(worker->tpl, overlay_fs_generation());
+	ctx->tpl = worker->tpl;
+
+	if (hbf_qjs_ctx_attach(ctx, worker->rt) != 0) {
+		free(ctx);
+		return NULL;
+	}
+
+	worker->in_use = 1;
+	return ctx;
+}
+
+/* Release a context obtained from hbf_qjs_ctx_acquire */
+void hbf_qjs_ctx_release(hbf_qjs_ctx_t *ctx)
+{
+	hbf_qjs_worker_t *worker;
+	JSRuntime *rt;
+	int recycle;
+
+	if (!ctx) {
+		return;
+	}
+
+	/*
+	 * A cursor in a reference cycle is only finalized by a GC that a
+	 * pooled runtime may not run soon; its statement would keep this
+	 * thread's reader on an old snapshot
+	 */
+	hbf_qjs_db_cursors_close(ctx);
+
+	/* A transaction the request left open must not outlive it */
+	hbf_db_pool_writer_end(ctx->db);
+	overlay_fs_statement_done(ctx->db);
+
+	if (!ctx->pooled) {
+		hbf_qjs_ctx_destroy(ctx);
+		return;
+	}
+
+	worker = (hbf_qjs_worker_t *)pthread_getspecific(g_qjs_worker_key);
+	rt = ctx->rt;
+
+	/*
+	 * Jobs still queued belong to the released context; they must never
+	 * run against the next request's context, so such a runtime is dropped.
+	 */
+	recycle = JS_IsJobPending(rt);
+
+	hbf_qjs_timers_free(ctx);
+	JS_FreeContext(ctx->ctx);
+	JS_SetInterruptHandler(rt, NULL, NULL);
+	ctx->ctx = NULL;
+	ctx->rt = NULL;
+	free(ctx);
+
+	if (!worker || worker->rt != rt) {
+		/* Should not happen: released on a thread that does not own rt */
+		hbf_log_error("QuickJS context released on foreign thread");
+		return;
+	}
+
+	worker->in_use = 0;
+	worker->requests++;
+
+	if (recycle || hbf_qjs_worker_should_recycle(worker)) {
+		hbf_qjs_worker_free_runtime(worker);
+	}
+}
+
 /* Evaluate JavaScript code */
 int hbf_qjs_eval(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 		 const char *filename)
@@ -270,6 +601,64 @@ int hbf_qjs_eval(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 	return 0;
 }
 
+/* Record the pending exception of js_ctx in ctx->error_buf */
+static void hbf_qjs_capture_error(hbf_qjs_ctx_t *ctx, const char *fallback)
+{
+	JSValue exception = JS_GetException(ctx->ctx);
+	const char *str = JS_ToCString(ctx->ctx, exception);
+
+	if (str) {
+		snprintf(ctx->error_buf, sizeof(ctx->error_buf), "%s", str);
+		JS_FreeCString(ctx->ctx, str);
+	} else {
+		snprintf(ctx->error_buf, sizeof(ctx->error_buf), "%s", fallback);
+	}
+
+	JS_FreeValue(ctx->ctx, exception);
+}
+
+/* Check a module evaluation result and run its pending jobs */
+static int hbf_qjs_finish_module(hbf_qjs_ctx_t *ctx, JSValue result)
+{
+	JSContext *js_ctx = ctx->ctx;
+
+	/* Check for exception */
+	if (JS_IsException(result)) {
+		hbf_qjs_capture_error(ctx, "Unknown JavaScript module error");
+		JS_FreeValue(js_ctx, result);
+
+		hbf_log_warn("JavaScript module evaluation error: %s",
+			     ctx->error_buf);
+		return -1;
+	}
+
+	/* Module evaluation returns a promise, execute pending jobs */
+	JSContext *pctx;
+	int ret;
+
+	while (1) {
+		ret = JS_ExecutePendingJob(JS_GetRuntime(js_ctx), &pctx);
+		if (ret < 0) {
+			/* Error during job execution */
+			hbf_qjs_capture_error(ctx, "Unknown JavaScript job error");
+			JS_FreeValue(js_ctx, result);
+
+			hbf_log_warn("JavaScript module job error: %s",
+				     ctx->error_buf);
+			return -1;
+		}
+
+		if (ret == 0) {
+			/* No more jobs */
+			break;
+		}
+	}
+
+	JS_FreeValue(js_ctx, result);
+	ctx->error_buf[0] = '\0';
+	return 0;
+}
+
 /* Evaluate JavaScript code as an ES module */
 int hbf_qjs_eval_module(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 			const char *filename)
@@ -295,62 +684,153 @@ int hbf_qjs_eval_module(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 	/* Evaluate code as a module */
 	result = JS_Eval(js_ctx, code, len, filename, JS_EVAL_TYPE_MODULE);
 
-	/* Check for exception */
-	if (JS_IsException(result)) {
-		JSValue exception = JS_GetException(js_ctx);
-		const char *str = JS_ToCString(js_ctx, exception);
-
-		if (str) {
-			snprintf(ctx->error_buf, sizeof(ctx->error_buf),
-				 "%s", str);
-			JS_FreeCString(js_ctx, str);
-		} else {
-			snprintf(ctx->error_buf, sizeof(ctx->error_buf),
-				 "Unknown JavaScript module error");
-		}
+	return hbf_qjs_finish_module(ctx, result);
+}
 
-		JS_FreeValue(js_ctx, exception);
-		JS_FreeValue(ctx->ctx, result);
+/* Evaluate the latest version of a module stored in the database */
+int hbf_qjs_eval_module_path(hbf_qjs_ctx_t *ctx, const char *path)
+{
+	JSValue func_val;
+	JSValue result;
+	JSContext *js_ctx;
 
-		hbf_log_warn("JavaScript module evaluation error: %s",
-			     ctx->error_buf);
+	if (!ctx || !ctx->ctx || !path) {
+		hbf_log_error("Invalid arguments to hbf_qjs_eval_module_path");
 		return -1;
 	}
 
-	/* Module evaluation returns a promise, execute pending jobs */
+	js_ctx = ctx->ctx;
+
+	/* Reset start time for timeout tracking */
+	ctx->start_time_ms = hbf_qjs_get_time_ms();
+
+	/* Compiled bytecode comes from the cache when available */
+	func_val = hbf_qjs_module_load(js_ctx, ctx->db, path);
+	if (JS_IsUndefined(func_val)) {
+		snprintf(ctx->error_buf, sizeof(ctx->error_buf),
+			 "Module not found: %s", path);
+		return -2;
+	}
+
+	if (!JS_IsException(func_val) && JS_ResolveModule(js_ctx, func_val) < 0) {
+		JS_FreeValue(js_ctx, func_val);
+		func_val = JS_EXCEPTION;
+	}
+
+	if (JS_IsException(func_val)) {
+		return hbf_qjs_finish_module(ctx, func_val);
+	}
+
+	result = JS_EvalFunction(js_ctx, func_val);
+
+	return hbf_qjs_finish_module(ctx, result);
+}
+
+/* Record the rejection reason of a handler promise */
+static void hbf_qjs_capture_rejection(hbf_qjs_ctx_t *ctx, JSValueConst promise)
+{
+	JSValue reason = JS_PromiseResult(ctx->ctx, promise);
+	const char *str = JS_ToCString(ctx->ctx, reason);
+
+	if (str) {
+		snprintf(ctx->error_buf, sizeof(ctx->error_buf),
+			 "Unhandled promise rejection: %s", str);
+		JS_FreeCString(ctx->ctx, str);
+	} else {
+		snprintf(ctx->error_buf, sizeof(ctx->error_buf),
+			 "Unhandled promise rejection");
+	}
+
+	JS_FreeValue(ctx->ctx, reason);
+}
+
+/* Run the context's event loop until a handler result has settled */
+int hbf_qjs_run_event_loop(hbf_qjs_ctx_t *ctx, JSValueConst result,
+			   const int *done)
+{
 	JSContext *pctx;
+	int is_promise;
+	int64_t now;
+	int64_t wake;
 	int ret;
 
+	if (!ctx || !ctx->ctx) {
+		hbf_log_error("Invalid arguments to hbf_qjs_run_event_loop");
+		return -1;
+	}
+
+	is_promise = JS_IsPromise(result);
+
 	while (1) {
-		ret = JS_ExecutePendingJob(JS_GetRuntime(js_ctx), &pctx);
+		/* Microtasks first: promise reactions and queueMicrotask */
+		do {
+			ret = JS_ExecutePendingJob(ctx->rt, &pctx);
+		} while (ret > 0);
+
 		if (ret < 0) {
-			/* Error during job execution */
-			JSValue exc = JS_GetException(js_ctx);
-			const char *str = JS_ToCString(js_ctx, exc);
+			hbf_qjs_capture_error(ctx, "Unknown JavaScript job error");
+			return -1;
+		}
+
+		if (is_promise) {
+			JSPromiseStateEnum state = JS_PromiseState(ctx->ctx, result);
+
+			if (state == JS_PROMISE_REJECTED) {
+				hbf_qjs_capture_rejection(ctx, result);
+				return -1;
+			}
+
+			if (state == JS_PROMISE_FULFILLED && (!done || *done)) {
+				return 0;
+			}
+		} else if (!done || *done) {
+			return 0;
+		}
+
+		/* Nothing left that could make progress */
+		if (hbf_qjs_timers_next_deadline(ctx) < 0) {
+			if (is_promise &&
+			    JS_PromiseState(ctx->ctx, result) == JS_PROMISE_PENDING) {
+				snprintf(ctx->error_buf, sizeof(ctx->error_buf),
+					 "Handler promise never settled");
+				return -1;
+			}
+			return 0;
+		}
+
+		now = hbf_qjs_get_time_ms();
+		wake = hbf_qjs_timers_next_deadline(ctx);
+
+		if (g_qjs_config.timeout_ms > 0) {
+			int64_t deadline = ctx->start_time_ms + g_qjs_config.timeout_ms;
 
-			if (str) {
+			if (now >= deadline) {
 				snprintf(ctx->error_buf, sizeof(ctx->error_buf),
-					 "%s", str);
-				JS_FreeCString(js_ctx, str);
+					 "Execution timeout after %d ms",
+					 g_qjs_config.timeout_ms);
+				return -2;
 			}
+			if (wake > deadline) {
+				wake = deadline;
+			}
+		}
 
-			JS_FreeValue(js_ctx, exc);
-			JS_FreeValue(js_ctx, result);
+		/* Sleep until the next timer (or the timeout) is due */
+		if (wake > now) {
+			struct timespec ts;
 
-			hbf_log_warn("JavaScript module job error: %s",
-				     ctx->error_buf);
-			return -1;
+			ts.tv_sec = (time_t)((wake - now) / 1000);
+			ts.tv_nsec = (long)((wake - now) % 1000) * 1000000L;
+			nanosleep(&ts, NULL);
+			now = hbf_qjs_get_time_ms();
 		}
 
-		if (ret == 0) {
-			/* No more jobs */
-			break;
+		ret = hbf_qjs_timers_run_due(ctx, now);
+		if (ret < 0) {
+			hbf_qjs_capture_error(ctx, "Unknown JavaScript timer error");
+			return -1;
 		}
 	}
-
-	JS_FreeValue(js_ctx, result);
-	ctx->error_buf[0] = '\0';
-	return 0;
 }
 
 /* Get last error message */
@@ -17,10 +17,15 @@ struct hbf_qjs_ctx {
 	int64_t start_time_ms;
 	sqlite3 *db;
 	int own_db; /* 1 if we own the DB and should close it */
+	int pooled; /* 1 if rt belongs to the calling thread's worker pool */
+	struct hbf_qjs_module_template *tpl; /* Worker's module template or NULL */
+	struct hbf_qjs_timer *timers; /* Pending setTimeout callbacks */
+	uint32_t timer_seq;           /* Last timer id handed out */
+	struct hbf_qjs_db_cursor *cursors; /* Open db.iterate() cursors */
 };
 
 /* Initialize QuickJS engine with global settings
- * mem_limit_mb: Memory limit per context in MB (0 = unlimited)
+ * mem_limit_mb: Memory limit per runtime in MB, enforced by its arena (0 = unlimited)
  * timeout_ms: Execution timeout in milliseconds (0 = unlimited)
  * Returns 0 on success, -1 on error
  */
@@ -44,6 +49,31 @@ hbf_qjs_ctx_t *hbf_qjs_ctx_create_with_db(sqlite3 *db);
 /* Destroy a QuickJS context */
 void hbf_qjs_ctx_destroy(hbf_qjs_ctx_t *ctx);
 
+/* Configure recycling of pooled worker runtimes
+ * max_requests: Recycle a runtime after this many contexts (0 = never)
+ * heap_watermark_mb: Recycle when the runtime's arena has grown beyond
+ *                    this size (0 = never)
+ */
+void hbf_qjs_set_recycle_policy(unsigned int max_requests,
+				size_t heap_watermark_mb);
+
+/* Acquire a fresh context on the calling thread's pooled runtime
+ * The JSRuntime is created on first use and kept warm across requests;
+ * every call gets a brand new JSContext, so no JS state is shared between
+ * acquisitions. Modules are instantiated from the worker's module
+ * template (see module_loader.h) once it has been recorded.
+ * Falls back to a private runtime if the thread's runtime is already in use.
+ * db: Existing SQLite database connection (caller owns, must remain valid)
+ * Returns context handle or NULL on error
+ */
+hbf_qjs_ctx_t *hbf_qjs_ctx_acquire(sqlite3 *db);
+
+/* Release a context obtained from hbf_qjs_ctx_acquire
+ * Frees the JSContext and returns the runtime to the thread's pool, or
+ * frees the runtime when the recycle policy says so.
+ */
+void hbf_qjs_ctx_release(hbf_qjs_ctx_t *ctx);
+
 /* Evaluate JavaScript code in context
  * filename: Source name for error messages (e.g., "server.js" or "<eval>")
  * Returns 0 on success, -1 on error
@@ -62,6 +92,31 @@ int hbf_qjs_eval(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 int hbf_qjs_eval_module(hbf_qjs_ctx_t *ctx, const char *code, size_t len,
 			const char *filename);
 
+/* Evaluate the latest version of a module stored in the database
+ * Like hbf_qjs_eval_module, but loads precompiled bytecode from the
+ * bytecode cache and only parses/compiles on a cache miss.
+ * path: Module path in the versioned filesystem (e.g., "hbf/server.js")
+ * Returns 0 on success, -1 on error, -2 if path does not exist
+ * Error details available via hbf_qjs_get_error()
+ */
+int hbf_qjs_eval_module_path(hbf_qjs_ctx_t *ctx, const char *path);
+
+/* Run the context's event loop until a handler result has settled
+ * Drains pending jobs (promise reactions, queueMicrotask) and fires
+ * setTimeout callbacks until result (if it is a Promise) has settled and
+ * *done is set (if done is non-NULL), or no work is left. The execution
+ * timeout is measured from the last hbf_qjs_begin_exec(), so it covers
+ * the whole async lifetime of the request, including time spent waiting
+ * for timers.
+ * result: Value returned by the handler (any value; not freed)
+ * done: Optional completion flag (e.g. "response sent") or NULL
+ * Returns 0 on success, -1 on error (rejection, uncaught exception, or a
+ * promise that can never settle), -2 on timeout
+ * Error details available via hbf_qjs_get_error()
+ */
+int hbf_qjs_run_event_loop(hbf_qjs_ctx_t *ctx, JSValueConst result,
+			   const int *done);
+
 /* Get last error message from context
  * Returns error string (valid until next call) or NULL if no error
  */
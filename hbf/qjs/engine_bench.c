@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: MIT */
+/* Per-request JavaScript start cost benchmark
+ *
+ * Compares what a request paid before pooling and templates (fresh
+ * runtime, source read from the database, parse + compile + evaluate
+ * hbf/server.js) against a pooled context whose module graph comes
+ * from the worker's module template.
+ *
+ * Usage: bazel run //hbf/qjs:engine_bench [-- iterations]
+ */
+#include "hbf/qjs/engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hbf/db/db.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/shell/log.h"
+
+#define BENCH_DEFAULT_ITERATIONS 500
+#define BENCH_SERVER_JS "hbf/server.js"
+
+static double bench_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/* Fresh runtime + source eval, as every request did originally */
+static int bench_fresh_runtime(sqlite3 *db)
+{
+	hbf_qjs_ctx_t *ctx;
+	unsigned char *src = NULL;
+	size_t len = 0;
+	int ret;
+
+	ctx = hbf_qjs_ctx_create_with_db(db);
+	if (!ctx) {
+		return -1;
+	}
+
+	if (overlay_fs_read_file(BENCH_SERVER_JS, 1, &src, &len) != 0) {
+		hbf_qjs_ctx_destroy(ctx);
+		return -1;
+	}
+
+	ret = hbf_qjs_eval_module(ctx, (const char *)src, len, BENCH_SERVER_JS);
+	free(src);
+	hbf_qjs_ctx_destroy(ctx);
+
+	return ret;
+}
+
+/* Pooled runtime, module graph from the worker's template */
+static int bench_pooled_template(sqlite3 *db)
+{
+	hbf_qjs_ctx_t *ctx;
+	int ret;
+
+	ctx = hbf_qjs_ctx_acquire(db);
+	if (!ctx) {
+		return -1;
+	}
+
+	ret = hbf_qjs_eval_module_path(ctx, BENCH_SERVER_JS);
+	hbf_qjs_ctx_release(ctx);
+
+	return ret;
+}
+
+/* Pooled runtime, context only (lower bound: no module evaluation) */
+static int bench_pooled_context(sqlite3 *db)
+{
+	hbf_qjs_ctx_t *ctx;
+
+	ctx = hbf_qjs_ctx_acquire(db);
+	if (!ctx) {
+		return -1;
+	}
+
+	hbf_qjs_ctx_release(ctx);
+	return 0;
+}
+
+static void bench_run(const char *name, int (*fn)(sqlite3 *), sqlite3 *db,
+		      int iterations)
+{
+	double start;
+	double elapsed;
+	int i;
+
+	/* Warm up caches, pool and template */
+	if (fn(db) != 0) {
+		fprintf(stderr, "%s: warm-up failed\n", name);
+		exit(1);
+	}
+
+	start = bench_now_us();
+	for (i = 0; i < iterations; i++) {
+		if (fn(db) != 0) {
+			fprintf(stderr, "%s: iteration %d failed\n", name, i);
+			exit(1);
+		}
+	}
+	elapsed = bench_now_us() - start;
+
+	printf("  %-40s %10.1f us/request\n", name,
+	       elapsed / (double)iterations);
+}
+
+int main(int argc, char **argv)
+{
+	sqlite3 *db = NULL;
+	int iterations = BENCH_DEFAULT_ITERATIONS;
+
+	if (argc > 1) {
+		iterations = atoi(argv[1]);
+		if (iterations <= 0) {
+			iterations = BENCH_DEFAULT_ITERATIONS;
+		}
+	}
+
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	if (hbf_db_init(1, &db) != 0) {
+		fprintf(stderr, "Failed to initialize database\n");
+		return 1;
+	}
+
+	if (hbf_qjs_init(64, 5000) != 0) {
+		fprintf(stderr, "Failed to initialize QuickJS\n");
+		hbf_db_close(db);
+		return 1;
+	}
+
+	printf("Per-request JS start cost (%d iterations):\n", iterations);
+	bench_run("fresh runtime + compile server.js", bench_fresh_runtime,
+		  db, iterations);
+	bench_run("pooled context + template server.js",
+		  bench_pooled_template, db, iterations);
+	bench_run("pooled context only", bench_pooled_context, db,
+		  iterations);
+
+	hbf_qjs_shutdown();
+	hbf_db_close(db);
+	return 0;
+}
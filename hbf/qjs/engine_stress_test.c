@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: MIT */
+/* Concurrent QuickJS execution stress test
+ *
+ * Runs many request-shaped workloads (acquire, eval, response object,
+ * release) on several threads at once, with no global lock, to guard
+ * against the heap corruption that used to require serializing all JS
+ * execution in the HTTP handler.
+ */
+#include "hbf/qjs/engine.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hbf/qjs/bindings/response.h"
+#include "hbf/shell/log.h"
+#include "quickjs.h"
+#include <sqlite3.h>
+
+#define STRESS_THREADS 8
+#define STRESS_ITERATIONS 250
+
+typedef struct {
+	sqlite3 *db;
+	int id;
+	int failures;
+} stress_worker_t;
+
+static const char *handler_js =
+	"function handle(req, res) {\n"
+	"  const items = [];\n"
+	"  for (let i = 0; i < 200; i++) {\n"
+	"    items.push({ id: i, name: 'item' + i, tags: [req.n, i % 7] });\n"
+	"  }\n"
+	"  const rows = db.query('SELECT ? AS n', [req.n]);\n"
+	"  res.status(200 + (rows[0].n % 2));\n"
+	"  res.set('X-Worker', String(req.worker));\n"
+	"  res.send(JSON.stringify({ n: rows[0].n, count: items.length }));\n"
+	"}\n";
+
+/* One request: fresh context, handler call, response check, release */
+static int stress_request(sqlite3 *db, int worker, int n)
+{
+	hbf_qjs_ctx_t *qjs_ctx;
+	JSContext *ctx;
+	JSValue global, handle, req, res, args[2], result;
+	hbf_response_t response;
+	char expected[64];
+	int ok = 1;
+
+	qjs_ctx = hbf_qjs_ctx_acquire(db);
+	if (!qjs_ctx) {
+		return 0;
+	}
+	ctx = (JSContext *)hbf_qjs_get_js_context(qjs_ctx);
+
+	if (hbf_qjs_eval(qjs_ctx, handler_js, strlen(handler_js),
+			 "<stress>") != 0) {
+		hbf_qjs_ctx_release(qjs_ctx);
+		return 0;
+	}
+
+	memset(&response, 0, sizeof(response));
+	response.status_code = 200;
+
+	global = JS_GetGlobalObject(ctx);
+	handle = JS_GetPropertyStr(ctx, global, "handle");
+	req = JS_NewObject(ctx);
+	JS_SetPropertyStr(ctx, req, "n", JS_NewInt32(ctx, n));
+	JS_SetPropertyStr(ctx, req, "worker", JS_NewInt32(ctx, worker));
+	res = hbf_qjs_create_response(ctx, &response);
+
+	args[0] = req;
+	args[1] = res;
+	hbf_qjs_begin_exec(qjs_ctx);
+	result = JS_Call(ctx, handle, JS_UNDEFINED, 2, args);
+
+	if (JS_IsException(result)) {
+		ok = 0;
+	} else {
+		snprintf(expected, sizeof(expected),
+			 "{\"n\":%d,\"count\":200}", n);
+		ok = response.status_code == 200 + (n % 2) &&
+		     response.header_count == 1 && response.body &&
+		     response.body_len == strlen(expected) &&
+		     memcmp(response.body, expected, response.body_len) == 0;
+	}
+
+	JS_FreeValue(ctx, result);
+	JS_FreeValue(ctx, res);
+	JS_FreeValue(ctx, req);
+	JS_FreeValue(ctx, handle);
+	JS_FreeValue(ctx, global);
+	hbf_response_free(&response);
+	hbf_qjs_ctx_release(qjs_ctx);
+
+	return ok;
+}
+
+static void *stress_thread(void *arg)
+{
+	stress_worker_t *w = (stress_worker_t *)arg;
+	int i;
+
+	for (i = 0; i < STRESS_ITERATIONS; i++) {
+		if (!stress_request(w->db, w->id, w->id * STRESS_ITERATIONS + i)) {
+			w->failures++;
+		}
+	}
+
+	return NULL;
+}
+
+static void test_parallel_requests(void)
+{
+	pthread_t threads[STRESS_THREADS];
+	stress_worker_t workers[STRESS_THREADS];
+	sqlite3 *db;
+	int i;
+	int failures = 0;
+
+	assert(sqlite3_open(":memory:", &db) == SQLITE_OK);
+	assert(hbf_qjs_init(64, 5000) == 0);
+
+	/* Recycle often so runtime setup/teardown also races */
+	hbf_qjs_set_recycle_policy(50, 0);
+
+	for (i = 0; i < STRESS_THREADS; i++) {
+		workers[i].db = db;
+		workers[i].id = i;
+		workers[i].failures = 0;
+		assert(pthread_create(&threads[i], NULL, stress_thread,
+				      &workers[i]) == 0);
+	}
+
+	for (i = 0; i < STRESS_THREADS; i++) {
+		assert(pthread_join(threads[i], NULL) == 0);
+		failures += workers[i].failures;
+	}
+
+	hbf_qjs_shutdown();
+	sqlite3_close(db);
+
+	assert(failures == 0); /* Every request MUST produce its own response */
+
+	printf("  ✓ %d threads x %d requests without a global lock\n",
+	       STRESS_THREADS, STRESS_ITERATIONS);
+}
+
+int main(void)
+{
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	printf("QuickJS Concurrency Stress Tests:\n");
+
+	test_parallel_requests();
+
+	printf("\nAll stress tests passed!\n");
+	return 0;
+}
@@ -5,8 +5,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "hbf/db/db.h"
+#include "hbf/db/db_pool.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/db/stmt_cache.h"
+#include "hbf/qjs/bytecode_cache.h"
+#include "hbf/qjs/module_loader.h"
 #include "hbf/shell/log.h"
 #include "quickjs.h"
+#include <sqlite3.h>
 
 /* Helper to evaluate and get integer result */
 static int eval_to_int(hbf_qjs_ctx_t *ctx, const char *code)
@@ -508,6 +515,319 @@ static void test_console_log(void)
 	printf("  ✓ Console module (verified: log/warn/error/debug work)\n");
 }
 
+static void test_pooled_ctx_isolation(void)
+{
+	hbf_qjs_ctx_t *ctx;
+	hbf_qjs_ctx_t *nested;
+	sqlite3 *db;
+	void *rt;
+	char buf[64];
+	int ret;
+
+	assert(sqlite3_open(":memory:", &db) == SQLITE_OK);
+	hbf_qjs_init(64, 5000);
+
+	/* First acquisition: leave a global behind */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	rt = hbf_qjs_get_js_runtime(ctx);
+	ret = hbf_qjs_eval(ctx, "globalThis.leak = 42;",
+			   strlen("globalThis.leak = 42;"), "<test>");
+	assert(ret == 0);
+	hbf_qjs_ctx_release(ctx);
+
+	/* Second acquisition: same runtime, fresh globals */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(hbf_qjs_get_js_runtime(ctx) == rt); /* Runtime MUST be reused */
+	eval_to_string(ctx, "typeof globalThis.leak", buf, sizeof(buf));
+	assert(strcmp(buf, "undefined") == 0); /* Globals MUST NOT leak */
+
+	/* Nested acquisition falls back to a private runtime */
+	nested = hbf_qjs_ctx_acquire(db);
+	assert(nested != NULL);
+	assert(hbf_qjs_get_js_runtime(nested) != rt);
+	assert(eval_to_int(nested, "6 * 7") == 42);
+	hbf_qjs_ctx_release(nested);
+
+	/* Response class registration survives reuse */
+	assert(eval_to_int(ctx, "1 + 1") == 2);
+	hbf_qjs_ctx_release(ctx);
+
+	/* Recycle after every request: contexts still work */
+	hbf_qjs_set_recycle_policy(1, 0);
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(eval_to_int(ctx, "40 + 2") == 42);
+	hbf_qjs_ctx_release(ctx);
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	eval_to_string(ctx, "typeof globalThis.leak", buf, sizeof(buf));
+	assert(strcmp(buf, "undefined") == 0);
+	hbf_qjs_ctx_release(ctx);
+	hbf_qjs_set_recycle_policy(1000, 16);
+
+	hbf_qjs_shutdown();
+	sqlite3_close(db);
+
+	printf("  ✓ Pooled contexts (verified: runtime reuse, isolation, recycle)\n");
+}
+
+/* Number of statements on db that are mid-step */
+static int busy_statements(sqlite3 *db)
+{
+	sqlite3_stmt *stmt = NULL;
+	int n = 0;
+
+	while ((stmt = sqlite3_next_stmt(db, stmt)) != NULL) {
+		if (sqlite3_stmt_busy(stmt)) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static void test_pooled_ctx_cursor_cycle(void)
+{
+	hbf_qjs_ctx_t *ctx;
+	sqlite3 *db;
+
+	assert(sqlite3_open(":memory:", &db) == SQLITE_OK);
+	assert(sqlite3_exec(db,
+			    "CREATE TABLE t (x INTEGER);"
+			    "INSERT INTO t VALUES (1), (2), (3);",
+			    NULL, NULL, NULL) == SQLITE_OK);
+	hbf_qjs_init(64, 5000);
+
+	/* A cursor kept alive by a cycle, left mid-iteration */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(eval_to_int(ctx,
+			   "var holder = {};"
+			   "holder.self = holder;"
+			   "holder.cursor = db.iterate('SELECT x FROM t ORDER BY x');"
+			   "holder.keep = function () { return holder; };"
+			   "holder.cursor.next().value.x") == 1);
+	assert(busy_statements(db) == 1);
+
+	/* Release returns the statement without waiting for a GC */
+	hbf_qjs_ctx_release(ctx);
+	assert(busy_statements(db) == 0);
+
+	/* Cursors that finished or closed are no longer tracked */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(eval_to_int(ctx,
+			   "var c = db.iterate('SELECT x FROM t');"
+			   "c.return();"
+			   "var s = 0;"
+			   "for (const r of db.iterate('SELECT x FROM t')) s += r.x;"
+			   "s") == 6);
+	hbf_qjs_ctx_release(ctx);
+	assert(busy_statements(db) == 0);
+
+	hbf_qjs_shutdown();
+	hbf_db_stmt_cache_clear(db);
+	sqlite3_close(db);
+
+	printf("  ✓ Pooled contexts return open cursors on release\n");
+}
+
+static void test_eval_module_path_bytecode_cache(void)
+{
+	hbf_qjs_ctx_t *ctx;
+	sqlite3 *db = NULL;
+	uint64_t hits_before, hits_after;
+	const char *lib_v1 = "export const answer = 42;";
+	const char *lib_v2 = "export const answer = 43;";
+	const char *main_js =
+		"import { answer } from './lib/answer.js';\n"
+		"globalThis.result = answer;\n";
+
+	assert(hbf_db_init(1, &db) == 0);
+	assert(overlay_fs_write(db, "lib/answer.js",
+				(const unsigned char *)lib_v1,
+				strlen(lib_v1)) == 0);
+	assert(overlay_fs_write(db, "main.js", (const unsigned char *)main_js,
+				strlen(main_js)) == 0);
+
+	hbf_qjs_init(64, 5000);
+	hbf_qjs_bytecode_cache_invalidate(NULL);
+
+	/* First load compiles, caches and records the worker's template */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(hbf_qjs_eval_module_path(ctx, "main.js") == 0);
+	assert(eval_to_int(ctx, "globalThis.result") == 42);
+	assert(hbf_qjs_module_template_count(ctx->tpl) == 2);
+	hbf_qjs_ctx_release(ctx);
+
+	/* Private runtimes (no template) MUST hit the bytecode cache */
+	hbf_qjs_bytecode_cache_stats(&hits_before, NULL, NULL);
+	ctx = hbf_qjs_ctx_create_with_db(db);
+	assert(ctx != NULL);
+	assert(hbf_qjs_eval_module_path(ctx, "main.js") == 0);
+	assert(eval_to_int(ctx, "globalThis.result") == 42);
+	hbf_qjs_ctx_destroy(ctx);
+	hbf_qjs_bytecode_cache_stats(&hits_after, NULL, NULL);
+	assert(hits_after == hits_before + 2); /* main.js + lib/answer.js */
+
+	/* Pooled contexts MUST be served from the template alone */
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(hbf_qjs_eval_module_path(ctx, "main.js") == 0);
+	assert(eval_to_int(ctx, "globalThis.result") == 42);
+	hbf_qjs_ctx_release(ctx);
+	hbf_qjs_bytecode_cache_stats(&hits_before, NULL, NULL);
+	assert(hits_before == hits_after);
+
+	/* A new version MUST invalidate the cached bytecode */
+	assert(overlay_fs_write(db, "lib/answer.js",
+				(const unsigned char *)lib_v2,
+				strlen(lib_v2)) == 0);
+	ctx = hbf_qjs_ctx_acquire(db);
+	assert(ctx != NULL);
+	assert(hbf_qjs_eval_module_path(ctx, "main.js") == 0);
+	assert(eval_to_int(ctx, "globalThis.result") == 43);
+	assert(hbf_qjs_module_template_count(ctx->tpl) == 2);
+
+	/* Missing modules are reported distinctly */
+	assert(hbf_qjs_eval_module_path(ctx, "missing.js") == -2);
+	hbf_qjs_ctx_release(ctx);
+
+	hbf_qjs_shutdown();
+	hbf_db_close(db);
+
+	printf("  ✓ Module by path (verified: bytecode cache, template, invalidation)\n");
+}
+
+static void test_db_execute_transaction(void)
+{
+	hbf_qjs_ctx_t *ctx;
+	sqlite3 *db = NULL;
+
+	/* Pooled: db.query reads on this thread's own connection */
+	assert(hbf_db_init(1, &db) == 0);
+	hbf_qjs_init(64, 5000);
+	ctx = hbf_qjs_ctx_create_with_db(db);
+	assert(ctx != NULL);
+
+	eval_to_int(ctx, "db.execute('CREATE TABLE tx (v INTEGER)')");
+
+	/* BEGIN MUST open the transaction on the writer, not a reader */
+	eval_to_int(ctx, "db.execute('BEGIN')");
+	assert(sqlite3_get_autocommit(db) == 0);
+	assert(eval_to_int(ctx, "db.execute('INSERT INTO tx VALUES (1)')") == 1);
+	assert(eval_to_int(ctx, "db.query('SELECT COUNT(*) AS n FROM tx')[0].n") == 1);
+	eval_to_int(ctx, "db.execute('ROLLBACK')");
+	assert(sqlite3_get_autocommit(db) == 1);
+	assert(eval_to_int(ctx, "db.query('SELECT COUNT(*) AS n FROM tx')[0].n") == 0);
+
+	eval_to_int(ctx, "db.execute('BEGIN')");
+	assert(eval_to_int(ctx, "db.execute('INSERT INTO tx VALUES (2)')") == 1);
+	eval_to_int(ctx, "db.execute('COMMIT')");
+	assert(sqlite3_get_autocommit(db) == 1);
+	assert(eval_to_int(ctx, "db.query('SELECT SUM(v) AS n FROM tx')[0].n") == 2);
+
+	/* The reader was never left inside a transaction */
+	assert(hbf_db_pool_reader(db) != db);
+	assert(sqlite3_get_autocommit(hbf_db_pool_reader(db)) == 1);
+
+	hbf_qjs_ctx_destroy(ctx);
+	hbf_qjs_shutdown();
+	hbf_db_close(db);
+
+	printf("  ✓ db.execute transactions (verified: BEGIN/ROLLBACK/COMMIT on writer)\n");
+}
+
+/* Evaluate an async handler body and run the event loop on its result */
+static int run_async(hbf_qjs_ctx_t *ctx, const char *code, const int *done)
+{
+	JSContext *js_ctx = (JSContext *)hbf_qjs_get_js_context(ctx);
+	JSValue result;
+	int ret;
+
+	hbf_qjs_begin_exec(ctx);
+	result = JS_Eval(js_ctx, code, strlen(code), "<test>",
+			 JS_EVAL_TYPE_GLOBAL);
+	assert(!JS_IsException(result));
+
+	ret = hbf_qjs_run_event_loop(ctx, result, done);
+	JS_FreeValue(js_ctx, result);
+
+	return ret;
+}
+
+static void test_event_loop(void)
+{
+	hbf_qjs_ctx_t *ctx;
+	const char *err;
+	char buf[64];
+	int done = 0;
+
+	hbf_qjs_init(64, 5000);
+	ctx = hbf_qjs_ctx_create();
+	assert(ctx != NULL);
+
+	/* Promise resolved by a timer, after a microtask */
+	assert(run_async(ctx,
+			 "globalThis.order = [];"
+			 "queueMicrotask(() => order.push('micro'));"
+			 "(async () => {"
+			 "  await new Promise(r => setTimeout(r, 20));"
+			 "  order.push('timer');"
+			 "})()",
+			 NULL) == 0);
+	eval_to_string(ctx, "order.join(',')", buf, sizeof(buf));
+	assert(strcmp(buf, "micro,timer") == 0);
+
+	/* Timers fire in deadline order, cleared timers never fire */
+	assert(run_async(ctx,
+			 "globalThis.seen = [];"
+			 "setTimeout(() => seen.push(2), 10);"
+			 "setTimeout(() => seen.push(1), 0);"
+			 "clearTimeout(setTimeout(() => seen.push('x'), 5));"
+			 "setTimeout((a, b) => seen.push(a + b), 15, 1, 2);"
+			 "undefined",
+			 NULL) == 0);
+	eval_to_string(ctx, "seen.join(',')", buf, sizeof(buf));
+	assert(strcmp(buf, "1,2,3") == 0);
+
+	/* Rejected promise is an error */
+	assert(run_async(ctx,
+			 "(async () => { throw new Error('boom'); })()",
+			 NULL) == -1);
+	err = hbf_qjs_get_error(ctx);
+	assert(err != NULL && strstr(err, "boom") != NULL);
+
+	/* A promise nothing can settle is an error, not a hang */
+	assert(run_async(ctx, "new Promise(() => {})", NULL) == -1);
+
+	/* Completion flag keeps the loop going after the promise settles */
+	assert(run_async(ctx,
+			 "globalThis.late = 0;"
+			 "setTimeout(() => { late = 1; }, 10);"
+			 "Promise.resolve(1)",
+			 &done) == 0);
+	assert(eval_to_int(ctx, "late") == 1);
+
+	hbf_qjs_ctx_destroy(ctx);
+	hbf_qjs_shutdown();
+
+	/* Waiting on timers counts against the execution timeout */
+	hbf_qjs_init(64, 100);
+	ctx = hbf_qjs_ctx_create();
+	assert(ctx != NULL);
+	assert(run_async(ctx,
+			 "new Promise(r => setTimeout(r, 1000))",
+			 NULL) == -2);
+	hbf_qjs_ctx_destroy(ctx);
+	hbf_qjs_shutdown();
+
+	printf("  ✓ Event loop (verified: timers, microtasks, rejection, timeout)\n");
+}
+
 int main(void)
 {
 	/* Initialize logging */
@@ -527,6 +847,11 @@ int main(void)
 	test_closures_and_scope();
 	test_boolean_logic();
 	test_console_log();
+	test_pooled_ctx_isolation();
+	test_pooled_ctx_cursor_cycle();
+	test_eval_module_path_bytecode_cache();
+	test_db_execute_transaction();
+	test_event_loop();
 
 	/* DB module tests */
 	hbf_qjs_init(64, 5000);
@@ -581,10 +906,24 @@ int main(void)
 	JS_FreeValue(js_ctx, row0);
 	JS_FreeValue(js_ctx, result);
 
+	/* Iterate rows lazily; for...of and early break both finalize */
+	assert(eval_to_int(ctx,
+			   "var n = 0;"
+			   "for (const r of db.iterate('SELECT id FROM test ORDER BY id')) n += r.id;"
+			   "n") == 3);
+	assert(eval_to_int(ctx,
+			   "var c = db.cursor('SELECT name FROM test WHERE id > ?', [0]);"
+			   "var first = c.next();"
+			   "c.return();"
+			   "(first.done ? 0 : 1) + (c.next().done ? 10 : 0)") == 11);
+	/* Unfinished cursor is finalized by GC / context teardown */
+	assert(eval_to_int(ctx,
+			   "db.iterate('SELECT * FROM test').next().value.id") == 1);
+
 	JS_RunGC(ctx->rt);
 	hbf_qjs_ctx_destroy(ctx);
 	hbf_qjs_shutdown();
-	printf("  ✓ DB module: db.query and db.execute work as expected\n");
+	printf("  ✓ DB module: db.query, db.execute and db.iterate work as expected\n");
 
 	/* Test loading and executing router.js and server.js */
 	hbf_qjs_init(64, 5000);
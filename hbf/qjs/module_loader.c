@@ -2,55 +2,111 @@
  * SPDX-License-Identifier: MIT
  * HBF QuickJS ES Module Loader
  * Loads JavaScript modules from the embedded SQLite database.
+ * Compiled bytecode is cached per (path, version_number), so a module
+ * is only parsed and compiled again after overlay_fs writes a new version.
  */
 
 #include "hbf/qjs/module_loader.h"
 
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "hbf/db/db_pool.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/qjs/bytecode_cache.h"
+#include "hbf/qjs/engine.h"
 #include "hbf/shell/log.h"
 #include "quickjs.h"
 
+/* Latest version of a module in the versioned filesystem */
+typedef struct {
+	int64_t file_id;
+	int64_t version;
+	int64_t mtime;
+	int64_t size;
+} hbf_qjs_module_meta_t;
+
 /*
- * Fetch module source from the versioned filesystem.
- * Returns malloc'd string or NULL on error. Caller must free.
+ * Look up the latest version of module_path.
+ * Returns 1 if found, 0 if not found, -1 on error.
  */
-static char *hbf_qjs_get_module_source(sqlite3 *db, const char *module_path)
+static int hbf_qjs_get_module_meta(sqlite3 *db, const char *module_path,
+				   hbf_qjs_module_meta_t *meta)
 {
 	sqlite3_stmt *stmt = NULL;
-	char *src = NULL;
+	int found = -1;
 	int rc;
-	const char *query = "SELECT data FROM latest_files WHERE path = ?";
-
-	if (!db || !module_path) {
-		return NULL;
-	}
+	const char *query =
+		"SELECT file_id, version_number, mtime, size "
+		"FROM latest_files_meta WHERE path = ?";
 
 	rc = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
 		hbf_log_error("Failed to prepare module query: %s",
 			      sqlite3_errmsg(db));
-		return NULL;
+		return -1;
 	}
 
-	rc = sqlite3_bind_text(stmt, 1, module_path, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 1, module_path, -1, SQLITE_STATIC);
+
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW) {
+		meta->file_id = sqlite3_column_int64(stmt, 0);
+		meta->version = sqlite3_column_int64(stmt, 1);
+		meta->mtime = sqlite3_column_int64(stmt, 2);
+		meta->size = sqlite3_column_int64(stmt, 3);
+		found = 1;
+	} else if (rc == SQLITE_DONE) {
+		found = 0;
+	} else {
+		hbf_log_error("Module query error: %s", sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/*
+ * Fetch module source for one version from the versioned filesystem.
+ * Returns malloc'd NUL-terminated string or NULL on error. Caller must free.
+ */
+static char *hbf_qjs_get_module_source(sqlite3 *db,
+				       const hbf_qjs_module_meta_t *meta,
+				       size_t *len)
+{
+	sqlite3_stmt *stmt = NULL;
+	char *src = NULL;
+	int rc;
+	const char *query =
+		"SELECT b.data, b.encoding, fv.size FROM file_versions fv "
+		"CROSS JOIN blobs b ON b.hash = fv.hash "
+		"WHERE fv.file_id = ? AND fv.version_number = ?";
+
+	rc = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
 	if (rc != SQLITE_OK) {
-		hbf_log_error("Failed to bind module path: %s",
+		hbf_log_error("Failed to prepare module query: %s",
 			      sqlite3_errmsg(db));
-		sqlite3_finalize(stmt);
 		return NULL;
 	}
 
+	sqlite3_bind_int64(stmt, 1, meta->file_id);
+	sqlite3_bind_int64(stmt, 2, meta->version);
+
 	rc = sqlite3_step(stmt);
 	if (rc == SQLITE_ROW) {
-		const unsigned char *data = sqlite3_column_text(stmt, 0);
-		if (data) {
-			src = strdup((const char *)data);
-			if (!src) {
-				hbf_log_error("Failed to allocate module source");
-			}
+		unsigned char *data = NULL;
+
+		/* Decoded contents come NUL-terminated */
+		if (overlay_fs_decode((const char *)sqlite3_column_text(stmt, 1),
+				      sqlite3_column_blob(stmt, 0),
+				      (size_t)sqlite3_column_bytes(stmt, 0),
+				      (size_t)sqlite3_column_int64(stmt, 2),
+				      &data, len) == 0) {
+			src = (char *)data;
+		} else {
+			hbf_log_error("Failed to decode module source");
 		}
 	} else if (rc != SQLITE_DONE) {
 		hbf_log_error("Module query error: %s", sqlite3_errmsg(db));
@@ -60,6 +116,247 @@ static char *hbf_qjs_get_module_source(sqlite3 *db, const char *module_path)
 	return src;
 }
 
+/* Compile a module from source and cache its bytecode */
+static JSValue hbf_qjs_compile_module(JSContext *ctx, sqlite3 *db,
+				      const char *path,
+				      const hbf_qjs_module_meta_t *meta)
+{
+	JSValue func_val;
+	char *src;
+	size_t src_len = 0;
+	uint8_t *buf;
+	size_t buf_len;
+
+	src = hbf_qjs_get_module_source(hbf_db_pool_reader(db), meta,
+					&src_len);
+	if (!src) {
+		return JS_ThrowReferenceError(ctx, "could not load module '%s'",
+					      path);
+	}
+
+	func_val = JS_Eval(ctx, src, src_len, path,
+			   JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+	free(src);
+
+	if (JS_IsException(func_val)) {
+		hbf_log_error("Failed to compile module: %s", path);
+		return func_val;
+	}
+
+	buf = JS_WriteObject(ctx, &buf_len, func_val, JS_WRITE_OBJ_BYTECODE);
+	if (!buf) {
+		/* Still usable, just not cacheable */
+		JS_FreeValue(ctx, JS_GetException(ctx));
+		return func_val;
+	}
+
+	hbf_qjs_bytecode_cache_put(path, meta->version, meta->mtime,
+				   meta->size, buf, buf_len);
+
+	js_free(ctx, buf);
+	return func_val;
+}
+
+/*
+ * Per-worker module template.
+ *
+ * QuickJS cannot snapshot or clone an initialized heap, so the closest
+ * cheap copy of "server.js and its imports, loaded" is the bytecode of the
+ * whole module graph held in one place. While a template is attached
+ * (see hbf_qjs_ctx_acquire) every module loaded is recorded in it; later
+ * contexts re-instantiate the graph straight from the recorded bytecode,
+ * with no SQL, parsing, compilation or shared-cache locking. The template
+ * belongs to one worker thread and is only valid for the overlay_fs
+ * generation it was recorded under.
+ */
+struct hbf_qjs_module_template {
+	uint64_t generation;
+	hbf_qjs_bytecode_t **modules; /* Referenced cache entries */
+	size_t count;
+	size_t cap;
+};
+
+hbf_qjs_module_template_t *hbf_qjs_module_template_new(void)
+{
+	return (hbf_qjs_module_template_t *)calloc(1,
+		sizeof(hbf_qjs_module_template_t));
+}
+
+/* Release every recorded module */
+static void hbf_qjs_module_template_reset(hbf_qjs_module_template_t *tpl)
+{
+	size_t i;
+
+	for (i = 0; i < tpl->count; i++) {
+		hbf_qjs_bytecode_release(tpl->modules[i]);
+	}
+	tpl->count = 0;
+}
+
+void hbf_qjs_module_template_free(hbf_qjs_module_template_t *tpl)
+{
+	if (!tpl) {
+		return;
+	}
+
+	hbf_qjs_module_template_reset(tpl);
+	free(tpl->modules);
+	free(tpl);
+}
+
+void hbf_qjs_module_template_sync(hbf_qjs_module_template_t *tpl,
+				  uint64_t generation)
+{
+	if (!tpl || tpl->generation == generation) {
+		return;
+	}
+
+	if (tpl->count > 0) {
+		hbf_log_debug("Module template outdated, dropping %zu modules",
+			      tpl->count);
+	}
+
+	hbf_qjs_module_template_reset(tpl);
+	tpl->generation = generation;
+}
+
+size_t hbf_qjs_module_template_count(const hbf_qjs_module_template_t *tpl)
+{
+	return tpl ? tpl->count : 0;
+}
+
+static hbf_qjs_bytecode_t *hbf_qjs_module_template_find(
+	hbf_qjs_module_template_t *tpl, const char *path)
+{
+	size_t i;
+
+	for (i = 0; i < tpl->count; i++) {
+		if (strcmp(tpl->modules[i]->path, path) == 0) {
+			return tpl->modules[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Record the cached bytecode of (path, meta); no-op if it is not cached */
+static void hbf_qjs_module_template_record(hbf_qjs_module_template_t *tpl,
+					   const char *path,
+					   const hbf_qjs_module_meta_t *meta)
+{
+	hbf_qjs_bytecode_t *bc;
+
+	bc = hbf_qjs_bytecode_cache_get(path, meta->version, meta->mtime,
+					meta->size);
+	if (!bc) {
+		return;
+	}
+
+	if (tpl->count == tpl->cap) {
+		size_t cap = tpl->cap ? tpl->cap * 2 : 16;
+		hbf_qjs_bytecode_t **modules;
+
+		modules = (hbf_qjs_bytecode_t **)realloc(tpl->modules,
+			cap * sizeof(*modules));
+		if (!modules) {
+			hbf_qjs_bytecode_release(bc);
+			return;
+		}
+		tpl->modules = modules;
+		tpl->cap = cap;
+	}
+
+	tpl->modules[tpl->count++] = bc;
+}
+
+/*
+ * Load the latest version of a module from the database, going through
+ * the in-memory bytecode cache and only compiling the source on a miss.
+ *
+ * Bytecode is never read back from the database: JS_ReadObject trusts
+ * its input, and handler JS can write any table through db.execute.
+ */
+static JSValue hbf_qjs_module_load_db(JSContext *ctx, sqlite3 *db,
+				      const char *path,
+				      hbf_qjs_module_meta_t *meta)
+{
+	hbf_qjs_bytecode_t *bc;
+	JSValue func_val;
+	sqlite3 *rdb;
+	int found;
+
+	/* Lookups run on this thread's read connection */
+	rdb = hbf_db_pool_reader(db);
+
+	found = hbf_qjs_get_module_meta(rdb, path, meta);
+	if (found < 0) {
+		return JS_ThrowInternalError(ctx, "could not query module '%s'",
+					     path);
+	}
+	if (found == 0) {
+		return JS_UNDEFINED;
+	}
+
+	bc = hbf_qjs_bytecode_cache_get(path, meta->version, meta->mtime,
+					meta->size);
+	if (bc) {
+		func_val = JS_ReadObject(ctx, bc->data, bc->len,
+					 JS_READ_OBJ_BYTECODE);
+		hbf_qjs_bytecode_release(bc);
+		if (!JS_IsException(func_val)) {
+			return func_val;
+		}
+		JS_FreeValue(ctx, JS_GetException(ctx));
+		hbf_qjs_bytecode_cache_invalidate(path);
+	}
+
+	return hbf_qjs_compile_module(ctx, db, path, meta);
+}
+
+/*
+ * Load a compiled (not yet evaluated) module by path.
+ * Served from the context's module template when it has the module,
+ * otherwise from the database (and then recorded in the template).
+ */
+JSValue hbf_qjs_module_load(JSContext *ctx, sqlite3 *db, const char *path)
+{
+	hbf_qjs_ctx_t *engine_ctx;
+	hbf_qjs_module_template_t *tpl = NULL;
+	hbf_qjs_module_meta_t meta;
+	hbf_qjs_bytecode_t *bc;
+	JSValue func_val;
+
+	if (!ctx || !db || !path) {
+		return JS_ThrowInternalError(ctx, "module loader: bad arguments");
+	}
+
+	engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
+	if (engine_ctx) {
+		tpl = engine_ctx->tpl;
+	}
+
+	if (tpl) {
+		bc = hbf_qjs_module_template_find(tpl, path);
+		if (bc) {
+			func_val = JS_ReadObject(ctx, bc->data, bc->len,
+						 JS_READ_OBJ_BYTECODE);
+			if (!JS_IsException(func_val)) {
+				return func_val;
+			}
+			JS_FreeValue(ctx, JS_GetException(ctx));
+			hbf_qjs_module_template_reset(tpl);
+		}
+	}
+
+	func_val = hbf_qjs_module_load_db(ctx, db, path, &meta);
+
+	if (tpl && !JS_IsException(func_val) && !JS_IsUndefined(func_val)) {
+		hbf_qjs_module_template_record(tpl, path, &meta);
+	}
+
+	return func_val;
+}
+
 /*
  * Module normalizer callback.
  * Resolves relative module paths against the base module.
@@ -129,13 +426,12 @@ static char *hbf_qjs_module_normalize(JSContext *ctx, const char *base_name,
 
 /*
  * Module loader callback.
- * Loads and compiles a JavaScript module from the database.
+ * Loads a JavaScript module from the database (via the bytecode cache).
  */
 static JSModuleDef *hbf_qjs_module_loader(JSContext *ctx,
 					  const char *module_name, void *opaque)
 {
 	sqlite3 *db = (sqlite3 *)opaque;
-	char *src = NULL;
 	JSValue func_val;
 	JSModuleDef *module = NULL;
 
@@ -144,22 +440,15 @@ static JSModuleDef *hbf_qjs_module_loader(JSContext *ctx,
 		return NULL;
 	}
 
-	/* Fetch module source from database */
-	src = hbf_qjs_get_module_source(db, module_name);
-	if (!src) {
+	func_val = hbf_qjs_module_load(ctx, db, module_name);
+	if (JS_IsUndefined(func_val)) {
 		hbf_log_error("Module not found: %s", module_name);
 		JS_ThrowReferenceError(ctx, "could not load module '%s'",
 				       module_name);
 		return NULL;
 	}
 
-	/* Compile module */
-	func_val = JS_Eval(ctx, src, strlen(src), module_name,
-			   JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
-	free(src);
-
 	if (JS_IsException(func_val)) {
-		hbf_log_error("Failed to compile module: %s", module_name);
 		return NULL;
 	}
 
@@ -8,6 +8,15 @@
 
 #include <quickjs.h>
 #include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Module template: bytecode of a module graph recorded while loading it,
+ * so later contexts can re-instantiate the graph without touching the
+ * database. Owned by a single thread; valid for one overlay_fs generation.
+ */
+typedef struct hbf_qjs_module_template hbf_qjs_module_template_t;
 
 /*
  * Initialize the ES module loader for a QuickJS runtime.
@@ -18,4 +27,29 @@
  */
 void hbf_qjs_module_loader_init(JSRuntime *rt, sqlite3 *db);
 
+/*
+ * Load the latest version of a module as compiled, unevaluated bytecode.
+ * Uses the bytecode cache and only compiles on a miss.
+ *
+ * Returns the module value, JS_UNDEFINED if path does not exist, or
+ * JS_EXCEPTION on error.
+ */
+JSValue hbf_qjs_module_load(JSContext *ctx, sqlite3 *db, const char *path);
+
+/* Create an empty module template. Returns NULL on allocation failure */
+hbf_qjs_module_template_t *hbf_qjs_module_template_new(void);
+
+/* Free a module template and release its bytecode */
+void hbf_qjs_module_template_free(hbf_qjs_module_template_t *tpl);
+
+/*
+ * Validate a template against the current overlay_fs generation.
+ * Recorded modules are dropped if the filesystem changed since recording.
+ */
+void hbf_qjs_module_template_sync(hbf_qjs_module_template_t *tpl,
+				  uint64_t generation);
+
+/* Number of modules recorded in a template */
+size_t hbf_qjs_module_template_count(const hbf_qjs_module_template_t *tpl);
+
 #endif /* HBF_QJS_MODULE_LOADER_H */
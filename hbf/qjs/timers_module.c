@@ -0,0 +1,229 @@
+/* Timers module implementation - per-context timer queue */
+#include "hbf/qjs/timers_module.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "hbf/shell/log.h"
+
+/* Pending setTimeout callback, kept sorted by deadline */
+struct hbf_qjs_timer {
+	struct hbf_qjs_timer *next;
+	int64_t deadline_ms;
+	uint32_t id;
+	JSValue func;
+	int argc;
+	JSValue *argv;
+};
+
+/* Get current time in milliseconds */
+static int64_t hbf_qjs_timers_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void hbf_qjs_timer_free(JSContext *ctx, struct hbf_qjs_timer *timer)
+{
+	int i;
+
+	JS_FreeValue(ctx, timer->func);
+	for (i = 0; i < timer->argc; i++) {
+		JS_FreeValue(ctx, timer->argv[i]);
+	}
+	free(timer->argv);
+	free(timer);
+}
+
+/* setTimeout(fn, delay, ...args) - returns timer id */
+static JSValue js_set_timeout(JSContext *ctx,
+			      JSValueConst this_val __attribute__((unused)),
+			      int argc, JSValueConst *argv)
+{
+	hbf_qjs_ctx_t *engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
+	struct hbf_qjs_timer *timer;
+	struct hbf_qjs_timer **link;
+	int64_t delay = 0;
+	int i;
+
+	if (!engine_ctx) {
+		return JS_ThrowInternalError(ctx, "setTimeout: no engine context");
+	}
+
+	if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+		return JS_ThrowTypeError(ctx, "setTimeout: callback is not a function");
+	}
+
+	if (argc > 1 && JS_ToInt64(ctx, &delay, argv[1]) < 0) {
+		return JS_EXCEPTION;
+	}
+	if (delay < 0) {
+		delay = 0;
+	}
+
+	timer = (struct hbf_qjs_timer *)calloc(1, sizeof(*timer));
+	if (!timer) {
+		return JS_ThrowOutOfMemory(ctx);
+	}
+
+	if (argc > 2) {
+		timer->argv = (JSValue *)calloc((size_t)(argc - 2), sizeof(JSValue));
+		if (!timer->argv) {
+			free(timer);
+			return JS_ThrowOutOfMemory(ctx);
+		}
+		for (i = 2; i < argc; i++) {
+			timer->argv[i - 2] = JS_DupValue(ctx, argv[i]);
+		}
+		timer->argc = argc - 2;
+	}
+
+	timer->func = JS_DupValue(ctx, argv[0]);
+	timer->deadline_ms = hbf_qjs_timers_now_ms() + delay;
+	timer->id = ++engine_ctx->timer_seq;
+
+	/* Keep FIFO order among timers with equal deadlines */
+	link = &engine_ctx->timers;
+	while (*link && (*link)->deadline_ms <= timer->deadline_ms) {
+		link = &(*link)->next;
+	}
+	timer->next = *link;
+	*link = timer;
+
+	return JS_NewUint32(ctx, timer->id);
+}
+
+/* clearTimeout(id) */
+static JSValue js_clear_timeout(JSContext *ctx,
+				JSValueConst this_val __attribute__((unused)),
+				int argc, JSValueConst *argv)
+{
+	hbf_qjs_ctx_t *engine_ctx = (hbf_qjs_ctx_t *)JS_GetContextOpaque(ctx);
+	struct hbf_qjs_timer **link;
+	uint32_t id;
+
+	if (!engine_ctx || argc < 1 || JS_ToUint32(ctx, &id, argv[0]) < 0) {
+		return JS_UNDEFINED;
+	}
+
+	for (link = &engine_ctx->timers; *link; link = &(*link)->next) {
+		if ((*link)->id == id) {
+			struct hbf_qjs_timer *timer = *link;
+
+			*link = timer->next;
+			hbf_qjs_timer_free(ctx, timer);
+			break;
+		}
+	}
+
+	return JS_UNDEFINED;
+}
+
+/* Job that runs a queueMicrotask callback */
+static JSValue js_microtask_job(JSContext *ctx, int argc, JSValueConst *argv)
+{
+	(void)argc;
+
+	return JS_Call(ctx, argv[0], JS_UNDEFINED, 0, NULL);
+}
+
+/* queueMicrotask(fn) */
+static JSValue js_queue_microtask(JSContext *ctx,
+				  JSValueConst this_val __attribute__((unused)),
+				  int argc, JSValueConst *argv)
+{
+	if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+		return JS_ThrowTypeError(ctx, "queueMicrotask: callback is not a function");
+	}
+
+	if (JS_EnqueueJob(ctx, js_microtask_job, 1, argv) < 0) {
+		return JS_EXCEPTION;
+	}
+
+	return JS_UNDEFINED;
+}
+
+/* Timers module function list */
+static const JSCFunctionListEntry timers_funcs[] = {
+	JS_CFUNC_DEF("setTimeout", 2, js_set_timeout),
+	JS_CFUNC_DEF("clearTimeout", 1, js_clear_timeout),
+};
+
+/* Initialize timers module */
+int hbf_qjs_init_timers_module(JSContext *ctx)
+{
+	JSValue global_obj;
+	JSValue existing;
+
+	global_obj = JS_GetGlobalObject(ctx);
+	JS_SetPropertyFunctionList(ctx, global_obj, timers_funcs,
+				   sizeof(timers_funcs) /
+					   sizeof(JSCFunctionListEntry));
+
+	/* Newer engines ship queueMicrotask as a builtin */
+	existing = JS_GetPropertyStr(ctx, global_obj, "queueMicrotask");
+	if (JS_IsUndefined(existing)) {
+		JS_SetPropertyStr(ctx, global_obj, "queueMicrotask",
+				  JS_NewCFunction(ctx, js_queue_microtask,
+						  "queueMicrotask", 1));
+	}
+	JS_FreeValue(ctx, existing);
+	JS_FreeValue(ctx, global_obj);
+
+	return 0;
+}
+
+int64_t hbf_qjs_timers_next_deadline(hbf_qjs_ctx_t *ctx)
+{
+	if (!ctx || !ctx->timers) {
+		return -1;
+	}
+
+	return ctx->timers->deadline_ms;
+}
+
+int hbf_qjs_timers_run_due(hbf_qjs_ctx_t *ctx, int64_t now_ms)
+{
+	struct hbf_qjs_timer *timer;
+	JSValue ret;
+
+	if (!ctx || !ctx->timers || ctx->timers->deadline_ms > now_ms) {
+		return 0;
+	}
+
+	/* Unlink first: the callback may add or clear timers */
+	timer = ctx->timers;
+	ctx->timers = timer->next;
+
+	ret = JS_Call(ctx->ctx, timer->func, JS_UNDEFINED, timer->argc,
+		      (JSValueConst *)timer->argv);
+	hbf_qjs_timer_free(ctx->ctx, timer);
+
+	if (JS_IsException(ret)) {
+		return -1;
+	}
+
+	JS_FreeValue(ctx->ctx, ret);
+	return 1;
+}
+
+void hbf_qjs_timers_free(hbf_qjs_ctx_t *ctx)
+{
+	struct hbf_qjs_timer *timer;
+
+	if (!ctx) {
+		return;
+	}
+
+	if (ctx->timers) {
+		hbf_log_debug("Dropping pending timers of finished request");
+	}
+
+	while (ctx->timers) {
+		timer = ctx->timers;
+		ctx->timers = timer->next;
+		hbf_qjs_timer_free(ctx->ctx, timer);
+	}
+}
@@ -0,0 +1,30 @@
+/* Timers module for QuickJS - setTimeout/clearTimeout/queueMicrotask */
+#ifndef HBF_QJS_TIMERS_MODULE_H
+#define HBF_QJS_TIMERS_MODULE_H
+
+#include <stdint.h>
+
+#include "hbf/qjs/engine.h"
+#include "quickjs.h"
+
+/* Initialize timers module
+ * Registers global setTimeout, clearTimeout and queueMicrotask (unless
+ * the engine already provides it). Timers live on the context's
+ * hbf_qjs_ctx_t and are driven by hbf_qjs_run_event_loop().
+ * Returns 0 on success, -1 on error
+ */
+int hbf_qjs_init_timers_module(JSContext *ctx);
+
+/* Earliest timer deadline (monotonic ms), or -1 if no timers are pending */
+int64_t hbf_qjs_timers_next_deadline(hbf_qjs_ctx_t *ctx);
+
+/* Run the earliest timer if it is due at now_ms
+ * Returns 1 if a timer ran, 0 if none was due, -1 if the callback threw
+ * (exception left pending on the context)
+ */
+int hbf_qjs_timers_run_due(hbf_qjs_ctx_t *ctx, int64_t now_ms);
+
+/* Drop all pending timers (must run before the JSContext is freed) */
+void hbf_qjs_timers_free(hbf_qjs_ctx_t *ctx);
+
+#endif /* HBF_QJS_TIMERS_MODULE_H */
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void print_usage(const char *program)
 {
@@ -12,9 +13,58 @@ static void print_usage(const char *program)
 	printf("  --port PORT          HTTP server port (default: 5309)\n");
 	printf("  --log-level LEVEL    Log level: debug, info, warn, error (default: info)\n");
 	printf("  --inmem              Use in-memory database (for testing)\n");
+	printf("  --stmt-cache N       Prepared statements cached per connection, 0 disables (default: 64)\n");
+	printf("  --compact            Delete old file versions, then exit\n");
+	printf("  --keep-versions N    Versions kept per file by --compact (default: 10)\n");
+	printf("  --keep-since TIME    Also keep versions modified at/after Unix TIME\n");
+	printf("  --no-keep-alive      Close HTTP connections after each response\n");
+	printf("  --keep-alive-timeout MS  Idle timeout of kept-alive connections (default: 2000)\n");
+	printf("  --threads N          HTTP worker threads (default: 8 per CPU, at least 32)\n");
+	printf("  --connection-queue N Accepted connections waiting for a worker (default: 20)\n");
+	printf("  --listen-backlog N   Pending connections queued by the kernel (default: 200)\n");
+	printf("  --request-timeout MS Time allowed to receive a request (default: 30000)\n");
+	printf("  --js-memory MB       Memory limit per JS runtime, 0 is unlimited (default: 64)\n");
+	printf("  --js-timeout MS      JS execution time limit, 0 is unlimited (default: 5000)\n");
 	printf("  --help, -h           Show this help message\n");
 }
 
+/* Default worker count, scaled by the online CPUs */
+static int default_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1) {
+		n = 1;
+	}
+	n = n > HBF_CONFIG_MAX_THREADS / HBF_CONFIG_THREADS_PER_CPU ?
+		    HBF_CONFIG_MAX_THREADS : n * HBF_CONFIG_THREADS_PER_CPU;
+	return n < HBF_CONFIG_MIN_THREADS ? HBF_CONFIG_MIN_THREADS : (int)n;
+}
+
+/*
+ * Parse the integer argument of option argv[*i] into value, advancing *i.
+ * what names the value in the error message. Returns 0 or -1.
+ */
+static int parse_int_arg(int argc, char *argv[], int *i, long min, long max,
+                         const char *what, int *value)
+{
+	char *endptr;
+	long val;
+
+	if (*i + 1 >= argc) {
+		hbf_log_error("%s requires an argument", argv[*i]);
+		return -1;
+	}
+	val = strtol(argv[++*i], &endptr, 10);
+	if (*endptr != '\0' || val < min || val > max) {
+		hbf_log_error("Invalid %s: %s", what, argv[*i]);
+		return -1;
+	}
+
+	*value = (int)val;
+	return 0;
+}
+
 int hbf_config_parse(int argc, char *argv[], hbf_config_t *config)
 {
 	int i;
@@ -27,6 +77,18 @@ int hbf_config_parse(int argc, char *argv[], hbf_config_t *config)
 	config->port = 5309;
 	strncpy(config->log_level, "info", sizeof(config->log_level) - 1);
 	config->inmem = 0;
+	config->stmt_cache = 64; /* HBF_DB_STMT_CACHE_CAPACITY */
+	config->compact = 0;
+	config->keep_versions = 10;
+	config->keep_since = 0;
+	config->keep_alive = 1;
+	config->keep_alive_timeout_ms = 2000; /* HBF_SERVER_KEEP_ALIVE_TIMEOUT_MS */
+	config->threads = default_threads();
+	config->connection_queue = 20;    /* HBF_SERVER_CONNECTION_QUEUE */
+	config->listen_backlog = 200;     /* HBF_SERVER_LISTEN_BACKLOG */
+	config->request_timeout_ms = 30000; /* HBF_SERVER_REQUEST_TIMEOUT_MS */
+	config->js_memory_mb = 64;
+	config->js_timeout_ms = 5000;
 
 	/* Parse arguments */
 	for (i = 1; i < argc; i++) {
@@ -35,19 +97,10 @@ int hbf_config_parse(int argc, char *argv[], hbf_config_t *config)
 			return 1;
 		}
 		if (strcmp(argv[i], "--port") == 0) {
-			char *endptr;
-			long port_val;
-
-			if (i + 1 >= argc) {
-				hbf_log_error("--port requires an argument");
+			if (parse_int_arg(argc, argv, &i, 1, 65535, "port",
+			                  &config->port) != 0) {
 				return -1;
 			}
-			port_val = strtol(argv[++i], &endptr, 10);
-			if (*endptr != '\0' || port_val <= 0 || port_val > 65535) {
-				hbf_log_error("Invalid port: %s", argv[i]);
-				return -1;
-			}
-			config->port = (int)port_val;
 			continue;
 		}
 		if (strcmp(argv[i], "--log-level") == 0) {
@@ -63,6 +116,101 @@ int hbf_config_parse(int argc, char *argv[], hbf_config_t *config)
 			config->inmem = 1;
 			continue;
 		}
+		if (strcmp(argv[i], "--stmt-cache") == 0) {
+			if (parse_int_arg(argc, argv, &i, 0, 100000,
+			                  "statement cache size",
+			                  &config->stmt_cache) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--compact") == 0) {
+			config->compact = 1;
+			continue;
+		}
+		if (strcmp(argv[i], "--keep-versions") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, 1000000,
+			                  "version count",
+			                  &config->keep_versions) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--keep-since") == 0) {
+			char *endptr;
+			long long since_val;
+
+			if (i + 1 >= argc) {
+				hbf_log_error("--keep-since requires an argument");
+				return -1;
+			}
+			since_val = strtoll(argv[++i], &endptr, 10);
+			if (*endptr != '\0' || since_val < 0) {
+				hbf_log_error("Invalid time: %s", argv[i]);
+				return -1;
+			}
+			config->keep_since = (int64_t)since_val;
+			continue;
+		}
+		if (strcmp(argv[i], "--no-keep-alive") == 0) {
+			config->keep_alive = 0;
+			continue;
+		}
+		if (strcmp(argv[i], "--keep-alive-timeout") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, 3600000,
+			                  "keep-alive timeout",
+			                  &config->keep_alive_timeout_ms) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--threads") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, HBF_CONFIG_MAX_THREADS,
+			                  "thread count", &config->threads) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--connection-queue") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, 100000,
+			                  "connection queue length",
+			                  &config->connection_queue) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--listen-backlog") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, 65535,
+			                  "listen backlog",
+			                  &config->listen_backlog) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--request-timeout") == 0) {
+			if (parse_int_arg(argc, argv, &i, 1, 3600000,
+			                  "request timeout",
+			                  &config->request_timeout_ms) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--js-memory") == 0) {
+			if (parse_int_arg(argc, argv, &i, 0, 65536,
+			                  "JS memory limit",
+			                  &config->js_memory_mb) != 0) {
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "--js-timeout") == 0) {
+			if (parse_int_arg(argc, argv, &i, 0, 3600000,
+			                  "JS timeout",
+			                  &config->js_timeout_ms) != 0) {
+				return -1;
+			}
+			continue;
+		}
 		hbf_log_error("Unknown option: %s", argv[i]);
 		return -1;
 	}
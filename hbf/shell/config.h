@@ -2,10 +2,35 @@
 #ifndef HBF_CONFIG_H
 #define HBF_CONFIG_H
 
+#include <stdint.h>
+
+/* Upper bound of --threads (and of the default) */
+#define HBF_CONFIG_MAX_THREADS 256
+
+/*
+ * Default --threads: HBF_CONFIG_THREADS_PER_CPU per online CPU, at least
+ * HBF_CONFIG_MIN_THREADS. A kept-alive connection holds a worker while
+ * idle, so workers must far outnumber the connections actually busy.
+ */
+#define HBF_CONFIG_THREADS_PER_CPU 8
+#define HBF_CONFIG_MIN_THREADS 32
+
 typedef struct {
 	int port;
 	char log_level[16];
 	int inmem;
+	int stmt_cache; /* Prepared statements cached per connection */
+	int compact;        /* Compact file version history and exit */
+	int keep_versions;  /* Newest versions kept per file by --compact */
+	int64_t keep_since; /* Unix time; versions from then on are kept too */
+	int keep_alive;            /* Persistent HTTP connections */
+	int keep_alive_timeout_ms; /* Idle timeout of kept-alive connections */
+	int threads;            /* HTTP worker threads */
+	int connection_queue;   /* Accepted connections waiting for a worker */
+	int listen_backlog;     /* Kernel queue of unaccepted connections */
+	int request_timeout_ms; /* Time allowed to receive a request */
+	int js_memory_mb;       /* Memory limit per QuickJS runtime (0: none) */
+	int js_timeout_ms;      /* QuickJS execution time limit (0: none) */
 } hbf_config_t;
 
 /*
@@ -16,6 +16,19 @@ static void test_config_parse_defaults(void)
 	assert(config.port == 5309);
 	assert(strcmp(config.log_level, "info") == 0);
 	assert(config.inmem == 0);
+	assert(config.stmt_cache == 64);
+	assert(config.compact == 0);
+	assert(config.keep_versions == 10);
+	assert(config.keep_since == 0);
+	assert(config.keep_alive == 1);
+	assert(config.keep_alive_timeout_ms == 2000);
+	assert(config.threads >= HBF_CONFIG_MIN_THREADS &&
+	       config.threads <= HBF_CONFIG_MAX_THREADS);
+	assert(config.connection_queue == 20);
+	assert(config.listen_backlog == 200);
+	assert(config.request_timeout_ms == 30000);
+	assert(config.js_memory_mb == 64);
+	assert(config.js_timeout_ms == 5000);
 
 	printf("  ✓ Config defaults\n");
 }
@@ -75,6 +88,97 @@ static void test_config_parse_inmem(void)
 	printf("  ✓ Inmem flag\n");
 }
 
+static void test_config_parse_stmt_cache(void)
+{
+	hbf_config_t config;
+	char *argv[] = {(char *)"hbf", (char *)"--stmt-cache", (char *)"0"};
+	char *bad[] = {(char *)"hbf", (char *)"--stmt-cache", (char *)"-1"};
+	int ret;
+
+	ret = hbf_config_parse(3, argv, &config);
+
+	assert(ret == 0);
+	assert(config.stmt_cache == 0);
+	assert(hbf_config_parse(3, bad, &config) == -1);
+
+	printf("  ✓ Statement cache size\n");
+}
+
+static void test_config_parse_compact(void)
+{
+	hbf_config_t config;
+	char *argv[] = {
+		(char *)"hbf", (char *)"--compact",
+		(char *)"--keep-versions", (char *)"3",
+		(char *)"--keep-since", (char *)"1700000000"
+	};
+	char *bad[] = {(char *)"hbf", (char *)"--keep-versions", (char *)"0"};
+	int ret;
+
+	ret = hbf_config_parse(6, argv, &config);
+
+	assert(ret == 0);
+	assert(config.compact == 1);
+	assert(config.keep_versions == 3);
+	assert(config.keep_since == 1700000000);
+	assert(hbf_config_parse(3, bad, &config) == -1);
+
+	printf("  ✓ Compaction flags\n");
+}
+
+static void test_config_parse_keep_alive(void)
+{
+	hbf_config_t config;
+	char *argv[] = {
+		(char *)"hbf", (char *)"--no-keep-alive",
+		(char *)"--keep-alive-timeout", (char *)"15000"
+	};
+	char *bad[] = {(char *)"hbf", (char *)"--keep-alive-timeout", (char *)"0"};
+	int ret;
+
+	ret = hbf_config_parse(4, argv, &config);
+
+	assert(ret == 0);
+	assert(config.keep_alive == 0);
+	assert(config.keep_alive_timeout_ms == 15000);
+	assert(hbf_config_parse(3, bad, &config) == -1);
+
+	printf("  ✓ Keep-alive flags\n");
+}
+
+static void test_config_parse_limits(void)
+{
+	hbf_config_t config;
+	char *argv[] = {
+		(char *)"hbf",
+		(char *)"--threads", (char *)"16",
+		(char *)"--connection-queue", (char *)"128",
+		(char *)"--listen-backlog", (char *)"1024",
+		(char *)"--request-timeout", (char *)"10000",
+		(char *)"--js-memory", (char *)"0",
+		(char *)"--js-timeout", (char *)"250"
+	};
+	char *bad_threads[] = {(char *)"hbf", (char *)"--threads", (char *)"0"};
+	char *bad_timeout[] = {(char *)"hbf", (char *)"--js-timeout", (char *)"-1"};
+	char *missing[] = {(char *)"hbf", (char *)"--listen-backlog"};
+	int ret;
+
+	ret = hbf_config_parse(13, argv, &config);
+
+	assert(ret == 0);
+	assert(config.threads == 16);
+	assert(config.connection_queue == 128);
+	assert(config.listen_backlog == 1024);
+	assert(config.request_timeout_ms == 10000);
+	assert(config.js_memory_mb == 0);
+	assert(config.js_timeout_ms == 250);
+	assert(hbf_config_parse(3, bad_threads, &config) == -1);
+	assert(hbf_config_parse(3, bad_timeout, &config) == -1);
+	assert(hbf_config_parse(2, missing, &config) == -1);
+
+	printf("  ✓ Server and JS limits\n");
+}
+
 static void test_config_parse_combined(void)
 {
 	hbf_config_t config;
@@ -105,6 +209,10 @@ int main(void)
 	test_config_parse_port();
 	test_config_parse_log_level();
 	test_config_parse_inmem();
+	test_config_parse_stmt_cache();
+	test_config_parse_compact();
+	test_config_parse_keep_alive();
+	test_config_parse_limits();
 	test_config_parse_combined();
 
 	printf("\nAll config tests passed!\n");
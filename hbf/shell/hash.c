@@ -4,9 +4,8 @@
 #include <string.h>
 
 /*
- * Simple SHA-256 implementation for hash generation.
- * This is a minimal implementation for Phase 0.
- * Will be replaced with proper vendored SHA-256 in Phase 3.
+ * Simple SHA-256 implementation, shared by the DNS-safe hash and the
+ * content digests of overlay_fs and asset_packer (hbf_sha256_hex).
  */
 
 #define ROTRIGHT(a, b) (((a) >> (b)) | ((a) << (32 - (b))))
@@ -154,6 +153,24 @@ static void sha256_final(sha256_ctx *ctx, uint8_t hash[])
 	}
 }
 
+void hbf_sha256_hex(const void *data, size_t len, char *hex)
+{
+	static const char digits[] = "0123456789abcdef";
+	sha256_ctx ctx;
+	uint8_t hash[32];
+	size_t i;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, (const uint8_t *)data, len);
+	sha256_final(&ctx, hash);
+
+	for (i = 0; i < 32; i++) {
+		hex[i * 2] = digits[hash[i] >> 4];
+		hex[i * 2 + 1] = digits[hash[i] & 0x0f];
+	}
+	hex[HBF_SHA256_HEX_LEN] = '\0';
+}
+
 int hbf_dns_safe_hash(const char *input, char *output)
 {
 	sha256_ctx ctx;
@@ -15,4 +15,16 @@
  */
 int hbf_dns_safe_hash(const char *input, char *output);
 
+/* Length of a hex SHA-256 digest, without the terminator */
+#define HBF_SHA256_HEX_LEN 64
+
+/*
+ * Compute the lowercase hex SHA-256 digest of data.
+ *
+ * @param data: Bytes to hash (may be NULL when len is 0)
+ * @param len: Number of bytes
+ * @param hex: Buffer for the digest (must be >= HBF_SHA256_HEX_LEN + 1 bytes)
+ */
+void hbf_sha256_hex(const void *data, size_t len, char *hex);
+
 #endif /* HBF_CORE_HASH_H */
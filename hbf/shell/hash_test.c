@@ -75,6 +75,28 @@ static void test_hash_null_inputs(void)
 	printf("  ✓ NULL input handling\n");
 }
 
+static void test_sha256_hex(void)
+{
+	char hex[HBF_SHA256_HEX_LEN + 1];
+	const char *two_blocks =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+	/* FIPS 180-2 test vectors */
+	hbf_sha256_hex(NULL, 0, hex);
+	assert(strcmp(hex, "e3b0c44298fc1c149afbf4c8996fb924"
+			   "27ae41e4649b934ca495991b7852b855") == 0);
+
+	hbf_sha256_hex("abc", 3, hex);
+	assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223"
+			   "b00361a396177a9cb410ff61f20015ad") == 0);
+
+	hbf_sha256_hex(two_blocks, strlen(two_blocks), hex);
+	assert(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039"
+			   "a33ce45964ff2167f6ecedd419db06c1") == 0);
+
+	printf("  ✓ Hex SHA-256 digest\n");
+}
+
 int main(void)
 {
 	printf("Running hash_test.c:\n");
@@ -84,6 +106,7 @@ int main(void)
 	test_hash_different_inputs();
 	test_hash_dns_safe_chars();
 	test_hash_null_inputs();
+	test_sha256_hex();
 
 	printf("\nAll tests passed!\n");
 	return 0;
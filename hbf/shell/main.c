@@ -2,16 +2,20 @@
 #include "config.h"
 #include "log.h"
 #include "hbf/db/db.h"
+#include "hbf/db/overlay_fs.h"
+#include "hbf/db/stmt_cache.h"
 #include "hbf/http/server.h"
 #include "hbf/qjs/engine.h"
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#define HBF_QJS_MEMORY_LIMIT_MB 64
-#define HBF_QJS_TIMEOUT_MS 5000
+/* Generated per pod by pod_binary (//tools:db_image) */
+extern const unsigned char hbf_db_image[];
+extern const size_t hbf_db_image_len;
 
 static volatile sig_atomic_t running = 1;
 
@@ -21,13 +25,24 @@ static void signal_handler(int sig)
 	running = 0;
 }
 
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
 int main(int argc, char *argv[])
 {
 	hbf_config_t config;
 	sqlite3 *db = NULL;
 	hbf_server_t *server = NULL;
+	double t_start, t_db, t_js, t_ready;
 	int ret;
 
+	t_start = now_ms();
+
 	/* Parse configuration */
 	ret = hbf_config_parse(argc, argv, &config);
 	if (ret != 0) {
@@ -40,21 +55,39 @@ int main(int argc, char *argv[])
 	hbf_log_info("HBF starting (port=%d, inmem=%d)",
 	             config.port, config.inmem);
 
-	/* Initialize database */
+	/* Prepared statements reused across requests */
+	hbf_db_stmt_cache_set_capacity((unsigned int)config.stmt_cache);
+
+	/* Initialize database; --inmem starts from the prebuilt image */
+	hbf_db_set_image(hbf_db_image, hbf_db_image_len);
 	ret = hbf_db_init(config.inmem, &db);
 	if (ret != 0) {
 		hbf_log_error("Failed to initialize database");
 		return 1;
 	}
+	t_db = now_ms();
+
+	/* Maintenance mode: trim file version history and exit */
+	if (config.compact) {
+		overlay_fs_compact_opts_t opts = {
+			config.keep_versions, config.keep_since, 0
+		};
+
+		ret = overlay_fs_compact(db, &opts, NULL);
+		hbf_db_close(db);
+		return (ret == 0) ? 0 : 1;
+	}
 
 	/* Initialize QuickJS engine */
-	ret = hbf_qjs_init(HBF_QJS_MEMORY_LIMIT_MB, HBF_QJS_TIMEOUT_MS);
+	ret = hbf_qjs_init((size_t)config.js_memory_mb, config.js_timeout_ms);
 	if (ret != 0) {
 		hbf_log_error("Failed to initialize QuickJS engine");
 		hbf_db_close(db);
 		return 1;
 	}
 
+	t_js = now_ms();
+
 	/* Create HTTP server */
 	server = hbf_server_create(config.port, db);
 	if (!server) {
@@ -63,6 +96,12 @@ int main(int argc, char *argv[])
 		hbf_db_close(db);
 		return 1;
 	}
+	server->keep_alive = config.keep_alive;
+	server->keep_alive_timeout_ms = config.keep_alive_timeout_ms;
+	server->num_threads = config.threads;
+	server->connection_queue = config.connection_queue;
+	server->listen_backlog = config.listen_backlog;
+	server->request_timeout_ms = config.request_timeout_ms;
 
 	/* Start HTTP server */
 	ret = hbf_server_start(server);
@@ -74,6 +113,11 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	t_ready = now_ms();
+	hbf_log_info("Startup took %.1f ms (database %.1f, js engine %.1f, "
+	             "http server %.1f)", t_ready - t_start, t_db - t_start,
+	             t_js - t_db, t_ready - t_js);
+
 	/* Setup signal handlers */
 	struct sigaction sa;
 	memset(&sa, 0, sizeof(sa));
@@ -29,7 +29,8 @@ app.handle = function (req, res) {
 
     // ESM import test route (dynamic import)
     if (path === "/esm-test" && method === "GET") {
-        (async function () {
+        // Returning the promise lets the server await it before responding
+        return (async function () {
             try {
                 const mod = await import("./lib/esm_test.js");
                 res.set("Content-Type", "application/json");
@@ -43,7 +44,6 @@ app.handle = function (req, res) {
                 res.send(JSON.stringify({ error: "Import failed", details: String(e) }));
             }
         })();
-        return;
     }
 
     // ESM import test route (static import)
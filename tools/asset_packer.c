@@ -2,19 +2,21 @@
 /*
  * asset_packer - Hermetic asset bundling tool for HBF
  *
- * Takes input files, packs them into a deterministic binary format,
- * compresses with zlib, and outputs as C arrays.
+ * Takes input files, packs them into a deterministic binary format and
+ * outputs it as a C array.
  *
  * Usage:
  *   asset_packer --output-source out.c --output-header out.h \
  *                --symbol-name assets_blob file1.js file2.html ...
  *
- * Binary format:
- *   [num_entries:u32]
- *   [name_len:u32][name:bytes][data_len:u32][data:bytes]
- *   ...
+ * Bundle format (v2): a base_fs table, see hbf/db/base_fs.h. Each file is
+ * compressed on its own (gzip, at --compression-level, when that saves at
+ * least an eighth) and indexed by path with a perfect hash, along with
+ * the SHA-256 of its contents. The runtime can thus serve any file, or
+ * copy it into the database, without decompressing the others.
  *
- * The entire bundle is then compressed with zlib at max compression.
+ * The SHA-256 of the whole bundle is emitted as <symbol>_id so the
+ * runtime need not hash it to recognise an already migrated bundle.
  */
 
 #define _POSIX_C_SOURCE 200809L
@@ -24,9 +26,15 @@
 #include <stdint.h>
 #include <zlib.h>
 
+#include "hbf/db/base_fs.h"
+#include "hbf/shell/hash.h"
+
 #define MAX_PATH_LEN 4096
 #define MAX_FILE_SIZE (100 * 1024 * 1024) /* 100MB per file */
 
+/* Files smaller than this stay uncompressed (as in overlay_fs) */
+#define TABLE_GZIP_MIN_SIZE 256
+
 typedef struct {
 	char *path;
 	uint8_t *data;
@@ -168,107 +176,130 @@ static int bundle_add_file(bundle_t *bundle, const char *path)
 	return 0;
 }
 
-/* Compare function for qsort - lexicographic ordering */
-static int compare_entries(const void *a, const void *b)
-{
-	const file_entry_t *ea = (const file_entry_t *)a;
-	const file_entry_t *eb = (const file_entry_t *)b;
-	return strcmp(ea->path, eb->path);
-}
-
-static int bundle_pack(bundle_t *bundle, uint8_t **out_data, size_t *out_len)
+/*
+ * gzip-encode data if that saves at least an eighth of it, as overlay_fs
+ * stores blobs. Returns a malloc'd buffer, or NULL to store it as is.
+ */
+static uint8_t *gzip_entry(const uint8_t *data, size_t len, int level,
+                           size_t *out_len)
 {
-	size_t total_size;
-	uint8_t *packed;
-	uint8_t *ptr;
-	uint32_t i;
+	z_stream zs;
+	uint8_t *out;
+	uLong bound;
 
-	/* Sort entries for deterministic output */
-	qsort(bundle->entries, bundle->count, sizeof(file_entry_t), compare_entries);
-
-	/* Calculate total size: num_entries + sum(name_len + name + data_len + data) */
-	total_size = sizeof(uint32_t); /* num_entries */
-	for (i = 0; i < bundle->count; i++) {
-		uint32_t name_len = (uint32_t)strlen(bundle->entries[i].path);
-		total_size += sizeof(uint32_t); /* name_len */
-		total_size += name_len;         /* name */
-		total_size += sizeof(uint32_t); /* data_len */
-		total_size += bundle->entries[i].data_len; /* data */
+	if (len < TABLE_GZIP_MIN_SIZE) {
+		return NULL;
 	}
 
-	/* Allocate packed buffer */
-	packed = malloc(total_size);
-	if (!packed) {
-		fprintf(stderr, "Error: failed to allocate packed buffer\n");
-		return -1;
+	memset(&zs, 0, sizeof(zs));
+	/* windowBits 15 + 16 writes a gzip header (mtime 0) and trailer */
+	if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8,
+	                 Z_DEFAULT_STRATEGY) != Z_OK) {
+		return NULL;
 	}
 
-	/* Pack entries */
-	ptr = packed;
+	bound = deflateBound(&zs, (uLong)len);
+	out = malloc((size_t)bound);
+	if (!out) {
+		deflateEnd(&zs);
+		return NULL;
+	}
 
-	/* Write num_entries */
-	memcpy(ptr, &bundle->count, sizeof(uint32_t));
-	ptr += sizeof(uint32_t);
+	zs.next_in = (Bytef *)(uintptr_t)data;
+	zs.avail_in = (uInt)len;
+	zs.next_out = out;
+	zs.avail_out = (uInt)bound;
 
-	/* Write each entry */
-	for (i = 0; i < bundle->count; i++) {
-		uint32_t name_len = (uint32_t)strlen(bundle->entries[i].path);
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END ||
+	    zs.total_out > len - len / 8) {
+		deflateEnd(&zs);
+		free(out);
+		return NULL;
+	}
 
-		/* name_len */
-		memcpy(ptr, &name_len, sizeof(uint32_t));
-		ptr += sizeof(uint32_t);
+	*out_len = (size_t)zs.total_out;
+	deflateEnd(&zs);
+	return out;
+}
 
-		/* name */
-		memcpy(ptr, bundle->entries[i].path, name_len);
-		ptr += name_len;
+/* Pack the files into a base_fs table (hbf/db/base_fs.h) */
+static int build_table(const bundle_t *bundle, int level, uint8_t **out_data,
+                       size_t *out_len)
+{
+	base_fs_entry_t *entries;
+	char (*digests)[65];
+	uint8_t **gzipped;
+	uint32_t i;
+	int rc;
+
+	entries = calloc(bundle->count + 1u, sizeof(*entries));
+	digests = calloc(bundle->count + 1u, sizeof(*digests));
+	gzipped = calloc(bundle->count + 1u, sizeof(*gzipped));
+	if (!entries || !digests || !gzipped) {
+		fprintf(stderr, "Error: failed to allocate file table\n");
+		free(gzipped);
+		free(digests);
+		free(entries);
+		return -1;
+	}
 
-		/* data_len */
-		memcpy(ptr, &bundle->entries[i].data_len, sizeof(uint32_t));
-		ptr += sizeof(uint32_t);
+	for (i = 0; i < bundle->count; i++) {
+		const file_entry_t *f = &bundle->entries[i];
+		size_t gzip_len = 0;
+
+		hbf_sha256_hex(f->data, f->data_len, digests[i]);
+		gzipped[i] = gzip_entry(f->data, f->data_len, level, &gzip_len);
+
+		entries[i].path = f->path;
+		entries[i].digest = digests[i];
+		entries[i].size = f->data_len;
+		entries[i].gzip = gzipped[i] != NULL;
+		entries[i].data = gzipped[i] ? gzipped[i] : f->data;
+		entries[i].stored_size = gzipped[i] ? gzip_len : f->data_len;
+	}
 
-		/* data */
-		memcpy(ptr, bundle->entries[i].data, bundle->entries[i].data_len);
-		ptr += bundle->entries[i].data_len;
+	rc = base_fs_build(entries, bundle->count, out_data, out_len);
+	if (rc != 0) {
+		fprintf(stderr, "Error: failed to build file table\n");
 	}
 
-	*out_data = packed;
-	*out_len = total_size;
-	return 0;
+	for (i = 0; i < bundle->count; i++) {
+		free(gzipped[i]);
+	}
+	free(gzipped);
+	free(digests);
+	free(entries);
+	return rc;
 }
 
-static int compress_bundle(const uint8_t *data, size_t data_len,
-					   uint8_t **out_data, size_t *out_len, int level)
+static void write_c_array(FILE *f, const char *name, const uint8_t *data,
+                          size_t data_len)
 {
-	uLongf compressed_len;
-	uint8_t *compressed;
-	int status;
-
-	/* Allocate worst-case compressed size */
-	compressed_len = compressBound((uLong)data_len);
-	compressed = malloc((size_t)compressed_len);
-	if (!compressed) {
-		fprintf(stderr, "Error: failed to allocate compression buffer\n");
-		return -1;
-	}
+	size_t i;
 
-	/* Compress at provided level (1-9) */
-	status = compress2((Bytef *)compressed, &compressed_len, (const Bytef *)data, (uLong)data_len, level);
-	if (status != Z_OK) {
-		fprintf(stderr, "Error: compression failed with status %d\n", status);
-		free(compressed);
-		return -1;
+	fprintf(f, "const unsigned char %s[] = {", name);
+
+	for (i = 0; i < data_len; i++) {
+		if (i % 12 == 0) {
+			fprintf(f, "\n\t");
+		}
+		fprintf(f, "0x%02x", data[i]);
+		if (i < data_len - 1) {
+			fprintf(f, ", ");
+		}
 	}
 
-	*out_data = compressed;
-	*out_len = (size_t)compressed_len;
-	return 0;
+	fprintf(f, "\n};\n\n");
+	fprintf(f, "const size_t %s_len = %zu;\n", name, data_len);
 }
 
 static int write_c_source(const char *output_source, const char *output_header,
                           const char *symbol_name, const uint8_t *data, size_t data_len)
 {
+	char bundle_id[65];
 	FILE *f;
-	size_t i;
+
+	hbf_sha256_hex(data, data_len, bundle_id);
 
 	/* Write source file */
 	f = fopen(output_source, "w");
@@ -279,20 +310,8 @@ static int write_c_source(const char *output_source, const char *output_header,
 
 	fprintf(f, "/* Auto-generated by asset_packer - do not edit */\n\n");
 	fprintf(f, "#include <stddef.h>\n\n");
-	fprintf(f, "const unsigned char %s[] = {", symbol_name);
-
-	for (i = 0; i < data_len; i++) {
-		if (i % 12 == 0) {
-			fprintf(f, "\n\t");
-		}
-		fprintf(f, "0x%02x", data[i]);
-		if (i < data_len - 1) {
-			fprintf(f, ", ");
-		}
-	}
-
-	fprintf(f, "\n};\n\n");
-	fprintf(f, "const size_t %s_len = %zu;\n", symbol_name, data_len);
+	write_c_array(f, symbol_name, data, data_len);
+	fprintf(f, "const char %s_id[] = \"%s\";\n", symbol_name, bundle_id);
 
 	fclose(f);
 
@@ -308,7 +327,9 @@ static int write_c_source(const char *output_source, const char *output_header,
 	fprintf(f, "#define ASSETS_BLOB_H\n\n");
 	fprintf(f, "#include <stddef.h>\n\n");
 	fprintf(f, "extern const unsigned char %s[];\n", symbol_name);
-	fprintf(f, "extern const size_t %s_len;\n\n", symbol_name);
+	fprintf(f, "extern const size_t %s_len;\n", symbol_name);
+	fprintf(f, "/* SHA-256 of %s, hex (migrations.bundle_id) */\n", symbol_name);
+	fprintf(f, "extern const char %s_id[];\n\n", symbol_name);
 	fprintf(f, "#endif /* ASSETS_BLOB_H */\n");
 
 	fclose(f);
@@ -324,10 +345,9 @@ int main(int argc, char **argv)
     int first_file_arg = -1;
     int num_files = 0;
     bundle_t bundle;
-    uint8_t *packed_data = NULL;
+    uint8_t *table_data = NULL;
+    size_t table_len = 0;
     size_t packed_len = 0;
-    uint8_t *compressed_data = NULL;
-    size_t compressed_len = 0;
     int rc = 0;
     int compression_level = 9; /* default to maximum compression */
     int i; /* loop index */
@@ -413,35 +433,30 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Pack bundle */
-	if (bundle_pack(&bundle, &packed_data, &packed_len) != 0) {
+	/* Pack bundle, compressing file by file */
+	if (build_table(&bundle, compression_level, &table_data, &table_len) != 0) {
 		bundle_free(&bundle);
 		return 1;
 	}
 
-	printf("Packed %u files into %zu bytes\n", bundle.count, packed_len);
-
-	/* Compress bundle */
-	if (compress_bundle(packed_data, packed_len, &compressed_data, &compressed_len, compression_level) != 0) {
-		free(packed_data);
-		bundle_free(&bundle);
-		return 1;
+	for (i = 0; i < (int)bundle.count; i++) {
+		packed_len += bundle.entries[i].data_len;
 	}
 
-    printf("Compressed to %zu bytes (%.1f%% of original)\n",
-	    compressed_len, (100.0 * (double)compressed_len) / (double)packed_len);
+	printf("Packed %u files (%zu bytes) into %zu bytes (%.1f%% of original)\n",
+	       bundle.count, packed_len, table_len,
+	       packed_len > 0 ? (100.0 * (double)table_len) / (double)packed_len : 100.0);
 
 	/* Write C source and header */
 	if (write_c_source(output_source, output_header, symbol_name,
-	                   compressed_data, compressed_len) != 0) {
+	                   table_data, table_len) != 0) {
 		rc = 1;
 	} else {
 		printf("Generated %s and %s\n", output_source, output_header);
 	}
 
 	/* Cleanup */
-	free(compressed_data);
-	free(packed_data);
+	free(table_data);
 	bundle_free(&bundle);
 
 	return rc;
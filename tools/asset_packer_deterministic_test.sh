@@ -46,6 +46,16 @@ if ! grep -Fq 'const unsigned char assets_blob[]' "$WORKDIR/first.c"; then
   echo "Missing assets_blob array in output" >&2
   exit 1
 fi
+if ! grep -Eq 'const char assets_blob_id\[\] = "[0-9a-f]{64}";' "$WORKDIR/first.c"; then
+  echo "Missing assets_blob_id bundle digest in output" >&2
+  exit 1
+fi
+
+# v2 bundle: a base_fs file table, magic "HBFT"
+if ! grep -A1 -F 'const unsigned char assets_blob[]' "$WORKDIR/first.c" | grep -q '0x48, 0x42, 0x46, 0x54'; then
+  echo "assets_blob is not a file table (missing HBFT magic)" >&2
+  exit 1
+fi
 
 # Ensure header declares extern symbols
 if ! grep -q 'extern const unsigned char assets_blob\[' "$WORKDIR/first.h"; then
@@ -56,5 +66,9 @@ if ! grep -q 'extern const size_t assets_blob_len' "$WORKDIR/first.h"; then
   echo "Header missing extern length declaration" >&2
   exit 1
 fi
+if ! grep -q 'extern const char assets_blob_id\[' "$WORKDIR/first.h"; then
+  echo "Header missing extern bundle ID declaration" >&2
+  exit 1
+fi
 
 echo "Deterministic asset_packer test passed (hash=$sha1_first)" >&2
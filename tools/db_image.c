@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * db_image - Prebuilt in-memory database for an HBF pod
+ *
+ * Runs the same initialization hbf does for --inmem (schema plus asset
+ * bundle migration) against the pod's linked-in assets_blob, then writes
+ * the resulting database file as a C array. hbf loads it at startup
+ * (hbf_db_set_image) instead of migrating the bundle again.
+ *
+ * Usage:
+ *   db_image --output-source out.c [--output-header out.h] \
+ *            [--symbol-name hbf_db_image]
+ *
+ * File and migration timestamps are always pinned, to SOURCE_DATE_EPOCH
+ * if set and to 0 otherwise (Bazel genrules do not pass the variable on),
+ * so the image is reproducible.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "hbf/db/db.h"
+#include "hbf/shell/log.h"
+
+/* Pin build-time timestamps to epoch */
+static int normalize_timestamps(sqlite3 *db, sqlite3_int64 epoch)
+{
+	static const char *const sql[] = {
+		"UPDATE file_versions SET mtime = ?",
+		"UPDATE latest_files_meta SET mtime = ?",
+		"UPDATE migrations SET applied_at = ?",
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(sql) / sizeof(sql[0]); i++) {
+		sqlite3_stmt *stmt = NULL;
+		int rc;
+
+		if (sqlite3_prepare_v2(db, sql[i], -1, &stmt, NULL) != SQLITE_OK) {
+			fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+			return -1;
+		}
+		sqlite3_bind_int64(stmt, 1, epoch);
+		rc = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE) {
+			fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int write_c_source(const char *output_source, const char *output_header,
+                          const char *symbol_name, const unsigned char *data,
+                          size_t data_len)
+{
+	FILE *f;
+	size_t i;
+
+	f = fopen(output_source, "w");
+	if (!f) {
+		fprintf(stderr, "Error: failed to open output source '%s'\n", output_source);
+		return -1;
+	}
+
+	fprintf(f, "/* Auto-generated by db_image - do not edit */\n\n");
+	fprintf(f, "#include <stddef.h>\n\n");
+	fprintf(f, "const unsigned char %s[] = {", symbol_name);
+
+	for (i = 0; i < data_len; i++) {
+		if (i % 12 == 0) {
+			fprintf(f, "\n\t");
+		}
+		fprintf(f, "0x%02x", data[i]);
+		if (i < data_len - 1) {
+			fprintf(f, ", ");
+		}
+	}
+
+	fprintf(f, "\n};\n\n");
+	fprintf(f, "const size_t %s_len = %zu;\n", symbol_name, data_len);
+
+	fclose(f);
+
+	if (!output_header) {
+		return 0;
+	}
+
+	f = fopen(output_header, "w");
+	if (!f) {
+		fprintf(stderr, "Error: failed to open output header '%s'\n", output_header);
+		return -1;
+	}
+
+	fprintf(f, "/* Auto-generated by db_image - do not edit */\n");
+	fprintf(f, "#ifndef HBF_DB_IMAGE_H\n");
+	fprintf(f, "#define HBF_DB_IMAGE_H\n\n");
+	fprintf(f, "#include <stddef.h>\n\n");
+	fprintf(f, "extern const unsigned char %s[];\n", symbol_name);
+	fprintf(f, "extern const size_t %s_len;\n\n", symbol_name);
+	fprintf(f, "#endif /* HBF_DB_IMAGE_H */\n");
+
+	fclose(f);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *output_source = NULL;
+	const char *output_header = NULL;
+	const char *symbol_name = "hbf_db_image";
+	const char *epoch;
+	sqlite3 *db = NULL;
+	unsigned char *image;
+	sqlite3_int64 image_len = 0;
+	int rc = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--output-source") == 0 && i + 1 < argc) {
+			output_source = argv[++i];
+		} else if (strcmp(argv[i], "--output-header") == 0 && i + 1 < argc) {
+			output_header = argv[++i];
+		} else if (strcmp(argv[i], "--symbol-name") == 0 && i + 1 < argc) {
+			symbol_name = argv[++i];
+		} else {
+			fprintf(stderr, "Error: unknown argument '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!output_source) {
+		fprintf(stderr, "Usage: %s --output-source FILE "
+		        "[--output-header FILE] [--symbol-name NAME]\n", argv[0]);
+		return 1;
+	}
+
+	hbf_log_set_level(HBF_LOG_WARN);
+
+	if (hbf_db_init(1, &db) != 0) {
+		fprintf(stderr, "Error: failed to initialize database\n");
+		return 1;
+	}
+
+	epoch = getenv("SOURCE_DATE_EPOCH");
+	if (normalize_timestamps(db, epoch && *epoch ?
+				 strtoll(epoch, NULL, 10) : 0) != 0) {
+		hbf_db_close(db);
+		return 1;
+	}
+
+	/* Drop free pages left over from migration */
+	if (sqlite3_exec(db, "VACUUM", NULL, NULL, NULL) != SQLITE_OK) {
+		fprintf(stderr, "Error: VACUUM failed: %s\n", sqlite3_errmsg(db));
+		hbf_db_close(db);
+		return 1;
+	}
+
+	image = sqlite3_serialize(db, "main", &image_len, 0);
+	if (!image) {
+		fprintf(stderr, "Error: failed to serialize database\n");
+		hbf_db_close(db);
+		return 1;
+	}
+
+	if (write_c_source(output_source, output_header, symbol_name, image,
+	                   (size_t)image_len) != 0) {
+		rc = 1;
+	} else {
+		printf("Generated %s (%lld bytes)\n", output_source,
+		       (long long)image_len);
+	}
+
+	sqlite3_free(image);
+	hbf_db_close(db);
+
+	return rc;
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Empty database image, linked by pod_binary unless inmem_image is set:
+ * --inmem then applies the schema and migrates the bundle at startup.
+ */
+
+#include <stddef.h>
+
+const unsigned char hbf_db_image[1] = { 0 };
+const size_t hbf_db_image_len = 0;
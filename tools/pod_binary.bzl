@@ -2,10 +2,11 @@
 
 This macro generates a complete HBF binary from a pod directory.
 It handles building the final cc_binary with all dependencies including
-the asset bundle from asset_packer.
+the asset bundle from asset_packer and, optionally, the prebuilt database
+image that --inmem starts from.
 """
 
-def pod_binary(name, pod, visibility = None, tags = None, strip = False, optimize = True, lto = False):
+def pod_binary(name, pod, visibility = None, tags = None, strip = False, optimize = True, lto = False, inmem_image = False):
     """Build an HBF binary with an embedded pod.
 
     Args:
@@ -13,11 +14,58 @@ def pod_binary(name, pod, visibility = None, tags = None, strip = False, optimiz
         pod: Label of the pod target (e.g., "//pods/base")
         visibility: Visibility for the binary target
         tags: Tags to apply to all targets (e.g., ["hbf_pod"])
+        inmem_image: Embed the migrated database for --inmem startup. The
+            image holds every file again as blob rows, so it roughly doubles
+            the embedded content; leave off unless --inmem startup matters.
     """
 
     # Internal target names
     pod_assets = pod + ":embedded_assets"
     binary = name + "_bin"
+    db_image_tool = name + "_db_image_tool"
+    db_image = name + "_db_image"
+
+    if inmem_image:
+        # Migrate the pod's bundle at build time; main.c hands the serialized
+        # database to hbf_db_set_image so --inmem skips schema and migration
+        native.cc_binary(
+            name = db_image_tool,
+            srcs = ["//tools:db_image.c"],
+            deps = [
+                pod_assets,
+                "//hbf/shell:log",
+                "//hbf/db:db",
+                "@sqlite3",
+            ],
+            visibility = ["//visibility:private"],
+            tags = tags,
+        )
+
+        native.genrule(
+            name = db_image + "_c",
+            outs = [db_image + ".c"],
+            cmd = "$(location :" + db_image_tool + ") --output-source $@ --symbol-name hbf_db_image > /dev/null",
+            tools = [":" + db_image_tool],
+            visibility = ["//visibility:private"],
+            tags = tags,
+        )
+
+        native.cc_library(
+            name = db_image,
+            srcs = [":" + db_image + "_c"],
+            alwayslink = True,
+            visibility = ["//visibility:private"],
+            tags = tags,
+        )
+    else:
+        # Empty image: --inmem migrates the bundle at startup
+        native.cc_library(
+            name = db_image,
+            srcs = ["//tools:db_image_none.c"],
+            alwayslink = True,
+            visibility = ["//visibility:private"],
+            tags = tags,
+        )
 
     # Create cc_binary that links everything together
     copts = []
@@ -42,6 +90,7 @@ def pod_binary(name, pod, visibility = None, tags = None, strip = False, optimiz
         srcs = ["//hbf/shell:main.c"],
         deps = [
             pod_assets,  # Link the asset bundle
+            ":" + db_image,  # Prebuilt --inmem database (may be empty)
             "//hbf/shell:config",
             "//hbf/shell:log",
             "//hbf/db:db",